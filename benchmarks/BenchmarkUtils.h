@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace collabserver {
+
+/**
+ * Runs fn and returns its duration in milliseconds.
+ * This is a rough wall clock measure, only meant to compare implementations
+ * on the same machine. Build in Release for meaningful numbers.
+ */
+template <typename Fn>
+double benchmark_run(Fn fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * Prints a benchmark result line.
+ *
+ * \param name      Name of the measure.
+ * \param ms        Duration in milliseconds.
+ * \param nbOps     Number of operations measured (To print ns / op).
+ */
+inline void benchmark_print(const std::string& name, double ms, long nbOps) {
+    std::cout << "  " << std::left << std::setw(48) << name << std::right << std::setw(10) << std::fixed
+              << std::setprecision(2) << ms << " ms" << std::setw(14) << std::setprecision(1)
+              << (ms * 1e6 / static_cast<double>(nbOps)) << " ns/op\n";
+}
+
+// Total of bytes currently allocated with operator new.
+// (Defined in runAllBenchmarks.cpp with the operator new replacement)
+extern std::atomic<long> benchmark_allocatedBytes;
+
+// Prevents the compiler from removing the measured code
+static volatile long benchmark_sink = 0;
+
+}  // namespace collabserver
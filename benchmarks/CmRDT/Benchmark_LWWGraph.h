@@ -0,0 +1,395 @@
+#pragma once
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "../BenchmarkUtils.h"
+#include "collabserver/datatypes/CmRDT/LWWGraph.h"
+#include "collabserver/datatypes/CmRDT/LWWMap.h"
+#include "collabserver/datatypes/CmRDT/ShardedLWWGraph.h"
+
+namespace collabserver {
+
+template <typename Graph>
+void LWWGraph_benchmarkEdges(const std::string& name, int nbVertex, int nbEdges) {
+    std::cout << " " << name << " (" << nbVertex << " vertex, " << nbEdges << " random edges)\n";
+
+    // Random edges, in random order (Some are duplicates)
+    std::mt19937 rng(42);
+    std::vector<std::pair<int, int>> edges(nbEdges);
+    for (auto& edge : edges) {
+        edge.first = static_cast<int>(rng() % nbVertex);
+        edge.second = static_cast<int>(rng() % nbVertex);
+    }
+
+    Graph* data = new Graph();
+    data->reserve(nbVertex);
+
+    double ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbEdges; ++k) {
+            total += data->add_edge(edges[k].first, edges[k].second, k + 1).isEdgeAdded;
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("add_edge (new edges)", ms, nbEdges);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbEdges; ++k) {
+            total += data->add_edge(edges[k].first, edges[k].second, nbEdges + k + 1).isEdgeAdded;
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("add_edge (existing edges)", ms, nbEdges);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbEdges; ++k) {
+            total += data->add_edge(edges[k].first, edges[k].second, k + 1).isEdgeAdded;
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("add_edge (older duplicates)", ms, nbEdges);
+
+    const int nbRemoved = nbVertex / 10;
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbRemoved; ++k) {
+            total += data->remove_vertex(k * 10, 2 * nbEdges + k + 1);
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("remove_vertex (10% of vertex)", ms, nbRemoved);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbEdges; ++k) {
+            total += data->add_edge(edges[k].first, edges[k].second, nbEdges + k + 1).isEdgeAdded;
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("add_edge (after concurrent remove_vertex)", ms, nbEdges);
+
+    ms = benchmark_run([&]() { benchmark_sink = static_cast<long>(data->size_edges()); });
+    benchmark_print("size_edges", ms, 1);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbVertex; ++k) {
+            total += static_cast<long>(data->in_degree(k));
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("in_degree", ms, nbVertex);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbVertex; ++k) {
+            for (const int from : data->in_edges(k)) {
+                total += from;
+            }
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("in_edges", ms, nbVertex);
+
+    // What in_edges replaces: a scan of all edges
+    const int nbScans = 10;
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbScans; ++k) {
+            for (const auto& vertex : *data) {
+                total += static_cast<long>(vertex.second.edges().count(k));
+            }
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("in_edges (scan of all vertex)", ms, nbScans);
+
+    delete data;
+}
+
+template <typename Graph>
+void LWWGraph_benchmarkCSR(const std::string& name, int nbVertex, int nbEdges) {
+    std::cout << " " << name << " CSR (" << nbVertex << " vertex, " << nbEdges << " random edges)\n";
+
+    std::mt19937 rng(42);
+    Graph data;
+    for (int k = 0; k < nbEdges; ++k) {
+        data.add_edge(static_cast<int>(rng() % nbVertex), static_cast<int>(rng() % nbVertex), k + 1);
+    }
+    for (int k = 0; k < nbVertex; k += 10) {
+        data.remove_vertex(k, nbEdges + k + 1);  // Some tombstones
+    }
+
+    const unsigned int nbThreadsList[] = {1, 2, 4, 8};
+    for (const unsigned int nbThreads : nbThreadsList) {
+        double ms = benchmark_run([&]() {
+            const auto csr = data.to_csr_parallel(nbThreads);
+            benchmark_sink = static_cast<long>(csr.nb_edges());
+        });
+        benchmark_print("to_csr_parallel (" + std::to_string(nbThreads) + " threads)", ms, nbEdges);
+    }
+
+    // Sum of keys of all neighbors
+    double ms = benchmark_run([&]() {
+        long total = 0;
+        for (const auto& elt : data) {
+            for (const int to : elt.second.edges()) {
+                total += to;
+            }
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("iterate edges (graph)", ms, nbEdges);
+
+    const auto csr = data.to_csr();
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (typename Graph::csr_type::vertex_id id = 0; id < csr.nb_vertex(); ++id) {
+            for (auto it = csr.neighbors_begin(id); it != csr.neighbors_end(id); ++it) {
+                total += *it;
+            }
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("iterate edges (csr)", ms, nbEdges);
+
+    // BFS from a vertex with edges (Likely in the giant component)
+    typename Graph::csr_type::vertex_id source_id = 0;
+    while (csr.degree(source_id) == 0) {
+        ++source_id;
+    }
+    const int source = csr.key(source_id);
+    ms = benchmark_run([&]() {
+        std::unordered_set<int> visited;
+        std::vector<int> queue(1, source);
+        visited.insert(source);
+        for (std::size_t k = 0; k < queue.size(); ++k) {
+            for (const int to : data.crdt_find_vertex(queue[k])->second.value().edges()) {
+                if (visited.insert(to).second) {
+                    queue.push_back(to);
+                }
+            }
+        }
+        benchmark_sink = static_cast<long>(queue.size());
+    });
+    benchmark_print("bfs (graph, hash set)", ms, nbEdges);
+
+    ms = benchmark_run([&]() { benchmark_sink = static_cast<long>(csr.bfs_depths(source_id).size()); });
+    benchmark_print("bfs_depths (csr)", ms, nbEdges);
+
+    for (const unsigned int nbThreads : nbThreadsList) {
+        ms = benchmark_run([&]() {
+            benchmark_sink = static_cast<long>(csr.bfs_depths_parallel(source_id, nbThreads).size());
+        });
+        benchmark_print("bfs_depths_parallel (" + std::to_string(nbThreads) + " threads)", ms, nbEdges);
+    }
+}
+
+template <typename Graph>
+void LWWGraph_benchmarkSparse(const std::string& name, int nbVertex) {
+    std::cout << " " << name << " sparse (" << nbVertex << " vertex, 0 to 3 edges each)\n";
+
+    std::mt19937 rng(42);
+    const long memBefore = benchmark_allocatedBytes;
+    Graph* data = new Graph();
+    long nbEdges = 0;
+    double ms = benchmark_run([&]() {
+        for (int k = 0; k < nbVertex; ++k) {
+            data->add_vertex(k, k + 1);
+            const int degree = static_cast<int>(rng() % 4);
+            for (int e = 0; e < degree; ++e) {
+                data->add_edge(k, static_cast<int>(rng() % nbVertex), k + 1);
+            }
+            nbEdges += degree;
+        }
+    });
+    benchmark_print("add_vertex + add_edge", ms, nbVertex + nbEdges);
+    std::cout << "  memory: " << (benchmark_allocatedBytes - memBefore) / nbVertex << " bytes/vertex\n";
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbVertex; ++k) {
+            total += data->count_edge(k, (k * 7) % nbVertex);
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("count_edge", ms, nbVertex);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (const auto& elt : *data) {
+            for (const int to : elt.second.edges()) {
+                total += to;
+            }
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("iterate edges", ms, nbEdges);
+
+    ms = benchmark_run([&]() { delete data; });
+    benchmark_print("destroy", ms, nbVertex);
+}
+
+template <typename Graph>
+void LWWGraph_benchmarkBulk(const std::string& name, int nbVertex, int nbEdges) {
+    std::cout << " " << name << " bulk load (" << nbVertex << " vertex, " << nbEdges << " random edges)\n";
+
+    std::mt19937 rng(42);
+    std::vector<std::pair<int, int>> edges(nbEdges);
+    for (auto& edge : edges) {
+        edge.first = static_cast<int>(rng() % nbVertex);
+        edge.second = static_cast<int>(rng() % nbVertex);
+    }
+
+    Graph* data = new Graph();
+    double ms = benchmark_run([&]() {
+        for (const auto& edge : edges) {
+            data->add_edge(edge.first, edge.second, 1);
+        }
+    });
+    benchmark_print("add_edge (one by one)", ms, nbEdges);
+    const auto sizeEdges = data->size_edges();
+    delete data;
+
+    data = new Graph();
+    ms = benchmark_run([&]() { data->add_edges(edges.begin(), edges.end(), 1); });
+    benchmark_print("add_edges", ms, nbEdges);
+    if (data->size_edges() != sizeEdges) {
+        std::cout << "  ERROR: add_edges gives another graph\n";
+    }
+    delete data;
+}
+
+// Edge values inline (set_edge) against a side LWWMap keyed by "from|to"
+void LWWGraph_benchmarkEdgeValues(int nbVertex, int nbEdges) {
+    std::cout << " LWWGraph edge values (" << nbVertex << " vertex, " << nbEdges << " random edges)\n";
+
+    std::mt19937 rng(42);
+    std::vector<std::pair<int, int>> edges(nbEdges);
+    for (auto& edge : edges) {
+        edge.first = static_cast<int>(rng() % nbVertex);
+        edge.second = static_cast<int>(rng() % nbVertex);
+    }
+
+    long bytes = benchmark_allocatedBytes;
+    auto* graph = new LWWGraph<int, int, int>();
+    auto* values = new LWWMap<std::string, double, int>();
+    double ms = benchmark_run([&]() {
+        for (std::size_t k = 0; k < edges.size(); ++k) {
+            const int stamp = static_cast<int>(k + 1);
+            graph->add_edge(edges[k].first, edges[k].second, stamp);
+            values->set(std::to_string(edges[k].first) + "|" + std::to_string(edges[k].second), 0.5 * k, stamp);
+        }
+    });
+    benchmark_print("side LWWMap: add_edge + set", ms, nbEdges);
+    std::cout << "  side LWWMap: memory " << (benchmark_allocatedBytes - bytes) / 1024 << " KB\n";
+    ms = benchmark_run([&]() {
+        double sum = 0;
+        for (const auto& edge : edges) {
+            if (graph->has_edge(edge.first, edge.second)) {
+                sum += values->find(std::to_string(edge.first) + "|" + std::to_string(edge.second))->second;
+            }
+        }
+        benchmark_sink = static_cast<long>(sum);
+    });
+    benchmark_print("side LWWMap: has_edge + find", ms, nbEdges);
+    delete values;
+    delete graph;
+
+    bytes = benchmark_allocatedBytes;
+    auto* weighted = new LWWGraph<int, int, int, SmallMapStorage<4>, double>();
+    ms = benchmark_run([&]() {
+        for (std::size_t k = 0; k < edges.size(); ++k) {
+            weighted->set_edge(edges[k].first, edges[k].second, 0.5 * k, static_cast<int>(k + 1));
+        }
+    });
+    benchmark_print("inline: set_edge", ms, nbEdges);
+    std::cout << "  inline: memory " << (benchmark_allocatedBytes - bytes) / 1024 << " KB\n";
+    ms = benchmark_run([&]() {
+        double sum = 0;
+        for (const auto& edge : edges) {
+            sum += weighted->at_edge(edge.first, edge.second);
+        }
+        benchmark_sink = static_cast<long>(sum);
+    });
+    benchmark_print("inline: at_edge", ms, nbEdges);
+    delete weighted;
+}
+
+// Applies op k of the stream (add_edge, some remove_edge and remove_vertex)
+template <typename Graph>
+void LWWGraph_benchmarkApplyOp(Graph& data, const std::vector<std::pair<int, int>>& edges, std::size_t k) {
+    const int stamp = static_cast<int>(k + 1);
+    if (k % 20 == 0) {
+        data.remove_vertex(edges[k].first, stamp);
+    } else if (k % 10 == 0) {
+        data.remove_edge(edges[k].first, edges[k].second, stamp);
+    } else {
+        data.add_edge(edges[k].first, edges[k].second, stamp);
+    }
+}
+
+void LWWGraph_benchmarkSharded(int nbVertex, int nbOps, std::size_t nbShards) {
+    std::cout << " ShardedLWWGraph (" << nbShards << " shards, " << nbVertex << " vertex, " << nbOps
+              << " random ops)\n";
+
+    std::mt19937 rng(42);
+    std::vector<std::pair<int, int>> edges(nbOps);
+    for (auto& edge : edges) {
+        edge.first = static_cast<int>(rng() % nbVertex);
+        edge.second = static_cast<int>(rng() % nbVertex);
+    }
+
+    LWWGraph<int, int, int> expected;
+    double ms = benchmark_run([&]() {
+        for (std::size_t k = 0; k < edges.size(); ++k) {
+            LWWGraph_benchmarkApplyOp(expected, edges, k);
+        }
+    });
+    benchmark_print("LWWGraph (1 thread)", ms, nbOps);
+
+    // Each thread applies one op out of nbThreads
+    const unsigned int nbThreadsList[] = {1, 2, 4, 8, 16, 32};
+    for (const unsigned int nbThreads : nbThreadsList) {
+        ShardedLWWGraph<int, int, int> data(nbShards);
+        ms = benchmark_run([&]() {
+            std::vector<std::thread> threads;
+            for (unsigned int t = 0; t < nbThreads; ++t) {
+                threads.emplace_back([&, t]() {
+                    for (std::size_t k = t; k < edges.size(); k += nbThreads) {
+                        LWWGraph_benchmarkApplyOp(data, edges, k);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        });
+        benchmark_print("ShardedLWWGraph (" + std::to_string(nbThreads) + " threads)", ms, nbOps);
+        if (!(data.snapshot() == expected)) {
+            std::cout << "  ERROR: ShardedLWWGraph gives another graph\n";
+        }
+    }
+}
+
+void LWWGraph_benchmark() {
+    std::cout << "\n----- CmRDT LWWGraph Benchmark ----------\n";
+
+    LWWGraph_benchmarkEdges<LWWGraph<int, int, int>>("LWWGraph", 200000, 1000000);
+    LWWGraph_benchmarkCSR<LWWGraph<int, int, int>>("LWWGraph", 200000, 1000000);
+    LWWGraph_benchmarkBulk<LWWGraph<int, int, int>>("LWWGraph", 200000, 1000000);
+    LWWGraph_benchmarkEdgeValues(200000, 1000000);
+    LWWGraph_benchmarkSparse<LWWGraph<int, int, int>>("LWWGraph", 1000000);
+    LWWGraph_benchmarkSparse<LWWGraph<int, int, int, HashMapStorage>>("LWWGraph HashMapStorage", 1000000);
+    LWWGraph_benchmarkSharded(200000, 1000000, 64);
+}
+
+}  // namespace collabserver
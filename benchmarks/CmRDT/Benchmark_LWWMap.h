@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../BenchmarkUtils.h"
+#include "collabserver/datatypes/CmRDT/ConcurrentLWWMap.h"
+#include "collabserver/datatypes/CmRDT/LWWMap.h"
+
+namespace collabserver {
+
+template <typename Map>
+void LWWMap_benchmarkStorage(const std::string& name, const std::vector<std::string>& keys) {
+    const int nbKeys = static_cast<int>(keys.size());
+    std::cout << " " << name << " (" << nbKeys << " string keys)\n";
+
+    const long memBefore = benchmark_allocatedBytes;
+    Map* data = new Map();
+
+    double ms = benchmark_run([&]() {
+        for (int k = 0; k < nbKeys; ++k) {
+            data->add(keys[k], k + 1);
+        }
+    });
+    benchmark_print("add (new keys)", ms, nbKeys);
+    std::cout << "  memory: " << (benchmark_allocatedBytes - memBefore) / nbKeys << " bytes/key\n";
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbKeys; ++k) {
+            total += data->crdt_find(keys[k])->second.value();
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("crdt_find (hit)", ms, nbKeys);
+
+    ms = benchmark_run([&]() {
+        for (int k = 0; k < nbKeys; k += 2) {
+            data->remove(keys[k], 2 * nbKeys + k);
+        }
+    });
+    benchmark_print("remove (half keys)", ms, nbKeys / 2);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (const auto& elt : *data) {
+            total += elt.second;
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("iterate", ms, nbKeys);
+
+    delete data;
+}
+
+// Baseline of the contention benchmark: one mutex around the whole map
+struct LWWMap_benchmarkMutexMap {
+    std::mutex mutex;
+    LWWMap<int, int, int> map;
+
+    void set(int key, int value, int stamp) {
+        std::lock_guard<std::mutex> lock(mutex);
+        map.set(key, value, stamp);
+    }
+
+    bool find(int key, int& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = map.find(key);
+        if (it == map.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+};
+
+// One writer (set) and nbReaders readers (find) at the same time
+template <typename Map>
+void LWWMap_benchmarkContention(const std::string& name, int nbKeys, int nbWrites, int nbReads) {
+    const unsigned int nbReadersList[] = {1, 2, 4, 8};
+    for (const unsigned int nbReaders : nbReadersList) {
+        Map data;
+        for (int k = 0; k < nbKeys; ++k) {
+            data.set(k, k, 1);
+        }
+        const double ms = benchmark_run([&]() {
+            std::vector<std::thread> threads;
+            threads.emplace_back([&]() {
+                for (int k = 0; k < nbWrites; ++k) {
+                    data.set(k % nbKeys, k, k + 2);
+                }
+            });
+            for (unsigned int t = 0; t < nbReaders; ++t) {
+                threads.emplace_back([&, t]() {
+                    long sum = 0;
+                    int value = 0;
+                    for (int k = 0; k < nbReads; ++k) {
+                        sum += data.find(static_cast<int>((k * 7919u + t) % nbKeys), value) ? value : 0;
+                    }
+                    benchmark_sink = sum;
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        });
+        benchmark_print(name + " (1 writer, " + std::to_string(nbReaders) + " readers)", ms,
+                        nbWrites + static_cast<long>(nbReads) * nbReaders);
+    }
+}
+
+// Snapshots for a slow reader (ex: export) while updates keep coming
+template <typename Map>
+void LWWMap_benchmarkSnapshot(const std::string& name, const std::vector<std::string>& keys, int nbUpdates,
+                              int snapshotEvery) {
+    const int nbKeys = static_cast<int>(keys.size());
+    std::cout << " " << name << " snapshot (" << nbKeys << " string keys, one every " << snapshotEvery
+              << " updates)\n";
+
+    Map data;
+    for (int k = 0; k < nbKeys; ++k) {
+        data.set(keys[k], k, k + 1);
+    }
+    std::mt19937 rng(42);
+    std::vector<int> updates(nbUpdates);
+    for (int& key : updates) {
+        key = static_cast<int>(rng() % nbKeys);
+    }
+    int stamp = nbKeys;
+
+    const int nbSnapshots = 10;
+    double ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbSnapshots; ++k) {
+            const Map snapshot = data.snapshot();
+            total += static_cast<long>(snapshot.size());
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("snapshot", ms, nbSnapshots);
+
+    ms = benchmark_run([&]() {
+        for (int k = 0; k < nbUpdates; ++k) {
+            data.set(keys[updates[k]], k, ++stamp);
+        }
+    });
+    benchmark_print("set (no snapshot)", ms, nbUpdates);
+
+    ms = benchmark_run([&]() {
+        Map snapshot = data.snapshot();
+        for (int k = 0; k < nbUpdates; ++k) {
+            if (k % snapshotEvery == 0) {
+                snapshot = data.snapshot();
+            }
+            data.set(keys[updates[k]], k, ++stamp);
+        }
+        benchmark_sink = static_cast<long>(snapshot.size());
+    });
+    benchmark_print("set + snapshots", ms, nbUpdates);
+}
+
+void LWWMap_benchmark() {
+    std::cout << "\n----- CmRDT LWWMap Benchmark ----------\n";
+
+    // Keys longer than the std::string small buffer (Heap allocated)
+    std::vector<std::string> keys(500000);
+    for (std::size_t k = 0; k < keys.size(); ++k) {
+        keys[k] = "collabserver-vertex-id-" + std::to_string(k);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+
+    LWWMap_benchmarkStorage<LWWMap<std::string, int, int, HashMapStorage>>("HashMapStorage", keys);
+    LWWMap_benchmarkStorage<LWWMap<std::string, int, int, FlatHashStorage>>("FlatHashStorage", keys);
+    LWWMap_benchmarkStorage<LWWMap<std::string, int, int, PersistentStorage>>("PersistentStorage", keys);
+
+    LWWMap_benchmarkSnapshot<LWWMap<std::string, int, int, HashMapStorage>>("HashMapStorage", keys, 200000, 10000);
+    LWWMap_benchmarkSnapshot<LWWMap<std::string, int, int, PersistentStorage>>("PersistentStorage", keys, 200000,
+                                                                                10000);
+
+    std::cout << " Contention (100000 keys, 1000000 writes, 1000000 reads per reader)\n";
+    LWWMap_benchmarkContention<LWWMap_benchmarkMutexMap>("mutex + LWWMap", 100000, 1000000, 1000000);
+    LWWMap_benchmarkContention<ConcurrentLWWMap<int, int, int>>("ConcurrentLWWMap", 100000, 1000000, 1000000);
+}
+
+}  // namespace collabserver
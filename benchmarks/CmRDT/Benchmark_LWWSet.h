@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../BenchmarkUtils.h"
+#include "collabserver/datatypes/CmRDT/LWWSet.h"
+
+namespace collabserver {
+
+template <typename Set>
+void LWWSet_benchmarkStorage(const std::string& name, const std::vector<int>& keys) {
+    const int nbKeys = static_cast<int>(keys.size());
+    std::cout << " " << name << " (" << nbKeys << " keys)\n";
+
+    const long memBefore = benchmark_allocatedBytes;
+    Set* data = new Set();
+
+    double ms = benchmark_run([&]() {
+        for (int k = 0; k < nbKeys; ++k) {
+            data->add(keys[k], k + 1);
+        }
+    });
+    benchmark_print("add (new keys)", ms, nbKeys);
+    std::cout << "  memory: " << (benchmark_allocatedBytes - memBefore) / nbKeys << " bytes/key\n";
+
+    ms = benchmark_run([&]() {
+        for (int k = 0; k < nbKeys; ++k) {
+            data->add(keys[k], nbKeys + k + 1);
+        }
+    });
+    benchmark_print("add (existing keys)", ms, nbKeys);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbKeys; ++k) {
+            total += data->count(keys[k]);
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("count (hit)", ms, nbKeys);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbKeys; ++k) {
+            total += data->count(keys[k] + 1);
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("count (miss)", ms, nbKeys);
+
+    ms = benchmark_run([&]() {
+        for (int k = 0; k < nbKeys; k += 2) {
+            data->remove(keys[k], 3 * nbKeys + k);
+        }
+    });
+    benchmark_print("remove (half keys)", ms, nbKeys / 2);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (const auto& key : *data) {
+            total += key;
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("iterate", ms, nbKeys);
+
+    ms = benchmark_run([&]() { data->clear(4 * nbKeys); });
+    benchmark_print("clear", ms, 1);
+
+    ms = benchmark_run([&]() {
+        for (int k = 0; k < nbKeys; ++k) {
+            data->add(keys[k], 4 * nbKeys + k + 1);
+        }
+    });
+    benchmark_print("add (after clear)", ms, nbKeys);
+
+    delete data;
+}
+
+template <typename Set>
+void LWWSet_benchmarkTombstones(const std::string& name, int nbKeys, int nbAlive) {
+    std::cout << " " << name << " (" << nbKeys << " keys, " << nbAlive << " alive)\n";
+
+    // Tombstone-heavy set: most keys were added then removed
+    // Alive keys are spread over the whole table, last ones are removed.
+    Set data;
+    const int step = nbKeys / nbAlive;
+    for (int k = 0; k < nbKeys; ++k) {
+        data.add(k, k + 1);
+    }
+    for (int k = 0; k < nbKeys; ++k) {
+        if (k % step != step / 2) {
+            data.remove(k, nbKeys + k + 1);
+        }
+    }
+
+    const int nbLookups = 100000;
+    double ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbLookups; ++k) {
+            total += data.count(k % nbKeys);
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("count", ms, nbLookups);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbLookups; ++k) {
+            total += (data.find(k % nbKeys) != data.end()) ? 1 : 0;
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("find() != end()", ms, nbLookups);
+
+    const int nbIterations = 100;
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbIterations; ++k) {
+            for (const auto& key : data) {
+                total += key;
+            }
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("iterate", ms, nbIterations);
+}
+
+template <typename Set>
+void LWWSet_benchmarkMerge(const std::string& name, int nbKeys) {
+    std::cout << " " << name << " merge (" << nbKeys << " keys, half shared)\n";
+
+    // Two replicates with half of the keys in common
+    Set data0;
+    Set data1;
+    for (int k = 0; k < nbKeys; ++k) {
+        data0.add(k, k + 1);
+        data1.add(k + nbKeys / 2, k + 2);
+    }
+
+    const unsigned int nbThreadsList[] = {1, 2, 4, 8};
+    for (const unsigned int nbThreads : nbThreadsList) {
+        Set merged(data0);
+        const double ms = benchmark_run([&]() { merged.merge_parallel(data1, nbThreads); });
+        benchmark_sink = static_cast<long>(merged.size());
+        benchmark_print("merge_parallel (" + std::to_string(nbThreads) + " threads)", ms, nbKeys);
+    }
+}
+
+template <typename Set>
+void LWWSet_benchmarkBatch(const std::string& name, int nbKeys, int nbHotKeys, int batchSize) {
+    typedef typename Set::batch_operation Op;
+    std::cout << " " << name << " batch (" << nbKeys << " keys, ops on " << nbHotKeys << " hot keys, " << batchSize
+              << " per batch)\n";
+
+    // Bursts of operations on a few keys of a large set
+    std::mt19937 rng(42);
+    std::vector<int> hotKeys(nbHotKeys);
+    for (int& key : hotKeys) {
+        key = static_cast<int>(rng() % nbKeys);
+    }
+    const int nbOps = 1000000;
+    std::vector<Op> ops;
+    ops.reserve(nbOps);
+    for (int k = 0; k < nbOps; ++k) {
+        const typename Op::Kind kind = (rng() % 3 == 0) ? Op::REMOVE : Op::ADD;
+        ops.push_back(Op{kind, hotKeys[rng() % nbHotKeys], nbKeys + k + 1});
+    }
+
+    Set data0;
+    Set data1;
+    for (int k = 0; k < nbKeys; ++k) {
+        data0.add(k, k + 1);
+        data1.add(k, k + 1);
+    }
+
+    double ms = benchmark_run([&]() {
+        long total = 0;
+        for (const Op& op : ops) {
+            total += (op.kind == Op::ADD) ? data0.add(op.key, op.stamp) : data0.remove(op.key, op.stamp);
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("add / remove (one by one)", ms, nbOps);
+
+    ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbOps; k += batchSize) {
+            const auto first = ops.begin() + k;
+            const auto last = ops.begin() + std::min(k + batchSize, nbOps);
+            const std::vector<bool> results = data1.apply_batch(first, last);
+            total += std::count(results.begin(), results.end(), true);
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("apply_batch", ms, nbOps);
+}
+
+// Snapshots for a slow reader (ex: export) while updates keep coming
+template <typename Set>
+void LWWSet_benchmarkSnapshot(const std::string& name, int nbKeys, int nbUpdates, int snapshotEvery) {
+    std::cout << " " << name << " snapshot (" << nbKeys << " keys, one every " << snapshotEvery << " updates)\n";
+
+    Set data;
+    for (int k = 0; k < nbKeys; ++k) {
+        data.add(k, k + 1);
+    }
+    std::mt19937 rng(42);
+    std::vector<int> updates(nbUpdates);
+    for (int& key : updates) {
+        key = static_cast<int>(rng() % nbKeys);
+    }
+    int stamp = nbKeys;
+
+    const int nbSnapshots = 10;
+    double ms = benchmark_run([&]() {
+        long total = 0;
+        for (int k = 0; k < nbSnapshots; ++k) {
+            const Set snapshot = data.snapshot();
+            total += static_cast<long>(snapshot.size());
+        }
+        benchmark_sink = total;
+    });
+    benchmark_print("snapshot", ms, nbSnapshots);
+
+    ms = benchmark_run([&]() {
+        for (int k = 0; k < nbUpdates; ++k) {
+            (k % 2 == 0) ? data.remove(updates[k], ++stamp) : data.add(updates[k], ++stamp);
+        }
+    });
+    benchmark_print("add / remove (no snapshot)", ms, nbUpdates);
+
+    ms = benchmark_run([&]() {
+        Set snapshot = data.snapshot();
+        for (int k = 0; k < nbUpdates; ++k) {
+            if (k % snapshotEvery == 0) {
+                snapshot = data.snapshot();
+            }
+            (k % 2 == 0) ? data.remove(updates[k], ++stamp) : data.add(updates[k], ++stamp);
+        }
+        benchmark_sink = static_cast<long>(snapshot.size());
+    });
+    benchmark_print("add / remove + snapshots", ms, nbUpdates);
+}
+
+void LWWSet_benchmark() {
+    std::cout << "\n----- CmRDT LWWSet Benchmark ----------\n";
+
+    // Keys in random order: ops from the network don't come sorted
+    std::vector<int> keys(1000000);
+    for (std::size_t k = 0; k < keys.size(); ++k) {
+        keys[k] = static_cast<int>(k * 2);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+
+    LWWSet_benchmarkStorage<LWWSet<int, int, HashMapStorage>>("HashMapStorage", keys);
+    LWWSet_benchmarkStorage<LWWSet<int, int, FlatHashStorage>>("FlatHashStorage", keys);
+    LWWSet_benchmarkStorage<LWWSet<int, int, PersistentStorage>>("PersistentStorage", keys);
+
+    LWWSet_benchmarkTombstones<LWWSet<int, int, HashMapStorage>>("HashMapStorage", 200000, 1000);
+    LWWSet_benchmarkTombstones<LWWSet<int, int, FlatHashStorage>>("FlatHashStorage", 200000, 1000);
+
+    LWWSet_benchmarkBatch<LWWSet<int, int, HashMapStorage>>("HashMapStorage", 1000000, 1000, 4096);
+    LWWSet_benchmarkBatch<LWWSet<int, int, FlatHashStorage>>("FlatHashStorage", 1000000, 1000, 4096);
+
+    LWWSet_benchmarkMerge<LWWSet<int, int, HashMapStorage>>("HashMapStorage", 1000000);
+    LWWSet_benchmarkMerge<LWWSet<int, int, FlatHashStorage>>("FlatHashStorage", 1000000);
+
+    LWWSet_benchmarkSnapshot<LWWSet<int, int, HashMapStorage>>("HashMapStorage", 1000000, 200000, 10000);
+    LWWSet_benchmarkSnapshot<LWWSet<int, int, PersistentStorage>>("PersistentStorage", 1000000, 200000, 10000);
+}
+
+}  // namespace collabserver
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../BenchmarkUtils.h"
+#include "collabserver/datatypes/CmRDT/LWWMap.h"
+#include "collabserver/datatypes/collabdata/CollabDataAsyncObserver.h"
+#include "collabserver/datatypes/collabdata/CollabDataIngestQueue.h"
+
+namespace collabserver {
+
+// Data that applies each operation as a set in a LWWMap (Buffer size as value)
+class CollabData_benchmarkData : public CollabData {
+   private:
+    LWWMap<unsigned int, std::size_t, long> _map;
+    long _stamp = 0;
+
+   public:
+    bool applyExternOperation(unsigned int id, const std::string& buffer) override {
+        _map.set(id % 10000, buffer.size(), ++_stamp);
+        return true;
+    }
+};
+
+// Baseline: network threads apply their operations under one lock
+struct CollabData_benchmarkMutexIngest {
+    std::mutex mutex;
+    CollabData_benchmarkData data;
+
+    void start() {}
+    void stop() {}
+
+    void push(unsigned int id, std::string buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        data.applyExternOperation(id, buffer);
+    }
+};
+
+struct CollabData_benchmarkQueueIngest {
+    CollabData_benchmarkData data;
+    CollabDataIngestQueue queue;
+
+    CollabData_benchmarkQueueIngest() : queue(data, 1024) {}
+
+    void start() { queue.start(); }
+    void stop() { queue.stop(); }
+
+    void push(unsigned int id, std::string buffer) { queue.push(id, std::move(buffer)); }
+};
+
+// nbThreads network threads send nbOps operations each.
+// Measured until all operations are applied.
+template <typename Ingest>
+void CollabData_benchmarkIngest(const std::string& name, int nbOps) {
+    const unsigned int nbThreadsList[] = {1, 2, 4, 8};
+    for (const unsigned int nbThreads : nbThreadsList) {
+        Ingest ingest;
+        const double ms = benchmark_run([&]() {
+            ingest.start();
+            std::vector<std::thread> threads;
+            for (unsigned int t = 0; t < nbThreads; ++t) {
+                threads.emplace_back([&, t]() {
+                    for (int k = 0; k < nbOps; ++k) {
+                        ingest.push(t * nbOps + k, "serialized-operation");
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            ingest.stop();
+        });
+        benchmark_print(name + " (" + std::to_string(nbThreads) + " threads)", ms,
+                        static_cast<long>(nbOps) * nbThreads);
+    }
+}
+
+// Operation without content (Only its notification is measured)
+class CollabData_benchmarkOperation : public CollabDataOperation {
+   public:
+    unsigned int getType() const override { return 1; }
+    bool serialize(std::stringstream& /*buffer*/) const override { return false; }
+    bool unserialize(const std::stringstream& /*buffer*/) override { return false; }
+    void accept(CollabDataOperationHandler& /*handler*/) const override {}
+    CollabDataOperationPtr clone() const override { return std::make_shared<CollabData_benchmarkOperation>(); }
+};
+
+// Observer with a fixed cost per call (ex: persistence writer that flushes its file)
+class CollabData_benchmarkSlowObserver : public CollabDataOperationObserver {
+   public:
+    long nbOps = 0;
+
+   public:
+    void onOperation(const CollabDataOperation& /*op*/) override { this->onCall(1); }
+
+    void onOperations(const std::vector<CollabDataOperationPtr>& ops) override { this->onCall(ops.size()); }
+
+   private:
+    void onCall(std::size_t nbReceived) {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+        while (std::chrono::steady_clock::now() < end) {
+        }
+        nbOps += static_cast<long>(nbReceived);
+    }
+};
+
+// Notifies nbOps operations to the slow observer, inline or through a CollabDataAsyncObserver.
+// Measured until all operations are delivered.
+void CollabData_benchmarkObserver(int nbOps) {
+    CollabData_benchmarkOperation op;
+    {
+        CollabData_benchmarkData data;
+        CollabData_benchmarkSlowObserver observer;
+        data.addOperationObserver(observer);
+        const double ms = benchmark_run([&]() {
+            for (int k = 0; k < nbOps; ++k) {
+                data.notifyOperationObservers(op);
+            }
+        });
+        benchmark_print("inline observer", ms, nbOps);
+        benchmark_sink = observer.nbOps;
+    }
+    const std::size_t maxBatchList[] = {1, 16, 64};
+    for (const std::size_t maxBatch : maxBatchList) {
+        CollabData_benchmarkData data;
+        CollabData_benchmarkSlowObserver observer;
+        CollabDataAsyncObserver asyncObserver(observer, 1024, CollabDataAsyncObserver::Overflow::Block, maxBatch);
+        data.addOperationObserver(asyncObserver);
+        const double ms = benchmark_run([&]() {
+            for (int k = 0; k < nbOps; ++k) {
+                data.notifyOperationObservers(op);
+            }
+            asyncObserver.flush();
+        });
+        benchmark_print("CollabDataAsyncObserver (batch " + std::to_string(maxBatch) + ")", ms, nbOps);
+        benchmark_sink = observer.nbOps;
+    }
+}
+
+void CollabData_benchmark() {
+    std::cout << "\n----- CollabData Benchmark ----------\n";
+
+    std::cout << " applyExternOperation from network threads (200000 ops per thread)\n";
+    CollabData_benchmarkIngest<CollabData_benchmarkMutexIngest>("mutex + applyExternOperation", 200000);
+    CollabData_benchmarkIngest<CollabData_benchmarkQueueIngest>("CollabDataIngestQueue", 200000);
+
+    std::cout << " Observer with 20 us per call (20000 ops)\n";
+    CollabData_benchmarkObserver(20000);
+}
+
+}  // namespace collabserver
@@ -0,0 +1,42 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "CmRDT/Benchmark_LWWGraph.h"
+#include "CmRDT/Benchmark_LWWMap.h"
+#include "CmRDT/Benchmark_LWWSet.h"
+#include "collabdata/Benchmark_CollabData.h"
+
+namespace collabserver {
+std::atomic<long> benchmark_allocatedBytes(0);
+}  // namespace collabserver
+
+// Counts allocated bytes to compare memory usage of the storage backends.
+// Size is stored in front of each block.
+void* operator new(std::size_t size) {
+    void* p = std::malloc(size + sizeof(std::max_align_t));
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    *static_cast<std::size_t*>(p) = size;
+    collabserver::benchmark_allocatedBytes += static_cast<long>(size);
+    return static_cast<char*>(p) + sizeof(std::max_align_t);
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        char* block = static_cast<char*>(p) - sizeof(std::max_align_t);
+        collabserver::benchmark_allocatedBytes -= static_cast<long>(*reinterpret_cast<std::size_t*>(block));
+        std::free(block);
+    }
+}
+
+int main() {
+    collabserver::LWWSet_benchmark();
+    collabserver::LWWMap_benchmark();
+    collabserver::LWWGraph_benchmark();
+    collabserver::CollabData_benchmark();
+
+    return 0;
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <type_traits>
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Value and timestamp of an AtomicLWWRegister, stored in 64 bits words.
+ *
+ * Packed version (Value and timestamp fit in one word): one atomic word.
+ * Readers load it, writers CAS it. Both are lock-free.
+ *
+ * \tparam State        Trivially copyable (value, timestamp) pair.
+ * \tparam isPacked     True if State fits in one 64 bits word.
+ */
+template <typename State, bool isPacked = (sizeof(State) <= sizeof(std::uint64_t))>
+class AtomicLWWRegisterStorage {
+   private:
+    std::atomic<std::uint64_t> _word;
+
+   public:
+    explicit AtomicLWWRegisterStorage(const State& state) : _word(encode(state)) {}
+
+    State load() const { return decode(_word.load(std::memory_order_acquire)); }
+
+    template <typename IsNewer>
+    bool update(const State& state, IsNewer isNewer) {
+        const std::uint64_t word = encode(state);
+        std::uint64_t current = _word.load(std::memory_order_acquire);
+        while (isNewer(decode(current))) {
+            if (_word.compare_exchange_weak(current, word, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+   private:
+    static std::uint64_t encode(const State& state) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, &state, sizeof(State));
+        return word;
+    }
+
+    static State decode(std::uint64_t word) {
+        State state;
+        std::memcpy(&state, &word, sizeof(State));
+        return state;
+    }
+};
+
+/**
+ * \brief
+ * Seqlock version (State larger than one word).
+ *
+ * Writers take the sequence (Odd while writing), then store the words.
+ * Readers never lock: they copy the words and retry if the sequence
+ * changed meanwhile (Only while a write is in progress).
+ *
+ * \tparam State Trivially copyable (value, timestamp) pair.
+ */
+template <typename State>
+class AtomicLWWRegisterStorage<State, false> {
+   private:
+    static constexpr std::size_t nbWords = (sizeof(State) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    std::atomic<std::uint64_t> _seq;
+    std::atomic<std::uint64_t> _words[nbWords];
+
+   public:
+    explicit AtomicLWWRegisterStorage(const State& state) : _seq(0) { this->store(state); }
+
+    State load() const {
+        for (;;) {
+            const std::uint64_t seq = _seq.load(std::memory_order_acquire);
+            if ((seq & 1) == 0) {
+                // DevNote: a word read from a write in progress (Release
+                // store) makes the odd sequence visible below.
+                const State state = this->copy();
+                if (_seq.load(std::memory_order_acquire) == seq) {
+                    return state;
+                }
+            }
+        }
+    }
+
+    template <typename IsNewer>
+    bool update(const State& state, IsNewer isNewer) {
+        if (!isNewer(this->load())) {
+            return false;  // Older update: no need to lock
+        }
+        std::uint64_t seq = _seq.load(std::memory_order_relaxed);
+        for (;;) {
+            if ((seq & 1) == 0 &&
+                _seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                break;
+            }
+            seq = _seq.load(std::memory_order_relaxed);  // Other writer
+        }
+        if (!isNewer(this->copy())) {
+            _seq.store(seq, std::memory_order_release);  // Unchanged
+            return false;
+        }
+        this->store(state);
+        _seq.store(seq + 2, std::memory_order_release);
+        return true;
+    }
+
+   private:
+    State copy() const {
+        std::uint64_t words[nbWords];
+        for (std::size_t k = 0; k < nbWords; ++k) {
+            words[k] = _words[k].load(std::memory_order_acquire);
+        }
+        State state;
+        std::memcpy(&state, words, sizeof(State));
+        return state;
+    }
+
+    void store(const State& state) {
+        std::uint64_t words[nbWords] = {0};
+        std::memcpy(words, &state, sizeof(State));
+        for (std::size_t k = 0; k < nbWords; ++k) {
+            _words[k].store(words[k], std::memory_order_release);
+        }
+    }
+};
+
+/**
+ * \brief
+ * Last-Writer-Wins Register shared between threads (See LWWRegister).
+ * CmRDT (Operation-based).
+ *
+ * Same semantic as LWWRegister, but update and queries may be called from
+ * several threads at once, without any lock. Meant for small values
+ * updated often from many threads (Cursor positions, presence flags...).
+ *
+ * \par Storage
+ * If value and timestamp fit in 64 bits, they are packed in one atomic
+ * word: readers are wait-free (One load) and update is a CAS loop.
+ * Otherwise, a seqlock is used: readers never wait for a lock, but retry
+ * their copy if it overlapped a write. Writers wait for each other.
+ *
+ * \par
+ * Value and timestamp are always read together: query and timestamp
+ * called one after the other may see two different updates, use load
+ * for a consistent pair.
+ *
+ * \warning
+ * Timestamps are strictly unique with total order (See LWWRegister).
+ *
+ * \warning
+ * T and U must be trivially copyable. T must have a default constructor.
+ * U timestamp must accept "U t = {0}" (This should set with minimal value).
+ *
+ *
+ * \tparam T    Type of element (Register content).
+ * \tparam U    Type of timestamps (Must implements operators > and <).
+ */
+template <typename T, typename U>
+class AtomicLWWRegister {
+    static_assert(std::is_trivially_copyable<T>::value, "AtomicLWWRegister value must be trivially copyable");
+    static_assert(std::is_trivially_copyable<U>::value, "AtomicLWWRegister timestamp must be trivially copyable");
+
+   private:
+    struct State {
+        T value;
+        U timestamp;
+    };
+
+    // Checks if the update at stamp wins over the current state
+    struct IsNewer {
+        const U& stamp;
+        bool operator()(const State& current) const { return stamp > current.timestamp; }
+    };
+
+    AtomicLWWRegisterStorage<State> _state;
+
+   public:
+    AtomicLWWRegister() : _state(State{T(), U{0}}) {}
+    AtomicLWWRegister(const AtomicLWWRegister& other) = delete;
+    AtomicLWWRegister& operator=(const AtomicLWWRegister& other) = delete;
+
+    // -------------------------------------------------------------------------
+    // Query methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Get a copy of the current register value.
+     *
+     * \return Copy of the register content.
+     */
+    T query() const { return _state.load().value; }
+
+    /**
+     * Get the internal current timestamps associated with this register.
+     *
+     * \return Current register's timestamps.
+     */
+    U timestamp() const { return _state.load().timestamp; }
+
+    /**
+     * Get the register value and its timestamp, both from the same update.
+     *
+     * \param value Set with the register content.
+     * \param stamp Set with the timestamp of value.
+     */
+    void load(T& value, U& stamp) const {
+        const State state = _state.load();
+        value = state.value;
+        stamp = state.timestamp;
+    }
+
+    /**
+     * Checks if register content is stored in one atomic word.
+     * (Wait-free readers, no seqlock).
+     *
+     * \return True if packed, otherwise, returns false.
+     */
+    static constexpr bool is_packed() { return sizeof(State) <= sizeof(std::uint64_t); }
+
+    // -------------------------------------------------------------------------
+    // Modifiers
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Change the local register value.
+     * Do nothing if given stamp is less to the current timestamps.
+     * Thread safe: concurrent updates end with the one of highest stamp.
+     *
+     * \param value New value to place in this register.
+     * \param stamp Timestamp of this update.
+     * \return True if update applied, otherwise, returns false.
+     */
+    bool update(const T& value, const U& stamp) { return _state.update(State{value, stamp}, IsNewer{stamp}); }
+
+    // -------------------------------------------------------------------------
+    // CRDT Specific
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Check if two registers have the exact same internal data.
+     * (Data and timestamps)
+     *
+     * \param other Container to compare with.
+     * \return True if equals, otherwise, return false.
+     */
+    bool crdt_equal(const AtomicLWWRegister& other) const {
+        const State lhs = _state.load();
+        const State rhs = other._state.load();
+        return (lhs.value == rhs.value) && (lhs.timestamp == rhs.timestamp);
+    }
+
+    // -------------------------------------------------------------------------
+    // Operators overload
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Check if two registers are equal.
+     * Two registers are equal if their data are equal.
+     * Timestamps is not used for equality.
+     *
+     * \param lhs   Left hand side.
+     * \param rhs   Right hand side.
+     * \return True if equal, otherwise, return false.
+     */
+    friend bool operator==(const AtomicLWWRegister& lhs, const AtomicLWWRegister& rhs) {
+        return (lhs.query() == rhs.query());
+    }
+
+    /**
+     * Check if two registers are different.
+     * See operator== for equality meaning.
+     *
+     * \see AtomicLWWRegister::operator==
+     *
+     * \param lhs   Left hand side.
+     * \param rhs   Right hand side.
+     * \return True if not equal, otherwise, return false.
+     */
+    friend bool operator!=(const AtomicLWWRegister& lhs, const AtomicLWWRegister& rhs) { return !(lhs == rhs); }
+
+    /**
+     * Displays the register value and its timestamp.
+     * This is mainly for debug print purpose.
+     */
+    friend std::ostream& operator<<(std::ostream& out, const AtomicLWWRegister& o) {
+        const State state = o._state.load();
+        out << "CmRDT::AtomicLWWRegister = (T=" << state.value << ", U=" << state.timestamp << ")";
+        return out;
+    }
+};
+
+}  // namespace collabserver
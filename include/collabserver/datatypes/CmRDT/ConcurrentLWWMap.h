@@ -0,0 +1,527 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../utils/EpochReclamation.h"
+#include "LWWMap.h"
+
+namespace collabserver {
+
+/**
+ * \brief
+ * LWWMap for many reader threads and a few writer threads.
+ *
+ * Same operations and results as LWWMap (add, set, remove, clear), with
+ * lock-striped writers and lock-free readers:
+ * - Keys are partitioned by hash in N stripes. Each stripe is a hash
+ *   table with its own writer lock. Writers of different stripes run in
+ *   parallel.
+ * - Readers (find, at, count, size...) take no lock: they never wait for
+ *   a writer, nor a writer for them.
+ *
+ * \par Readers
+ * The state of a key (Value, timestamp, removed flag) is an immutable
+ * version. A writer publishes a new version, then retires the old one:
+ * it is deleted once no reader may still read it (See EpochReclamation).
+ * A reader sees, for each key, the last version published before its
+ * lookup, or a newer one.
+ *
+ * \par Convergence
+ * Each operation is applied like LWWMap (Same timestamps rules). Applying
+ * any set of operations from any number of threads gives the same content
+ * as a LWWMap that receives them, in any order. (See snapshot).
+ *
+ * \note
+ * Each add / remove that changes a key copies its value in the new
+ * version. Prefer small values (Or values that share their content).
+ * size is the sum of the sizes of each stripe: not atomic while other
+ * threads apply operations.
+ * Merge, delta_since and compact are not provided: use snapshot to get a
+ * LWWMap.
+ *
+ * \tparam Key  Type of key.
+ * \tparam T    Type of element (Must have a default constructor).
+ * \tparam U    Type of timestamps (Must implements operators > and <).
+ */
+template <typename Key, typename T, typename U>
+class ConcurrentLWWMap {
+   public:
+    typedef LWWMap<Key, T, U> map_type;
+    typedef std::size_t size_type;
+
+   private:
+    // Immutable state of a key (Replaced by each change)
+    struct Version {
+        T value;
+        U timestamp;
+        bool isRemoved;
+        U valueTime;  // Last set of value (See LWWMap::set)
+    };
+
+    // Key with its current version. Never removed from its chain.
+    struct Node {
+        const Key key;
+        std::atomic<const Version*> version;
+        Node* next;  // Set before the node is published
+
+        Node(const Key& k, const Version* v, Node* n) : key(k), version(v), next(n) {}
+    };
+
+    // Buckets of a stripe. Replaced by a larger table on growth.
+    struct Table {
+        std::size_t mask;  // Nb of buckets - 1 (Power of two)
+        std::unique_ptr<std::atomic<Node*>[]> buckets;
+
+        explicit Table(std::size_t nbBuckets) : mask(nbBuckets - 1), buckets(new std::atomic<Node*>[nbBuckets]) {
+            for (std::size_t k = 0; k < nbBuckets; ++k) {
+                buckets[k].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // Nodes are owned by the table (Not their versions)
+        ~Table() {
+            for (std::size_t k = 0; k <= mask; ++k) {
+                Node* node = buckets[k].load(std::memory_order_relaxed);
+                while (node != nullptr) {
+                    Node* next = node->next;
+                    delete node;
+                    node = next;
+                }
+            }
+        }
+    };
+
+    struct Stripe {
+        std::mutex mutex;  // Writers only
+        std::atomic<Table*> table;
+        std::atomic<size_type> sizeAlive;
+        size_type crdtSize = 0;
+        U lastClearTime = {0};
+        RetiredList retired;  // Versions and tables (Under mutex)
+
+        Stripe() : table(new Table(8)), sizeAlive(0) {}
+    };
+
+    std::vector<std::unique_ptr<Stripe>> _stripes;
+    std::size_t _stripeShift;  // log2 of the nb of stripes
+    mutable EpochReclamation _epochs;
+
+    // -------------------------------------------------------------------------
+    // Initialization
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Creates an empty map.
+     *
+     * \param nbStripes Number of stripes (Rounded up to a power of two).
+     *                  More stripes than writer threads lowers the chance
+     *                  that two writers wait for the same lock.
+     */
+    explicit ConcurrentLWWMap(std::size_t nbStripes = 64) : _stripeShift(0) {
+        while ((std::size_t(1) << _stripeShift) < nbStripes) {
+            ++_stripeShift;
+        }
+        _stripes.resize(std::size_t(1) << _stripeShift);
+        for (auto& stripe : _stripes) {
+            stripe.reset(new Stripe());
+        }
+    }
+
+    ConcurrentLWWMap(const ConcurrentLWWMap& other) = delete;
+    ConcurrentLWWMap& operator=(const ConcurrentLWWMap& other) = delete;
+
+    ~ConcurrentLWWMap() {
+        for (auto& stripe : _stripes) {
+            Table* table = stripe->table.load();
+            for (std::size_t k = 0; k <= table->mask; ++k) {
+                for (Node* node = table->buckets[k].load(); node != nullptr; node = node->next) {
+                    delete node->version.load();
+                }
+            }
+            delete table;
+            stripe->retired.clear();
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns the number of stripes.
+     *
+     * \return Number of stripes.
+     */
+    std::size_t nb_stripes() const noexcept { return _stripes.size(); }
+
+    /**
+     * Checks if the container has no elements. Lock-free.
+     * Only elements that are not marked as 'removed' count.
+     *
+     * \return True if the container is empty, false otherwise.
+     */
+    bool empty() const { return this->size() == 0; }
+
+    /**
+     * Returns the number of elements in the container. Lock-free.
+     * Only elements that are not marked as 'removed' count.
+     *
+     * \return Number of elements in the container.
+     */
+    size_type size() const {
+        size_type total = 0;
+        for (const auto& stripe : _stripes) {
+            total += stripe->sizeAlive.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /**
+     * Get the actual internal size of the container.
+     * This also count elements with removed flag.
+     *
+     * \return Internal size of the container.
+     */
+    size_type crdt_size() const {
+        size_type total = 0;
+        for (const auto& stripe : _stripes) {
+            std::lock_guard<std::mutex> lock(stripe->mutex);
+            total += stripe->crdtSize;
+        }
+        return total;
+    }
+
+    // -------------------------------------------------------------------------
+    // Lookup methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns a copy of the value of the element with this key. Lock-free.
+     * If no such element exists, an exception of type std::out_of_range is
+     * thrown.
+     *
+     * \param key Key value of the element to search for.
+     * \return Copy of the value (Value may change right after).
+     */
+    T at(const Key& key) const {
+        T value;
+        if (!this->find(key, value)) {
+            throw std::out_of_range("No element for this key");
+        }
+        return value;
+    }
+
+    /**
+     * Find an element in the container. Lock-free.
+     *
+     * This only lookup for elements that are not internally deleted.
+     *
+     * \param key   Key value of the element to search for.
+     * \param value Set with a copy of the value if found.
+     * \return True if found, otherwise, return false.
+     */
+    bool find(const Key& key, T& value) const {
+        return this->visit(key, [&](const T& found) { value = found; });
+    }
+
+    /**
+     * Calls fn on the value of the element with this key. Lock-free.
+     * (Value must not be used once fn returns).
+     *
+     * \param key   Key value of the element to search for.
+     * \param fn    Function called as fn(const T&).
+     * \return True if found (And fn called), otherwise, return false.
+     */
+    template <typename Fn>
+    bool visit(const Key& key, Fn fn) const {
+        const auto guard = _epochs.read();
+        const Version* version = this->findVersion(key);
+        if (version == nullptr || version->isRemoved) {
+            return false;
+        }
+        fn(version->value);
+        return true;
+    }
+
+    /**
+     * Count the number of element with this key. Lock-free.
+     * Since no duplicate are allowed, return 0 or 1.
+     *
+     * \param key Key value of the element to count.
+     * \return Number of elements with this key, either 0 or 1.
+     */
+    size_type count(const Key& key) const {
+        const auto guard = _epochs.read();
+        const Version* version = this->findVersion(key);
+        return (version != nullptr && !version->isRemoved) ? 1 : 0;
+    }
+
+    /**
+     * Count the number of element with this key. Lock-free.
+     * Also lookup for 'removed' element (Internal CRDT data).
+     *
+     * \param key Key value of the element to count.
+     * \return Number of elements with this key, either 0 or 1.
+     */
+    size_type crdt_count(const Key& key) const {
+        const auto guard = _epochs.read();
+        return (this->findVersion(key) != nullptr) ? 1 : 0;
+    }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * \copydoc LWWMap::clear
+     *
+     * \par Complexity
+     * Linear in crdt_size. Each stripe is locked in turn.
+     */
+    bool clear(const U& stamp) {
+        bool isCleared = false;
+        for (auto& stripe : _stripes) {
+            std::lock_guard<std::mutex> lock(stripe->mutex);
+            if (!(stamp > stripe->lastClearTime)) {
+                continue;
+            }
+            isCleared = true;
+            stripe->lastClearTime = stamp;
+            Table* table = stripe->table.load(std::memory_order_relaxed);
+            for (std::size_t k = 0; k <= table->mask; ++k) {
+                for (Node* node = table->buckets[k].load(std::memory_order_relaxed); node != nullptr;
+                     node = node->next) {
+                    const Version* version = node->version.load(std::memory_order_relaxed);
+                    if (stamp > version->timestamp) {
+                        this->publish(*stripe, *node, Version{version->value, stamp, true, version->valueTime});
+                    }
+                }
+            }
+        }
+        return isCleared;
+    }
+
+    /**
+     * \copydoc LWWMap::add(const Key&, const U&)
+     */
+    bool add(const Key& key, const U& stamp) {
+        Stripe& stripe = this->stripeOf(key);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Node* node = this->findNode(stripe, key);
+        if (node == nullptr) {
+            const bool isAdded = stamp > stripe.lastClearTime;
+            this->insertNode(stripe, key, Version{T(), isAdded ? stamp : stripe.lastClearTime, !isAdded, U()});
+            return isAdded;
+        }
+        const Version* version = node->version.load(std::memory_order_relaxed);
+        if (stamp > version->timestamp) {
+            const bool isAdded = version->isRemoved;
+            this->publish(stripe, *node, Version{version->value, stamp, false, version->valueTime});
+            return isAdded;
+        }
+        return false;
+    }
+
+    /**
+     * \copydoc LWWMap::set(const Key&, V&&, const U&)
+     */
+    template <typename V>
+    bool set(const Key& key, V&& value, const U& stamp) {
+        Stripe& stripe = this->stripeOf(key);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Node* node = this->findNode(stripe, key);
+        if (node == nullptr) {
+            const bool isAdded = stamp > stripe.lastClearTime;
+            this->insertNode(stripe, key,
+                             Version{std::forward<V>(value), isAdded ? stamp : stripe.lastClearTime, !isAdded, stamp});
+            return true;
+        }
+        const Version* version = node->version.load(std::memory_order_relaxed);
+        const bool isAssigned = stamp > version->valueTime;
+        const bool isAdded = stamp > version->timestamp;
+        if (isAssigned && isAdded) {
+            this->publish(stripe, *node, Version{std::forward<V>(value), stamp, false, stamp});
+        } else if (isAssigned) {
+            this->publish(stripe, *node,
+                          Version{std::forward<V>(value), version->timestamp, version->isRemoved, stamp});
+        } else if (isAdded) {
+            this->publish(stripe, *node, Version{version->value, stamp, false, version->valueTime});
+        }
+        return isAssigned;
+    }
+
+    /**
+     * \copydoc LWWMap::remove(const Key&, const U&)
+     */
+    bool remove(const Key& key, const U& stamp) {
+        Stripe& stripe = this->stripeOf(key);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Node* node = this->findNode(stripe, key);
+        if (node == nullptr) {
+            const U& removeTime = (stripe.lastClearTime > stamp) ? stripe.lastClearTime : stamp;
+            this->insertNode(stripe, key, Version{T(), removeTime, true, U()});
+            return false;
+        }
+        const Version* version = node->version.load(std::memory_order_relaxed);
+        if (stamp > version->timestamp) {
+            const bool isRemoved = !version->isRemoved;
+            this->publish(stripe, *node, Version{version->value, stamp, true, version->valueTime});
+            return isRemoved;
+        }
+        return false;
+    }
+
+    // -------------------------------------------------------------------------
+    // CRDT Specific
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns a copy of the container, as a LWWMap.
+     *
+     * \par Complexity
+     * Linear in crdt_size. All stripes are locked meanwhile.
+     *
+     * \return Copy of the map (Same CRDT state as a LWWMap that received
+     *         the same operations).
+     */
+    map_type snapshot() const {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (const auto& stripe : _stripes) {
+            locks.emplace_back(stripe->mutex);
+        }
+        map_type map;
+        size_type crdtSize = 0;
+        U lastClearTime = {0};
+        for (const auto& stripe : _stripes) {
+            crdtSize += stripe->crdtSize;
+            if (stripe->lastClearTime > lastClearTime) {
+                lastClearTime = stripe->lastClearTime;
+            }
+        }
+        map.clear(lastClearTime);
+        map.reserve(crdtSize);
+        for (const auto& stripe : _stripes) {
+            const Table* table = stripe->table.load(std::memory_order_relaxed);
+            for (std::size_t k = 0; k <= table->mask; ++k) {
+                for (Node* node = table->buckets[k].load(std::memory_order_relaxed); node != nullptr;
+                     node = node->next) {
+                    const Version* version = node->version.load(std::memory_order_relaxed);
+                    if (version->isRemoved) {
+                        map.remove(node->key, version->timestamp);
+                    } else {
+                        map.add(node->key, version->timestamp);
+                    }
+                    map.set(node->key, version->value, version->valueTime);  // No-op if never set
+                }
+            }
+        }
+        return map;
+    }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    std::size_t hashOf(const Key& key) const {
+        // Murmur3 finalizer: std::hash is often the identity for integers
+        std::uint64_t h = std::hash<Key>()(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<std::size_t>(h);
+    }
+
+    // Stripe from the low bits of the hash, bucket from the bits left
+    Stripe& stripeOf(const Key& key) const { return *_stripes[this->hashOf(key) & (_stripes.size() - 1)]; }
+
+    std::size_t bucketOf(const Key& key, const Table& table) const { return this->bucketOf(this->hashOf(key), table); }
+
+    std::size_t bucketOf(std::size_t hash, const Table& table) const { return (hash >> _stripeShift) & table.mask; }
+
+    static Node* findInTable(const Table& table, std::size_t bucket, const Key& key) {
+        for (Node* node = table.buckets[bucket].load(std::memory_order_acquire); node != nullptr;
+             node = node->next) {
+            if (node->key == key) {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    // DevNote: readers only, in a read section. Acquire loads are enough
+    // after the seq cst fence that ends EpochReclamation::read.
+    const Version* findVersion(const Key& key) const {
+        const std::size_t hash = this->hashOf(key);
+        const Table* table = _stripes[hash & (_stripes.size() - 1)]->table.load(std::memory_order_acquire);
+        const Node* node = findInTable(*table, this->bucketOf(hash, *table), key);
+        return (node != nullptr) ? node->version.load(std::memory_order_acquire) : nullptr;
+    }
+
+    // DevNote: writers only (Stripe locked)
+    Node* findNode(Stripe& stripe, const Key& key) const {
+        const Table* table = stripe.table.load(std::memory_order_relaxed);
+        return findInTable(*table, this->bucketOf(key, *table), key);
+    }
+
+    void insertNode(Stripe& stripe, const Key& key, Version&& version) {
+        if (stripe.crdtSize > stripe.table.load(std::memory_order_relaxed)->mask) {
+            this->grow(stripe);
+        }
+        Table* table = stripe.table.load(std::memory_order_relaxed);
+        std::atomic<Node*>& bucket = table->buckets[this->bucketOf(key, *table)];
+        if (!version.isRemoved) {
+            stripe.sizeAlive.fetch_add(1, std::memory_order_relaxed);
+        }
+        Node* node = new Node(key, new Version(std::move(version)), bucket.load(std::memory_order_relaxed));
+        bucket.store(node, std::memory_order_release);
+        ++stripe.crdtSize;
+    }
+
+    // Replaces the version of node. The old one is deleted once no reader
+    // may use it.
+    void publish(Stripe& stripe, Node& node, Version&& version) {
+        const Version* old = node.version.load(std::memory_order_relaxed);
+        if (old->isRemoved != version.isRemoved) {
+            if (version.isRemoved) {
+                stripe.sizeAlive.fetch_sub(1, std::memory_order_relaxed);
+            } else {
+                stripe.sizeAlive.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        node.version.store(new Version(std::move(version)));  // Seq cst (See RetiredList::retire)
+        stripe.retired.retire(old, _epochs);
+    }
+
+    // DevNote: readers may still walk the old table. Its nodes are copied
+    // in the new one (Sharing their versions), then it is retired.
+    void grow(Stripe& stripe) {
+        Table* old = stripe.table.load(std::memory_order_relaxed);
+        Table* table = new Table(2 * (old->mask + 1));
+        for (std::size_t k = 0; k <= old->mask; ++k) {
+            for (Node* node = old->buckets[k].load(std::memory_order_relaxed); node != nullptr; node = node->next) {
+                std::atomic<Node*>& bucket = table->buckets[this->bucketOf(node->key, *table)];
+                bucket.store(new Node(node->key, node->version.load(std::memory_order_relaxed),
+                                      bucket.load(std::memory_order_relaxed)),
+                             std::memory_order_relaxed);
+            }
+        }
+        stripe.table.store(table);  // Seq cst (See RetiredList::retire)
+        stripe.retired.retire(old, _epochs);
+    }
+};
+
+}  // namespace collabserver
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "../storage/FlatHashMap.h"
+#include "../utils/Parallel.h"
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Immutable compressed sparse row (CSR) view of the live part of a graph.
+ *
+ * Built by LWWGraph::to_csr. Each alive vertex gets a dense id in
+ * [0, nb_vertex). The alive edges of vertex v are the ids in
+ * neighbors()[offsets()[v] .. offsets()[v + 1]), sorted by id.
+ * Removed vertex and edges are not in the view. Traversing it only reads
+ * two contiguous arrays (No hash lookup, no tombstone to skip).
+ *
+ * \par Traversals
+ * bfs, dfs, reachable and topological_order mark visited vertex in a
+ * dense bitset indexed by id (No hash set). bfs_depths_parallel is a
+ * level-synchronous BFS for large graphs.
+ *
+ * \warning
+ * Structure (Vertex and edges) is a snapshot: later graph operations are
+ * not seen. Keys and contents are not copied, but point back to the
+ * graph: they are valid as long as the vertex is in the graph (Until
+ * destroyed or purged by compact) and content reads its current value.
+ *
+ * \tparam Key  Type of vertex keys.
+ * \tparam T    Type of vertex content data.
+ */
+template <typename Key, typename T>
+class GraphCSR {
+   public:
+    typedef std::uint32_t vertex_id;
+    typedef std::size_t size_type;
+
+    static const vertex_id npos = std::numeric_limits<vertex_id>::max();
+
+   private:
+    template <typename, typename, typename, typename, typename>
+    friend class LWWGraph;
+
+    struct KeyHash {
+        std::size_t operator()(const Key* key) const { return std::hash<Key>()(*key); }
+    };
+
+    struct KeyEqual {
+        bool operator()(const Key* lhs, const Key* rhs) const { return *lhs == *rhs; }
+    };
+
+    std::vector<const Key*> _keys;      // Key of each vertex id
+    std::vector<const T*> _contents;    // Content of each vertex id
+    std::vector<size_type> _offsets;    // First edge of each id (nb_vertex + 1)
+    std::vector<vertex_id> _neighbors;  // Destination of each edge
+
+    // Id of each key (Points to the keys in the graph)
+    FlatHashMap<const Key*, vertex_id, KeyHash, KeyEqual> _ids;
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns the number of vertex in this view.
+     *
+     * \return Number of vertex.
+     */
+    size_type nb_vertex() const noexcept { return _keys.size(); }
+
+    /**
+     * Returns the number of edges in this view.
+     *
+     * \return Number of edges.
+     */
+    size_type nb_edges() const noexcept { return _neighbors.size(); }
+
+    // -------------------------------------------------------------------------
+    // Lookup methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns the id of the vertex with this key.
+     *
+     * \param key Key of the vertex.
+     * \return Vertex id, or npos if no alive vertex has this key.
+     */
+    vertex_id find(const Key& key) const {
+        const auto it = _ids.find(&key);
+        return (it != _ids.end()) ? it->second : npos;
+    }
+
+    /**
+     * Returns the key of a vertex.
+     *
+     * \param id Vertex id (Lower than nb_vertex).
+     * \return Reference to the key, in the graph.
+     */
+    const Key& key(vertex_id id) const { return *_keys[id]; }
+
+    /**
+     * Returns the content of a vertex.
+     *
+     * \param id Vertex id (Lower than nb_vertex).
+     * \return Reference to the content, in the graph.
+     */
+    const T& content(vertex_id id) const { return *_contents[id]; }
+
+    /**
+     * Returns the number of edges from a vertex.
+     *
+     * \param id Vertex id (Lower than nb_vertex).
+     * \return Out degree of the vertex.
+     */
+    size_type degree(vertex_id id) const { return _offsets[id + 1] - _offsets[id]; }
+
+    /**
+     * Returns pointer to the first destination id of the edges from a vertex.
+     *
+     * \param id Vertex id (Lower than nb_vertex).
+     * \return Pointer to the first neighbor.
+     */
+    const vertex_id* neighbors_begin(vertex_id id) const { return _neighbors.data() + _offsets[id]; }
+
+    /**
+     * Returns pointer past the last destination id of the edges from a vertex.
+     *
+     * \param id Vertex id (Lower than nb_vertex).
+     * \return Pointer past the last neighbor.
+     */
+    const vertex_id* neighbors_end(vertex_id id) const { return _neighbors.data() + _offsets[id + 1]; }
+
+    /**
+     * Returns the offsets array (nb_vertex + 1 entries).
+     *
+     * \return Constant reference to the offsets.
+     */
+    const std::vector<size_type>& offsets() const noexcept { return _offsets; }
+
+    /**
+     * Returns the neighbors array (nb_edges entries).
+     *
+     * \return Constant reference to the neighbors.
+     */
+    const std::vector<vertex_id>& neighbors() const noexcept { return _neighbors; }
+
+    // -------------------------------------------------------------------------
+    // Traversals
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Breadth-first traversal from source.
+     * Calls fn(id, depth) once for each reachable vertex (source included,
+     * with depth 0), in BFS order. Neighbors are visited by increasing id.
+     *
+     * \param source    Id of the first vertex.
+     * \param fn        Function called as fn(vertex_id id, size_type depth).
+     */
+    template <typename Fn>
+    void bfs(vertex_id source, Fn fn) const {
+        std::vector<bool> visited(this->nb_vertex(), false);
+        std::vector<vertex_id> queue;
+        queue.push_back(source);
+        visited[source] = true;
+        size_type levelEnd = 1;
+        size_type depth = 0;
+        for (size_type k = 0; k < queue.size(); ++k) {
+            if (k == levelEnd) {
+                levelEnd = queue.size();
+                ++depth;
+            }
+            const vertex_id id = queue[k];
+            fn(id, depth);
+            for (auto it = this->neighbors_begin(id); it != this->neighbors_end(id); ++it) {
+                if (!visited[*it]) {
+                    visited[*it] = true;
+                    queue.push_back(*it);
+                }
+            }
+        }
+    }
+
+    /**
+     * Depth-first traversal from source (Preorder).
+     * Calls fn(id) once for each reachable vertex, source first.
+     * Neighbors are visited by increasing id. Uses an explicit stack (No
+     * recursion limit).
+     *
+     * \param source    Id of the first vertex.
+     * \param fn        Function called as fn(vertex_id id).
+     */
+    template <typename Fn>
+    void dfs(vertex_id source, Fn fn) const {
+        std::vector<bool> visited(this->nb_vertex(), false);
+        std::vector<vertex_id> stack;
+        stack.push_back(source);
+        while (!stack.empty()) {
+            const vertex_id id = stack.back();
+            stack.pop_back();
+            if (visited[id]) {
+                continue;
+            }
+            visited[id] = true;
+            fn(id);
+            // Pushed in reverse order: lowest id is visited first
+            for (auto it = this->neighbors_end(id); it != this->neighbors_begin(id);) {
+                --it;
+                if (!visited[*it]) {
+                    stack.push_back(*it);
+                }
+            }
+        }
+    }
+
+    /**
+     * Checks whether there is a path from a vertex to another.
+     * (A vertex always reaches itself).
+     *
+     * \param from  Id of the origin vertex.
+     * \param to    Id of the destination vertex.
+     * \return True if to is reachable from from, otherwise, return false.
+     */
+    bool reachable(vertex_id from, vertex_id to) const {
+        if (from == to) {
+            return true;
+        }
+        std::vector<bool> visited(this->nb_vertex(), false);
+        std::vector<vertex_id> stack;
+        stack.push_back(from);
+        visited[from] = true;
+        while (!stack.empty()) {
+            const vertex_id id = stack.back();
+            stack.pop_back();
+            for (auto it = this->neighbors_begin(id); it != this->neighbors_end(id); ++it) {
+                if (*it == to) {
+                    return true;
+                }
+                if (!visited[*it]) {
+                    visited[*it] = true;
+                    stack.push_back(*it);
+                }
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Computes a topological order of all vertex (Kahn's algorithm).
+     * For each edge (u, v), u is before v. Ties are given by increasing id.
+     *
+     * \param order Filled with the vertex ids in topological order.
+     *              If the graph has a cycle, only holds the vertex before it.
+     * \return True if the graph has no cycle, otherwise, return false.
+     */
+    bool topological_order(std::vector<vertex_id>& order) const {
+        const size_type nbVertex = this->nb_vertex();
+        std::vector<vertex_id> inDegree(nbVertex, 0);
+        for (const vertex_id to : _neighbors) {
+            ++inDegree[to];
+        }
+        order.clear();
+        order.reserve(nbVertex);
+        for (size_type id = 0; id < nbVertex; ++id) {
+            if (inDegree[id] == 0) {
+                order.push_back(static_cast<vertex_id>(id));
+            }
+        }
+        for (size_type k = 0; k < order.size(); ++k) {
+            const vertex_id id = order[k];
+            for (auto it = this->neighbors_begin(id); it != this->neighbors_end(id); ++it) {
+                if (--inDegree[*it] == 0) {
+                    order.push_back(*it);
+                }
+            }
+        }
+        return order.size() == nbVertex;
+    }
+
+    /**
+     * Returns the BFS depth of each vertex from source.
+     *
+     * \param source Id of the first vertex.
+     * \return Depth of each vertex id (npos if not reachable).
+     */
+    std::vector<vertex_id> bfs_depths(vertex_id source) const { return this->bfs_depths_parallel(source, 1); }
+
+    /**
+     * Parallel version of bfs_depths (Level-synchronous BFS).
+     *
+     * Each level of the BFS is split between the threads. A vertex is
+     * claimed by the first thread that sets its bit in a shared atomic
+     * bitset. Threads are started for each level: only worth it for
+     * large graphs with wide levels.
+     *
+     * \param source    Id of the first vertex.
+     * \param nbThreads Number of threads (0 to use all hardware threads).
+     * \return Depth of each vertex id (npos if not reachable).
+     */
+    std::vector<vertex_id> bfs_depths_parallel(vertex_id source, unsigned int nbThreads = 0) const {
+        const size_type nbVertex = this->nb_vertex();
+        std::vector<vertex_id> depths(nbVertex, npos);
+        std::vector<std::atomic<std::uint64_t>> visited((nbVertex + 63) / 64);
+        visited[source / 64] = std::uint64_t(1) << (source % 64);
+        depths[source] = 0;
+
+        std::vector<vertex_id> frontier(1, source);
+        std::vector<std::vector<vertex_id>> nexts;
+        for (vertex_id depth = 1; !frontier.empty(); ++depth) {
+            nexts.assign(parallel_threads_count(nbThreads, frontier.size()), std::vector<vertex_id>());
+            parallel_for_chunks(frontier.size(), nbThreads, [&](std::size_t begin, std::size_t end, unsigned int k) {
+                std::vector<vertex_id>& next = nexts[k];
+                for (std::size_t pos = begin; pos < end; ++pos) {
+                    const vertex_id id = frontier[pos];
+                    for (auto it = this->neighbors_begin(id); it != this->neighbors_end(id); ++it) {
+                        const std::uint64_t bit = std::uint64_t(1) << (*it % 64);
+                        std::atomic<std::uint64_t>& word = visited[*it / 64];
+                        if ((word.load(std::memory_order_relaxed) & bit) == 0 &&
+                            (word.fetch_or(bit, std::memory_order_relaxed) & bit) == 0) {
+                            depths[*it] = depth;
+                            next.push_back(*it);
+                        }
+                    }
+                }
+            });
+            frontier.clear();
+            for (const auto& next : nexts) {
+                frontier.insert(frontier.end(), next.begin(), next.end());
+            }
+        }
+        return depths;
+    }
+};
+
+template <typename Key, typename T>
+const typename GraphCSR<Key, T>::vertex_id GraphCSR<Key, T>::npos;
+
+}  // namespace collabserver
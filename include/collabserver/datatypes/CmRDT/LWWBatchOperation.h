@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "../storage/FlatHashMap.h"
+
+namespace collabserver {
+
+/**
+ * \brief
+ * One received operation, as given to LWWSet::apply_batch and
+ * LWWMap::apply_batch.
+ *
+ * \tparam Key  Type of container keys.
+ * \tparam U    Type of timestamps.
+ */
+template <typename Key, typename U>
+struct LWWBatchOperation {
+    enum Kind { ADD, REMOVE, CLEAR };
+
+    Kind kind;
+    Key key;  // Not used by CLEAR
+    U stamp;
+};
+
+namespace detail {
+
+template <typename Key>
+struct BatchKeyHash {
+    std::size_t operator()(const Key* key) const { return std::hash<Key>()(*key); }
+};
+
+template <typename Key>
+struct BatchKeyEqual {
+    bool operator()(const Key* lhs, const Key* rhs) const { return *lhs == *rhs; }
+};
+
+/**
+ * Groups batch operations with the same key (Used by apply_batch).
+ *
+ * Operations of a key are chained in their range order: next[i] is
+ * the index of the next operation with the same key as ops[i]
+ * (ops.size() for the last one).
+ *
+ * \param ops   Operations to group.
+ * \param next  Filled with the index of the next operation of each key.
+ * \return Index of the first operation of each key, by first occurrence.
+ */
+template <typename Key, typename U>
+std::vector<std::size_t> group_by_key(const std::vector<const LWWBatchOperation<Key, U>*>& ops,
+                                      std::vector<std::size_t>& next) {
+    // Points to the keys in ops (No copy). Value is (first, last) index.
+    FlatHashMap<const Key*, std::pair<std::size_t, std::size_t>, BatchKeyHash<Key>, BatchKeyEqual<Key>> groups;
+    groups.reserve(ops.size());
+    std::vector<std::size_t> firsts;
+    next.assign(ops.size(), ops.size());
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+        auto res = groups.insert(std::make_pair(&ops[i]->key, std::make_pair(i, i)));
+        if (res.second) {
+            firsts.push_back(i);
+        } else {
+            next[res.first->second.second] = i;
+            res.first->second.second = i;
+        }
+    }
+    return firsts;
+}
+
+}  // namespace detail
+
+}  // namespace collabserver
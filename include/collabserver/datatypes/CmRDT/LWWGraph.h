@@ -1,14 +1,27 @@
 #pragma once
 
-#include <cassert>
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <ostream>
+#include <stdexcept>  // std::out_of_range
 #include <type_traits>
-
+#include <utility>  // std::move
+#include <vector>
+
+#include "../storage/FlatHashMap.h"
+#include "../storage/StoragePolicy.h"
+#include "../utils/ChangeIndex.h"
+#include "../utils/Parallel.h"
+#include "GraphCSR.h"
 #include "LWWMap.h"
 #include "LWWSet.h"
 
 namespace collabserver {
 
+template <typename Key, typename T, typename U, typename EdgeStorage, typename EdgeValue>
+class ShardedLWWGraph;
+
 /**
  * \brief
  * Last-Writer-Wins Directed Graph (LWW Graph).
@@ -26,7 +39,8 @@ namespace collabserver {
  * \par
  * Any added key is never removed but only marked as deleted instead.
  * For that reason, this CRDT container may not fit all systems
- * due to the used memory space.
+ * due to the used memory space. Old deleted vertex and edges may be purged
+ * with compact once all replicates have seen them.
  *
  * \par
  * All operations on this container are commutative! You may receive a remove
@@ -73,15 +87,34 @@ namespace collabserver {
  * T type must have a default constructor.
  * U timestamp must accept "U t = {0}" (This should set with minimal value).
  *
+ * \par Edge storage
+ * Most vertex only have a few edges. By default, the edges of a vertex
+ * (And its reverse adjacency) are stored inline in the vertex, and only
+ * move to a hash table past 4 edges (See SmallMapStorage). Use another
+ * storage policy (ex: HashMapStorage) for graphs with high degree vertex.
+ *
+ * \par Incoming edges
+ * Each vertex also keeps the origins of the edges to it, updated by each
+ * operation. in_edges and in_degree don't scan the graph.
+ *
+ * \par Edge values
+ * With EdgeValue (ex: weight or label), each edge carries a value, stored
+ * inline with the edge in the edge set of its origin (See LWWSet payload).
+ * The value is a LWW register with its own timestamp: set_edge with the
+ * higher timestamp wins, whatever the add / remove of the edge.
  *
- * \tparam Key  Type of unique identifier for each graph vertex
- * \tparam T    Type of vertex content data.
- * \tparam U    Type of timestamps (Must implements operators > and <).
+ *
+ * \tparam Key          Type of unique identifier for each graph vertex
+ * \tparam T            Type of vertex content data.
+ * \tparam U            Type of timestamps (Must implements operators > and <).
+ * \tparam EdgeStorage  Storage policy of each vertex edges (See StoragePolicy.h).
+ * \tparam EdgeValue    Type of value of each edge (void for none).
  */
-template <typename Key, typename T, typename U>
+template <typename Key, typename T, typename U, typename EdgeStorage = SmallMapStorage<4>, typename EdgeValue = void>
 class LWWGraph {
    public:
     class Vertex;
+    class in_edge_range;
 
     /**
      * Information used by add_edge method.
@@ -95,16 +128,41 @@ class LWWGraph {
         bool isToAdded;
     };
 
+    /**
+     * One edge with its own timestamp, as given to add_edges.
+     *
+     * \see LWWGraph::add_edges
+     */
+    struct BatchEdge {
+        Key from;
+        Key to;
+        U stamp;
+    };
+
     typedef typename LWWMap<Key, Vertex, U>::size_type size_type;
     typedef typename LWWMap<Key, Vertex, U>::iterator iterator;
     typedef typename LWWMap<Key, Vertex, U>::const_iterator const_iterator;
     typedef typename LWWMap<Key, Vertex, U>::crdt_iterator crdt_iterator;
     typedef typename LWWMap<Key, Vertex, U>::const_crdt_iterator const_crdt_iterator;
 
-    typedef typename LWWSet<Key, U>::size_type size_type_edges;
+    typedef LWWSet<Key, U, EdgeStorage, EdgeValue> edge_set;
+    typedef typename edge_set::size_type size_type_edges;
+    typedef EdgeValue edge_value_type;
+    typedef typename edge_set::const_payload_reference const_edge_value_reference;
+    typedef GraphCSR<Key, T> csr_type;
 
    private:
+    template <typename, typename, typename, typename, typename>
+    friend class ShardedLWWGraph;  // Shares the operations (See SelfGraph)
+
+    typedef typename LWWMap<Key, Vertex, U>::Element vertex_element;
+    typedef typename EdgeStorage::template map<Key, bool> in_edges_map;  // Origin -> is edge alive
+
     LWWMap<Key, Vertex, U> _adj;
+    size_type_edges _sizeEdges = 0;      // Nb of alive edges
+    size_type_edges _crdtSizeEdges = 0;  // Nb of edges (Also removed ones)
+    U _compactTime = {0};                // Watermark of the last compact
+    ChangeIndex<U, Key> _changes;        // Last change of each vertex (See track_changes)
 
     // -------------------------------------------------------------------------
     // Capacity methods
@@ -144,31 +202,23 @@ class LWWGraph {
     /**
      * Returns the total number of edges in this graph.
      *
+     * \par Complexity
+     * Constant (Counter updated by each operation).
+     *
      * \return Number of edges in the graph.
      */
-    size_type_edges size_edges() const noexcept {
-        size_type_edges total = 0;
-
-        for (const auto& elt : _adj) {
-            total += elt.second._edges.size();
-        }
-        return total;
-    }
+    size_type_edges size_edges() const noexcept { return _sizeEdges; }
 
     /**
      * Returns the total number of edges in this graph.
      * Also check for elements marked as 'removed'.
      *
+     * \par Complexity
+     * Constant (Counter updated by each operation).
+     *
      * \return Number of edges in the graph.
      */
-    size_type_edges crdt_size_edges() const noexcept {
-        size_type_edges total = 0;
-
-        for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
-            total += it->second.value()._edges.crdt_size();
-        }
-        return total;
-    }
+    size_type_edges crdt_size_edges() const noexcept { return _crdtSizeEdges; }
 
     // -------------------------------------------------------------------------
     // Lookup methods (Vertex)
@@ -190,7 +240,7 @@ class LWWGraph {
     /**
      * \copydoc LWWGraph::at_vertex
      */
-    const T& at_vertex(const Key& key) const { return this->at_vertex(key); }
+    const T& at_vertex(const Key& key) const { return _adj.at(key).content(); }
 
     /**
      * Returns a reference to the vertex content for this key. If no such
@@ -207,9 +257,9 @@ class LWWGraph {
     }
 
     /**
-     * \copydoc LWWGraph::at_vertex
+     * \copydoc LWWGraph::crdt_at_vertex
      */
-    const T& crdt_at_vertex(const Key& key) const { return this->crdt_at_vertex(key); }
+    const T& crdt_at_vertex(const Key& key) const { return _adj.crdt_at(key).content(); }
 
     /**
      * Find a vertex in the graph.
@@ -344,6 +394,130 @@ class LWWGraph {
      */
     bool crdt_has_edge(const Key& from, const Key& to) const { return this->crdt_count_edge(from, to) == 1; }
 
+    /**
+     * Returns the value of the edge from given vertex to another. If no
+     * such edge exists, an exception of type std::out_of_range is thrown.
+     * (Only if EdgeValue is not void).
+     *
+     * \param from  The origin vertex.
+     * \param to    The destination vertex.
+     * \return Reference to the value of the edge.
+     */
+    const_edge_value_reference at_edge(const Key& from, const Key& to) const {
+        auto vertex_it = _adj.find(from);
+        if (vertex_it == _adj.end()) {
+            throw std::out_of_range("No element for this key");
+        }
+        return vertex_it->second.edges().at(to);
+    }
+
+    /**
+     * Returns the value of the edge from given vertex to another. If no
+     * such edge exists, an exception of type std::out_of_range is thrown.
+     * Also lookup for element internally marked as 'removed'.
+     *
+     * \param from  The origin vertex.
+     * \param to    The destination vertex.
+     * \return Reference to the value of the edge.
+     */
+    const_edge_value_reference crdt_at_edge(const Key& from, const Key& to) const {
+        auto vertex_it = _adj.crdt_find(from);
+        if (vertex_it == _adj.crdt_end()) {
+            throw std::out_of_range("No element for this key");
+        }
+        return vertex_it->second.value().edges().crdt_at(to);
+    }
+
+    /**
+     * Returns the number of edges from a vertex.
+     *
+     * \par Complexity
+     * Constant.
+     *
+     * \param key The origin vertex.
+     * \return Number of alive edges from this vertex (0 if no such vertex).
+     */
+    size_type_edges out_degree(const Key& key) const {
+        auto vertex_it = _adj.find(key);
+        return (vertex_it != _adj.end()) ? vertex_it->second.edges().size() : 0;
+    }
+
+    /**
+     * Returns the number of edges from a vertex.
+     * Also counts edges internally marked as 'removed'.
+     *
+     * \param key The origin vertex.
+     * \return Number of edges from this vertex (0 if not in internal data).
+     */
+    size_type_edges crdt_out_degree(const Key& key) const {
+        auto vertex_it = _adj.crdt_find(key);
+        return (vertex_it != _adj.crdt_end()) ? vertex_it->second.value().edges().crdt_size() : 0;
+    }
+
+    /**
+     * Returns the number of edges to a vertex.
+     *
+     * \par Complexity
+     * Constant. Each vertex keeps the origins of its edges (Reverse
+     * adjacency), updated by each operation.
+     *
+     * \param key The destination vertex.
+     * \return Number of alive edges to this vertex (0 if no such vertex).
+     */
+    size_type_edges in_degree(const Key& key) const {
+        auto vertex_it = _adj.find(key);
+        return (vertex_it != _adj.end()) ? vertex_it->second._inDegree : 0;
+    }
+
+    /**
+     * Returns the number of edges to a vertex.
+     * Also counts edges internally marked as 'removed'.
+     *
+     * \note
+     * Removed edges to a vertex purged by compact are not counted until
+     * the next compact or merge, if the vertex is added again.
+     *
+     * \param key The destination vertex.
+     * \return Number of edges to this vertex (0 if not in internal data).
+     */
+    size_type_edges crdt_in_degree(const Key& key) const {
+        auto vertex_it = _adj.crdt_find(key);
+        return (vertex_it != _adj.crdt_end()) ? vertex_it->second.value()._inEdges.size() : 0;
+    }
+
+    /**
+     * Returns the origins of the edges to a vertex.
+     *
+     * \par Complexity
+     * No scan of the graph: iterates the reverse adjacency of the vertex.
+     * (Removed edges to the vertex are skipped).
+     *
+     * \warning
+     * The range is invalidated by any operation on the graph.
+     *
+     * \param key The destination vertex.
+     * \return Range of origin keys (Empty if no such vertex).
+     */
+    in_edge_range in_edges(const Key& key) const {
+        auto vertex_it = _adj.find(key);
+        return (vertex_it != _adj.end()) ? in_edge_range(vertex_it->second, false) : in_edge_range();
+    }
+
+    /**
+     * Returns the origins of the edges to a vertex.
+     * Also includes edges internally marked as 'removed'.
+     *
+     * \see LWWGraph::in_edges
+     * \see LWWGraph::crdt_in_degree
+     *
+     * \param key The destination vertex.
+     * \return Range of origin keys (Empty if not in internal data).
+     */
+    in_edge_range crdt_in_edges(const Key& key) const {
+        auto vertex_it = _adj.crdt_find(key);
+        return (vertex_it != _adj.crdt_end()) ? in_edge_range(vertex_it->second.value(), true) : in_edge_range();
+    }
+
     // -------------------------------------------------------------------------
     // Modifiers methods
     // -------------------------------------------------------------------------
@@ -366,12 +540,18 @@ class LWWGraph {
      * From a user point of view, if you display a UI after a clear, you
      * should iterate over the set anyway.
      *
+     * \par Complexity
+     * Linear in the number of vertex and alive edges. Each edge set is
+     * cleared in constant time in the usual case (See LWWSet::clear), then
+     * only the edges removed by this clear are updated in the reverse
+     * adjacency of their destination.
+     *
      * \param stamp Timestamp of this operation.
      * \return True if clear actually applied, otherwise, return false.
      */
     bool clear_vertices(const U& stamp) {
         for (auto& vertex_elt : _adj) {
-            vertex_elt.second._edges.clear(stamp);
+            this->clearEdges(vertex_elt.first, vertex_elt.second, stamp, SelfGraph{*this});
         }
         return _adj.clear(stamp);
     }
@@ -382,6 +562,10 @@ class LWWGraph {
      * Only elements with timestamp inferior to clear timestamp are
      * actually removed.
      *
+     * If vertex doesn't exists, creates a temporary vertex (Like
+     * remove_edge) that keeps the clear timestamp: edges added later with
+     * an older timestamp are removed, as if this clear was received after.
+     *
      * \par Idempotent
      * Duplicate calls with same stamp is idempotent.
      *
@@ -389,14 +573,7 @@ class LWWGraph {
      * \param stamp Timestamp of this operation.
      * \return True if clear actually applied, otherwise, return false.
      */
-    bool clear_vertex_edges(const Key& key, const U& stamp) {
-        auto vertex_it = _adj.crdt_find(key);
-        if (vertex_it == _adj.crdt_end()) {
-            return false;
-        }
-        auto& edges = vertex_it->second.value()._edges;
-        return edges.clear(stamp);
-    }
+    bool clear_vertex_edges(const Key& key, const U& stamp) { return clearVertexEdges(key, stamp, SelfGraph{*this}); }
 
     /**
      * Add a new vertex in the graph.
@@ -418,14 +595,79 @@ class LWWGraph {
      *
      * \note
      * This only adds the key. A default vertex is created.
-     * To add key and set its content, call this add method and query the
-     * newly added vertex (Then update it with its default value).
+     * To add key and set its content, use set_vertex.
      *
      * \param key   The unique vertex's key.
      * \param stamp Timestamp of this operation.
      * \return True if vertex added, otherwise, return false.
      */
-    bool add_vertex(const Key& key, const U& stamp) { return _adj.add(key, stamp); }
+    bool add_vertex(const Key& key, const U& stamp) {
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        bool isAdded = false;
+        vertex_element& elt = this->addVertexElement(key, stamp, isAdded);
+        this->indexChange(key, elt.value(), stamp);
+        return isAdded;
+    }
+
+    /**
+     * Adds a range of vertex. Same as calling add_vertex for each key, in
+     * order, but the vertex container is reserved once for all keys.
+     *
+     * \tparam ForwardIt Forward iterator on Key.
+     * \param first Iterator to the first key.
+     * \param last  Iterator past the last key.
+     * \param stamp Timestamp of this operation (For all keys).
+     * \return For each key, the value add_vertex would have returned.
+     */
+    template <typename ForwardIt>
+    std::vector<bool> add_vertices(ForwardIt first, ForwardIt last, const U& stamp) {
+        std::vector<bool> results;
+        const auto count = static_cast<size_type>(std::distance(first, last));
+        results.reserve(count);
+        _adj.reserve(_adj.crdt_size() + count);
+        for (; first != last; ++first) {
+            results.push_back(this->add_vertex(*first, stamp));
+        }
+        return results;
+    }
+
+    /**
+     * Adds a vertex with its content.
+     *
+     * Same as add_vertex for the key. The content has its own timestamp:
+     * it replaces the current one only if this operation is newer than the
+     * last set_vertex of this key (See LWWMap::set). Edges are not changed.
+     *
+     * \par Idempotent
+     * Duplicate calls with same stamp and content is idempotent.
+     *
+     * \param key       The unique vertex's key.
+     * \param content   Content of the vertex (Moved only if assigned).
+     * \param stamp     Timestamp of this operation.
+     * \return True if content assigned, otherwise, return false.
+     */
+    bool set_vertex(const Key& key, T&& content, const U& stamp) {
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        const bool isAssigned = _adj.setElement(key, std::move(content), stamp, AssignContent());
+        this->indexChange(key, stamp);
+        return isAssigned;
+    }
+
+    /**
+     * \copydoc LWWGraph::set_vertex(const Key&, T&&, const U&)
+     */
+    bool set_vertex(const Key& key, const T& content, const U& stamp) {
+        if (stamp < _compactTime) {
+            return false;
+        }
+        const bool isAssigned = _adj.setElement(key, content, stamp, AssignContent());
+        this->indexChange(key, stamp);
+        return isAssigned;
+    }
 
     /**
      * Remove a vertex from the graph.
@@ -446,28 +688,16 @@ class LWWGraph {
      *
      * \see LWWGraph::add_edge
      *
+     * \par Complexity
+     * Linear in the degree of the vertex. Incoming edges are found with
+     * the reverse adjacency of the vertex (No scan of the whole graph).
+     * (Removed incoming edges also count).
+     *
      * \param key   The unique vertex's key.
      * \param stamp Timestamp of this operation.
      * \return True if vertex removed, otherwise, return false.
      */
-    bool remove_vertex(const Key& key, const U& stamp) {
-        bool isVertexRemoved = _adj.remove(key, stamp);
-
-        // Remove all edges of this vertex
-        auto from_it = _adj.crdt_find(key);
-        auto& edges = from_it->second.value()._edges;
-        edges.clear(stamp);
-
-        // Remove all edge to this vertex (On others vertex)
-        for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
-            auto& edges = it->second.value()._edges;
-            if (it->first != key && edges.count(key) == 1) {
-                edges.remove(key, stamp);
-            }
-        }
-
-        return isVertexRemoved;
-    }
+    bool remove_vertex(const Key& key, const U& stamp) { return removeVertex(key, stamp, SelfGraph{*this}); }
 
     /**
      * Add edge from a vertex to another.
@@ -481,6 +711,8 @@ class LWWGraph {
      * removed. Meaning 'add_edge' was before 'remove_vertex', this edge
      * is marked as removed (With the 'remove_vertex' timestamp).
      * This resolve the concurrent 'add_edge' | 'remove_vertex'
+     * Same if the vertex was added back since: an edge older than the last
+     * 'remove_vertex' of from or to is removed.
      *
      * \par Idempotent
      * Duplicate calls with same stamp is idempotent.
@@ -490,41 +722,60 @@ class LWWGraph {
      * \return Structure to know if edge, from and/or, to where added.
      */
     AddEdgeInfo add_edge(const Key& from, const Key& to, const U& stamp) {
-        AddEdgeInfo info;
-        info.isFromAdded = _adj.add(from, stamp);
-        info.isToAdded = false;
-        if (from != to) {
-            info.isToAdded = _adj.add(to, stamp);
-        }
+        return addEdge(from, to, stamp, SelfGraph{*this});
+    }
 
-        auto from_it = _adj.crdt_find(from);
-        Vertex& vertex = from_it->second.value();
-        info.isEdgeAdded = vertex._edges.add(to, stamp);
-
-        // If edge added, check whether vertex from or to are not removed.
-        // If one of them is removed, this newly created edge must be
-        // removed now. (important for CRDT commutativity)
-
-        auto from_edge_it = vertex.edges().crdt_find(to);
-        if (!from_edge_it->second.isRemoved()) {
-            auto vertex_it_from = _adj.crdt_find(from);
-            auto vertex_it_to = _adj.crdt_find(to);
-            assert(vertex_it_from != _adj.crdt_end());
-            assert(vertex_it_to != _adj.crdt_end());
-            const bool from_removed = vertex_it_from->second.isRemoved();
-            const bool to_removed = vertex_it_to->second.isRemoved();
-
-            if (from_removed || to_removed) {
-                U from_time = vertex_it_from->second.timestamp();
-                U to_time = vertex_it_to->second.timestamp();
-                U high_time = (from_time > to_time) ? from_time : to_time;
-
-                vertex._edges.remove(to, high_time);
-                info.isEdgeAdded = false;
-                return info;
-            }
-        }
-        return info;
+    /**
+     * Adds an edge with its value. (Only if EdgeValue is not void).
+     *
+     * Same as add_edge. The value replaces the current one only if stamp
+     * is higher than the timestamp of its last assign, whatever the add /
+     * remove of the edge or its vertex. A removed edge keeps its value,
+     * back if the edge is added again. (See LWWSet::set).
+     *
+     * \par Idempotent
+     * Duplicate calls with same stamp and value is idempotent.
+     *
+     * \param from  The origin vertex.
+     * \param to    The destination vertex.
+     * \param value Value of the edge (Moved only if assigned).
+     * \param stamp Timestamp of this operation.
+     * \return True if value assigned, otherwise, return false.
+     */
+    template <typename V>
+    bool set_edge(const Key& from, const Key& to, V&& value, const U& stamp) {
+        return setEdge(from, to, std::forward<V>(value), stamp, SelfGraph{*this});
+    }
+
+    /**
+     * Adds a range of edges. Same as calling add_edge for each edge, in
+     * order (Same graph and same returned information).
+     *
+     * Each distinct vertex key is looked up once for the whole range.
+     * Edges are then applied grouped by origin vertex: the edge set of each
+     * origin is reserved once for all its new edges (No rehash while it
+     * grows). Intended for bulk loading (ex: opening a document).
+     *
+     * \tparam ForwardIt Forward iterator on std::pair<Key, Key> (from, to).
+     * \param first Iterator to the first edge.
+     * \param last  Iterator past the last edge.
+     * \param stamp Timestamp of this operation (For all edges).
+     * \return For each edge, the information add_edge would have returned.
+     */
+    template <typename ForwardIt>
+    std::vector<AddEdgeInfo> add_edges(ForwardIt first, ForwardIt last, const U& stamp) {
+        return this->addEdges(first, last, PairEdgeAccess{stamp});
+    }
+
+    /**
+     * \copydoc LWWGraph::add_edges(ForwardIt, ForwardIt, const U&)
+     *
+     * \note
+     * Each edge has its own timestamp (See BatchEdge).
+     */
+    template <typename ForwardIt>
+    std::vector<AddEdgeInfo> add_edges(ForwardIt first, ForwardIt last) {
+        return this->addEdges(first, last, BatchEdgeAccess());
     }
 
     /**
@@ -543,14 +794,7 @@ class LWWGraph {
      * \return True if edge removed, otherwise, return false.
      */
     bool remove_edge(const Key& from, const Key& to, const U& stamp) {
-        _adj.remove(from, 0);
-        if (from != to) {
-            _adj.remove(to, 0);
-        }
-
-        auto coco_it = _adj.crdt_find(from);
-        Vertex& v = coco_it->second.value();
-        return v._edges.remove(to, stamp);
+        return removeEdge(from, to, stamp, SelfGraph{*this});
     }
 
     // -------------------------------------------------------------------------
@@ -601,6 +845,910 @@ class LWWGraph {
         return true;
     }
 
+    /**
+     * Purges the deleted vertex and edges older than a causal-stability
+     * watermark.
+     *
+     * Compacts the edges of each vertex (See LWWSet::compact). A deleted
+     * vertex older than stableBefore is erased once it has no edge left,
+     * even deleted ones. (Otherwise a newer edge tombstone would be lost).
+     *
+     * \warning
+     * The application must guarantee that every replicate has already
+     * received all operations with timestamp lower than stableBefore.
+     *
+     * \see LWWSet::compact
+     *
+     * \param stableBefore Watermark timestamp.
+     * \return Number of purged vertex and edges.
+     */
+    size_type compact(const U& stableBefore) { return this->compactVertex(stableBefore, SelfGraph{*this}); }
+
+    /**
+     * Joins the full state of another replicate into this one.
+     *
+     * Vertex are joined like LWWMap::merge (Content of the newer one is
+     * kept) and edges of each vertex like LWWSet::merge. Then, an edge older
+     * than a remove_vertex of its origin or destination (Or than the last
+     * clear_vertices) is removed, even if the replicate that removed the
+     * vertex never received this edge.
+     * Observable content is the same as if all operations were applied
+     * here. (Internal timestamps of removed edges may differ).
+     *
+     * \par Complexity
+     * Proportional to the number of vertex of other and their degree. Other
+     * vertex of this graph are not visited (Unless other has a newer
+     * clear_vertices).
+     *
+     * \param other Replicate to merge in this one.
+     */
+    void merge(const LWWGraph& other) { this->mergeWith(other, 1); }
+
+    /**
+     * Parallel version of merge for large graphs. Vertex are merged in
+     * parallel. (See LWWMap::merge_parallel)
+     *
+     * \param other     Replicate to merge in this one.
+     * \param nbThreads Number of threads (0 to use all hardware threads).
+     */
+    void merge_parallel(const LWWGraph& other, unsigned int nbThreads = 0) { this->mergeWith(other, nbThreads); }
+
+    /**
+     * Enables or disables the change index used by delta_since.
+     *
+     * The index keeps, ordered by timestamp, each vertex at its last
+     * change (Vertex or edge changes). Disabled by default. Enabling it
+     * indexes the current content. Entries older than the compact
+     * watermark are dropped by compact.
+     *
+     * \param enable True to enable the change index.
+     */
+    void track_changes(bool enable) {
+        _changes.enable(enable);
+        this->indexChanges();
+    }
+
+    /**
+     * \copydoc LWWSet::is_tracking_changes
+     */
+    bool is_tracking_changes() const noexcept { return _changes.enabled(); }
+
+    /**
+     * Returns the changes since a timestamp, as a new LWWGraph.
+     *
+     * The delta contains each vertex touched since this timestamp, with its
+     * content and only its edges changed since this timestamp. Clear
+     * timestamps are kept. Merging it in a replicate that already received
+     * all operations older than since gives the same content as merging the
+     * full graph. (See LWWSet::delta_since)
+     *
+     * \par Complexity
+     * With the change index, proportional to the number of touched vertex
+     * and their degree. Otherwise (Or if since is older than the last
+     * compact), linear in the number of vertex and edges.
+     *
+     * \param since Timestamp of the first change to include.
+     * \return Delta graph.
+     */
+    LWWGraph delta_since(const U& since) const {
+        LWWGraph delta;
+        delta._adj.clear(_adj.crdt_clear_time());
+        if (_changes.enabled() && !(since < _compactTime)) {
+            _changes.for_each_since(since, [&](const Key& key) {
+                const auto vertex_it = _adj.crdt_find(key);
+                if (vertex_it != _adj.crdt_end() && delta._adj.crdt_count(key) == 0) {
+                    delta.copyVertex(key, vertex_it->second, vertex_it->second.value()._edges.delta_since(since));
+                }
+            });
+        } else {
+            for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
+                auto edges = it->second.value()._edges.delta_since(since);
+                if (!(it->second.timestamp() < since) || !edges.crdt_empty()) {
+                    delta.copyVertex(it->first, it->second, std::move(edges));
+                }
+            }
+        }
+        delta._compactTime = _compactTime;
+        delta.indexInEdges();
+        delta.countEdges();
+        return delta;
+    }
+
+    // -------------------------------------------------------------------------
+    // Snapshot
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Builds a compressed sparse row view of the alive vertex and edges.
+     *
+     * \par Complexity
+     * Linear in the number of vertex and edges.
+     *
+     * \see GraphCSR
+     *
+     * \return Immutable CSR view of this graph.
+     */
+    csr_type to_csr() const { return this->buildCSR(1); }
+
+    /**
+     * Parallel version of to_csr for large graphs. Vertex ids are given
+     * sequentially, then edges of each vertex are converted in parallel.
+     *
+     * \param nbThreads Number of threads (0 to use all hardware threads).
+     * \return Immutable CSR view of this graph.
+     */
+    csr_type to_csr_parallel(unsigned int nbThreads = 0) const { return this->buildCSR(nbThreads); }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    csr_type buildCSR(unsigned int nbThreads) const {
+        typedef typename csr_type::vertex_id vertex_id;
+        csr_type csr;
+        std::vector<const edge_set*> edges;
+        csr._keys.reserve(_adj.size());
+        csr._contents.reserve(_adj.size());
+        csr._ids.reserve(_adj.size());
+        edges.reserve(_adj.size());
+        for (const auto& elt : _adj) {
+            csr._ids.insert(std::make_pair(&elt.first, static_cast<vertex_id>(csr._keys.size())));
+            csr._keys.push_back(&elt.first);
+            csr._contents.push_back(&elt.second._content);
+            edges.push_back(&elt.second._edges);
+        }
+
+        // Destination may not be in the graph (ex: delta graph): skipped
+        const std::size_t nbVertex = csr._keys.size();
+        csr._offsets.assign(nbVertex + 1, 0);
+        parallel_for_chunks(nbVertex, nbThreads, [&](std::size_t begin, std::size_t end, unsigned int) {
+            for (std::size_t id = begin; id < end; ++id) {
+                for (const Key& to : *edges[id]) {
+                    csr._offsets[id + 1] += (csr.find(to) != csr.npos) ? 1 : 0;
+                }
+            }
+        });
+        for (std::size_t id = 0; id < nbVertex; ++id) {
+            csr._offsets[id + 1] += csr._offsets[id];
+        }
+
+        csr._neighbors.resize(csr._offsets[nbVertex]);
+        parallel_for_chunks(nbVertex, nbThreads, [&](std::size_t begin, std::size_t end, unsigned int) {
+            for (std::size_t id = begin; id < end; ++id) {
+                vertex_id* first = csr._neighbors.data() + csr._offsets[id];
+                vertex_id* last = first;
+                for (const Key& to : *edges[id]) {
+                    const vertex_id to_id = csr.find(to);
+                    if (to_id != csr.npos) {
+                        *last++ = to_id;
+                    }
+                }
+                std::sort(first, last);
+            }
+        });
+        return csr;
+    }
+
+    // Assigns only the content of an existing vertex (See set_vertex)
+    struct AssignContent {
+        template <typename V>
+        void operator()(Vertex& vertex, V&& content) const {
+            vertex._content = std::forward<V>(content);
+        }
+    };
+
+    // Graph that holds each vertex: this one. Operations below take the
+    // graph of each key from graphOf, so that ShardedLWWGraph runs the same
+    // code on vertex split between several graphs (Its shards).
+    struct SelfGraph {
+        LWWGraph& graph;
+
+        LWWGraph& operator()(const Key&) const { return graph; }
+    };
+
+    // Does nothing on the edge added by add_edge (See setEdge)
+    struct NoEdgeValue {
+        void operator()(edge_set&, const Key&) const {}
+    };
+
+    // Body of add_edge. onEdge(edges, to) is then called on the edge set
+    // of from, with the edge inserted.
+    template <typename GraphOf, typename OnEdge = NoEdgeValue>
+    static AddEdgeInfo addEdge(const Key& from, const Key& to, const U& stamp, GraphOf graphOf,
+                               OnEdge onEdge = OnEdge()) {
+        LWWGraph& fromGraph = graphOf(from);
+        LWWGraph& toGraph = graphOf(to);
+        AddEdgeInfo info = {false, false, false};
+        if (stamp < fromGraph._compactTime) {
+            return info;  // Already seen operation (See compact)
+        }
+        vertex_element& fromElt = fromGraph.addVertexElement(from, stamp, info.isFromAdded);
+        vertex_element& toElt = (from != to) ? toGraph.addVertexElement(to, stamp, info.isToAdded) : fromElt;
+        fromGraph.indexChange(from, fromElt.value(), stamp);
+        toGraph.indexChange(to, toElt.value(), stamp);
+
+        const EdgeVertexState state =
+            edgeVertexState(fromGraph._adj.crdt_clear_time(), fromElt, toElt, fromElt.value(), toElt.value());
+        info.isEdgeAdded = fromGraph.updateEdge(fromElt.value(), from, toElt.value(), [&](edge_set& edges) {
+            const bool isEdgeAdded = fromGraph.addEdgeElement(edges, to, stamp, state);
+            onEdge(edges, to);
+            return isEdgeAdded;
+        });
+        return info;
+    }
+
+    // Body of set_edge
+    template <typename V, typename GraphOf>
+    static bool setEdge(const Key& from, const Key& to, V&& value, const U& stamp, GraphOf graphOf) {
+        bool isAssigned = false;
+        addEdge(from, to, stamp, graphOf, [&](edge_set& edges, const Key& key) {
+            isAssigned = edges.setPayload(key, std::forward<V>(value), stamp);
+        });
+        return isAssigned;
+    }
+
+    // Body of remove_edge
+    template <typename GraphOf>
+    static bool removeEdge(const Key& from, const Key& to, const U& stamp, GraphOf graphOf) {
+        LWWGraph& fromGraph = graphOf(from);
+        LWWGraph& toGraph = graphOf(to);
+        if (stamp < fromGraph._compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        Vertex& fromVertex = fromGraph.crdtVertex(from);
+        Vertex& toVertex = toGraph.crdtVertex(to);
+        fromGraph.indexChange(from, fromVertex, stamp);
+        toGraph.indexChange(to, toVertex, stamp);
+        return fromGraph.updateEdge(fromVertex, from, toVertex,
+                                    [&](edge_set& edges) { return edges.remove(to, stamp); });
+    }
+
+    // Body of remove_vertex. Changes the graph of the vertex and of each
+    // vertex visited by forEachNeighbor(key, true).
+    template <typename GraphOf>
+    static bool removeVertex(const Key& key, const U& stamp, GraphOf graphOf) {
+        LWWGraph& graph = graphOf(key);
+        if (stamp < graph._compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        bool isVertexRemoved = graph._adj.remove(key, stamp);
+
+        // Remove all edges of this vertex
+        auto from_it = graph._adj.crdt_find(key);
+        Vertex& vertex = from_it->second.value();
+        graph.indexChange(key, vertex, stamp);
+        if (stamp > vertex._removeTime) {
+            vertex._removeTime = stamp;
+        }
+        graph.clearEdges(key, vertex, stamp, graphOf);
+
+        // Remove all alive edge to this vertex (On others vertex)
+        // DevNote: origins are copied first, updateEdge changes _inEdges
+        // (May rehash, ex: FlatHashStorage)
+        std::vector<Key> origins;
+        for (auto in_it = vertex._inEdges.begin(); in_it != vertex._inEdges.end(); ++in_it) {
+            if (in_it->second && in_it->first != key) {
+                origins.push_back(in_it->first);
+            }
+        }
+        for (const Key& from : origins) {
+            LWWGraph& fromGraph = graphOf(from);
+            Vertex& fromVertex = fromGraph._adj.crdt_find(from)->second.value();
+            fromGraph.indexChange(from, fromVertex, stamp);
+            fromGraph.updateEdge(fromVertex, from, vertex, [&](edge_set& edges) { return edges.remove(key, stamp); });
+        }
+
+        return isVertexRemoved;
+    }
+
+    // Body of clear_vertex_edges. Changes the graph of the vertex and of
+    // each vertex visited by forEachNeighbor(key, false).
+    template <typename GraphOf>
+    static bool clearVertexEdges(const Key& key, const U& stamp, GraphOf graphOf) {
+        LWWGraph& graph = graphOf(key);
+        if (stamp < graph._compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        const bool isKnown = graph._adj.crdt_count(key) == 1;
+        Vertex& vertex = graph.crdtVertex(key);
+        graph.indexChange(key, vertex, stamp);
+        return graph.clearEdges(key, vertex, stamp, graphOf) && isKnown;
+    }
+
+    // Calls fn on the key of each vertex that remove_vertex (withInEdges) or
+    // clear_vertex_edges may change, other than key (May repeat keys)
+    template <typename Fn>
+    void forEachNeighbor(const Key& key, bool withInEdges, Fn fn) const {
+        const auto vertex_it = _adj.crdt_find(key);
+        if (vertex_it == _adj.crdt_end()) {
+            return;
+        }
+        const Vertex& vertex = vertex_it->second.value();
+        for (const Key& to : vertex._edges) {
+            fn(to);
+        }
+        if (withInEdges) {
+            for (auto in_it = vertex._inEdges.begin(); in_it != vertex._inEdges.end(); ++in_it) {
+                if (in_it->second) {
+                    fn(in_it->first);
+                }
+            }
+        }
+    }
+
+    // Body of compact. Purged edges are erased from the reverse adjacency
+    // of their destination. A purged vertex has no edge left: it is not the
+    // origin of any indexed edge.
+    template <typename GraphOf>
+    size_type compactVertex(const U& stableBefore, GraphOf graphOf) {
+        if (stableBefore > _compactTime) {
+            _compactTime = stableBefore;
+        }
+
+        size_type nbPurged = 0;
+        std::vector<Key> removed;
+        for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
+            Vertex& vertex = it->second.value();
+            removed.clear();
+            if (vertex._edges.crdt_size() != vertex._edges.size()) {
+                for (auto edge_it = vertex._edges.crdt_begin(); edge_it != vertex._edges.crdt_end(); ++edge_it) {
+                    if (vertex._edges.count(edge_it->first) == 0) {
+                        removed.push_back(edge_it->first);
+                    }
+                }
+            }
+            nbPurged += this->updateEdges(vertex, [&](edge_set& edges) { return edges.compact(stableBefore); });
+            for (const Key& to : removed) {
+                LWWMap<Key, Vertex, U>& toAdj = graphOf(to)._adj;
+                const auto to_it = toAdj.crdt_find(to);
+                if (vertex._edges.crdt_count(to) == 0 && to_it != toAdj.crdt_end()) {
+                    to_it->second.value()._inEdges.erase(it->first);
+                }
+            }
+        }
+        nbPurged += _adj.compact(stableBefore, [&](const Vertex& v) {
+            return v._edges.crdt_empty() && v._edges.crdt_clear_time() < stableBefore;
+        });
+        _changes.erase_before(stableBefore);
+        return nbPurged;
+    }
+
+    // Vertex of key, added as removed if unknown (Temporary vertex, see
+    // remove_edge). Same as _adj.remove(key, 0), whatever the compact floor.
+    Vertex& crdtVertex(const Key& key) {
+        auto coco_it = _adj.insertKey(key, 0, true);
+        _adj.removeElement(coco_it.first, coco_it.second, 0);
+        return coco_it.first->second.value();
+    }
+
+    // Same as _adj.add but keeps the vertex element (No lookup after add).
+    // DevNote: a reference stays valid when another key is inserted in
+    // _adj (Node-based map), an iterator may not (Rehash).
+    vertex_element& addVertexElement(const Key& key, const U& stamp, bool& isAdded) {
+        auto coco_it = _adj.insertKey(key, stamp, false);
+        isAdded = _adj.addElement(coco_it.first, coco_it.second, stamp);
+        return coco_it.first->second;
+    }
+
+    // State of from and to once added by add_edge: an edge older than the
+    // remove of from or to is removed, with the remove time. This is the
+    // time of a vertex still removed, or of the last remove_vertex of a
+    // vertex added back since, or of the last clear_vertices (Same as merge).
+    // Gives the same edge whatever the order add_edge and remove_vertex (Or
+    // clear_vertices) are received.
+    struct EdgeVertexState {
+        U removeTime;
+    };
+
+    template <typename Elt>
+    static EdgeVertexState edgeVertexState(const U& clearTime, const Elt& fromElt, const Elt& toElt,
+                                           const Vertex& fromVertex, const Vertex& toVertex) {
+        EdgeVertexState state{clearTime};
+        if (fromVertex._removeTime > state.removeTime) {
+            state.removeTime = fromVertex._removeTime;
+        }
+        if (toVertex._removeTime > state.removeTime) {
+            state.removeTime = toVertex._removeTime;
+        }
+        if (fromElt.isRemoved() && fromElt.timestamp() > state.removeTime) {
+            state.removeTime = fromElt.timestamp();
+        }
+        if (toElt.isRemoved() && toElt.timestamp() > state.removeTime) {
+            state.removeTime = toElt.timestamp();
+        }
+        return state;
+    }
+
+    // Body of add_edge once from and to are added
+    bool addEdgeElement(edge_set& edges, const Key& to, const U& stamp, const EdgeVertexState& state) {
+        auto edge_it = edges.insertKey(to, stamp, false);
+        const bool isEdgeAdded = edges.addElement(edge_it.first, edge_it.second, stamp);
+
+        // If edge added, check whether vertex from or to were removed after.
+        // If so, this newly created edge must be removed now. (important for
+        // CRDT commutativity)
+        if (!edge_it.first->second.isRemoved() && edge_it.first->second.timestamp() < state.removeTime) {
+            edges.removeElement(edge_it.first, false, state.removeTime);
+            return false;
+        }
+        return isEdgeAdded;
+    }
+
+    // Reads the edges of add_edges(first, last, stamp)
+    struct PairEdgeAccess {
+        const U& stamp;
+
+        template <typename Edge>
+        static const Key& from(const Edge& edge) {
+            return edge.first;
+        }
+
+        template <typename Edge>
+        static const Key& to(const Edge& edge) {
+            return edge.second;
+        }
+
+        template <typename Edge>
+        const U& stampOf(const Edge&) const {
+            return stamp;
+        }
+    };
+
+    // Reads the edges of add_edges(first, last)
+    struct BatchEdgeAccess {
+        static const Key& from(const BatchEdge& edge) { return edge.from; }
+        static const Key& to(const BatchEdge& edge) { return edge.to; }
+        const U& stampOf(const BatchEdge& edge) const { return edge.stamp; }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key* key) const { return std::hash<Key>()(*key); }
+    };
+
+    struct KeyEqual {
+        bool operator()(const Key* lhs, const Key* rhs) const { return *lhs == *rhs; }
+    };
+
+    // One distinct vertex of add_edges, with a copy of its state
+    struct BatchVertex {
+        crdt_iterator it;
+        bool isResolved = false;
+        bool _isRemoved = false;
+        U _timestamp = {0};  // Also stamp of the last add (See addBatchVertex)
+
+        bool isRemoved() const { return _isRemoved; }
+        const U& timestamp() const { return _timestamp; }
+    };
+
+    // Same as addVertexElement. The vertex is looked up only the first time.
+    // An add with the stamp of the previous one does nothing (Idempotent):
+    // the vertex is not even read.
+    // DevNote: the vertex container is reserved, iterators stay valid.
+    bool addBatchVertex(BatchVertex& vertex, const Key& key, const U& stamp) {
+        bool isAdded = false;
+        if (!vertex.isResolved) {
+            auto coco_it = _adj.insertKey(key, stamp, false);
+            vertex.it = coco_it.first;
+            vertex.isResolved = true;
+            isAdded = _adj.addElement(coco_it.first, coco_it.second, stamp);
+        } else if (!(stamp < vertex._timestamp) && !(vertex._timestamp < stamp)) {
+            return false;
+        } else {
+            isAdded = _adj.addElement(vertex.it, false, stamp);
+        }
+        this->indexChange(key, vertex.it->second.value(), stamp);
+        vertex._isRemoved = vertex.it->second.isRemoved();
+        vertex._timestamp = vertex.it->second.timestamp();
+        return isAdded;
+    }
+
+    // DevNote: vertex adds are applied in range order (Each edge sees the
+    // same from / to state as add_edge would). Edges of different origins
+    // are independent: they are applied after, grouped by origin.
+    template <typename ForwardIt, typename Access>
+    std::vector<AddEdgeInfo> addEdges(ForwardIt first, ForwardIt last, const Access& access) {
+        typedef typename std::iterator_traits<ForwardIt>::value_type edge_type;
+
+        // Dense id of each distinct vertex (Points to the keys in the range).
+        // Edges older than the compact floor do nothing (See compact).
+        FlatHashMap<const Key*, std::size_t, KeyHash, KeyEqual> ids;
+        std::vector<const edge_type*> edges;
+        std::vector<std::size_t> positions;  // Position of each applied edge in the range
+        std::vector<std::size_t> fromIds;
+        std::vector<std::size_t> toIds;
+        std::size_t nbRange = 0;
+        for (; first != last; ++first, ++nbRange) {
+            const edge_type& edge = *first;
+            if (access.stampOf(edge) < _compactTime) {
+                continue;
+            }
+            edges.push_back(&edge);
+            positions.push_back(nbRange);
+            fromIds.push_back(ids.insert(std::make_pair(&access.from(edge), ids.size())).first->second);
+            toIds.push_back(ids.insert(std::make_pair(&access.to(edge), ids.size())).first->second);
+        }
+        const std::size_t nbEdges = edges.size();
+        std::vector<BatchVertex> vertex(ids.size());
+        std::vector<AddEdgeInfo> infos(nbRange, AddEdgeInfo{false, false, false});
+        std::vector<EdgeVertexState> states;
+        states.reserve(nbEdges);
+        _adj.reserve(_adj.crdt_size() + vertex.size());
+
+        for (std::size_t i = 0; i < nbEdges; ++i) {
+            const Key& from = access.from(*edges[i]);
+            const Key& to = access.to(*edges[i]);
+            const U& stamp = access.stampOf(*edges[i]);
+            BatchVertex& fromVertex = vertex[fromIds[i]];
+            BatchVertex& toVertex = vertex[toIds[i]];
+            AddEdgeInfo& info = infos[positions[i]];
+            info.isFromAdded = this->addBatchVertex(fromVertex, from, stamp);
+            info.isToAdded = (fromIds[i] != toIds[i]) ? this->addBatchVertex(toVertex, to, stamp) : false;
+            states.push_back(edgeVertexState(_adj.crdt_clear_time(), fromVertex, toVertex,
+                                             fromVertex.it->second.value(), toVertex.it->second.value()));
+        }
+
+        // Edges of each origin, in range order
+        std::vector<char> isAlive(nbEdges, 0);  // Edge state once all applied
+        std::vector<std::size_t> begins;
+        std::vector<std::size_t> order;
+        groupByVertex(fromIds, vertex.size(), begins, order);
+        for (std::size_t id = 0; id < vertex.size(); ++id) {
+            if (begins[id] == begins[id + 1]) {
+                continue;
+            }
+            this->updateEdges(vertex[id].it->second.value(), [&](edge_set& edgeSet) {
+                edgeSet.reserve(edgeSet.crdt_size() + (begins[id + 1] - begins[id]));
+                for (std::size_t k = begins[id]; k < begins[id + 1]; ++k) {
+                    const std::size_t i = order[k];
+                    infos[positions[i]].isEdgeAdded =
+                        this->addEdgeElement(edgeSet, access.to(*edges[i]), access.stampOf(*edges[i]), states[i]);
+                }
+                for (std::size_t k = begins[id]; k < begins[id + 1]; ++k) {
+                    isAlive[order[k]] = edgeSet.count(access.to(*edges[order[k]])) == 1;
+                }
+                return edgeSet.size();
+            });
+        }
+
+        // Reverse adjacency, grouped by destination
+        groupByVertex(toIds, vertex.size(), begins, order);
+        for (std::size_t id = 0; id < vertex.size(); ++id) {
+            for (std::size_t k = begins[id]; k < begins[id + 1]; ++k) {
+                const std::size_t i = order[k];
+                this->indexInEdge(vertex[id].it->second.value(), access.from(*edges[i]), isAlive[i] != 0);
+            }
+        }
+        return infos;
+    }
+
+    // Sorts the indexes of ids by id, in index order (Counting sort).
+    // Indexes with id v are order[begins[v] .. begins[v + 1]).
+    static void groupByVertex(const std::vector<std::size_t>& ids, std::size_t nbIds, std::vector<std::size_t>& begins,
+                              std::vector<std::size_t>& order) {
+        begins.assign(nbIds + 1, 0);
+        for (const std::size_t id : ids) {
+            ++begins[id + 1];
+        }
+        for (std::size_t id = 0; id < nbIds; ++id) {
+            begins[id + 1] += begins[id];
+        }
+        order.resize(ids.size());
+        std::vector<std::size_t> ends(begins.begin(), begins.end() - 1);
+        for (std::size_t i = 0; i < ids.size(); ++i) {
+            order[ends[ids[i]]++] = i;
+        }
+    }
+
+    // Applies fn on the edges of vertex and updates the edge counters
+    template <typename Fn>
+    auto updateEdges(Vertex& vertex, Fn fn) -> decltype(fn(vertex._edges)) {
+        const size_type_edges size = vertex._edges.size();
+        const size_type_edges crdtSize = vertex._edges.crdt_size();
+        auto res = fn(vertex._edges);
+        _sizeEdges = _sizeEdges - size + vertex._edges.size();
+        _crdtSizeEdges = _crdtSizeEdges - crdtSize + vertex._edges.crdt_size();
+        return res;
+    }
+
+    // Recomputes the edge counters (After changes on many vertex)
+    void countEdges() {
+        _sizeEdges = 0;
+        _crdtSizeEdges = 0;
+        for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
+            _sizeEdges += it->second.value()._edges.size();
+            _crdtSizeEdges += it->second.value()._edges.crdt_size();
+        }
+    }
+
+    // Applies fn on the edge from -> toVertex only, then updates the reverse
+    // adjacency of toVertex. Since only this edge changes, the edge counts of
+    // fromVertex tell whether it was added, removed or is a new tombstone.
+    template <typename Fn>
+    bool updateEdge(Vertex& fromVertex, const Key& from, Vertex& toVertex, Fn fn) {
+        const size_type_edges size = fromVertex._edges.size();
+        const size_type_edges crdtSize = fromVertex._edges.crdt_size();
+        const bool res = this->updateEdges(fromVertex, fn);
+        if (fromVertex._edges.size() != size || fromVertex._edges.crdt_size() != crdtSize) {
+            this->indexInEdge(toVertex, from, fromVertex._edges.size() > size);
+        }
+        return res;
+    }
+
+    // Clears the edges of vertex (key), then updates the reverse adjacency
+    // of the destinations of the edges removed by this clear
+    template <typename GraphOf>
+    bool clearEdges(const Key& key, Vertex& vertex, const U& stamp, GraphOf graphOf) {
+        std::vector<const Key*> alive;
+        alive.reserve(vertex._edges.size());
+        for (const Key& to : vertex._edges) {
+            alive.push_back(&to);  // DevNote: lazy clear, keys are not moved
+        }
+        const bool isCleared = this->updateEdges(vertex, [&](edge_set& edges) { return edges.clear(stamp); });
+        for (const Key* to : alive) {
+            if (vertex._edges.count(*to) == 0) {
+                LWWMap<Key, Vertex, U>& toAdj = graphOf(*to)._adj;
+                const auto to_it = toAdj.crdt_find(*to);
+                if (to_it != toAdj.crdt_end()) {
+                    this->indexInEdge(to_it->second.value(), key, false);
+                }
+            }
+        }
+        return isCleared;
+    }
+
+    // Sets the state of the edge from -> vertex in the reverse adjacency of
+    // vertex (Added if not there yet)
+    void indexInEdge(Vertex& vertex, const Key& from, bool isAlive) {
+        auto& isIndexedAlive = StorageEmplace<in_edges_map>::try_emplace(vertex._inEdges, from).first->second;
+        if (isAlive != isIndexedAlive) {
+            isIndexedAlive = isAlive;
+            if (isAlive) {
+                ++vertex._inDegree;
+            } else {
+                --vertex._inDegree;
+            }
+        }
+    }
+
+    // Rebuilds the reverse adjacency of all vertex (After changes on many
+    // vertex)
+    void indexInEdges() {
+        this->clearInEdges();
+        this->indexOutEdges(SelfGraph{*this});
+    }
+
+    void clearInEdges() {
+        for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
+            Vertex& vertex = it->second.value();
+            vertex._inEdges.clear();
+            vertex._inDegree = 0;
+        }
+    }
+
+    // Adds each edge of this graph in the reverse adjacency of its
+    // destination
+    template <typename GraphOf>
+    void indexOutEdges(GraphOf graphOf) {
+        for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
+            const auto& edges = it->second.value()._edges;
+            for (auto edge_it = edges.crdt_begin(); edge_it != edges.crdt_end(); ++edge_it) {
+                LWWMap<Key, Vertex, U>& toAdj = graphOf(edge_it->first)._adj;
+                const auto to_it = toAdj.crdt_find(edge_it->first);
+                if (to_it != toAdj.crdt_end()) {
+                    this->indexInEdge(to_it->second.value(), it->first, edges.count(edge_it->first) == 1);
+                }
+            }
+        }
+    }
+
+    // Indexes vertex at stamp, in place of its previous change: the index
+    // keeps one entry per vertex, at its newest change.
+    void indexChange(const Key& key, Vertex& vertex, const U& stamp) {
+        if (!_changes.enabled() || stamp < vertex._changeTime) {
+            return;
+        }
+        if (stamp > vertex._changeTime) {
+            _changes.update(vertex._changeTime, stamp, key);
+            vertex._changeTime = stamp;
+        } else {
+            _changes.insert(stamp, key);  // First change may have stamp {0}
+        }
+    }
+
+    // Same as above. The vertex is looked up only if the index is enabled.
+    void indexChange(const Key& key, const U& stamp) {
+        if (_changes.enabled()) {
+            const auto it = _adj.crdt_find(key);
+            if (it != _adj.crdt_end()) {
+                this->indexChange(key, it->second.value(), stamp);
+            }
+        }
+    }
+
+    // Newest timestamp of the vertex or one of its edges
+    template <typename Elt>
+    static U newestChange(const Elt& elt) {
+        U stamp = elt.timestamp();
+        const auto& edges = elt.value()._edges;
+        for (auto edge_it = edges.crdt_begin(); edge_it != edges.crdt_end(); ++edge_it) {
+            if (edge_it->second.timestamp() > stamp) {
+                stamp = edge_it->second.timestamp();
+            }
+        }
+        return stamp;
+    }
+
+    // Indexes each vertex of graph (Merged in this one) at its newest change
+    void indexChanges(const LWWGraph& graph) {
+        if (_changes.enabled()) {
+            for (auto it = graph._adj.crdt_begin(); it != graph._adj.crdt_end(); ++it) {
+                this->indexChange(it->first, newestChange(it->second));
+            }
+        }
+    }
+
+    // Rebuilds the change index from the current content (See track_changes)
+    void indexChanges() {
+        _changes.clear();
+        if (_changes.enabled()) {
+            for (auto it = _adj.crdt_begin(); it != _adj.crdt_end(); ++it) {
+                Vertex& vertex = it->second.value();
+                vertex._changeTime = newestChange(it->second);
+                _changes.insert(vertex._changeTime, it->first);
+            }
+        }
+    }
+
+    template <typename Elt>
+    void copyVertex(const Key& key, const Elt& elt, edge_set&& edges) {
+        if (elt.isRemoved()) {
+            _adj.remove(key, elt.timestamp());
+        } else {
+            _adj.add(key, elt.timestamp());
+        }
+        auto& adjElt = _adj.crdt_find(key)->second;
+        adjElt._valueTime = elt.valueTimestamp();
+        Vertex& vertex = adjElt.value();
+        vertex._content = elt.value()._content;
+        vertex._removeTime = elt.value()._removeTime;
+        vertex._edges = std::move(edges);
+    }
+
+    // State of a vertex of other in this graph, before merge
+    struct MergedVertex {
+        size_type_edges size = 0;
+        size_type_edges crdtSize = 0;
+        U removeTime = {0};
+        bool isEdgeClearNewer = false;  // All its edges may change (Not only the ones of other)
+    };
+
+    // DevNote: only the vertex of other change, and the alive edges to them
+    // if their remove_vertex is newer. Edge counters and reverse adjacency
+    // are updated for these only.
+    void mergeWith(const LWWGraph& other, unsigned int nbThreads) {
+        if (&other == this) {
+            return;
+        }
+        if (other._adj.crdt_clear_time() > _adj.crdt_clear_time()) {
+            this->clear_vertices(other._adj.crdt_clear_time());
+        }
+
+        std::vector<MergedVertex> merged;
+        merged.reserve(other._adj.crdt_size());
+        for (auto other_it = other._adj.crdt_begin(); other_it != other._adj.crdt_end(); ++other_it) {
+            merged.emplace_back();
+            const auto vertex_it = _adj.crdt_find(other_it->first);
+            if (vertex_it != _adj.crdt_end()) {
+                const Vertex& vertex = vertex_it->second.value();
+                merged.back().size = vertex._edges.size();
+                merged.back().crdtSize = vertex._edges.crdt_size();
+                merged.back().removeTime = vertex._removeTime;
+                merged.back().isEdgeClearNewer =
+                    other_it->second.value()._edges.crdt_clear_time() > vertex._edges.crdt_clear_time();
+            }
+        }
+
+        auto mergeVertex = [](Vertex& v, const Vertex& otherVertex, bool isOtherNewer) {
+            if (isOtherNewer) {
+                v._content = otherVertex._content;
+            }
+            if (otherVertex._removeTime > v._removeTime) {
+                v._removeTime = otherVertex._removeTime;
+            }
+            v._edges.merge(otherVertex._edges);
+        };
+        // DevNote: a missing vertex older than the compact floor is skipped
+        // only if its edges are too (Same as the purge of compactVertex).
+        auto isPurged = [this](const Vertex& v) {
+            if (!(v._edges.crdt_clear_time() < _compactTime)) {
+                return false;
+            }
+            for (auto edge_it = v._edges.crdt_begin(); edge_it != v._edges.crdt_end(); ++edge_it) {
+                if (!(edge_it->second.timestamp() < _compactTime)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        _adj.mergeWith(other._adj, mergeVertex, nbThreads, isPurged);
+        this->indexChanges(other);
+
+        // Edges of each merged vertex (Same order as merged)
+        std::size_t i = 0;
+        for (auto other_it = other._adj.crdt_begin(); other_it != other._adj.crdt_end(); ++other_it, ++i) {
+            const auto vertex_it = _adj.crdt_find(other_it->first);
+            if (vertex_it == _adj.crdt_end()) {
+                continue;  // Purged here (See isPurged)
+            }
+            const Vertex& vertex = vertex_it->second.value();
+            _sizeEdges = _sizeEdges - merged[i].size + vertex._edges.size();
+            _crdtSizeEdges = _crdtSizeEdges - merged[i].crdtSize + vertex._edges.crdt_size();
+            const edge_set& changed = merged[i].isEdgeClearNewer ? vertex._edges : other_it->second.value()._edges;
+            for (auto edge_it = changed.crdt_begin(); edge_it != changed.crdt_end(); ++edge_it) {
+                const auto to_it = _adj.crdt_find(edge_it->first);
+                if (to_it != _adj.crdt_end()) {
+                    this->indexInEdge(to_it->second.value(), other_it->first, vertex._edges.count(edge_it->first) == 1);
+                }
+            }
+        }
+
+        // Replays remove_vertex on the edges its replicate didn't have
+        std::vector<Key> keys;
+        i = 0;
+        for (auto other_it = other._adj.crdt_begin(); other_it != other._adj.crdt_end(); ++other_it, ++i) {
+            const Key& key = other_it->first;
+            const auto vertex_it = _adj.crdt_find(key);
+            if (vertex_it == _adj.crdt_end()) {
+                continue;  // Purged here (See isPurged)
+            }
+            Vertex& vertex = vertex_it->second.value();
+            keys.assign(vertex._edges.begin(), vertex._edges.end());
+            for (const Key& to : keys) {
+                this->replayRemoveVertex(key, vertex, to);
+            }
+            if (vertex._removeTime > merged[i].removeTime) {
+                keys.clear();
+                for (auto in_it = vertex._inEdges.begin(); in_it != vertex._inEdges.end(); ++in_it) {
+                    if (in_it->second && in_it->first != key) {
+                        keys.push_back(in_it->first);
+                    }
+                }
+                for (const Key& from : keys) {
+                    this->replayRemoveVertex(from, _adj.crdt_find(from)->second.value(), key);
+                }
+            }
+        }
+
+        if (other._compactTime > _compactTime) {
+            _compactTime = other._compactTime;  // After the join (See LWWSet::mergeWith)
+        }
+    }
+
+    // Removes the alive edge from -> to if older than the last remove_vertex
+    // of from or to, or than the last clear_vertices (See edgeVertexState)
+    void replayRemoveVertex(const Key& from, Vertex& fromVertex, const Key& to) {
+        U removeTime = _adj.crdt_clear_time();
+        if (fromVertex._removeTime > removeTime) {
+            removeTime = fromVertex._removeTime;
+        }
+        const auto to_it = _adj.crdt_find(to);
+        if (to_it != _adj.crdt_end() && to_it->second.value()._removeTime > removeTime) {
+            removeTime = to_it->second.value()._removeTime;
+        }
+        if (!(removeTime > fromVertex._edges.crdt_find(to)->second.timestamp())) {
+            return;
+        }
+        this->indexChange(from, fromVertex, removeTime);
+        auto removeEdge = [&](edge_set& edges) { return edges.remove(to, removeTime); };
+        if (to_it != _adj.crdt_end()) {
+            this->updateEdge(fromVertex, from, to_it->second.value(), removeEdge);
+        } else {
+            this->updateEdges(fromVertex, removeEdge);
+        }
+    }
+
     // -------------------------------------------------------------------------
     // Iterator
     // -------------------------------------------------------------------------
@@ -623,18 +1771,12 @@ class LWWGraph {
      *
      * \return iterator to the last element.
      */
-    iterator end() {
-        iterator it(_adj, _adj.crdt_end());
-        return it;
-    }
+    iterator end() { return _adj.end(); }
 
     /**
      * \copydoc LWWGraph::end
      */
-    const_iterator end() const noexcept {
-        const_iterator it(_adj, _adj.crdt_end());
-        return it;
-    }
+    const_iterator end() const noexcept { return _adj.end(); }
 
     /**
      * \copydoc LWWGraph::begin
@@ -644,10 +1786,7 @@ class LWWGraph {
     /**
      * \copydoc LWWGraph::end
      */
-    const_iterator cend() const noexcept {
-        const_iterator it(_adj, _adj.crdt_end());
-        return it;
-    }
+    const_iterator cend() const noexcept { return _adj.cend(); }
 
     /**
      * Returns crdt_iterator to the beginning.
@@ -712,7 +1851,7 @@ class LWWGraph {
      * Display the internal graph content.
      * This is mainly for debug print purpose.
      */
-    friend std::ostream& operator<<(std::ostream& out, const LWWGraph<Key, T, U>& o) {
+    friend std::ostream& operator<<(std::ostream& out, const LWWGraph& o) {
         out << "CmRDT::LWWGraph = ";
         for (auto it = o.crdt_begin(); it != o.crdt_end(); ++it) {
             out << "\n Vertex(" << it->first << "," << it->second.timestamp();
@@ -742,14 +1881,35 @@ class LWWGraph {
  * \tparam T    Type of element.
  * \tparam U    Type of timestamps.
  */
-template <typename Key, typename T, typename U>
-class LWWGraph<Key, T, U>::Vertex {
+template <typename Key, typename T, typename U, typename EdgeStorage, typename EdgeValue>
+class LWWGraph<Key, T, U, EdgeStorage, EdgeValue>::Vertex {
    private:
     friend LWWGraph;
     T _content;
-    LWWSet<Key, U> _edges;
+    edge_set _edges;
+    U _removeTime = {0};  // Last remove_vertex (Edges older than that are removed)
+
+    // Reverse adjacency: origin of each edge to this vertex (Also removed
+    // ones), with whether the edge is alive. Not part of the CRDT state.
+    in_edges_map _inEdges;
+    size_type_edges _inDegree = 0;  // Nb of alive edges to this vertex
+    U _changeTime = {0};            // Entry in the change index of its graph (Not part of the CRDT state)
 
    public:
+    Vertex() = default;
+
+    /**
+     * Creates a vertex without edges (See set_vertex).
+     *
+     * \param content Content of the vertex.
+     */
+    explicit Vertex(const T& content) : _content(content) {}
+
+    /**
+     * \copydoc Vertex::Vertex(const T&)
+     */
+    explicit Vertex(T&& content) : _content(std::move(content)) {}
+
     /**
      * Returns a reference to the vertex content data.
      *
@@ -767,7 +1927,7 @@ class LWWGraph<Key, T, U>::Vertex {
      *
      * \return Reference to the set of edges.
      */
-    const LWWSet<Key, U>& edges() const { return _edges; }
+    const edge_set& edges() const { return _edges; }
 
     // -------------------------------------------------------------------------
     // Operators overload
@@ -800,4 +1960,88 @@ class LWWGraph<Key, T, U>::Vertex {
     friend bool operator!=(const Vertex& lhs, const Vertex& rhs) { return !(lhs == rhs); }
 };
 
+/**
+ * \brief
+ * Origins of the edges to a vertex (See LWWGraph::in_edges).
+ *
+ * Iterates the reverse adjacency of the vertex. Unless built by
+ * crdt_in_edges, origins of removed edges are skipped.
+ *
+ *
+ * \tparam Key  Type of key.
+ * \tparam T    Type of element.
+ * \tparam U    Type of timestamps.
+ */
+template <typename Key, typename T, typename U, typename EdgeStorage, typename EdgeValue>
+class LWWGraph<Key, T, U, EdgeStorage, EdgeValue>::in_edge_range {
+   private:
+    friend LWWGraph;
+    typedef typename in_edges_map::const_iterator map_iterator;
+
+    const in_edges_map& _inEdges;
+    size_type_edges _size;
+    bool _isCrdt;
+
+    in_edge_range() : _inEdges(emptyInEdges()), _size(0), _isCrdt(true) {}
+
+    in_edge_range(const Vertex& vertex, bool isCrdt)
+        : _inEdges(vertex._inEdges), _size(isCrdt ? vertex._inEdges.size() : vertex._inDegree), _isCrdt(isCrdt) {}
+
+    static const in_edges_map& emptyInEdges() {
+        static const in_edges_map empty;
+        return empty;
+    }
+
+   public:
+    class const_iterator : public std::iterator<std::input_iterator_tag, Key> {
+       private:
+        friend in_edge_range;
+
+        map_iterator _it;
+        map_iterator _end;
+        bool _isCrdt;
+
+        const_iterator(map_iterator it, map_iterator end, bool isCrdt) : _it(it), _end(end), _isCrdt(isCrdt) {
+            this->skipRemoved();
+        }
+
+        void skipRemoved() {
+            while (!_isCrdt && _it != _end && !_it->second) {
+                ++_it;
+            }
+        }
+
+       public:
+        const_iterator& operator++() {
+            ++_it;
+            this->skipRemoved();
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const { return _it == other._it; }
+
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+        const Key& operator*() const { return _it->first; }
+    };
+
+    const_iterator begin() const { return const_iterator(_inEdges.begin(), _inEdges.end(), _isCrdt); }
+
+    const_iterator end() const { return const_iterator(_inEdges.end(), _inEdges.end(), _isCrdt); }
+
+    /**
+     * Returns the number of origins in the range.
+     *
+     * \return Number of origins (Constant time).
+     */
+    size_type_edges size() const { return _size; }
+
+    /**
+     * Checks whether the range is empty.
+     *
+     * \return True if empty, otherwise, return false.
+     */
+    bool empty() const { return _size == 0; }
+};
+
 }  // namespace collabserver
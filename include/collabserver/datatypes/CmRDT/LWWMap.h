@@ -1,19 +1,33 @@
 #pragma once
 
+#include <cstddef>
+#include <new>
 #include <ostream>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>  // std::pair
+#include <vector>
+
+#include "../storage/StoragePolicy.h"
+#include "../utils/ChangeIndex.h"
+#include "../utils/Parallel.h"
+#include "LWWBatchOperation.h"
 
 namespace collabserver {
 
+template <typename Key, typename T, typename U, typename EdgeStorage, typename EdgeValue>
+class LWWGraph;
+
 /**
  * \brief
  * Last-Writer-Wins Map (LWW Map).
  * CmRDT (Operation-based)
  *
  * Associative container that contains key-value pairs with unique keys.
- * Internally uses std::unordered_map to store the pair and its CRDT metadata.
+ * Internally uses an associative container (Selected by the Storage policy)
+ * to store the pair and its CRDT metadata.
  * As the end user, you see this container as a std::unordered_map (See iterator
  * for instance). You may request the actual internal data using crdt_iterator.
  * Check out std::unordered_map documentation for further informations.
@@ -26,7 +40,8 @@ namespace collabserver {
  * \par
  * Any added key is never removed but only marked as deleted instead.
  * For that reason, this CRDT container may not fit all systems
- * due to the used memory space.
+ * due to the used memory space. Old deleted keys may be purged with
+ * compact once all replicates have seen them.
  *
  * \par
  * All operations on this container are commutative! You may receive a remove
@@ -62,34 +77,47 @@ namespace collabserver {
  * content.
  * To have a map of CRDT atomic content, you may use a map of LWWRegister
  * for instance. To update a key value, use query on this key and call the
- * register update function.
+ * register update function. (Or use set, that assigns the value only if its
+ * timestamp wins).
  *
  * \warning
  * Timestamps are strictly unique for each user's operation, with total order.
  * For any distinct operations (ex: add(t1) / remove(t2)), t1==t2 must return
  * false. (See quote and implementation for further informations).
  *
+ * \note
+ * clear is applied lazily: elements are only updated by the next write.
+ * Const crdt queries see an element older than the last clear as removed
+ * at the clear timestamp (See ElementView). Const methods never write the
+ * container (See LWWSet).
+ *
  * \warning
  * T type must have a default constructor.
  * U timestamp must accept "U t = {0}". (This should set the minimal value.)
  *
  * \see http://en.cppreference.com/w/cpp/container/unordered_map
+ * \see StoragePolicy.h
  *
  *
- * \tparam Key  Type of key.
- * \tparam T    Type of element.
- * \tparam U    Type of timestamps (Must implements operators > and <).
+ * \tparam Key      Type of key.
+ * \tparam T        Type of element.
+ * \tparam U        Type of timestamps (Must implements operators > and <).
+ * \tparam Storage  Internal storage policy (See HashMapStorage).
  */
-template <typename Key, typename T, typename U>
+template <typename Key, typename T, typename U, typename Storage = HashMapStorage>
 class LWWMap {
    public:
     class Element;
+    class ElementView;
     class iterator;
     class const_iterator;
+    class const_crdt_iterator;
 
-    typedef typename std::unordered_map<Key, Element>::size_type size_type;
-    typedef typename std::unordered_map<Key, Element>::iterator crdt_iterator;
-    typedef typename std::unordered_map<Key, Element>::const_iterator const_crdt_iterator;
+    // Element already holds its key (See Element::key)
+    typedef typename Storage::template keyed_map<Key, Element> map_type;
+    typedef typename map_type::size_type size_type;
+    typedef typename map_type::iterator crdt_iterator;
+    typedef LWWBatchOperation<Key, U> batch_operation;
 
     // From outside, we see LWWMap as <Key, T> (Except crdt_iterator)
     typedef typename std::unordered_map<Key, T>::key_type key_type;
@@ -101,9 +129,20 @@ class LWWMap {
     typedef typename std::unordered_map<Key, T>::const_pointer const_pointer;
 
    private:
-    std::unordered_map<Key, Element> _map;
-    size_type _sizeAlive = 0;  // Nb of alive elts (Not marked as removed)
-    U _lastClearTime = {0};    // Last time a clear has been applied
+    template <typename, typename, typename, typename, typename>
+    friend class LWWGraph;  // Uses setElement for vertex content
+
+    typedef StorageMarks<map_type> marks;  // Alive elts are marked
+    typedef StorageEmplace<map_type> emplace;
+    typedef typename map_type::const_iterator map_const_iterator;
+
+    map_type _map;
+    size_type _sizeAlive = 0;      // Nb of alive elts (Not marked as removed)
+    U _lastClearTime = {0};        // Last time a clear has been applied
+    U _compactTime = {0};          // Watermark of the last compact
+    U _maxStamp = {0};             // Highest timestamp ever applied
+    ChangeIndex<U, Key> _changes;  // Optional (See track_changes)
+    bool _isClearPending = false;  // Some elts not updated by last clear (See LWWSet)
 
     // -------------------------------------------------------------------------
     // Capacity methods
@@ -166,7 +205,7 @@ class LWWMap {
      */
     T& at(const Key& key) {
         auto elt_it = _map.find(key);
-        if (elt_it == _map.end() || elt_it->second.isRemoved()) {
+        if (elt_it == _map.end() || !this->isAlive(elt_it->second)) {
             throw std::out_of_range("No element for this key");
         }
         return elt_it->second.value();
@@ -175,7 +214,13 @@ class LWWMap {
     /**
      * \copydoc LWWMap::at
      */
-    const T& at(const Key& key) const { return this->at(key); }
+    const T& at(const Key& key) const {
+        const auto elt_it = _map.find(key);
+        if (elt_it == _map.end() || !this->isAlive(elt_it->second)) {
+            throw std::out_of_range("No element for this key");
+        }
+        return elt_it->second.value();
+    }
 
     /**
      * Returns a reference to the mapped value of the element with key
@@ -198,7 +243,13 @@ class LWWMap {
     /**
      * \copydoc LWWMap::crdt_at
      */
-    const T& crdt_at(const Key& key) const { return this->crdt_at(key); }
+    const T& crdt_at(const Key& key) const {
+        const auto elt_it = _map.find(key);
+        if (elt_it == _map.end()) {
+            throw std::out_of_range("No element for this key");
+        }
+        return elt_it->second.value();
+    }
 
     /**
      * Find a key-element in the container.
@@ -213,9 +264,8 @@ class LWWMap {
      */
     iterator find(const Key& key) {
         const auto elt_it = _map.find(key);
-        if (elt_it != _map.end() && !elt_it->second.isRemoved()) {
-            iterator it(*this, elt_it);
-            return it;
+        if (elt_it != _map.end() && this->isAlive(elt_it->second)) {
+            return iterator(*this, elt_it, _sizeAlive);
         } else {
             return this->end();
         }
@@ -226,9 +276,8 @@ class LWWMap {
      */
     const_iterator find(const Key& key) const {
         const auto elt_it = _map.find(key);
-        if (elt_it != _map.end() && !elt_it->second.isRemoved()) {
-            const_iterator it(*this, elt_it);
-            return it;
+        if (elt_it != _map.end() && this->isAlive(elt_it->second)) {
+            return const_iterator(*this, elt_it, _sizeAlive);
         } else {
             return this->end();
         }
@@ -250,12 +299,18 @@ class LWWMap {
      * \param key The key to query.
      * \return Iterator CRDT to the key or crdt_end() if not found.
      */
-    crdt_iterator crdt_find(const Key& key) { return _map.find(key); }
+    crdt_iterator crdt_find(const Key& key) {
+        const auto elt_it = _map.find(key);
+        if (elt_it != _map.end()) {
+            this->settle(elt_it->second);
+        }
+        return elt_it;
+    }
 
     /**
      * \copydoc LWWMap::crdt_find
      */
-    const_crdt_iterator crdt_find(const Key& key) const { return _map.find(key); }
+    const_crdt_iterator crdt_find(const Key& key) const { return const_crdt_iterator(_map.find(key), _lastClearTime); }
 
     /**
      * Count the number of element with this key.
@@ -264,7 +319,10 @@ class LWWMap {
      * \param key Key value of the element to count.
      * \return Number of elements with this key, either 0 or 1.
      */
-    size_type count(const Key& key) const { return (this->find(key) != this->end()) ? 1 : 0; }
+    size_type count(const Key& key) const {
+        const auto elt_it = _map.find(key);
+        return (elt_it != _map.end() && this->isAlive(elt_it->second)) ? 1 : 0;
+    }
 
     /**
      * Count the number of element with this key.
@@ -296,22 +354,37 @@ class LWWMap {
      * From a user point of view, if you display a UI after a clear, you
      * should iterate over the set anyway.
      *
+     * \par Complexity
+     * Constant if stamp is higher than all applied timestamps (Usual case).
+     * Otherwise, linear in crdt_size. (See LWWSet::clear)
+     *
      * \param stamp Timestamp of this operation.
      * \return True if clear actually applied, otherwise, return false.
      */
-    bool clear(const U& stamp) noexcept {
-        if (stamp > _lastClearTime) {
+    bool clear(const U& stamp) {
+        if (stamp > _maxStamp) {
+            // Lazy clear: all elts are older than stamp, so all are removed
+            _lastClearTime = stamp;
+            _maxStamp = stamp;
+            _sizeAlive = 0;
+            _isClearPending = !_map.empty();
+            marks::clear(_map);
+            return true;
+        } else if (stamp > _lastClearTime) {
+            this->settleAll();
             _lastClearTime = stamp;
 
             // DevNote: Same code as 'remove' but without the insert attempt
-            for (auto& elt_it : _map) {
-                Element& elt = elt_it.second;
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                Element& elt = elt_it->second;
 
                 if (stamp > elt._timestamp) {
+                    _changes.update(elt._timestamp, stamp, elt_it->first);
                     elt._timestamp = stamp;
 
                     if (elt._isRemoved == false) {
                         elt._isRemoved = true;
+                        marks::mark(_map, elt_it, false);
                         --_sizeAlive;
                     }
                 }
@@ -338,8 +411,7 @@ class LWWMap {
      *
      * \note
      * This only adds the key. A default element is created.
-     * To add key and set its content, call this add method and query the
-     * added element (Then update it with its default value).
+     * To add key and set its content, use set.
      *
      * \par Idempotent
      * Duplicate calls with same stamp is idempotent.
@@ -349,36 +421,61 @@ class LWWMap {
      * \return True if key added, otherwise, return false.
      */
     bool add(const Key& key, const U& stamp) {
-        Element newElt(key);  // Content is not set here
-        newElt._timestamp = stamp;
-        newElt._isRemoved = false;
-
-        auto coco_it = _map.insert(std::make_pair(key, newElt));
-        bool isKeyAdded = coco_it.second;
-        Element& elt = coco_it.first->second;
-        const U& keyStamp = elt.timestamp();
-
-        if (!isKeyAdded) {
-            if (stamp > keyStamp) {
-                elt._timestamp = stamp;
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        auto coco_it = this->insertKey(key, stamp, false);
+        return this->addElement(coco_it.first, coco_it.second, stamp);
+    }
 
-                if (elt._isRemoved == true) {
-                    elt._isRemoved = false;
-                    ++_sizeAlive;
-                    return true;
-                }
-            }
+    /**
+     * \copydoc LWWMap::add(const Key&, const U&)
+     *
+     * \note
+     * The key is moved only if actually inserted.
+     */
+    bool add(Key&& key, const U& stamp) {
+        if (stamp < _compactTime) {
             return false;
-        } else {
-            if (stamp > _lastClearTime) {
-                ++_sizeAlive;
-                return true;
-            } else {
-                elt._timestamp = _lastClearTime;
-                elt._isRemoved = true;
-                return false;
-            }
         }
+        auto coco_it = this->insertKey(std::move(key), stamp, false);
+        return this->addElement(coco_it.first, coco_it.second, stamp);
+    }
+
+    /**
+     * Adds key with its value (Like insert_or_assign).
+     *
+     * Same as add for the key. The value has its own timestamp (Like the
+     * LWWSet payload): it replaces the current one only if this operation
+     * is newer than the last set of this key. Add, remove and clear don't
+     * change it, so that set commutes with them. For a new key, the element
+     * is directly built with value (No default value).
+     *
+     * \par Idempotent
+     * Duplicate calls with same stamp and value is idempotent.
+     *
+     * \par Complexity
+     * One lookup. The value is moved (or copied) only if assigned.
+     *
+     * \param key   Key of the element to set.
+     * \param value Value to assign (Forwarded).
+     * \param stamp Timestamps of this operation.
+     * \return True if value assigned, otherwise, return false.
+     */
+    template <typename V>
+    bool set(const Key& key, V&& value, const U& stamp) {
+        return this->setElement(key, std::forward<V>(value), stamp, AssignValue());
+    }
+
+    /**
+     * \copydoc LWWMap::set(const Key&, V&&, const U&)
+     *
+     * \note
+     * The key is moved only if actually inserted.
+     */
+    template <typename V>
+    bool set(Key&& key, V&& value, const U& stamp) {
+        return this->setElement(std::move(key), std::forward<V>(value), stamp, AssignValue());
     }
 
     /**
@@ -402,27 +499,48 @@ class LWWMap {
      * \return True if key removed, otherwise, return false.
      */
     bool remove(const Key& key, const U& stamp) {
-        Element newElt(key);  // Content is not set here
-        newElt._timestamp = stamp;
-        newElt._isRemoved = true;
-
-        auto coco_it = _map.insert(std::make_pair(key, newElt));
-        bool isKeyAdded = coco_it.second;
-        Element& elt = coco_it.first->second;
-        const U& keyStamp = elt.timestamp();
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        auto coco_it = this->insertKey(key, stamp, true);
+        return this->removeElement(coco_it.first, coco_it.second, stamp);
+    }
 
-        if (!isKeyAdded) {
-            if (stamp > keyStamp) {
-                elt._timestamp = stamp;
+    /**
+     * \copydoc LWWMap::remove(const Key&, const U&)
+     *
+     * \note
+     * The key is moved only if actually inserted.
+     */
+    bool remove(Key&& key, const U& stamp) {
+        if (stamp < _compactTime) {
+            return false;
+        }
+        auto coco_it = this->insertKey(std::move(key), stamp, true);
+        return this->removeElement(coco_it.first, coco_it.second, stamp);
+    }
 
-                if (elt._isRemoved == false) {
-                    elt._isRemoved = true;
-                    --_sizeAlive;
-                    return true;
-                }
+    /**
+     * \copydoc LWWSet::apply_batch
+     *
+     * \note
+     * Like add, this only adds keys. Values are not set.
+     */
+    template <typename ForwardIt>
+    std::vector<bool> apply_batch(ForwardIt first, ForwardIt last) {
+        std::vector<bool> results;
+        std::vector<const batch_operation*> ops;
+        for (; first != last; ++first) {
+            const batch_operation& op = *first;
+            if (op.kind == batch_operation::CLEAR) {
+                this->applyBatchOperations(ops, results);
+                results.push_back(this->clear(op.stamp));
+            } else {
+                ops.push_back(&op);
             }
         }
-        return false;  // DevNote: see LWWSet::remove
+        this->applyBatchOperations(ops, results);
+        return results;
     }
 
     // -------------------------------------------------------------------------
@@ -457,7 +575,203 @@ class LWWMap {
      * \param other Container to compare with.
      * \return True if equals, otherwise, return false.
      */
-    bool crdt_equal(const LWWMap& other) const { return _map == other._map; }
+    bool crdt_equal(const LWWMap& other) const {
+        if (!_isClearPending && !other._isClearPending) {
+            return _map == other._map;
+        }
+        if (_map.size() != other._map.size()) {
+            return false;
+        }
+        for (auto elt_it = this->crdt_begin(); elt_it != this->crdt_end(); ++elt_it) {
+            const auto other_it = other.crdt_find(elt_it->first);
+            if (other_it == other.crdt_end() || elt_it->second != other_it->second) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Returns a copy of the container, as it is now.
+     *
+     * With PersistentStorage, the copy shares the internal nodes of this
+     * container and is O(1) (Plus the change index, if tracked). Following
+     * updates of this container only copy the nodes they modify, so the
+     * snapshot may be read (ex: iterated for an export) from another thread
+     * while this container keeps applying operations. Other storages make a
+     * full copy.
+     *
+     * \warning
+     * Must be called from the thread that modifies this container (Or under
+     * the same lock). Only const methods may be called on the snapshot from
+     * another thread.
+     *
+     * \see PersistentHashMap
+     *
+     * \return Copy of this container.
+     */
+    LWWMap snapshot() const { return *this; }
+
+    /**
+     * Purges the deleted keys older than a causal-stability watermark.
+     *
+     * Keys marked as removed with a timestamp strictly lower than
+     * stableBefore are erased from the internal container. Memory and
+     * iteration cost then follow the number of alive keys, not the history.
+     * The watermark is kept as a floor: a later operation with a lower
+     * timestamp does nothing (See LWWSet::compact).
+     *
+     * \warning
+     * The application must guarantee that every replicate has already
+     * received all operations with timestamp lower than stableBefore.
+     * Otherwise, a late add may bring back a purged key.
+     * crdt_equal returns false between a compacted and a not compacted
+     * replicate, though they have the same content.
+     *
+     * \par Idempotent
+     * Duplicate calls with same stamp is idempotent.
+     *
+     * \param stableBefore Watermark timestamp.
+     * \return Number of purged keys.
+     */
+    size_type compact(const U& stableBefore) {
+        return this->compact(stableBefore, [](const T&) { return true; });
+    }
+
+    /**
+     * \copydoc LWWMap::compact
+     *
+     * \par
+     * Only removed keys whose value satisfies isPurgeable are erased.
+     * Useful when the value holds CRDT data that must outlive its key.
+     * (ex: LWWGraph vertex with edges still to compact).
+     *
+     * \param isPurgeable Predicate called with the value of a purge candidate.
+     */
+    template <typename Pred>
+    size_type compact(const U& stableBefore, Pred isPurgeable) {
+        if (stableBefore > _compactTime) {
+            _compactTime = stableBefore;
+        }
+
+        this->settleAll();
+        size_type nbPurged = 0;
+        for (auto elt_it = _map.begin(); elt_it != _map.end();) {
+            const Element& elt = elt_it->second;
+            if (elt._isRemoved && elt._timestamp < stableBefore && isPurgeable(elt.value())) {
+                elt_it = _map.erase(elt_it);
+                ++nbPurged;
+            } else {
+                ++elt_it;
+            }
+        }
+        if (nbPurged > 0) {
+            _map.rehash(0);  // Shrink if possible
+            this->indexChanges();
+        }
+        return nbPurged;
+    }
+
+    /**
+     * Joins the full state of another replicate into this one.
+     *
+     * Keys (Including removed ones) are joined with the higher timestamp.
+     * The value of the key with the higher timestamp is kept.
+     * Clear and compact timestamps are joined too. (See LWWSet::merge)
+     *
+     * \param other Replicate to merge in this one.
+     */
+    void merge(const LWWMap& other) { this->mergeWith(other, TakeNewerValue(), 1); }
+
+    /**
+     * \copydoc LWWMap::merge
+     *
+     * \par
+     * mergeValue decides how values are joined. It is called for each key
+     * of other as mergeValue(T& value, const T& otherValue, bool isOtherNewer)
+     * where isOtherNewer is true if the value of other has the higher set
+     * timestamp (Or is a new key). If both were never set (Or set at the
+     * same time), the key timestamps decide instead. Useful when T is
+     * itself a CRDT.
+     *
+     * \param mergeValue Value join function.
+     */
+    template <typename MergeValue>
+    void merge(const LWWMap& other, MergeValue mergeValue) {
+        this->mergeWith(other, mergeValue, 1);
+    }
+
+    /**
+     * Parallel version of merge for large states.
+     * Gives the same result as merge. (See LWWSet::merge_parallel)
+     *
+     * \param other     Replicate to merge in this one.
+     * \param nbThreads Number of threads (0 to use all hardware threads).
+     */
+    void merge_parallel(const LWWMap& other, unsigned int nbThreads = 0) {
+        this->mergeWith(other, TakeNewerValue(), nbThreads);
+    }
+
+    /**
+     * \copydoc LWWMap::merge_parallel
+     *
+     * \warning
+     * mergeValue is called concurrently (On distinct values).
+     *
+     * \param mergeValue Value join function. (See merge)
+     */
+    template <typename MergeValue>
+    void merge_parallel(const LWWMap& other, MergeValue mergeValue, unsigned int nbThreads = 0) {
+        this->mergeWith(other, mergeValue, nbThreads);
+    }
+
+    /**
+     * Returns the timestamp of the last clear applied. ({0} if none).
+     *
+     * \return Last clear timestamp.
+     */
+    const U& crdt_clear_time() const noexcept { return _lastClearTime; }
+
+    /**
+     * \copydoc LWWSet::track_changes
+     */
+    void track_changes(bool enable) {
+        _changes.enable(enable);
+        this->indexChanges();
+    }
+
+    /**
+     * \copydoc LWWSet::is_tracking_changes
+     */
+    bool is_tracking_changes() const noexcept { return _changes.enabled(); }
+
+    /**
+     * Returns the changes since a timestamp, as a new LWWMap.
+     * Values are copied with their keys. (See LWWSet::delta_since)
+     *
+     * \param since Timestamp of the first change to include.
+     * \return Delta container.
+     */
+    LWWMap delta_since(const U& since) const {
+        LWWMap delta;
+        delta.clear(_lastClearTime);
+        if (_changes.enabled()) {
+            _changes.for_each_since(since, [&](const Key& key) {
+                const auto elt_it = _map.find(key);
+                if (elt_it != _map.end() && !(this->settledTimestamp(elt_it->second) < since)) {
+                    delta.copyElement(key, elt_it->second);
+                }
+            });
+        } else {
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                if (!(this->settledTimestamp(elt_it->second) < since)) {
+                    delta.copyElement(elt_it->first, elt_it->second);
+                }
+            }
+        }
+        delta._compactTime = _compactTime;
+        return delta;
+    }
 
     // -------------------------------------------------------------------------
     // Iterator
@@ -478,21 +792,16 @@ class LWWMap {
 
     /**
      * Returns an iterator to the end.
+     * Constant time (No lookup).
      *
      * \return iterator to the last element.
      */
-    iterator end() {
-        iterator it(*this, _map.end());
-        return it;
-    }
+    iterator end() { return iterator(*this, _map.end(), 0); }
 
     /**
      * \copydoc LWWMap::end
      */
-    const_iterator end() const noexcept {
-        const_iterator it(*this, _map.end());
-        return it;
-    }
+    const_iterator end() const noexcept { return const_iterator(*this, _map.end(), 0); }
 
     /**
      * \copydoc LWWMap::begin
@@ -502,23 +811,29 @@ class LWWMap {
     /**
      * \copydoc LWWMap::end
      */
-    const_iterator cend() const noexcept {
-        const_iterator it(*this, _map.end());
-        return it;
-    }
+    const_iterator cend() const noexcept { return this->end(); }
 
     /**
      * Returns a crdt_iterator to the beginning.
      *
+     * Elements older than the last clear are settled first. (May throw if
+     * the change index is enabled, see track_changes)
+     *
      * \see LWWMap::crdt_iterator
      * \return CRDT iterator to the first element.
      */
-    crdt_iterator crdt_begin() noexcept { return _map.begin(); }
+    crdt_iterator crdt_begin() {
+        this->settleAll();
+        return _map.begin();
+    }
 
     /**
-     * \copydoc LWWMap::crdt_begin
+     * Returns a constant crdt_iterator to the beginning.
+     *
+     * \see LWWMap::const_crdt_iterator
+     * \return Constant CRDT iterator to the first element.
      */
-    const_crdt_iterator crdt_begin() const noexcept { return _map.cbegin(); }
+    const_crdt_iterator crdt_begin() const noexcept { return const_crdt_iterator(_map.begin(), _lastClearTime); }
 
     /**
      * Returns a crdt_iterator to the end.
@@ -531,7 +846,7 @@ class LWWMap {
     /**
      * \copydoc LWWMap::crdt_end
      */
-    const_crdt_iterator crdt_end() const noexcept { return _map.cend(); }
+    const_crdt_iterator crdt_end() const noexcept { return const_crdt_iterator(_map.end(), _lastClearTime); }
 
     // -------------------------------------------------------------------------
     // Operators overload
@@ -592,11 +907,11 @@ class LWWMap {
      * Display the internal content.
      * This is mainly for debug print purpose.
      */
-    friend std::ostream& operator<<(std::ostream& out, const LWWMap<Key, T, U>& o) {
+    friend std::ostream& operator<<(std::ostream& out, const LWWMap& o) {
         out << "CmRDT::LWWMap = ";
-        for (const auto& elt : o._map) {
-            out << "\n  (" << elt.first << ", " << elt.second.value() << ", " << elt.second.timestamp();
-            if (elt.second.isRemoved()) {
+        for (auto elt = o.crdt_begin(); elt != o.crdt_end(); ++elt) {
+            out << "\n  (" << elt->first << ", " << elt->second.value() << ", " << elt->second.timestamp();
+            if (elt->second.isRemoved()) {
                 out << ", x)";
             } else {
                 out << ", o)";
@@ -604,6 +919,367 @@ class LWWMap {
         }
         return out;
     }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    // DevNote: see LWWSet::firstAlive
+    crdt_iterator firstAlive() {
+        if (_sizeAlive == 0) {
+            return _map.end();
+        }
+        return this->skipRemoved(marks::first(_map), _map.end());
+    }
+
+    map_const_iterator firstAlive() const {
+        if (_sizeAlive == 0) {
+            return _map.end();
+        }
+        return this->skipRemoved(marks::first(_map), _map.end());
+    }
+
+    crdt_iterator nextAlive(crdt_iterator it) { return this->skipRemoved(marks::next(_map, it), _map.end()); }
+
+    map_const_iterator nextAlive(map_const_iterator it) const {
+        return this->skipRemoved(marks::next(_map, it), _map.end());
+    }
+
+    template <typename It>
+    It skipRemoved(It it, It end) const {
+        if (!marks::enabled) {
+            while (it != end && !this->isAlive(it->second)) {
+                ++it;
+            }
+        }
+        return it;
+    }
+
+    // DevNote: see LWWSet::isAlive (Lazy clear)
+    bool isAlive(const Element& elt) const { return !elt._isRemoved && !(_lastClearTime > elt._timestamp); }
+
+    const U& settledTimestamp(const Element& elt) const {
+        return (_lastClearTime > elt._timestamp) ? _lastClearTime : elt._timestamp;
+    }
+
+    void settle(Element& elt) {
+        if (_lastClearTime > elt._timestamp) {
+            _changes.update(elt._timestamp, _lastClearTime, elt.key());
+            elt._timestamp = _lastClearTime;
+            elt._isRemoved = true;
+        }
+    }
+
+    void settleAll() {
+        if (_isClearPending) {
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                this->settle(elt_it->second);
+            }
+            _isClearPending = false;
+        }
+    }
+
+    // Inserts key if not there yet. Nothing is built otherwise (No copy)
+    // Element value is built from args.
+    template <typename K, typename... Args>
+    std::pair<crdt_iterator, bool> insertKey(K&& key, const U& stamp, bool isRemoved, Args&&... args) {
+        auto coco_it = emplace::try_emplace_keyed(_map, std::forward<K>(key), std::forward<Args>(args)...);
+        if (coco_it.second) {
+            Element& elt = coco_it.first->second;
+            elt._timestamp = stamp;
+            elt._isRemoved = isRemoved;
+        }
+        return coco_it;
+    }
+
+    // DevNote: body of add once the key is inserted (See apply_batch)
+    bool addElement(crdt_iterator elt_it, bool isKeyAdded, const U& stamp) {
+        Element& elt = elt_it->second;
+        const Key& key = elt_it->first;
+        const U& keyStamp = elt.timestamp();
+        this->updateMaxStamp(stamp);
+
+        if (!isKeyAdded) {
+            this->settle(elt);
+
+            if (stamp > keyStamp) {
+                _changes.update(keyStamp, stamp, key);
+                elt._timestamp = stamp;
+
+                if (elt._isRemoved == true) {
+                    elt._isRemoved = false;
+                    marks::mark(_map, elt_it, true);
+                    ++_sizeAlive;
+                    return true;
+                }
+            }
+            return false;
+        } else {
+            if (stamp > _lastClearTime) {
+                marks::mark(_map, elt_it, true);
+                ++_sizeAlive;
+            } else {
+                // Older than last clear
+                if (_lastClearTime > stamp) {
+                    elt._timestamp = _lastClearTime;
+                }
+                elt._isRemoved = true;
+            }
+            _changes.insert(elt._timestamp, key);
+            return !elt._isRemoved;
+        }
+    }
+
+    // Body of set. assign(T&, V&&) updates an existing element value.
+    template <typename K, typename V, typename Assign>
+    bool setElement(K&& key, V&& value, const U& stamp, Assign assign) {
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+
+        auto coco_it = this->insertKey(std::forward<K>(key), stamp, false, std::forward<V>(value));
+        Element& elt = coco_it.first->second;
+        bool isAssigned = coco_it.second;
+        if (!coco_it.second && stamp > elt._valueTime) {
+            assign(elt.value(), std::forward<V>(value));
+            isAssigned = true;
+        }
+        if (isAssigned) {
+            elt._valueTime = stamp;
+        }
+        this->addElement(coco_it.first, coco_it.second, stamp);
+        return isAssigned;
+    }
+
+    struct AssignValue {
+        template <typename V>
+        void operator()(T& dst, V&& value) const {
+            dst = std::forward<V>(value);
+        }
+    };
+
+    // DevNote: body of remove once the key is inserted (See apply_batch)
+    bool removeElement(crdt_iterator elt_it, bool isKeyAdded, const U& stamp) {
+        Element& elt = elt_it->second;
+        const Key& key = elt_it->first;
+        const U& keyStamp = elt.timestamp();
+        this->updateMaxStamp(stamp);
+        this->settle(elt);  // New key older than last clear is removed at clear time
+        if (isKeyAdded) {
+            _changes.insert(elt._timestamp, key);
+        }
+
+        if (!isKeyAdded) {
+            if (stamp > keyStamp) {
+                _changes.update(keyStamp, stamp, key);
+                elt._timestamp = stamp;
+
+                if (elt._isRemoved == false) {
+                    elt._isRemoved = true;
+                    marks::mark(_map, elt_it, false);
+                    --_sizeAlive;
+                    return true;
+                }
+            }
+        }
+        return false;  // DevNote: see LWWSet::remove
+    }
+
+    // Applies ops (Add / remove only) and appends their results
+    void applyBatchOperations(std::vector<const batch_operation*>& ops, std::vector<bool>& results) {
+        if (ops.empty()) {
+            return;
+        }
+        const std::size_t offset = results.size();
+        results.resize(offset + ops.size(), false);
+
+        std::vector<std::size_t> next;
+        const std::vector<std::size_t> firsts = detail::group_by_key(ops, next);
+
+        for (std::size_t i : firsts) {
+            // Operations older than the compact floor do nothing (See compact)
+            while (i < ops.size() && ops[i]->stamp < _compactTime) {
+                i = next[i];
+            }
+            if (i == ops.size()) {
+                continue;
+            }
+
+            // Key is inserted as its first operation would do
+            const batch_operation& op = *ops[i];
+            auto coco_it = this->insertKey(op.key, op.stamp, op.kind == batch_operation::REMOVE);
+
+            bool isKeyAdded = coco_it.second;
+            for (; i < ops.size(); i = next[i]) {
+                if (ops[i]->stamp < _compactTime) {
+                    continue;
+                }
+                if (ops[i]->kind == batch_operation::ADD) {
+                    results[offset + i] = this->addElement(coco_it.first, isKeyAdded, ops[i]->stamp);
+                } else {
+                    results[offset + i] = this->removeElement(coco_it.first, isKeyAdded, ops[i]->stamp);
+                }
+                isKeyAdded = false;
+            }
+        }
+        ops.clear();
+    }
+
+    void updateMaxStamp(const U& stamp) {
+        if (stamp > _maxStamp) {
+            _maxStamp = stamp;
+        }
+    }
+
+    // Default value join of merge
+    struct TakeNewerValue {
+        void operator()(T& value, const T& otherValue, bool isOtherNewer) const {
+            if (isOtherNewer) {
+                value = otherValue;
+            }
+        }
+    };
+
+    // Per thread results of merge (See LWWSet::MergeChunk)
+    struct MergeChunk {
+        std::vector<map_const_iterator> missing;
+        std::vector<std::pair<crdt_iterator, bool>> aliveChanges;
+        std::vector<std::pair<U, crdt_iterator>> newerStamps;  // Only if tracking changes
+        size_type nbAdded = 0;
+        size_type nbRemoved = 0;
+        U maxStamp = {0};
+    };
+
+    template <typename MergeValue>
+    void mergeWith(const LWWMap& other, MergeValue mergeValue, unsigned int nbThreads) {
+        this->mergeWith(other, mergeValue, nbThreads, [](const T&) { return true; });
+    }
+
+    // DevNote: see LWWSet::mergeWith. A missing key is skipped only if
+    // isPurged(otherValue) too (Same as the predicate of compact).
+    template <typename MergeValue, typename Pred>
+    void mergeWith(const LWWMap& other, MergeValue mergeValue, unsigned int nbThreads, Pred isPurged) {
+        if (&other == this) {
+            return;
+        }
+        this->mergeClearTime(other);
+
+        std::vector<map_const_iterator> entries;  // Not settled elts are joined as removed (See LWWSet)
+        entries.reserve(other.crdt_size());
+        for (auto it = other._map.begin(); it != other._map.end(); ++it) {
+            entries.push_back(it);
+        }
+
+        if (StorageSharedNodes<map_type>::enabled) {
+            nbThreads = 1;  // Lookups may copy shared nodes (Not thread safe)
+        }
+        nbThreads = parallel_threads_count(nbThreads, entries.size());
+        std::vector<MergeChunk> chunks(nbThreads);
+        parallel_for_chunks(entries.size(), nbThreads, [&](std::size_t begin, std::size_t end, unsigned int k) {
+            MergeChunk& chunk = chunks[k];
+            for (std::size_t i = begin; i < end; ++i) {
+                const auto elt_it = _map.find(entries[i]->first);
+                if (elt_it == _map.end()) {
+                    const Element& otherElt = entries[i]->second;
+                    if (!(otherElt._timestamp < _compactTime && isPurged(otherElt.value()))) {
+                        chunk.missing.push_back(entries[i]);
+                    }
+                } else {
+                    this->mergeExisting(elt_it, entries[i]->second, chunk, mergeValue);
+                }
+            }
+        });
+
+        for (const MergeChunk& chunk : chunks) {
+            _sizeAlive = _sizeAlive + chunk.nbAdded - chunk.nbRemoved;
+            this->updateMaxStamp(chunk.maxStamp);
+            for (const auto& change : chunk.aliveChanges) {
+                marks::mark(_map, change.first, change.second);
+            }
+            for (const auto& change : chunk.newerStamps) {
+                _changes.update(change.first, change.second->second._timestamp, change.second->first);
+            }
+        }
+        for (const MergeChunk& chunk : chunks) {
+            for (const auto& other_it : chunk.missing) {
+                Element& elt = this->mergeElement(other_it->first, other_it->second);
+                mergeValue(elt.value(), other_it->second.value(), true);
+            }
+        }
+
+        if (other._compactTime > _compactTime) {
+            _compactTime = other._compactTime;  // After the join (See LWWSet::mergeWith)
+        }
+    }
+
+    void indexChanges() {
+        if (_changes.enabled()) {
+            this->settleAll();
+            _changes.clear();
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                _changes.insert(elt_it->second._timestamp, elt_it->first);
+            }
+        }
+    }
+
+    void mergeClearTime(const LWWMap& other) {
+        if (other._lastClearTime > _lastClearTime) {
+            this->clear(other._lastClearTime);
+        }
+    }
+
+    // DevNote: not an operation, the compact floor doesn't apply (See addElement)
+    Element& mergeElement(const Key& key, const Element& otherElt) {
+        auto coco_it = this->insertKey(key, otherElt._timestamp, otherElt._isRemoved);
+        if (otherElt._isRemoved) {
+            this->removeElement(coco_it.first, coco_it.second, otherElt._timestamp);
+        } else {
+            this->addElement(coco_it.first, coco_it.second, otherElt._timestamp);
+        }
+        Element& elt = coco_it.first->second;  // Not moved: add and remove only mark
+        elt._valueTime = otherElt._valueTime;
+        return elt;
+    }
+
+    void copyElement(const Key& key, const Element& otherElt) {
+        this->mergeElement(key, otherElt).value() = otherElt.value();
+    }
+
+    template <typename MergeValue>
+    void mergeExisting(crdt_iterator elt_it, const Element& otherElt, MergeChunk& chunk, MergeValue& mergeValue) {
+        Element& elt = elt_it->second;
+        const U indexedStamp = elt._timestamp;  // Index is updated after (See LWWSet::mergeExisting)
+        if (_lastClearTime > elt._timestamp) {
+            elt._timestamp = _lastClearTime;  // Same as settle
+            elt._isRemoved = true;
+        }
+        if (otherElt._timestamp > chunk.maxStamp) {
+            chunk.maxStamp = otherElt._timestamp;
+        }
+        const bool isOtherNewer = otherElt._timestamp > elt._timestamp;
+        const bool isOtherValueNewer = (otherElt._valueTime > elt._valueTime) ||
+                                       (!(elt._valueTime > otherElt._valueTime) && isOtherNewer);
+        if (otherElt._valueTime > elt._valueTime) {
+            elt._valueTime = otherElt._valueTime;
+        }
+        if (isOtherNewer) {
+            elt._timestamp = otherElt._timestamp;
+            if (elt._isRemoved != otherElt._isRemoved) {
+                elt._isRemoved = otherElt._isRemoved;
+                chunk.aliveChanges.push_back(std::make_pair(elt_it, !elt._isRemoved));
+                if (elt._isRemoved) {
+                    ++chunk.nbRemoved;
+                } else {
+                    ++chunk.nbAdded;
+                }
+            }
+        }
+        if (_changes.enabled() && indexedStamp < elt._timestamp) {
+            chunk.newerStamps.push_back(std::make_pair(indexedStamp, elt_it));
+        }
+        mergeValue(elt.value(), otherElt.value(), isOtherValueNewer);
+    }
 };
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -626,21 +1302,26 @@ class LWWMap {
  * (I put some resources in the README)
  *
  *
- * \tparam Key  Type of key.
- * \tparam T    Type of element.
- * \tparam U    Type of timestamps.
+ * \tparam Key      Type of key.
+ * \tparam T        Type of element.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
  */
-template <typename Key, typename T, typename U>
-class LWWMap<Key, T, U>::Element {
+template <typename Key, typename T, typename U, typename Storage>
+class LWWMap<Key, T, U, Storage>::Element {
    private:
     friend LWWMap;
+    template <typename, typename, typename, typename, typename>
+    friend class LWWGraph;  // Copies the content timestamp (See LWWGraph::copyVertex)
 
     // I did this for the iterator* method
     // This is possibly not the best solution
     // Actual element value is in _internalValue.second (Burk! Ugly!)
+    // With FlatHashStorage, this is the only copy of the key (keyed_map).
     std::pair<const Key, T> _internalValue;
 
     U _timestamp = {0};
+    U _valueTime = {0};  // Last set of the value (See LWWMap::set)
     bool _isRemoved = false;
 
     // -------------------------------------------------------------------------
@@ -648,17 +1329,37 @@ class LWWMap<Key, T, U>::Element {
     // -------------------------------------------------------------------------
 
    public:
-    Element(const Key& key) : _internalValue(std::make_pair(key, T{})) {
+    Element(const Key& key) : _internalValue(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()) {
         // TODO: T must have default constructor.
         // This may be too restrictive for end-user.
         // I should think about another way.
     }
 
+    Element(Key&& key)
+        : _internalValue(std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::tuple<>()) {}
+
+    template <typename V>
+    Element(const Key& key, V&& value)
+        : _internalValue(std::piecewise_construct, std::forward_as_tuple(key),
+                         std::forward_as_tuple(std::forward<V>(value))) {}
+
+    template <typename V>
+    Element(Key&& key, V&& value)
+        : _internalValue(std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                         std::forward_as_tuple(std::forward<V>(value))) {}
+
     // -------------------------------------------------------------------------
     // Methods
     // -------------------------------------------------------------------------
 
    public:
+    /**
+     * Returns the key of this element.
+     *
+     * \return Constant reference to the key.
+     */
+    const Key& key() const { return _internalValue.first; }
+
     /**
      * Returns a reference to the Key's value.
      *
@@ -680,6 +1381,13 @@ class LWWMap<Key, T, U>::Element {
      */
     const U& timestamp() const { return _timestamp; }
 
+    /**
+     * Returns the timestamp of the last set of the value.
+     *
+     * \return Value's timestamp ({0} if never set).
+     */
+    const U& valueTimestamp() const { return _valueTime; }
+
     /**
      * Check whether this key is marked as removed.
      *
@@ -704,8 +1412,122 @@ class LWWMap<Key, T, U>::Element {
         // See the crdt_equal 'bug' note. But anyway, it is maybe better
         // like this.
         return (rhs._internalValue == lhs._internalValue) && (rhs._isRemoved == lhs._isRemoved) &&
-               (rhs._timestamp == lhs._timestamp);
+               (rhs._timestamp == lhs._timestamp) && (rhs._valueTime == lhs._valueTime);
+    }
+};
+
+/**
+ * \brief
+ * Element of a key, as returned by const crdt queries.
+ *
+ * Shows an element older than the last clear as removed at the clear
+ * timestamp, though it is only updated by the next write (Lazy clear).
+ * \see LWWSet::MetadataView
+ *
+ *
+ * \tparam Key      Type of key.
+ * \tparam T        Type of element.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
+ */
+template <typename Key, typename T, typename U, typename Storage>
+class LWWMap<Key, T, U, Storage>::ElementView {
+   private:
+    friend LWWMap;
+
+    const Element* _elt;
+    const U* _clearTime;  // Last clear of the map
+
+    ElementView(const Element& elt, const U& clearTime) : _elt(&elt), _clearTime(&clearTime) {}
+
+    bool isCleared() const { return *_clearTime > _elt->timestamp(); }
+
+   public:
+    /**
+     * \copydoc Element::key
+     */
+    const Key& key() const { return _elt->key(); }
+
+    /**
+     * \copydoc Element::value
+     */
+    const T& value() const { return _elt->value(); }
+
+    /**
+     * \copydoc Element::timestamp
+     */
+    const U& timestamp() const { return this->isCleared() ? *_clearTime : _elt->timestamp(); }
+
+    /**
+     * \copydoc Element::valueTimestamp
+     */
+    const U& valueTimestamp() const { return _elt->valueTimestamp(); }
+
+    /**
+     * \copydoc Element::isRemoved
+     */
+    bool isRemoved() const { return _elt->isRemoved() || this->isCleared(); }
+
+   public:
+    friend bool operator==(const ElementView& rhs, const ElementView& lhs) {
+        return (rhs.key() == lhs.key()) && (rhs.value() == lhs.value()) && (rhs.isRemoved() == lhs.isRemoved()) &&
+               (rhs.timestamp() == lhs.timestamp()) && (rhs.valueTimestamp() == lhs.valueTimestamp());
+    }
+
+    friend bool operator!=(const ElementView& rhs, const ElementView& lhs) { return !(rhs == lhs); }
+};
+
+/**
+ * \brief
+ * Constant CRDT iterator for LWWMap container.
+ *
+ * Iterate over all keys, including the ones marked as removed.
+ * 'it->first' is the key, 'it->second' its element (See ElementView).
+ * Forward iterator, references are valid until it moves or is destroyed.
+ * \see LWWSet::const_crdt_iterator
+ *
+ *
+ * \tparam Key      Type of key.
+ * \tparam T        Type of element.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
+ */
+template <typename Key, typename T, typename U, typename Storage>
+class LWWMap<Key, T, U, Storage>::const_crdt_iterator
+    : public std::iterator<std::forward_iterator_tag, std::pair<const Key&, ElementView>, std::ptrdiff_t,
+                           const std::pair<const Key&, ElementView>*, const std::pair<const Key&, ElementView>&> {
+   private:
+    friend LWWMap;
+
+    typedef std::pair<const Key&, ElementView> entry_type;
+
+    map_const_iterator _it;
+    const U* _clearTime;
+    mutable typename std::aligned_storage<sizeof(entry_type), alignof(entry_type)>::type _entry;  // See LWWSet
+
+    const_crdt_iterator(map_const_iterator it, const U& clearTime) : _it(it), _clearTime(&clearTime) {}
+
+   public:
+    const_crdt_iterator& operator++() {
+        ++_it;
+        return *this;
+    }
+
+    const_crdt_iterator operator++(int) {
+        const_crdt_iterator it = *this;
+        ++_it;
+        return it;
+    }
+
+    bool operator==(const const_crdt_iterator& other) const { return _it == other._it; }
+
+    bool operator!=(const const_crdt_iterator& other) const { return !(*this == other); }
+
+    const entry_type& operator*() const {
+        return *::new (&_entry) entry_type(_it->first, ElementView(_it->second, *_clearTime));
     }
+
+    const entry_type* operator->() const { return &**this; }
 };
 
 /**
@@ -713,40 +1535,40 @@ class LWWMap<Key, T, U>::Element {
  * Iterator for LWWMap container.
  *
  * Iterate over all keys-elements that are in set and are NOT marked as removed.
+ * Stops right after the last alive element (See LWWSet::const_iterator).
  *
  *
- * \tparam Key  Type of key.
- * \tparam T    Type of element.
- * \tparam U    Type of timestamps.
+ * \tparam Key      Type of key.
+ * \tparam T        Type of element.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
  */
-template <typename Key, typename T, typename U>
-class LWWMap<Key, T, U>::iterator : public std::iterator<std::input_iterator_tag, value_type> {
+template <typename Key, typename T, typename U, typename Storage>
+class LWWMap<Key, T, U, Storage>::iterator : public std::iterator<std::input_iterator_tag, value_type> {
    private:
+    friend LWWMap;
+
     LWWMap& _data;
     crdt_iterator _it;
+    size_type _remaining;  // Upper bound of alive elts from _it (0 for end)
 
-   public:
-    explicit iterator(LWWMap& map) : _data(map) {
-        _it = _data._map.begin();
+    iterator(LWWMap& map, crdt_iterator it, size_type remaining) : _data(map), _it(it), _remaining(remaining) {}
 
-        // If first element is already removed, skip it
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
-            ++_it;
-        }
-    }
+   public:
+    explicit iterator(LWWMap& map) : _data(map), _it(map.firstAlive()), _remaining(map._sizeAlive) {}
 
-    explicit iterator(LWWMap& map, crdt_iterator start) : _data(map), _it(start) {
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
+    explicit iterator(LWWMap& map, crdt_iterator start) : _data(map), _it(start), _remaining(map._sizeAlive) {
+        while (_it != _data._map.end() && !_data.isAlive(_it->second)) {
             ++_it;
         }
     }
 
    public:
     iterator& operator++() {
-        ++_it;
-
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
-            ++_it;
+        if (--_remaining == 0) {
+            _it = _data._map.end();
+        } else {
+            _it = _data.nextAlive(_it);
         }
         return *this;
     }
@@ -765,40 +1587,42 @@ class LWWMap<Key, T, U>::iterator : public std::iterator<std::input_iterator_tag
  * Constant iterator for LWWMap container.
  *
  * Iterate over all keys-elements that are in set and are NOT marked as removed.
+ * Stops right after the last alive element (See LWWSet::const_iterator).
  *
  *
- * \tparam Key  Type of key.
- * \tparam T    Type of element.
- * \tparam U    Type of timestamps.
+ * \tparam Key      Type of key.
+ * \tparam T        Type of element.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
  */
-template <typename Key, typename T, typename U>
-class LWWMap<Key, T, U>::const_iterator : public std::iterator<std::input_iterator_tag, value_type> {
+template <typename Key, typename T, typename U, typename Storage>
+class LWWMap<Key, T, U, Storage>::const_iterator : public std::iterator<std::input_iterator_tag, value_type> {
    private:
+    friend LWWMap;
+
     const LWWMap& _data;
-    const_crdt_iterator _it;
+    map_const_iterator _it;
+    size_type _remaining;  // Upper bound of alive elts from _it (0 for end)
 
-   public:
-    explicit const_iterator(const LWWMap& map) : _data(map) {
-        _it = _data._map.begin();
+    const_iterator(const LWWMap& map, map_const_iterator it, size_type remaining)
+        : _data(map), _it(it), _remaining(remaining) {}
 
-        // If first element is already removed, skip it
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
-            ++_it;
-        }
-    }
+   public:
+    explicit const_iterator(const LWWMap& map) : _data(map), _it(map.firstAlive()), _remaining(map._sizeAlive) {}
 
-    explicit const_iterator(const LWWMap& map, const_crdt_iterator start) : _data(map), _it(start) {
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
+    explicit const_iterator(const LWWMap& map, map_const_iterator start)
+        : _data(map), _it(start), _remaining(map._sizeAlive) {
+        while (_it != _data._map.end() && !_data.isAlive(_it->second)) {
             ++_it;
         }
     }
 
    public:
     const_iterator& operator++() {
-        ++_it;
-
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
-            ++_it;
+        if (--_remaining == 0) {
+            _it = _data._map.end();
+        } else {
+            _it = _data.nextAlive(_it);
         }
         return *this;
     }
@@ -1,18 +1,102 @@
 #pragma once
 
+#include <cstddef>      // std::ptrdiff_t
+#include <new>          // Placement new
 #include <ostream>
-#include <unordered_map>
-#include <utility>  // std::pair
+#include <stdexcept>    // std::out_of_range
+#include <type_traits>  // std::is_void, std::aligned_storage
+#include <utility>      // std::pair
+#include <vector>
+
+#include "../storage/StoragePolicy.h"
+#include "../utils/ChangeIndex.h"
+#include "../utils/Parallel.h"
+#include "LWWBatchOperation.h"
 
 namespace collabserver {
 
+template <typename Key, typename T, typename U, typename EdgeStorage, typename EdgeValue>
+class LWWGraph;
+
+/**
+ * \brief
+ * Payload of a key in LWWSet, stored inline with its CRDT metadata.
+ *
+ * The payload is a LWW register with its own timestamp: the assign with
+ * the higher timestamp wins, whatever the add / remove of the key.
+ * Empty if Payload is void (Default): no space is used.
+ *
+ * \tparam Payload  Type of payload (Must have a default constructor).
+ * \tparam U        Type of timestamps.
+ */
+template <typename Payload, typename U>
+class LWWSetPayload {
+   public:
+    typedef const Payload& const_reference;
+
+   protected:
+    Payload _payload = Payload();
+    U _payloadTime = {0};  // Timestamp of the last assign
+
+   public:
+    /**
+     * Returns the payload associated with the key.
+     *
+     * \return Key's payload (Default value if never assigned).
+     */
+    const Payload& payload() const { return _payload; }
+
+    /**
+     * Returns the timestamp of the last assign of the payload.
+     *
+     * \return Payload's timestamp ({0} if never assigned).
+     */
+    const U& payloadTimestamp() const { return _payloadTime; }
+
+   protected:
+    template <typename V>
+    bool assignPayload(V&& payload, const U& stamp) {
+        if (stamp > _payloadTime) {
+            _payload = std::forward<V>(payload);
+            _payloadTime = stamp;
+            return true;
+        }
+        return false;
+    }
+
+    void mergePayload(const LWWSetPayload& other) {
+        if (other._payloadTime > _payloadTime) {
+            _payload = other._payload;
+            _payloadTime = other._payloadTime;
+        }
+    }
+
+    bool isSamePayload(const LWWSetPayload& other) const { return _payload == other._payload; }
+
+    bool isSamePayloadState(const LWWSetPayload& other) const {
+        return this->isSamePayload(other) && _payloadTime == other._payloadTime;
+    }
+};
+
+template <typename U>
+class LWWSetPayload<void, U> {
+   public:
+    typedef void const_reference;
+
+   protected:
+    void mergePayload(const LWWSetPayload&) {}
+    bool isSamePayload(const LWWSetPayload&) const { return true; }
+    bool isSamePayloadState(const LWWSetPayload&) const { return true; }
+};
+
 /**
  * \brief
  * Last-Writer-Wins Set.
  * CmRDT (Operation-based)
  *
  * Associative container that contains a set of unique keys.
- * Internally uses std::unordered_map to store the key and its CRDT metadata.
+ * Internally uses an associative container (Selected by the Storage policy)
+ * to store the key and its CRDT metadata.
  * As the end user, you see this container as a std::unordered_set (See iterator
  * for instance). You may request the actual internal data using crdt_iterator.
  * Check out std::unordered_set documentation for further informations.
@@ -25,7 +109,8 @@ namespace collabserver {
  * \par
  * Any added key is never removed but only marked as deleted instead.
  * For that reason, this CRDT container may not fit all systems
- * due to the used memory space.
+ * due to the used memory space. Old deleted keys may be purged with
+ * compact once all replicates have seen them.
  *
  * \par
  * All operations on this container are commutative! You may receive a remove
@@ -56,6 +141,12 @@ namespace collabserver {
  * For any distinct operations (ex: add(t1) / remove(t2)), t1==t2 must return
  * false. (See quote and implementation for further informations).
  *
+ * \note
+ * clear is applied lazily: elements are only updated by the next write.
+ * Until then, crdt queries see an element older than the last clear as
+ * removed at the clear timestamp (See MetadataView). Const methods never
+ * write the container.
+ *
  * \warning
  * U timestamp must accept "U t = {0}".
  * This must set timestamp with the minimal value.
@@ -64,22 +155,49 @@ namespace collabserver {
  * \see http://en.cppreference.com/w/cpp/container/unordered_map
  *
  *
- * \tparam Key  Type of set elements.
- * \tparam U    Type of timestamps (Must implements operators > and <).
+ * \see StoragePolicy.h
+ *
+ * \par Payload
+ * Each key may carry a payload (ex: weight or label of a graph edge),
+ * stored inline with its metadata. The payload has its own timestamp
+ * (See set): it is not changed by add / remove of the key. A removed key
+ * keeps its payload, back if the key is added again.
+ *
+ *
+ * \tparam Key      Type of set elements.
+ * \tparam U        Type of timestamps (Must implements operators > and <).
+ * \tparam Storage  Internal storage policy (See HashMapStorage).
+ * \tparam Payload  Type of payload of each key (void for none).
  */
-template <typename Key, typename U>
+template <typename Key, typename U, typename Storage = HashMapStorage, typename Payload = void>
 class LWWSet {
    public:
     class const_iterator;
+    class const_crdt_iterator;
     class Metadata;
+    class MetadataView;
 
-    typedef typename std::unordered_map<Key, Metadata>::size_type size_type;
-    typedef typename std::unordered_map<Key, Metadata>::const_iterator const_crdt_iterator;
+    typedef typename Storage::template map<Key, Metadata> map_type;
+    typedef typename map_type::size_type size_type;
+    typedef LWWBatchOperation<Key, U> batch_operation;
+    typedef Payload payload_type;
+    typedef typename LWWSetPayload<Payload, U>::const_reference const_payload_reference;
 
    private:
-    std::unordered_map<Key, Metadata> _map;
-    size_type _sizeAlive = 0;  // Nb of alive elts (Not marked as removed)
-    U _lastClearTime = {0};    // Last time a clear has been applied
+    template <typename, typename, typename, typename, typename>
+    friend class LWWGraph;  // Edges updated in place (See LWWGraph::add_edge)
+
+    typedef StorageMarks<map_type> marks;  // Alive elts are marked
+    typedef StorageEmplace<map_type> emplace;
+    typedef typename map_type::const_iterator map_const_iterator;
+
+    map_type _map;
+    size_type _sizeAlive = 0;      // Nb of alive elts (Not marked as removed)
+    U _lastClearTime = {0};        // Last time a clear has been applied
+    U _compactTime = {0};          // Watermark of the last compact
+    U _maxStamp = {0};             // Highest timestamp ever applied
+    ChangeIndex<U, Key> _changes;  // Optional (See track_changes)
+    bool _isClearPending = false;  // Some elts not updated by last clear (See settle)
 
     // -------------------------------------------------------------------------
     // Capacity methods
@@ -145,10 +263,8 @@ class LWWSet {
      */
     const_iterator find(const Key& key) const {
         const auto elt_it = _map.find(key);
-        if (elt_it != _map.end() && !elt_it->second.isRemoved()) {
-            const_iterator it(*this);
-            it._it = elt_it;
-            return it;
+        if (elt_it != _map.end() && this->isAlive(elt_it->second)) {
+            return const_iterator(*this, elt_it, _sizeAlive);
         } else {
             return this->end();
         }
@@ -170,7 +286,7 @@ class LWWSet {
      * \param key The key to query.
      * \return Iterator CRDT to the key or crdt_end() if not found.
      */
-    const_crdt_iterator crdt_find(const Key& key) const { return _map.find(key); }
+    const_crdt_iterator crdt_find(const Key& key) const { return const_crdt_iterator(_map.find(key), _lastClearTime); }
 
     /**
      * Count the number of element with this key.
@@ -179,7 +295,10 @@ class LWWSet {
      * \param key Key value of the element to count.
      * \return Number of elements with this key, either 0 or 1.
      */
-    size_type count(const Key& key) const { return (this->find(key) != this->end()) ? 1 : 0; }
+    size_type count(const Key& key) const {
+        const auto elt_it = _map.find(key);
+        return (elt_it != _map.end() && this->isAlive(elt_it->second)) ? 1 : 0;
+    }
 
     /**
      * Count the number of element with this key.
@@ -190,6 +309,38 @@ class LWWSet {
      */
     size_type crdt_count(const Key& key) const { return _map.count(key); }
 
+    /**
+     * Returns the payload of a key. If no such key exists, or if it is
+     * marked as removed, an exception of type std::out_of_range is thrown.
+     * (Only if Payload is not void).
+     *
+     * \param key Key value of the element to search for.
+     * \return Reference to the payload of the key.
+     */
+    const_payload_reference at(const Key& key) const {
+        const auto elt_it = _map.find(key);
+        if (elt_it == _map.end() || !this->isAlive(elt_it->second)) {
+            throw std::out_of_range("No element for this key");
+        }
+        return elt_it->second.payload();
+    }
+
+    /**
+     * Returns the payload of a key. If no such key exists, an exception of
+     * type std::out_of_range is thrown.
+     * Also lookup for 'removed' element (Internal CRDT data).
+     *
+     * \param key Key value of the element to search for.
+     * \return Reference to the payload of the key.
+     */
+    const_payload_reference crdt_at(const Key& key) const {
+        const auto elt_it = _map.find(key);
+        if (elt_it == _map.end()) {
+            throw std::out_of_range("No element for this key");
+        }
+        return elt_it->second.payload();
+    }
+
     // -------------------------------------------------------------------------
     // Modifiers methods
     // -------------------------------------------------------------------------
@@ -211,22 +362,38 @@ class LWWSet {
      * From a user point of view, if you display a UI after a clear, you
      * should iterate over the set anyway.
      *
+     * \par Complexity
+     * Constant if stamp is higher than all applied timestamps (Usual case).
+     * Elements are then only updated by the next write (See settle).
+     * Otherwise, linear in crdt_size.
+     *
      * \param stamp Timestamp of this operation.
      * \return True if clear actually applied, otherwise, return false.
      */
-    bool clear(const U& stamp) noexcept {
-        if (stamp > _lastClearTime) {
+    bool clear(const U& stamp) {
+        if (stamp > _maxStamp) {
+            // Lazy clear: all elts are older than stamp, so all are removed
+            _lastClearTime = stamp;
+            _maxStamp = stamp;
+            _sizeAlive = 0;
+            _isClearPending = !_map.empty();
+            marks::clear(_map);
+            return true;
+        } else if (stamp > _lastClearTime) {
+            this->settleAll();
             _lastClearTime = stamp;
 
             // DevNote: Same code as 'remove' but without the insert attempt
-            for (auto& elt_it : _map) {
-                Metadata& elt = elt_it.second;
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                Metadata& elt = elt_it->second;
 
                 if (stamp > elt._timestamp) {
+                    _changes.update(elt._timestamp, stamp, elt_it->first);
                     elt._timestamp = stamp;
 
                     if (elt._isRemoved == false) {
                         elt._isRemoved = true;
+                        marks::mark(_map, elt_it, false);
                         --_sizeAlive;
                     }
                 }
@@ -259,36 +426,54 @@ class LWWSet {
      * \return True if key added, otherwise, return false.
      */
     bool add(const Key& key, const U& stamp) {
-        Metadata newElt;  // DevNote: Content is not set here
-        newElt._timestamp = stamp;
-        newElt._isRemoved = false;
-
-        auto coco_it = _map.insert(std::make_pair(key, newElt));
-        bool isKeyAdded = coco_it.second;
-        Metadata& elt = coco_it.first->second;
-        const U& keyStamp = elt.timestamp();
-
-        if (!isKeyAdded) {
-            if (stamp > keyStamp) {
-                elt._timestamp = stamp;
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        auto coco_it = this->insertKey(key, stamp, false);
+        return this->addElement(coco_it.first, coco_it.second, stamp);
+    }
 
-                if (elt._isRemoved == true) {
-                    elt._isRemoved = false;
-                    ++_sizeAlive;
-                    return true;
-                }
-            }
+    /**
+     * \copydoc LWWSet::add(const Key&, const U&)
+     *
+     * \note
+     * The key is moved only if actually inserted.
+     */
+    bool add(Key&& key, const U& stamp) {
+        if (stamp < _compactTime) {
             return false;
-        } else {
-            if (stamp > _lastClearTime) {
-                ++_sizeAlive;
-                return true;
-            } else {
-                elt._timestamp = _lastClearTime;
-                elt._isRemoved = true;
-                return false;
-            }
         }
+        auto coco_it = this->insertKey(std::move(key), stamp, false);
+        return this->addElement(coco_it.first, coco_it.second, stamp);
+    }
+
+    /**
+     * Adds key with its payload. (Only if Payload is not void).
+     *
+     * Same as add for the key. The payload replaces the current one only
+     * if stamp is higher than the timestamp of its last assign. (Own
+     * timestamp: a newer add, remove or clear of the key doesn't prevent
+     * the assign, see LWWSetPayload).
+     *
+     * \par Idempotent
+     * Duplicate calls with same stamp and payload is idempotent.
+     *
+     * \par Complexity
+     * One lookup. The payload is moved (or copied) only if assigned.
+     *
+     * \param key     Key of the element to set.
+     * \param payload Payload to assign (Forwarded).
+     * \param stamp   Timestamps of this operation.
+     * \return True if payload assigned, otherwise, return false.
+     */
+    template <typename V>
+    bool set(const Key& key, V&& payload, const U& stamp) {
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        auto coco_it = this->insertKey(key, stamp, false);
+        this->addElement(coco_it.first, coco_it.second, stamp);
+        return coco_it.first->second.assignPayload(std::forward<V>(payload), stamp);
     }
 
     /**
@@ -312,31 +497,57 @@ class LWWSet {
      * \return True if key removed, otherwise, return false.
      */
     bool remove(const Key& key, const U& stamp) {
-        Metadata newElt;  // Content is not set here
-        newElt._timestamp = stamp;
-        newElt._isRemoved = true;
-
-        auto coco_it = _map.insert(std::make_pair(key, newElt));
-        bool isKeyAdded = coco_it.second;
-        Metadata& elt = coco_it.first->second;
-        const U& keyStamp = elt.timestamp();
+        if (stamp < _compactTime) {
+            return false;  // Already seen operation (See compact)
+        }
+        auto coco_it = this->insertKey(key, stamp, true);
+        return this->removeElement(coco_it.first, coco_it.second, stamp);
+    }
 
-        if (!isKeyAdded) {
-            if (stamp > keyStamp) {
-                elt._timestamp = stamp;
+    /**
+     * \copydoc LWWSet::remove(const Key&, const U&)
+     *
+     * \note
+     * The key is moved only if actually inserted.
+     */
+    bool remove(Key&& key, const U& stamp) {
+        if (stamp < _compactTime) {
+            return false;
+        }
+        auto coco_it = this->insertKey(std::move(key), stamp, true);
+        return this->removeElement(coco_it.first, coco_it.second, stamp);
+    }
 
-                if (elt._isRemoved == false) {
-                    elt._isRemoved = true;
-                    --_sizeAlive;
-                    return true;
-                }
+    /**
+     * Applies a range of operations. Same as calling add / remove / clear
+     * for each operation, in order.
+     *
+     * Operations are grouped by key: the storage is probed once per distinct
+     * key, then all operations of this key are applied in order on the found
+     * element. (In a burst, many operations often hit the same key).
+     * A clear operation is applied once all previous operations are.
+     *
+     * \tparam ForwardIt Forward iterator on batch_operation.
+     * \param first Iterator to the first operation.
+     * \param last  Iterator past the last operation.
+     * \return For each operation, the value add / remove / clear would have
+     *         returned. (True if it changed the visible content).
+     */
+    template <typename ForwardIt>
+    std::vector<bool> apply_batch(ForwardIt first, ForwardIt last) {
+        std::vector<bool> results;
+        std::vector<const batch_operation*> ops;
+        for (; first != last; ++first) {
+            const batch_operation& op = *first;
+            if (op.kind == batch_operation::CLEAR) {
+                this->applyBatchOperations(ops, results);
+                results.push_back(this->clear(op.stamp));
+            } else {
+                ops.push_back(&op);
             }
         }
-
-        // DevNote: in case remove called before even add, remove does the
-        // CRDT job (add and mark as deleted). However, from user point of
-        // view, this did nothing.
-        return false;
+        this->applyBatchOperations(ops, results);
+        return results;
     }
 
     // -------------------------------------------------------------------------
@@ -364,7 +575,175 @@ class LWWSet {
      * \param other Container to compare with.
      * \return True if equals, otherwise, return false.
      */
-    bool crdt_equal(const LWWSet& other) const { return _map == other._map; }
+    bool crdt_equal(const LWWSet& other) const {
+        if (!_isClearPending && !other._isClearPending) {
+            return _map == other._map;
+        }
+        if (_map.size() != other._map.size()) {
+            return false;
+        }
+        for (auto elt_it = this->crdt_begin(); elt_it != this->crdt_end(); ++elt_it) {
+            const auto other_it = other.crdt_find(elt_it->first);
+            if (other_it == other.crdt_end() || elt_it->second != other_it->second) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Returns a copy of the container, as it is now.
+     * O(1) with PersistentStorage (See LWWMap::snapshot).
+     *
+     * \warning
+     * Must be called from the thread that modifies this container (Or under
+     * the same lock). Only const methods may be called on the snapshot from
+     * another thread.
+     *
+     * \return Copy of this container.
+     */
+    LWWSet snapshot() const { return *this; }
+
+    /**
+     * Purges the deleted keys older than a causal-stability watermark.
+     *
+     * Keys marked as removed with a timestamp strictly lower than
+     * stableBefore are erased from the internal container. Memory and
+     * iteration cost then follow the number of alive keys, not the history.
+     * The watermark is kept as a floor: a later operation with a lower
+     * timestamp is an already seen duplicate and does nothing (Not even
+     * inserted back as removed). Same for the keys older than the floor
+     * merged from a not compacted replicate.
+     *
+     * \warning
+     * The application must guarantee that every replicate has already
+     * received all operations with timestamp lower than stableBefore.
+     * Otherwise, a late add may bring back a purged key.
+     * crdt_equal returns false between a compacted and a not compacted
+     * replicate, though they have the same content.
+     *
+     * \par Idempotent
+     * Duplicate calls with same stamp is idempotent.
+     *
+     * \param stableBefore Watermark timestamp.
+     * \return Number of purged keys.
+     */
+    size_type compact(const U& stableBefore) {
+        if (stableBefore > _compactTime) {
+            _compactTime = stableBefore;
+        }
+
+        this->settleAll();
+        size_type nbPurged = 0;
+        for (auto elt_it = _map.begin(); elt_it != _map.end();) {
+            const Metadata& elt = elt_it->second;
+            if (elt._isRemoved && elt._timestamp < stableBefore) {
+                elt_it = _map.erase(elt_it);
+                ++nbPurged;
+            } else {
+                ++elt_it;
+            }
+        }
+        if (nbPurged > 0) {
+            _map.rehash(0);  // Shrink if possible
+            this->indexChanges();
+        }
+        return nbPurged;
+    }
+
+    /**
+     * Joins the full state of another replicate into this one.
+     *
+     * State-based counterpart of add / remove: result is the same as if all
+     * operations received by other were applied here. Elements (Including
+     * removed ones) are joined with the higher timestamp. Clear and compact
+     * timestamps are joined too. Use this to bootstrap a new replicate
+     * instead of replaying every operation.
+     *
+     * \par Idempotent
+     * Merge is commutative, associative and idempotent.
+     *
+     * \param other Replicate to merge in this one.
+     */
+    void merge(const LWWSet& other) { this->mergeWith(other, 1); }
+
+    /**
+     * Parallel version of merge for large states.
+     *
+     * Elements of other are split in contiguous chunks, one per thread.
+     * Each thread updates the keys already in this container in place.
+     * New keys are then inserted by the calling thread (Insert may rehash).
+     * Gives the same result as merge.
+     *
+     * \param other     Replicate to merge in this one.
+     * \param nbThreads Number of threads (0 to use all hardware threads).
+     */
+    void merge_parallel(const LWWSet& other, unsigned int nbThreads = 0) { this->mergeWith(other, nbThreads); }
+
+    /**
+     * Returns the timestamp of the last clear applied. ({0} if none).
+     *
+     * \return Last clear timestamp.
+     */
+    const U& crdt_clear_time() const noexcept { return _lastClearTime; }
+
+    /**
+     * Enables or disables the change index used by delta_since.
+     *
+     * The index orders keys by timestamp so that delta_since runs in time
+     * proportional to the number of changes. It is disabled by default and
+     * then costs nothing. Enabling it indexes all current elements.
+     *
+     * \param enable True to enable the change index.
+     */
+    void track_changes(bool enable) {
+        _changes.enable(enable);
+        this->indexChanges();
+    }
+
+    /**
+     * Checks whether the change index is enabled. (See track_changes)
+     *
+     * \return True if enabled, otherwise, return false.
+     */
+    bool is_tracking_changes() const noexcept { return _changes.enabled(); }
+
+    /**
+     * Returns the changes since a timestamp, as a new LWWSet.
+     *
+     * The delta contains all elements (Including removed ones) with a
+     * timestamp equal or higher than since, and the last clear timestamp.
+     * Merging it in a replicate that already received all operations older
+     * than since gives the same state as merging the full container.
+     * (See merge)
+     *
+     * \par Complexity
+     * Proportional to the number of changes if the change index is enabled
+     * (See track_changes), otherwise, linear in crdt_size.
+     *
+     * \param since Timestamp of the first change to include.
+     * \return Delta container.
+     */
+    LWWSet delta_since(const U& since) const {
+        LWWSet delta;
+        delta.clear(_lastClearTime);
+        if (_changes.enabled()) {
+            _changes.for_each_since(since, [&](const Key& key) {
+                const auto elt_it = _map.find(key);
+                if (elt_it != _map.end() && !(this->settledTimestamp(elt_it->second) < since)) {
+                    delta.mergeElement(key, elt_it->second);
+                }
+            });
+        } else {
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                if (!(this->settledTimestamp(elt_it->second) < since)) {
+                    delta.mergeElement(elt_it->first, elt_it->second);
+                }
+            }
+        }
+        delta._compactTime = _compactTime;
+        return delta;
+    }
 
     // -------------------------------------------------------------------------
     // Iterators
@@ -380,14 +759,11 @@ class LWWSet {
 
     /**
      * Returns a constant iterator to the end.
+     * Constant time (No lookup).
      *
      * \return Constant iterator to the last element.
      */
-    const_iterator end() const noexcept {
-        const_iterator it(*this);
-        it._it = _map.end();
-        return it;
-    }
+    const_iterator end() const noexcept { return const_iterator(*this, _map.end(), 0); }
 
     /**
      * \copydoc LWWSet::begin
@@ -397,11 +773,7 @@ class LWWSet {
     /**
      * \copydoc LWWSet::end
      */
-    const_iterator cend() const noexcept {
-        const_iterator it(*this);
-        it._it = _map.end();
-        return it;
-    }
+    const_iterator cend() const noexcept { return this->end(); }
 
     /**
      * Returns a constant crdt iterator to the beginning.
@@ -409,7 +781,7 @@ class LWWSet {
      * \see LWWSet::crdt_iterator
      * \return CRDT iterator to the first element.
      */
-    const_crdt_iterator crdt_begin() const noexcept { return _map.begin(); }
+    const_crdt_iterator crdt_begin() const noexcept { return const_crdt_iterator(_map.begin(), _lastClearTime); }
 
     /**
      * Returns a constant crdt iterator to the end.
@@ -417,7 +789,7 @@ class LWWSet {
      * \see LWWSet::crdt_iterator
      * \return CRDT iterator to the last element.
      */
-    const_crdt_iterator crdt_end() const noexcept { return _map.end(); }
+    const_crdt_iterator crdt_end() const noexcept { return const_crdt_iterator(_map.end(), _lastClearTime); }
 
     // -------------------------------------------------------------------------
     // Operators overload
@@ -429,7 +801,7 @@ class LWWSet {
      * Two sets are equal if their 'living' set of keys are equal.
      *
      * \warning
-     * Only keys are considered. Content of key may differs.
+     * Only keys (And their payload) are considered. Metadata may differ.
      *
      * \param lhs Left hand side
      * \param rhs Right hand side
@@ -445,12 +817,12 @@ class LWWSet {
         // Equality should not be called that often anyway (Since in
         // collab environment, the local user has one replicate).
         for (const auto& elt : lhs) {
-            if (rhs.find(elt) == rhs.end()) {
+            if (!lhs.isSameAlive(elt, rhs)) {
                 return false;
             }
         }
         for (const auto& elt : rhs) {
-            if (lhs.find(elt) == lhs.end()) {
+            if (!rhs.isSameAlive(elt, lhs)) {
                 return false;
             }
         }
@@ -474,11 +846,11 @@ class LWWSet {
      * Display the internal content.
      * This is mainly for debug print purpose.
      */
-    friend std::ostream& operator<<(std::ostream& out, const LWWSet<Key, U>& o) {
+    friend std::ostream& operator<<(std::ostream& out, const LWWSet& o) {
         out << "CmRDT::LWWSet = ";
-        for (const auto& elt : o._map) {
-            out << "(" << elt.first << "," << elt.second.timestamp();
-            if (elt.second.isRemoved()) {
+        for (auto elt_it = o.crdt_begin(); elt_it != o.crdt_end(); ++elt_it) {
+            out << "(" << elt_it->first << "," << elt_it->second.timestamp();
+            if (elt_it->second.isRemoved()) {
                 out << ",x) ";
             } else {
                 out << ",o) ";
@@ -486,6 +858,326 @@ class LWWSet {
         }
         return out;
     }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    // DevNote: with storage marks (FlatHashStorage), only alive elts are
+    // visited. Otherwise, tombstones are skipped one by one.
+    map_const_iterator firstAlive() const {
+        if (_sizeAlive == 0) {
+            return _map.end();
+        }
+        return this->skipRemoved(marks::first(_map));
+    }
+
+    map_const_iterator nextAlive(map_const_iterator it) const { return this->skipRemoved(marks::next(_map, it)); }
+
+    map_const_iterator skipRemoved(map_const_iterator it) const {
+        if (!marks::enabled) {
+            while (it != _map.end() && !this->isAlive(it->second)) {
+                ++it;
+            }
+        }
+        return it;
+    }
+
+    // DevNote: clear is lazy. An elt older than the last clear is removed,
+    // even if its metadata are not updated yet. Metadata are only updated
+    // (settled) by writers, before being modified. Readers use isAlive and
+    // settledTimestamp (Or MetadataView) instead.
+    bool isAlive(const Metadata& elt) const { return !elt._isRemoved && !(_lastClearTime > elt._timestamp); }
+
+    const U& settledTimestamp(const Metadata& elt) const {
+        return (_lastClearTime > elt._timestamp) ? _lastClearTime : elt._timestamp;
+    }
+
+    void settle(const Key& key, Metadata& elt) {
+        if (_lastClearTime > elt._timestamp) {
+            _changes.update(elt._timestamp, _lastClearTime, key);
+            elt._timestamp = _lastClearTime;
+            elt._isRemoved = true;
+        }
+    }
+
+    void settleAll() {
+        if (_isClearPending) {
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                this->settle(elt_it->first, elt_it->second);
+            }
+            _isClearPending = false;
+        }
+    }
+
+    // Whether key (Alive here) is alive in other, with the same payload
+    bool isSameAlive(const Key& key, const LWWSet& other) const {
+        const auto other_it = other._map.find(key);
+        if (other_it == other._map.end() || !other.isAlive(other_it->second)) {
+            return false;
+        }
+        return std::is_void<Payload>::value || _map.find(key)->second.isSamePayload(other_it->second);
+    }
+
+    // Assigns the payload of a key already inserted (See set)
+    template <typename V>
+    bool setPayload(const Key& key, V&& payload, const U& stamp) {
+        return _map.find(key)->second.assignPayload(std::forward<V>(payload), stamp);
+    }
+
+    // Inserts key if not there yet. Nothing is built otherwise (No copy)
+    template <typename K>
+    std::pair<typename map_type::iterator, bool> insertKey(K&& key, const U& stamp, bool isRemoved) {
+        auto coco_it = emplace::try_emplace(_map, std::forward<K>(key));
+        if (coco_it.second) {
+            Metadata& elt = coco_it.first->second;
+            elt._timestamp = stamp;
+            elt._isRemoved = isRemoved;
+        }
+        return coco_it;
+    }
+
+    // DevNote: body of add once the key is inserted (See apply_batch)
+    bool addElement(typename map_type::iterator elt_it, bool isKeyAdded, const U& stamp) {
+        Metadata& elt = elt_it->second;
+        const Key& key = elt_it->first;
+        const U& keyStamp = elt.timestamp();
+        this->updateMaxStamp(stamp);
+
+        if (!isKeyAdded) {
+            this->settle(key, elt);
+
+            if (stamp > keyStamp) {
+                _changes.update(keyStamp, stamp, key);
+                elt._timestamp = stamp;
+
+                if (elt._isRemoved == true) {
+                    elt._isRemoved = false;
+                    marks::mark(_map, elt_it, true);
+                    ++_sizeAlive;
+                    return true;
+                }
+            }
+            return false;
+        } else {
+            if (stamp > _lastClearTime) {
+                marks::mark(_map, elt_it, true);
+                ++_sizeAlive;
+            } else {
+                // Older than last clear
+                if (_lastClearTime > stamp) {
+                    elt._timestamp = _lastClearTime;
+                }
+                elt._isRemoved = true;
+            }
+            _changes.insert(elt._timestamp, key);
+            return !elt._isRemoved;
+        }
+    }
+
+    // DevNote: body of remove once the key is inserted (See apply_batch)
+    bool removeElement(typename map_type::iterator elt_it, bool isKeyAdded, const U& stamp) {
+        Metadata& elt = elt_it->second;
+        const Key& key = elt_it->first;
+        const U& keyStamp = elt.timestamp();
+        this->updateMaxStamp(stamp);
+        this->settle(key, elt);  // New key older than last clear is removed at clear time
+        if (isKeyAdded) {
+            _changes.insert(elt._timestamp, key);
+        }
+
+        if (!isKeyAdded) {
+            if (stamp > keyStamp) {
+                _changes.update(keyStamp, stamp, key);
+                elt._timestamp = stamp;
+
+                if (elt._isRemoved == false) {
+                    elt._isRemoved = true;
+                    marks::mark(_map, elt_it, false);
+                    --_sizeAlive;
+                    return true;
+                }
+            }
+        }
+
+        // DevNote: in case remove called before even add, remove does the
+        // CRDT job (add and mark as deleted). However, from user point of
+        // view, this did nothing.
+        return false;
+    }
+
+    // Applies ops (Add / remove only) and appends their results
+    void applyBatchOperations(std::vector<const batch_operation*>& ops, std::vector<bool>& results) {
+        if (ops.empty()) {
+            return;
+        }
+        const std::size_t offset = results.size();
+        results.resize(offset + ops.size(), false);
+
+        std::vector<std::size_t> next;
+        const std::vector<std::size_t> firsts = detail::group_by_key(ops, next);
+
+        for (std::size_t i : firsts) {
+            // Operations older than the compact floor do nothing (See compact)
+            while (i < ops.size() && ops[i]->stamp < _compactTime) {
+                i = next[i];
+            }
+            if (i == ops.size()) {
+                continue;
+            }
+
+            // Key is inserted as its first operation would do
+            const batch_operation& op = *ops[i];
+            auto coco_it = this->insertKey(op.key, op.stamp, op.kind == batch_operation::REMOVE);
+
+            bool isKeyAdded = coco_it.second;
+            for (; i < ops.size(); i = next[i]) {
+                if (ops[i]->stamp < _compactTime) {
+                    continue;
+                }
+                if (ops[i]->kind == batch_operation::ADD) {
+                    results[offset + i] = this->addElement(coco_it.first, isKeyAdded, ops[i]->stamp);
+                } else {
+                    results[offset + i] = this->removeElement(coco_it.first, isKeyAdded, ops[i]->stamp);
+                }
+                isKeyAdded = false;
+            }
+        }
+        ops.clear();
+    }
+
+    void updateMaxStamp(const U& stamp) {
+        if (stamp > _maxStamp) {
+            _maxStamp = stamp;
+        }
+    }
+
+    // Per thread results of merge_parallel
+    struct MergeChunk {
+        std::vector<map_const_iterator> missing;  // Keys not in this container
+        std::vector<std::pair<typename map_type::iterator, bool>> aliveChanges;
+        std::vector<std::pair<U, typename map_type::iterator>> newerStamps;  // Only if tracking changes
+        size_type nbAdded = 0;
+        size_type nbRemoved = 0;
+        U maxStamp = {0};
+    };
+
+    // DevNote: elements already in this container are updated in place by
+    // nbThreads threads. New keys are inserted after (Insert may rehash).
+    void mergeWith(const LWWSet& other, unsigned int nbThreads) {
+        if (&other == this) {
+            return;
+        }
+        this->mergeClearTime(other);
+
+        // DevNote: elts of other not settled yet are older than its last
+        // clear, already merged here: they are joined as removed anyway.
+        std::vector<map_const_iterator> entries;
+        entries.reserve(other.crdt_size());
+        for (auto it = other._map.begin(); it != other._map.end(); ++it) {
+            entries.push_back(it);
+        }
+
+        // Parallel phase: distinct threads never touch the same element
+        if (StorageSharedNodes<map_type>::enabled) {
+            nbThreads = 1;  // Lookups may copy shared nodes (Not thread safe)
+        }
+        nbThreads = parallel_threads_count(nbThreads, entries.size());
+        std::vector<MergeChunk> chunks(nbThreads);
+        parallel_for_chunks(entries.size(), nbThreads, [&](std::size_t begin, std::size_t end, unsigned int k) {
+            MergeChunk& chunk = chunks[k];
+            for (std::size_t i = begin; i < end; ++i) {
+                const auto elt_it = _map.find(entries[i]->first);
+                if (elt_it == _map.end()) {
+                    if (!(entries[i]->second._timestamp < _compactTime)) {
+                        chunk.missing.push_back(entries[i]);
+                    }
+                } else {
+                    this->mergeExisting(elt_it, entries[i]->second, chunk);
+                }
+            }
+        });
+
+        // Sequential phase: counters, storage marks and new keys
+        for (const MergeChunk& chunk : chunks) {
+            _sizeAlive = _sizeAlive + chunk.nbAdded - chunk.nbRemoved;
+            this->updateMaxStamp(chunk.maxStamp);
+            for (const auto& change : chunk.aliveChanges) {
+                marks::mark(_map, change.first, change.second);
+            }
+            for (const auto& change : chunk.newerStamps) {
+                _changes.update(change.first, change.second->second._timestamp, change.second->first);
+            }
+        }
+        for (const MergeChunk& chunk : chunks) {
+            for (const auto& other_it : chunk.missing) {
+                this->mergeElement(other_it->first, other_it->second);
+            }
+        }
+
+        // DevNote: compact time is joined last, only the local floor skips
+        // missing keys. A key of other older than it was purged here: all
+        // its operations were already applied (See compact).
+        if (other._compactTime > _compactTime) {
+            _compactTime = other._compactTime;
+        }
+    }
+
+    void indexChanges() {
+        if (_changes.enabled()) {
+            this->settleAll();
+            _changes.clear();
+            for (auto elt_it = _map.begin(); elt_it != _map.end(); ++elt_it) {
+                _changes.insert(elt_it->second._timestamp, elt_it->first);
+            }
+        }
+    }
+
+    void mergeClearTime(const LWWSet& other) {
+        if (other._lastClearTime > _lastClearTime) {
+            this->clear(other._lastClearTime);
+        }
+    }
+
+    void mergeElement(const Key& key, const Metadata& otherElt) {
+        auto coco_it = this->insertKey(key, otherElt._timestamp, otherElt._isRemoved);
+        if (otherElt._isRemoved) {
+            this->removeElement(coco_it.first, coco_it.second, otherElt._timestamp);
+        } else {
+            this->addElement(coco_it.first, coco_it.second, otherElt._timestamp);
+        }
+        coco_it.first->second.mergePayload(otherElt);
+    }
+
+    // DevNote: same as add / remove on an existing key, without shared writes
+    void mergeExisting(typename map_type::iterator elt_it, const Metadata& otherElt, MergeChunk& chunk) {
+        Metadata& elt = elt_it->second;
+        const U indexedStamp = elt._timestamp;  // Index is updated after (See newerStamps)
+        if (_lastClearTime > elt._timestamp) {
+            elt._timestamp = _lastClearTime;  // Same as settle
+            elt._isRemoved = true;
+        }
+        elt.mergePayload(otherElt);
+        if (otherElt._timestamp > chunk.maxStamp) {
+            chunk.maxStamp = otherElt._timestamp;
+        }
+        if (otherElt._timestamp > elt._timestamp) {
+            elt._timestamp = otherElt._timestamp;
+            if (elt._isRemoved != otherElt._isRemoved) {
+                elt._isRemoved = otherElt._isRemoved;
+                chunk.aliveChanges.push_back(std::make_pair(elt_it, !elt._isRemoved));
+                if (elt._isRemoved) {
+                    ++chunk.nbRemoved;
+                } else {
+                    ++chunk.nbAdded;
+                }
+            }
+        }
+        if (_changes.enabled() && indexedStamp < elt._timestamp) {
+            chunk.newerStamps.push_back(std::make_pair(indexedStamp, elt_it));
+        }
+    }
 };
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -507,13 +1199,20 @@ class LWWSet {
  * README)
  *
  *
- * \tparam Key  Type of set elements.
- * \tparam U    Type of timestamps.
+ * \par
+ * The payload of the key, if any, is stored inline (See LWWSetPayload).
+ *
+ *
+ * \tparam Key      Type of set elements.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
+ * \tparam Payload  Type of payload of each key.
  */
-template <typename Key, typename U>
-class LWWSet<Key, U>::Metadata {
+template <typename Key, typename U, typename Storage, typename Payload>
+class LWWSet<Key, U, Storage, Payload>::Metadata : public LWWSetPayload<Payload, U> {
    private:
     friend LWWSet;
+    friend MetadataView;
 
     U _timestamp = {0};
     bool _isRemoved = false;
@@ -535,12 +1234,130 @@ class LWWSet<Key, U>::Metadata {
 
    public:
     friend bool operator==(const Metadata& rhs, const Metadata& lhs) {
-        return (rhs._timestamp == lhs._timestamp) && (rhs._isRemoved == lhs._isRemoved);
+        return (rhs._timestamp == lhs._timestamp) && (rhs._isRemoved == lhs._isRemoved) &&
+               rhs.isSamePayloadState(lhs);
     }
 
     friend bool operator!=(const Metadata& rhs, const Metadata& lhs) { return !(rhs == lhs); }
 };
 
+/**
+ * \brief
+ * Metadata of a key, as returned by crdt queries (See const_crdt_iterator).
+ *
+ * Clear is lazy: Metadata of a key older than the last clear are only
+ * updated by the next write. This view already shows such a key as removed
+ * at the clear timestamp, without writing it.
+ *
+ *
+ * \tparam Key      Type of set elements.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
+ * \tparam Payload  Type of payload of each key.
+ */
+template <typename Key, typename U, typename Storage, typename Payload>
+class LWWSet<Key, U, Storage, Payload>::MetadataView {
+   private:
+    friend LWWSet;
+
+    const Metadata* _elt;
+    const U* _clearTime;  // Last clear of the set
+
+    MetadataView(const Metadata& elt, const U& clearTime) : _elt(&elt), _clearTime(&clearTime) {}
+
+    bool isCleared() const { return *_clearTime > _elt->_timestamp; }
+
+    bool isSamePayloadState(const MetadataView& other) const { return _elt->isSamePayloadState(*other._elt); }
+
+   public:
+    /**
+     * \copydoc Metadata::timestamp
+     */
+    const U& timestamp() const { return this->isCleared() ? *_clearTime : _elt->_timestamp; }
+
+    /**
+     * \copydoc Metadata::isRemoved
+     */
+    bool isRemoved() const { return _elt->_isRemoved || this->isCleared(); }
+
+    /**
+     * \copydoc LWWSetPayload::payload
+     */
+    const_payload_reference payload() const { return _elt->payload(); }
+
+    /**
+     * \copydoc LWWSetPayload::payloadTimestamp
+     */
+    const U& payloadTimestamp() const { return _elt->payloadTimestamp(); }
+
+   public:
+    friend bool operator==(const MetadataView& rhs, const MetadataView& lhs) {
+        return (rhs.timestamp() == lhs.timestamp()) && (rhs.isRemoved() == lhs.isRemoved()) &&
+               rhs.isSamePayloadState(lhs);
+    }
+
+    friend bool operator!=(const MetadataView& rhs, const MetadataView& lhs) { return !(rhs == lhs); }
+};
+
+/**
+ * \brief
+ * Constant CRDT iterator for LWWSet container.
+ *
+ * Iterate over all keys, including the ones marked as removed.
+ * 'it->first' is the key, 'it->second' its CRDT metadata (See MetadataView).
+ *
+ * \par
+ * Forward iterator. The entry is stored in the iterator: references returned
+ * by operator* and operator-> are valid until the iterator moves or is
+ * destroyed (Not for the whole container lifetime, as map iterators).
+ *
+ *
+ * \tparam Key      Type of set elements.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
+ * \tparam Payload  Type of payload of each key.
+ */
+template <typename Key, typename U, typename Storage, typename Payload>
+class LWWSet<Key, U, Storage, Payload>::const_crdt_iterator
+    : public std::iterator<std::forward_iterator_tag, std::pair<const Key&, MetadataView>, std::ptrdiff_t,
+                           const std::pair<const Key&, MetadataView>*, const std::pair<const Key&, MetadataView>&> {
+   private:
+    friend LWWSet;
+
+    typedef std::pair<const Key&, MetadataView> entry_type;
+
+    map_const_iterator _it;
+    const U* _clearTime;
+
+    // DevNote: entry of _it, built by operator* (The key is a reference, the
+    // entry can't be assigned). Trivially destructible: built over the old.
+    mutable typename std::aligned_storage<sizeof(entry_type), alignof(entry_type)>::type _entry;
+
+    const_crdt_iterator(map_const_iterator it, const U& clearTime) : _it(it), _clearTime(&clearTime) {}
+
+   public:
+    const_crdt_iterator& operator++() {
+        ++_it;
+        return *this;
+    }
+
+    const_crdt_iterator operator++(int) {
+        const_crdt_iterator it = *this;
+        ++_it;
+        return it;
+    }
+
+    bool operator==(const const_crdt_iterator& other) const { return _it == other._it; }
+
+    bool operator!=(const const_crdt_iterator& other) const { return !(*this == other); }
+
+    const entry_type& operator*() const {
+        return *::new (&_entry) entry_type(_it->first, MetadataView(_it->second, *_clearTime));
+    }
+
+    const entry_type* operator->() const { return &**this; }
+};
+
 /**
  * \brief
  * Constant iterator for LWWSet container.
@@ -548,33 +1365,36 @@ class LWWSet<Key, U>::Metadata {
  * Iterate over all keys that are in this set and are NOT marked as removed.
  * This behave like a normal set iterator.
  *
+ * \par
+ * The iterator counts the alive keys left to visit, so it stops right after
+ * the last one instead of scanning the trailing tombstones.
+ *
  *
- * \tparam Key  Type of set elements.
- * \tparam U    Type of timestamps.
+ * \tparam Key      Type of set elements.
+ * \tparam U        Type of timestamps.
+ * \tparam Storage  Internal storage policy.
+ * \tparam Payload  Type of payload of each key.
  */
-template <typename Key, typename U>
-class LWWSet<Key, U>::const_iterator : public std::iterator<std::input_iterator_tag, Key> {
+template <typename Key, typename U, typename Storage, typename Payload>
+class LWWSet<Key, U, Storage, Payload>::const_iterator : public std::iterator<std::input_iterator_tag, Key> {
    private:
     friend LWWSet;
 
     const LWWSet& _data;
-    const_crdt_iterator _it;
+    map_const_iterator _it;
+    size_type _remaining;  // Upper bound of alive elts from _it (0 for end)
 
-   public:
-    const_iterator(const LWWSet& set) : _data(set) {
-        _it = _data._map.begin();
+    const_iterator(const LWWSet& set, map_const_iterator it, size_type remaining)
+        : _data(set), _it(it), _remaining(remaining) {}
 
-        // If first element is already removed, skip it
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
-            ++_it;
-        }
-    }
+   public:
+    const_iterator(const LWWSet& set) : _data(set), _it(set.firstAlive()), _remaining(set._sizeAlive) {}
 
     const_iterator& operator++() {
-        ++_it;
-
-        while (_it != _data._map.end() && _it->second.isRemoved()) {
-            ++_it;
+        if (--_remaining == 0) {
+            _it = _data._map.end();
+        } else {
+            _it = _data.nextAlive(_it);
         }
         return *this;
     }
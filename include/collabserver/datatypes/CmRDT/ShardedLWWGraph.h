@@ -0,0 +1,438 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "LWWGraph.h"
+
+namespace collabserver {
+
+/**
+ * \brief
+ * LWWGraph split in shards, for operations applied from several threads.
+ *
+ * Vertex are partitioned by key hash in N shards. Each shard is a LWWGraph
+ * with its own lock, that holds its vertex with their edges (An edge is
+ * stored in the shard of its origin, and indexed in the shard of its
+ * destination, see LWWGraph::in_edges). Operations on vertex of different
+ * shards run in parallel.
+ *
+ * \par Operations on several shards
+ * Each operation locks all the shards it changes, always by increasing
+ * shard index (No deadlock):
+ * - add_vertex, set_vertex: the shard of the vertex.
+ * - add_edge, set_edge, remove_edge: the shards of from and to.
+ * - remove_vertex, clear_vertex_edges: the shard of the vertex and of its
+ *   neighbors (Read from the vertex once its shard is locked; locked again
+ *   if a neighbor changed meanwhile).
+ * - compact, snapshot: all shards.
+ *
+ * \par Convergence
+ * Shards run the same code as LWWGraph (Each operation is applied on the
+ * vertex whatever the shard that holds it). Since operations are
+ * commutative, applying any set of operations from any number of threads
+ * gives the same graph as a LWWGraph that receives them, in any order.
+ * (See snapshot).
+ *
+ * \note
+ * Sizes are the sum of the sizes of each shard, read one shard at a time:
+ * not atomic while other threads apply operations.
+ * Merge, delta_since and clear_vertices are not provided: use snapshot to
+ * get a LWWGraph.
+ *
+ * \tparam Key          Type of unique identifier for each graph vertex
+ * \tparam T            Type of vertex content data.
+ * \tparam U            Type of timestamps (Must implements operators > and <).
+ * \tparam EdgeStorage  Storage policy of each vertex edges (See StoragePolicy.h).
+ * \tparam EdgeValue    Type of value of each edge (void for none).
+ */
+template <typename Key, typename T, typename U, typename EdgeStorage = SmallMapStorage<4>, typename EdgeValue = void>
+class ShardedLWWGraph {
+   public:
+    typedef LWWGraph<Key, T, U, EdgeStorage, EdgeValue> graph_type;
+    typedef typename graph_type::AddEdgeInfo AddEdgeInfo;
+    typedef typename graph_type::size_type size_type;
+    typedef typename graph_type::size_type_edges size_type_edges;
+
+   private:
+    struct Shard {
+        std::mutex mutex;
+        graph_type graph;
+    };
+
+    class ShardLock;
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    // -------------------------------------------------------------------------
+    // Initialization
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Creates an empty graph.
+     *
+     * \param nbShards Number of shards (At least 1). More shards than
+     *                 threads lowers the chance that two threads wait for
+     *                 the same shard.
+     */
+    explicit ShardedLWWGraph(std::size_t nbShards) : _shards(nbShards > 0 ? nbShards : 1) {
+        for (auto& shard : _shards) {
+            shard.reset(new Shard());
+        }
+    }
+
+    ShardedLWWGraph(const ShardedLWWGraph& other) = delete;
+    ShardedLWWGraph& operator=(const ShardedLWWGraph& other) = delete;
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns the number of shards.
+     *
+     * \return Number of shards.
+     */
+    std::size_t nb_shards() const noexcept { return _shards.size(); }
+
+    /**
+     * Returns the number of vertex in this graph.
+     *
+     * \return Number of vertex.
+     */
+    size_type size_vertex() const {
+        return this->sumShards([](const graph_type& graph) { return graph.size_vertex(); });
+    }
+
+    /**
+     * Returns the number of vertex in this graph.
+     * Also counts vertex internally marked as 'removed'.
+     *
+     * \return Number of vertex.
+     */
+    size_type crdt_size_vertex() const {
+        return this->sumShards([](const graph_type& graph) { return graph.crdt_size_vertex(); });
+    }
+
+    /**
+     * Returns the number of edges in this graph.
+     *
+     * \return Number of edges.
+     */
+    size_type_edges size_edges() const {
+        return this->sumShards([](const graph_type& graph) { return graph.size_edges(); });
+    }
+
+    /**
+     * Returns the number of edges in this graph.
+     * Also counts edges internally marked as 'removed'.
+     *
+     * \return Number of edges.
+     */
+    size_type_edges crdt_size_edges() const {
+        return this->sumShards([](const graph_type& graph) { return graph.crdt_size_edges(); });
+    }
+
+    // -------------------------------------------------------------------------
+    // Lookup methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * \copydoc LWWGraph::has_vertex
+     */
+    bool has_vertex(const Key& key) const {
+        const ShardLock lock(*this, this->shardOf(key));
+        return this->graphOf(key).has_vertex(key);
+    }
+
+    /**
+     * \copydoc LWWGraph::has_edge
+     */
+    bool has_edge(const Key& from, const Key& to) const {
+        const ShardLock lock(*this, this->shardOf(from));
+        return this->graphOf(from).has_edge(from, to);
+    }
+
+    /**
+     * \copydoc LWWGraph::out_degree
+     */
+    size_type_edges out_degree(const Key& key) const {
+        const ShardLock lock(*this, this->shardOf(key));
+        return this->graphOf(key).out_degree(key);
+    }
+
+    /**
+     * \copydoc LWWGraph::in_degree
+     */
+    size_type_edges in_degree(const Key& key) const {
+        const ShardLock lock(*this, this->shardOf(key));
+        return this->graphOf(key).in_degree(key);
+    }
+
+    /**
+     * Calls fn on the vertex with this key, while its shard is locked.
+     * (Vertex must not be used once fn returns).
+     *
+     * \param key   The unique vertex's key.
+     * \param fn    Function called as fn(const LWWGraph::Vertex&).
+     * \return True if vertex found (And fn called), otherwise, return false.
+     */
+    template <typename Fn>
+    bool visit_vertex(const Key& key, Fn fn) const {
+        const ShardLock lock(*this, this->shardOf(key));
+        const graph_type& graph = this->graphOf(key);
+        const auto vertex_it = graph.find_vertex(key);
+        if (vertex_it == graph.end()) {
+            return false;
+        }
+        fn(vertex_it->second);
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * \copydoc LWWGraph::add_vertex
+     */
+    bool add_vertex(const Key& key, const U& stamp) {
+        const ShardLock lock(*this, this->shardOf(key));
+        return this->graphOf(key).add_vertex(key, stamp);
+    }
+
+    /**
+     * \copydoc LWWGraph::set_vertex(const Key&, const T&, const U&)
+     */
+    bool set_vertex(const Key& key, const T& content, const U& stamp) {
+        const ShardLock lock(*this, this->shardOf(key));
+        return this->graphOf(key).set_vertex(key, content, stamp);
+    }
+
+    /**
+     * \copydoc LWWGraph::remove_vertex
+     */
+    bool remove_vertex(const Key& key, const U& stamp) {
+        return this->withNeighbors(key, true,
+                                   [&]() { return graph_type::removeVertex(key, stamp, ShardGraph{*this}); });
+    }
+
+    /**
+     * \copydoc LWWGraph::clear_vertex_edges
+     */
+    bool clear_vertex_edges(const Key& key, const U& stamp) {
+        return this->withNeighbors(key, false,
+                                   [&]() { return graph_type::clearVertexEdges(key, stamp, ShardGraph{*this}); });
+    }
+
+    /**
+     * \copydoc LWWGraph::add_edge
+     */
+    AddEdgeInfo add_edge(const Key& from, const Key& to, const U& stamp) {
+        const ShardLock lock(*this, this->shardOf(from), this->shardOf(to));
+        return graph_type::addEdge(from, to, stamp, ShardGraph{*this});
+    }
+
+    /**
+     * \copydoc LWWGraph::set_edge
+     */
+    template <typename V>
+    bool set_edge(const Key& from, const Key& to, V&& value, const U& stamp) {
+        const ShardLock lock(*this, this->shardOf(from), this->shardOf(to));
+        return graph_type::setEdge(from, to, std::forward<V>(value), stamp, ShardGraph{*this});
+    }
+
+    /**
+     * \copydoc LWWGraph::remove_edge
+     */
+    bool remove_edge(const Key& from, const Key& to, const U& stamp) {
+        const ShardLock lock(*this, this->shardOf(from), this->shardOf(to));
+        return graph_type::removeEdge(from, to, stamp, ShardGraph{*this});
+    }
+
+    // -------------------------------------------------------------------------
+    // CRDT Specific
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * \copydoc LWWGraph::compact
+     */
+    size_type compact(const U& stableBefore) {
+        const ShardLock lock(*this);
+        size_type nbPurged = 0;
+        for (auto& shard : _shards) {
+            nbPurged += shard->graph.compactVertex(stableBefore, ShardGraph{*this});
+        }
+        return nbPurged;
+    }
+
+    /**
+     * Returns the whole graph as a LWWGraph (Ex: to merge it in another
+     * replicate or send it).
+     *
+     * \par Complexity
+     * Linear in the number of vertex and edges. All shards are locked
+     * meanwhile.
+     *
+     * \return Copy of the graph (Same CRDT state as a LWWGraph that received
+     *         the same operations).
+     */
+    graph_type snapshot() const {
+        const ShardLock lock(*this);
+        graph_type graph;
+        size_type nbVertex = 0;
+        for (const auto& shard : _shards) {
+            nbVertex += shard->graph.crdt_size_vertex();
+        }
+        graph.reserve(nbVertex);
+        for (const auto& shard : _shards) {
+            for (auto it = shard->graph.crdt_begin(); it != shard->graph.crdt_end(); ++it) {
+                typename graph_type::edge_set edges(it->second.value().edges());
+                graph.copyVertex(it->first, it->second, std::move(edges));
+            }
+            if (shard->graph._compactTime > graph._compactTime) {
+                graph._compactTime = shard->graph._compactTime;
+            }
+        }
+        graph.indexInEdges();
+        graph.countEdges();
+        return graph;
+    }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    // Graph of the shard of each key (Given to the LWWGraph operations)
+    struct ShardGraph {
+        ShardedLWWGraph& sharded;
+
+        graph_type& operator()(const Key& key) const { return sharded.graphOf(key); }
+    };
+
+    std::size_t shardOf(const Key& key) const {
+        // Murmur3 finalizer: std::hash is often the identity for integers
+        std::uint64_t h = std::hash<Key>()(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<std::size_t>(h % _shards.size());
+    }
+
+    graph_type& graphOf(const Key& key) const { return _shards[this->shardOf(key)]->graph; }
+
+    template <typename Fn>
+    auto sumShards(Fn fn) const -> decltype(fn(std::declval<const graph_type&>())) {
+        decltype(fn(std::declval<const graph_type&>())) total = 0;
+        for (const auto& shard : _shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += fn(shard->graph);
+        }
+        return total;
+    }
+
+    // Runs fn with the shards of key and of its neighbors locked (See
+    // LWWGraph::forEachNeighbor). Neighbors are read with the shard of key
+    // locked, then the lock is taken again with all these shards, until no
+    // new shard is needed. (Each try locks more shards: at most N tries).
+    template <typename Fn>
+    auto withNeighbors(const Key& key, bool withInEdges, Fn fn) -> decltype(fn()) {
+        std::vector<std::size_t> ids(1, this->shardOf(key));
+        for (;;) {
+            const ShardLock lock(*this, ids);
+            const std::size_t nbLocked = ids.size();
+            this->graphOf(key).forEachNeighbor(key, withInEdges,
+                                               [&](const Key& neighbor) { ids.push_back(this->shardOf(neighbor)); });
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            if (ids.size() == nbLocked) {
+                return fn();
+            }
+        }
+    }
+};
+
+// /////////////////////////////////////////////////////////////////////////////
+// *****************************************************************************
+// Nested classes
+// *****************************************************************************
+// /////////////////////////////////////////////////////////////////////////////
+
+/**
+ * \brief
+ * Locks a set of shards, by increasing index (No deadlock between
+ * operations that lock several shards).
+ *
+ *
+ * \tparam Key  Type of key.
+ * \tparam T    Type of element.
+ * \tparam U    Type of timestamps.
+ */
+template <typename Key, typename T, typename U, typename EdgeStorage, typename EdgeValue>
+class ShardedLWWGraph<Key, T, U, EdgeStorage, EdgeValue>::ShardLock {
+   private:
+    const ShardedLWWGraph& _graph;
+    std::size_t _first;   // Lowest locked shard (One or two shards)
+    std::size_t _second;  // Other locked shard (Same as _first if one)
+    std::vector<std::size_t> _ids;  // Locked shards, sorted (Otherwise)
+
+   public:
+    // Locks one shard
+    ShardLock(const ShardedLWWGraph& graph, std::size_t id) : ShardLock(graph, id, id) {}
+
+    // Locks two shards (Or one if the same)
+    ShardLock(const ShardedLWWGraph& graph, std::size_t id1, std::size_t id2)
+        : _graph(graph), _first(std::min(id1, id2)), _second(std::max(id1, id2)) {
+        _graph._shards[_first]->mutex.lock();
+        if (_second != _first) {
+            _graph._shards[_second]->mutex.lock();
+        }
+    }
+
+    // Locks sorted unique shards
+    ShardLock(const ShardedLWWGraph& graph, const std::vector<std::size_t>& ids)
+        : _graph(graph), _first(0), _second(0), _ids(ids) {
+        for (const std::size_t id : _ids) {
+            _graph._shards[id]->mutex.lock();
+        }
+    }
+
+    // Locks all shards
+    explicit ShardLock(const ShardedLWWGraph& graph)
+        : _graph(graph), _first(0), _second(0), _ids(graph._shards.size()) {
+        for (std::size_t id = 0; id < _ids.size(); ++id) {
+            _ids[id] = id;
+            _graph._shards[id]->mutex.lock();
+        }
+    }
+
+    ShardLock(const ShardLock& other) = delete;
+    ShardLock& operator=(const ShardLock& other) = delete;
+
+    ~ShardLock() {
+        if (_ids.empty()) {
+            if (_second != _first) {
+                _graph._shards[_second]->mutex.unlock();
+            }
+            _graph._shards[_first]->mutex.unlock();
+        } else {
+            for (auto it = _ids.rbegin(); it != _ids.rend(); ++it) {
+                _graph._shards[*it]->mutex.unlock();
+            }
+        }
+    }
+};
+
+}  // namespace collabserver
@@ -22,6 +22,8 @@ namespace collabserver {
  * conflicts, lock and synchronization. However, the local replicate applies
  * modifications in one thread (For instance, a server that receives
  * modifications from several users but applies them on one thread).
+ * CollabDataIngestQueue may be used to receive operations from several
+ * threads and apply them on one writer thread.
  * CollabData deals with the fact that operations themselves may be concurrent.
  * (ex: Bob deletes a component that Alice has modified at the same time).
  *
@@ -60,6 +62,10 @@ namespace collabserver {
  * CollabDataOperationObserver creates the borderland between internal CRDT (Where
  * everything is valid) and the end-user semantic which requires causality
  * preservation.
+ * \par
+ * Observers are notified inline, by the thread that modifies the data.
+ * Wrap slow observers in a CollabDataAsyncObserver: operations are then
+ * queued and delivered by batches on another thread.
  *
  * \par Broadcaster
  * This is a special kind CollabDataOperationObserver. They technically both implement
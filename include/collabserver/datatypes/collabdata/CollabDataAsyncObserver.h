@@ -0,0 +1,251 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CollabDataOperation.h"
+#include "CollabDataOperationObserver.h"
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Delivers operations to an observer asynchronously, by batches.
+ *
+ * CollabData notifies its observers inline, from the thread that applies
+ * the operation: one slow observer (Database writer, UI bridge...) stalls
+ * the whole data. Register this wrapper instead of the slow observer.
+ * Each notified operation is copied (See CollabDataOperation::clone) and
+ * queued. The wrapped observer later receives the queued operations, in
+ * the same order, through onOperations, on its own executor.
+ *
+ * \par Executor
+ * Function that runs a delivery task somewhere else (Thread pool, UI
+ * event loop...). At most one task per wrapper is scheduled at a time:
+ * the wrapped observer is never called from two threads at once. Each
+ * task delivers one batch, then schedules the next one if any.
+ * Without executor, the wrapper starts its own delivery thread.
+ *
+ * \par Queue depth
+ * At most maxDepth operations wait for delivery. Once full:
+ *  - Drop: the new operation is dropped (See nb_dropped). For observers
+ *    that can catch up by other means. (ex: UI that reloads the data)
+ *  - Block: the notifying thread waits until a batch is delivered.
+ *
+ * \note
+ * Operations without clone (Default returns nullptr) can't be queued.
+ * They are delivered inline, once all queued operations are delivered.
+ *
+ * \warning
+ * The wrapped observer must not call flush, nor modify the data with the
+ * Block policy (It would wait for itself). With an executor, the executor
+ * must run the tasks until this wrapper is destroyed.
+ *
+ * \see CollabData
+ * \see CollabDataOperationObserver
+ */
+class CollabDataAsyncObserver : public CollabDataOperationObserver {
+   public:
+    /**
+     * What a notification does if the queue is full.
+     */
+    enum class Overflow { Drop, Block };
+
+    /**
+     * Runs the given delivery task (Now or later, on any thread).
+     */
+    typedef std::function<void(std::function<void()>)> Executor;
+
+   private:
+    CollabDataOperationObserver& _observer;
+    const std::size_t _maxDepth;
+    const Overflow _overflow;
+    const std::size_t _maxBatch;
+    const Executor _executor;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _notFull;
+    std::condition_variable _changed;  // Delivery scheduled, done, or stopping
+    std::deque<CollabDataOperationPtr> _pending;
+    std::vector<CollabDataOperationPtr> _batch;  // Delivery task only
+    bool _isScheduled = false;                   // A delivery task is scheduled or running
+    bool _isStopping = false;
+    std::size_t _nbDropped = 0;
+    std::thread _worker;  // Only without executor
+
+    // -------------------------------------------------------------------------
+    // Initialization
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Wraps an observer.
+     *
+     * \param observer  Observer to deliver operations to.
+     * \param maxDepth  Max number of operations waiting for delivery.
+     * \param overflow  What a notification does if the queue is full.
+     * \param maxBatch  Max number of operations given at once to onOperations.
+     * \param executor  Runs the delivery tasks (Own thread if empty).
+     */
+    explicit CollabDataAsyncObserver(CollabDataOperationObserver& observer, std::size_t maxDepth = 1024,
+                                     Overflow overflow = Overflow::Block, std::size_t maxBatch = 64,
+                                     Executor executor = Executor())
+        : _observer(observer),
+          _maxDepth(maxDepth > 0 ? maxDepth : 1),
+          _overflow(overflow),
+          _maxBatch(maxBatch > 0 ? maxBatch : 1),
+          _executor(std::move(executor)) {
+        _batch.reserve(_maxBatch);
+        if (!_executor) {
+            _worker = std::thread(&CollabDataAsyncObserver::runWorker, this);
+        }
+    }
+
+    CollabDataAsyncObserver(const CollabDataAsyncObserver& other) = delete;
+    CollabDataAsyncObserver& operator=(const CollabDataAsyncObserver& other) = delete;
+
+    /**
+     * Delivers the queued operations, then stops the delivery thread.
+     */
+    ~CollabDataAsyncObserver() override {
+        this->flush();
+        if (_worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _isStopping = true;
+                _changed.notify_all();
+            }
+            _worker.join();
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns the number of operations waiting for delivery.
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _pending.size();
+    }
+
+    /**
+     * Returns the number of operations dropped because the queue was full.
+     */
+    std::size_t nb_dropped() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _nbDropped;
+    }
+
+    // -------------------------------------------------------------------------
+    // CollabDataOperationObserver
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Queues a copy of the operation for the wrapped observer.
+     * See Overflow if the queue is full.
+     *
+     * \param op Reference to the operation.
+     */
+    void onOperation(const CollabDataOperation& op) override {
+        CollabDataOperationPtr copy = op.clone();
+        if (copy == nullptr) {
+            this->flush();
+            const std::vector<CollabDataOperationPtr> inlineOps = {
+                CollabDataOperationPtr(&op, [](const CollabDataOperation*) {})};
+            _observer.onOperations(inlineOps);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_pending.size() >= _maxDepth) {
+            if (_overflow == Overflow::Drop) {
+                ++_nbDropped;
+                return;
+            }
+            _notFull.wait(lock, [this]() { return _pending.size() < _maxDepth; });
+        }
+        _pending.push_back(std::move(copy));
+        if (!_isScheduled) {
+            _isScheduled = true;
+            this->schedule(lock);
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Waits until all queued operations are delivered.
+     */
+    void flush() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _changed.wait(lock, [this]() { return !_isScheduled; });
+    }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    // Called with _isScheduled just set (Lock held)
+    void schedule(std::unique_lock<std::mutex>& lock) {
+        if (_executor) {
+            lock.unlock();
+            _executor([this]() { this->deliverBatch(); });
+        } else {
+            _changed.notify_all();
+        }
+    }
+
+    // Delivers one batch, then schedules the next one if any
+    void deliverBatch() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            while (!_pending.empty() && _batch.size() < _maxBatch) {
+                _batch.push_back(std::move(_pending.front()));
+                _pending.pop_front();
+            }
+            _notFull.notify_all();
+        }
+        if (!_batch.empty()) {
+            _observer.onOperations(_batch);
+            _batch.clear();
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_pending.empty()) {
+            _isScheduled = false;
+            _changed.notify_all();
+        } else {
+            this->schedule(lock);
+        }
+    }
+
+    void runWorker() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            _changed.wait(lock, [this]() { return _isScheduled || _isStopping; });
+            if (!_isScheduled) {
+                return;  // Stopping once idle
+            }
+            lock.unlock();
+            this->deliverBatch();
+            lock.lock();
+        }
+    }
+};
+
+}  // namespace collabserver
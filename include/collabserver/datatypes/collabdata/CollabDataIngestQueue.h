@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../utils/BoundedMPSCQueue.h"
+#include "CollabData.h"
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Ingestion stage in front of CollabData::applyExternOperation.
+ *
+ * CollabData is not thread safe: operations received by several network
+ * threads must be applied one at a time. Instead of serializing these
+ * threads with a lock around applyExternOperation, they push operations in
+ * a bounded lock-free queue (See BoundedMPSCQueue). One writer thread
+ * pops them by batches and applies them on the data.
+ *
+ * \par
+ * A network thread only waits if the queue is full (See Backpressure).
+ * Operations pushed by one thread are applied in the order they were
+ * pushed. Operations from different threads are interleaved in any order,
+ * which is fine since CollabData operations are commutative.
+ *
+ * \par Completion
+ * Each operation may come with a completion callback. It is called by the
+ * writer thread, right after the operation is applied, with the result of
+ * applyExternOperation (False if the operation could not be unserialized).
+ *
+ * \par Writer thread
+ * start runs a writer thread that waits for operations. Otherwise, the
+ * owner may pump the queue itself with drain (For instance, from its own
+ * event loop). Either way, operation observers of the data are notified
+ * from the thread that applies the operation.
+ *
+ * \warning
+ * The data must only be modified through this queue while it is used.
+ * Completion callbacks must not throw, and must not push in a full queue
+ * with the Block policy (The writer thread would wait for itself).
+ *
+ * \see CollabData
+ * \see BoundedMPSCQueue
+ */
+class CollabDataIngestQueue {
+   public:
+    /**
+     * What push does if the queue is full.
+     *  - Reject: returns false right away. (The caller may drop the
+     *    connection or retry later).
+     *  - Block: waits until the writer makes room.
+     */
+    enum class Backpressure { Reject, Block };
+
+    /**
+     * Called once the operation is applied.
+     * Receives the result of applyExternOperation.
+     */
+    typedef std::function<void(bool isApplied)> Completion;
+
+   private:
+    struct Entry {
+        unsigned int id = 0;
+        std::string buffer;
+        Completion done;
+    };
+
+    CollabData& _data;
+    BoundedMPSCQueue<Entry> _queue;
+    const Backpressure _policy;
+    const std::size_t _batchSize;
+    std::vector<Entry> _batch;  // Consumer only (Reused by each drain)
+
+    // DevNote: mutex and conditions are only used to sleep and wake up.
+    // A push that finds room never takes the mutex, unless the writer
+    // thread is sleeping on an empty queue.
+    std::mutex _mutex;
+    std::condition_variable _notFull;
+    std::condition_variable _notEmpty;
+    std::atomic<int> _nbWaitingProducers;
+    std::atomic<bool> _isWriterSleeping;
+    std::atomic<bool> _isStopping;
+    std::thread _writer;
+
+    // Times a thread yields before it sleeps (Waking up a thread costs
+    // more than a few yields when the other side is about to catch up).
+    static constexpr int nbYieldsBeforeSleep = 16;
+
+    // -------------------------------------------------------------------------
+    // Initialization
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Creates an ingestion queue for this data.
+     * No writer thread is started (See start).
+     *
+     * \param data      Data to apply operations on.
+     * \param capacity  Max number of queued operations (Rounded up to a power of two).
+     * \param policy    What push does when the queue is full.
+     * \param batchSize Max number of operations popped at once by the writer.
+     */
+    explicit CollabDataIngestQueue(CollabData& data, std::size_t capacity = 1024,
+                                   Backpressure policy = Backpressure::Block, std::size_t batchSize = 64)
+        : _data(data),
+          _queue(capacity),
+          _policy(policy),
+          _batchSize(batchSize > 0 ? batchSize : 1),
+          _nbWaitingProducers(0),
+          _isWriterSleeping(false),
+          _isStopping(false) {
+        _batch.reserve(_batchSize);
+    }
+
+    CollabDataIngestQueue(const CollabDataIngestQueue& other) = delete;
+    CollabDataIngestQueue& operator=(const CollabDataIngestQueue& other) = delete;
+
+    /**
+     * Stops the writer thread, if any.
+     * Operations still queued are applied first.
+     */
+    ~CollabDataIngestQueue() {
+        this->stop();
+        this->drain();
+    }
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns the max number of queued operations.
+     */
+    std::size_t capacity() const { return _queue.capacity(); }
+
+    /**
+     * Returns the number of operations not popped by the writer yet.
+     * Only a hint while other threads push.
+     */
+    std::size_t size() const { return _queue.size(); }
+
+    /**
+     * Checks whether the writer thread is running.
+     */
+    bool is_running() const { return _writer.joinable(); }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Queues an operation received from an external component.
+     * Same parameters as CollabData::applyExternOperation.
+     * Thread safe: may be called by any number of threads at once.
+     *
+     * If the queue is full, either returns false (Reject policy) or waits
+     * for the writer to make room (Block policy). A rejected operation is
+     * dropped: its completion is never called. With the Block policy, the
+     * queue must be drained meanwhile (Writer thread or drain).
+     *
+     * \param id        CollabDataOperation's ID.
+     * \param buffer    Serialized version of the operation.
+     * \param done      Called once the operation is applied (Optional).
+     * \return True if queued, otherwise, return false.
+     */
+    bool push(unsigned int id, std::string buffer, Completion done = Completion()) {
+        Entry entry;
+        entry.id = id;
+        entry.buffer = std::move(buffer);
+        entry.done = std::move(done);
+
+        int nbTries = 0;
+        while (!_queue.try_push(std::move(entry))) {
+            if (_policy == Backpressure::Reject) {
+                return false;
+            }
+            if (++nbTries <= nbYieldsBeforeSleep) {
+                std::this_thread::yield();  // Writer is probably popping
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _nbWaitingProducers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);  // See notifyNotFull
+            if (_queue.full()) {
+                _notFull.wait(lock);
+            }
+            _nbWaitingProducers.fetch_sub(1);
+        }
+
+        // DevNote: the fence orders the push before the flag load. With the
+        // fence of waitNotEmpty, either the writer sees the operation, or
+        // this sees the writer sleeping and wakes it up.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_isWriterSleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _notEmpty.notify_one();
+        }
+        return true;
+    }
+
+    /**
+     * Applies queued operations from the calling thread.
+     * Each operation is applied, then its completion is called.
+     * Stops once the queue is empty or nbMax operations were applied.
+     *
+     * \warning
+     * Must not be called while the writer thread is running.
+     * Only one thread at a time may call drain.
+     *
+     * \param nbMax Max number of operations to apply.
+     * \return Number of applied operations.
+     */
+    std::size_t drain(std::size_t nbMax = std::numeric_limits<std::size_t>::max()) {
+        std::size_t nbApplied = 0;
+        while (nbApplied < nbMax) {
+            const std::size_t nbPopped = this->popBatch(std::min(_batchSize, nbMax - nbApplied));
+            if (nbPopped == 0) {
+                break;
+            }
+            for (Entry& entry : _batch) {
+                const bool isApplied = _data.applyExternOperation(entry.id, entry.buffer);
+                if (entry.done) {
+                    entry.done(isApplied);
+                }
+            }
+            _batch.clear();
+            nbApplied += nbPopped;
+        }
+        return nbApplied;
+    }
+
+    /**
+     * Starts the writer thread.
+     * It applies operations by batches, and sleeps while the queue is empty.
+     * Does nothing if already running.
+     */
+    void start() {
+        if (!_writer.joinable()) {
+            _isStopping.store(false);
+            _writer = std::thread(&CollabDataIngestQueue::runWriter, this);
+        }
+    }
+
+    /**
+     * Stops the writer thread, once all operations queued so far are
+     * applied. Waits for it to end.
+     * Does nothing if not running.
+     */
+    void stop() {
+        if (!_writer.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _isStopping.store(true);
+            _notEmpty.notify_one();
+        }
+        _writer.join();
+        _isStopping.store(false);
+    }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    // Pops up to nbMax entries in _batch. Cells are free once popped:
+    // producers waiting for room are woken up before the batch is applied.
+    std::size_t popBatch(std::size_t nbMax) {
+        Entry entry;
+        while (_batch.size() < nbMax && _queue.try_pop(entry)) {
+            _batch.push_back(std::move(entry));
+        }
+        if (!_batch.empty()) {
+            this->notifyNotFull();
+        }
+        return _batch.size();
+    }
+
+    void notifyNotFull() {
+        // DevNote: same as push, the fence orders the pops before the
+        // counter load (Paired with the fence of the blocked producer).
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_nbWaitingProducers.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _notFull.notify_all();
+        }
+    }
+
+    // Sleeps until an operation is pushed or stop is requested.
+    void waitNotEmpty() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _isWriterSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // See push
+        if (_queue.empty() && !_isStopping.load()) {
+            _notEmpty.wait(lock);
+        }
+        _isWriterSleeping.store(false, std::memory_order_relaxed);
+    }
+
+    void runWriter() {
+        int nbTries = 0;
+        for (;;) {
+            if (this->drain(_batchSize) > 0) {
+                nbTries = 0;
+                continue;
+            }
+            if (_isStopping.load()) {
+                this->drain();  // Pushed before stop
+                return;
+            }
+            if (++nbTries <= nbYieldsBeforeSleep) {
+                std::this_thread::yield();
+            } else {
+                this->waitNotEmpty();
+                nbTries = 0;
+            }
+        }
+    }
+};
+
+}  // namespace collabserver
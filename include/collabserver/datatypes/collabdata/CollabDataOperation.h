@@ -1,11 +1,20 @@
 #pragma once
 
+#include <memory>
 #include <sstream>
 
 #include "CollabDataOperationHandler.h"
 
 namespace collabserver {
 
+class CollabDataOperation;
+
+/**
+ * Operation shared by several components.
+ * (ex: queued for several asynchronous observers)
+ */
+typedef std::shared_ptr<const CollabDataOperation> CollabDataOperationPtr;
+
 /**
  * \brief
  * Interface of any operation applicable on a CollabData.
@@ -57,6 +66,16 @@ class CollabDataOperation {
      * \param handler The famous concrete handler to use.
      */
     virtual void accept(CollabDataOperationHandler& handler) const = 0;
+
+    /**
+     * Returns a copy of this operation.
+     * Used to keep an operation after it was notified. (ex: to deliver it
+     * later to a CollabDataAsyncObserver).
+     * Returns nullptr by default (Operation not copyable).
+     *
+     * \return Copy of this operation, or nullptr.
+     */
+    virtual CollabDataOperationPtr clone() const { return nullptr; }
 };
 
 }  // namespace collabserver
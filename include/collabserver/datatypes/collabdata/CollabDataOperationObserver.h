@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "CollabDataOperation.h"
 
 namespace collabserver {
@@ -51,6 +53,19 @@ class CollabDataOperationObserver {
      * \param op Reference to the operation.
      */
     virtual void onOperation(const CollabDataOperation& op) = 0;
+
+    /**
+     * Receives several operations at once, in the order they took place.
+     * Only called by a CollabDataAsyncObserver that wraps this observer.
+     * Default calls onOperation for each operation.
+     *
+     * \param ops Operations to process.
+     */
+    virtual void onOperations(const std::vector<CollabDataOperationPtr>& ops) {
+        for (const CollabDataOperationPtr& op : ops) {
+            this->onOperation(*op);
+        }
+    }
 };
 
 }  // namespace collabserver
@@ -0,0 +1,732 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>  // std::hash, std::equal_to
+#include <iterator>
+#include <limits>
+#include <memory>  // std::allocator
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>  // std::pair
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Default FlatHashMap slot layout: each slot is a std::pair<const Key, T>.
+ *
+ * A layout tells FlatHashMap what is stored in each slot, how to read the
+ * key of a slot and what iterators return.
+ *
+ *
+ * \tparam Key  Type of key.
+ * \tparam T    Type of mapped value.
+ */
+template <typename Key, typename T>
+struct FlatPairLayout {
+    typedef std::pair<const Key, T> slot_type;
+
+    static const Key& key(const slot_type& slot) { return slot.first; }
+
+    template <typename K, typename... Args>
+    static void construct(slot_type* p, K&& key, Args&&... args) {
+        ::new (static_cast<void*>(p)) slot_type(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                                                std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <bool IsConst>
+    struct access {
+        typedef typename std::conditional<IsConst, const slot_type, slot_type>::type& reference;
+        typedef typename std::conditional<IsConst, const slot_type, slot_type>::type* pointer;
+
+        static reference deref(reference slot) { return slot; }
+        static pointer arrow(reference slot) { return &slot; }
+    };
+};
+
+/**
+ * \brief
+ * FlatHashMap slot layout for values that already hold their own key.
+ *
+ * Each slot only stores T, the key is read with T::key(). This avoids
+ * storing the key twice when the mapped value needs it. T must be
+ * constructible from (key, args...).
+ *
+ * Iterators return a proxy pair of references, so 'it->first' and
+ * 'it->second' work as for std::unordered_map.
+ *
+ *
+ * \tparam Key  Type of key.
+ * \tparam T    Type of mapped value (Must implement 'const Key& key() const').
+ */
+template <typename Key, typename T>
+struct FlatKeyedLayout {
+    typedef T slot_type;
+
+    static const Key& key(const slot_type& slot) { return slot.key(); }
+
+    template <typename K, typename... Args>
+    static void construct(slot_type* p, K&& key, Args&&... args) {
+        build(p, IsSlot<Args...>(), std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    template <bool IsConst>
+    struct access {
+        typedef typename std::conditional<IsConst, const T, T>::type mapped;
+
+        struct reference {
+            const Key& first;
+            mapped& second;
+        };
+
+        struct pointer {
+            reference ref;
+            const reference* operator->() const { return &ref; }
+        };
+
+        static reference deref(mapped& slot) { return reference{slot.key(), slot}; }
+        static pointer arrow(mapped& slot) { return pointer{deref(slot)}; }
+    };
+
+   private:
+    // True if Args is one T (Inserting an already built value: copy it)
+    template <typename... Args>
+    struct IsSlot : std::false_type {};
+
+    template <typename Arg>
+    struct IsSlot<Arg> : std::is_same<typename std::decay<Arg>::type, T> {};
+
+    template <typename K, typename Arg>
+    static void build(slot_type* p, std::true_type, K&&, Arg&& value) {
+        ::new (static_cast<void*>(p)) slot_type(std::forward<Arg>(value));
+    }
+
+    template <typename K, typename... Args>
+    static void build(slot_type* p, std::false_type, K&& key, Args&&... args) {
+        ::new (static_cast<void*>(p)) slot_type(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+};
+
+/**
+ * \brief
+ * Open-addressing hash map with keys and values stored inline.
+ *
+ * Drop-in replacement for the subset of std::unordered_map used by the CRDT
+ * containers. Elements are stored in one contiguous array of slots (no node
+ * per element). A parallel array of control bytes marks each slot as empty,
+ * erased or full. Full slots also keep 7 bits of the key hash, so most probes
+ * for a missing key never touch the slot itself.
+ *
+ * \par Probing
+ * Linear probing over a power of two capacity. Erased slots are kept as
+ * markers until the next rehash so that erase never moves other elements.
+ * The table is grown when full and erased slots reach 3/4 of capacity.
+ *
+ * \par Iterators and references
+ * Inserting may rehash and invalidates all iterators and references.
+ * If bucket_count() is unchanged after an insert, no element moved.
+ * Erasing only invalidates iterators to the erased element.
+ *
+ * \par Marks
+ * Each element has one user mark bit, kept in a separate bitmap (1 bit per
+ * slot). begin_marked / next_marked only visit marked elements and skip 64
+ * slots per bitmap word. The CRDT containers mark their alive elements so
+ * that iterating over them is cheap even with many tombstones.
+ * New elements are unmarked. Marks follow their element on rehash and copy.
+ *
+ * \see FlatPairLayout
+ * \see FlatKeyedLayout
+ *
+ *
+ * \tparam Key      Type of key.
+ * \tparam T        Type of mapped value.
+ * \tparam Hash     Hash function for Key.
+ * \tparam KeyEqual Equality function for Key.
+ * \tparam Layout   What is stored in each slot (Default: pair of key, value).
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>,
+          typename Layout = FlatPairLayout<Key, T>>
+class FlatHashMap {
+   public:
+    template <bool IsConst>
+    class basic_iterator;
+
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::size_t size_type;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+    typedef typename Layout::slot_type slot_type;
+    typedef basic_iterator<false> iterator;
+    typedef basic_iterator<true> const_iterator;
+
+   private:
+    static const std::uint8_t kEmpty = 0x00;
+    static const std::uint8_t kErased = 0x01;
+    static const std::uint8_t kFullBit = 0x80;
+    static const size_type kMinCapacity = 8;
+
+    struct Probe {
+        size_type index;
+        std::uint8_t tag;
+        bool isFound;
+    };
+
+    std::uint8_t* _ctrl = nullptr;    // One control byte per slot
+    std::uint64_t* _marks = nullptr;  // One mark bit per slot
+    slot_type* _slots = nullptr;      // Raw storage, only full slots are built
+    size_type _capacity = 0;        // Always 0 or a power of two
+    size_type _size = 0;            // Nb of full slots
+    size_type _erased = 0;          // Nb of erased markers
+    Hash _hash;
+    KeyEqual _equal;
+
+    // -------------------------------------------------------------------------
+    // Initialization
+    // -------------------------------------------------------------------------
+
+   public:
+    FlatHashMap() = default;
+
+    FlatHashMap(const FlatHashMap& other) : _hash(other._hash), _equal(other._equal) {
+        this->reserve(other._size);
+        for (size_type k = 0; k < other._capacity; ++k) {
+            if (other._ctrl[k] & kFullBit) {
+                const slot_type& slot = other._slots[k];
+                const Probe probe = this->prepareInsert(Layout::key(slot));
+                ::new (static_cast<void*>(_slots + probe.index)) slot_type(slot);
+                this->commitInsert(probe);
+                if (other.isMarked(k)) {
+                    this->setMark(probe.index, true);
+                }
+            }
+        }
+    }
+
+    FlatHashMap(FlatHashMap&& other) noexcept : _hash(other._hash), _equal(other._equal) { this->swap(other); }
+
+    FlatHashMap& operator=(const FlatHashMap& other) {
+        if (this != &other) {
+            FlatHashMap copy(other);
+            this->swap(copy);
+        }
+        return *this;
+    }
+
+    FlatHashMap& operator=(FlatHashMap&& other) noexcept {
+        if (this != &other) {
+            this->destroyAll();
+            this->swap(other);
+        }
+        return *this;
+    }
+
+    ~FlatHashMap() { this->destroyAll(); }
+
+    void swap(FlatHashMap& other) noexcept {
+        std::swap(_ctrl, other._ctrl);
+        std::swap(_marks, other._marks);
+        std::swap(_slots, other._slots);
+        std::swap(_capacity, other._capacity);
+        std::swap(_size, other._size);
+        std::swap(_erased, other._erased);
+        std::swap(_hash, other._hash);
+        std::swap(_equal, other._equal);
+    }
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    bool empty() const noexcept { return _size == 0; }
+
+    size_type size() const noexcept { return _size; }
+
+    size_type max_size() const noexcept { return std::numeric_limits<size_type>::max() / (sizeof(slot_type) + 1) / 2; }
+
+    /**
+     * Returns the number of slots in the table.
+     * Named after std::unordered_map::bucket_count for compatibility.
+     *
+     * \return Number of slots.
+     */
+    size_type bucket_count() const noexcept { return _capacity; }
+
+    // -------------------------------------------------------------------------
+    // Lookup methods
+    // -------------------------------------------------------------------------
+
+   public:
+    iterator find(const Key& key) { return iterator(this, this->findIndex(key)); }
+
+    const_iterator find(const Key& key) const { return const_iterator(this, this->findIndex(key)); }
+
+    size_type count(const Key& key) const { return (this->findIndex(key) != _capacity) ? 1 : 0; }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Inserts element if no element with the same key exists.
+     *
+     * \param value Pair of key and mapped value to insert.
+     * \return Iterator to the element with this key and true if inserted.
+     */
+    template <typename P>
+    std::pair<iterator, bool> insert(P&& value) {
+        return this->try_emplace(value.first, std::forward<P>(value).second);
+    }
+
+    /**
+     * Inserts an element built in place from key and args if the key is
+     * not already in the map. Nothing is built if the key exists.
+     *
+     * \param key   Key of the element.
+     * \param args  Arguments forwarded to the mapped value constructor.
+     * \return Iterator to the element with this key and true if inserted.
+     */
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        const Probe probe = this->prepareInsert(key);
+        if (!probe.isFound) {
+            Layout::construct(_slots + probe.index, std::forward<K>(key), std::forward<Args>(args)...);
+            this->commitInsert(probe);
+        }
+        return std::make_pair(iterator(this, probe.index), !probe.isFound);
+    }
+
+    /**
+     * Removes the element at pos.
+     *
+     * \param pos Iterator to the element to remove.
+     * \return Iterator following the removed element.
+     */
+    iterator erase(const_iterator pos) {
+        const size_type index = pos._index;
+        _slots[index].~slot_type();
+        _ctrl[index] = kErased;
+        this->setMark(index, false);
+        --_size;
+        ++_erased;
+        return iterator(this, this->nextFull(index + 1));
+    }
+
+    /**
+     * Removes the element with this key (If any).
+     *
+     * \param key Key of the element to remove.
+     * \return Number of elements removed (0 or 1).
+     */
+    size_type erase(const Key& key) {
+        const size_type index = this->findIndex(key);
+        if (index == _capacity) {
+            return 0;
+        }
+        this->erase(const_iterator(this, index));
+        return 1;
+    }
+
+    /**
+     * Removes all elements. Capacity is kept.
+     */
+    void clear() noexcept {
+        for (size_type k = 0; k < _capacity; ++k) {
+            if (_ctrl[k] & kFullBit) {
+                _slots[k].~slot_type();
+            }
+            _ctrl[k] = kEmpty;
+        }
+        this->clear_marks();
+        _size = 0;
+        _erased = 0;
+    }
+
+    // -------------------------------------------------------------------------
+    // Marks
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Sets or clears the mark of the element at pos.
+     *
+     * \param pos    Iterator to the element.
+     * \param marked New mark value.
+     */
+    void mark(const_iterator pos, bool marked) noexcept { this->setMark(pos._index, marked); }
+
+    /**
+     * Checks whether the element at pos is marked.
+     *
+     * \param pos Iterator to the element.
+     * \return True if marked.
+     */
+    bool is_marked(const_iterator pos) const noexcept { return this->isMarked(pos._index); }
+
+    /**
+     * Unmarks all elements. Only touches the bitmap (capacity / 64 words).
+     */
+    void clear_marks() noexcept {
+        const size_type nbWords = wordCount(_capacity);
+        for (size_type k = 0; k < nbWords; ++k) {
+            _marks[k] = 0;
+        }
+    }
+
+    /**
+     * Returns an iterator to the first marked element (Or end).
+     */
+    iterator begin_marked() noexcept { return iterator(this, this->nextMarked(0)); }
+
+    const_iterator begin_marked() const noexcept { return const_iterator(this, this->nextMarked(0)); }
+
+    /**
+     * Returns an iterator to the next marked element after pos (Or end).
+     *
+     * \param pos Iterator to an element (Must not be end).
+     * \return Iterator to the next marked element.
+     */
+    iterator next_marked(const_iterator pos) noexcept { return iterator(this, this->nextMarked(pos._index + 1)); }
+
+    const_iterator next_marked(const_iterator pos) const noexcept {
+        return const_iterator(this, this->nextMarked(pos._index + 1));
+    }
+
+    // -------------------------------------------------------------------------
+    // Hash policy methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Reserves space for at least count elements without rehash.
+     *
+     * \param count Number of elements.
+     */
+    void reserve(size_type count) {
+        size_type capacity = kMinCapacity;
+        while (capacity - capacity / 4 < count) {
+            capacity *= 2;
+        }
+        if (capacity > _capacity) {
+            this->resize(capacity);
+        }
+    }
+
+    /**
+     * Rebuilds the table with at least count slots (Enough for size()).
+     * Drops the erased markers. May shrink the table after many erase.
+     *
+     * \param count Minimal number of slots.
+     */
+    void rehash(size_type count) {
+        if (_capacity == 0 && count == 0) {
+            return;
+        }
+        size_type capacity = kMinCapacity;
+        while (capacity < count || capacity - capacity / 4 < _size) {
+            capacity *= 2;
+        }
+        if (capacity != _capacity || _erased > 0) {
+            this->resize(capacity);
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Iterators
+    // -------------------------------------------------------------------------
+
+   public:
+    iterator begin() noexcept { return iterator(this, this->nextFull(0)); }
+
+    const_iterator begin() const noexcept { return const_iterator(this, this->nextFull(0)); }
+
+    const_iterator cbegin() const noexcept { return this->begin(); }
+
+    iterator end() noexcept { return iterator(this, _capacity); }
+
+    const_iterator end() const noexcept { return const_iterator(this, _capacity); }
+
+    const_iterator cend() const noexcept { return this->end(); }
+
+    // -------------------------------------------------------------------------
+    // Operators overload
+    // -------------------------------------------------------------------------
+
+   public:
+    friend bool operator==(const FlatHashMap& lhs, const FlatHashMap& rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (auto it = lhs.begin(); it != lhs.end(); ++it) {
+            const_iterator other_it = rhs.find(it->first);
+            if (other_it == rhs.end() || !(other_it->second == it->second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const FlatHashMap& lhs, const FlatHashMap& rhs) { return !(lhs == rhs); }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    static std::uint64_t mix(std::uint64_t h) {
+        // Murmur3 finalizer: std::hash is often the identity for integers
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static std::uint8_t tagOf(std::uint64_t h) { return static_cast<std::uint8_t>((h >> 57) | kFullBit); }
+
+    size_type nextFull(size_type index) const {
+        while (index < _capacity && !(_ctrl[index] & kFullBit)) {
+            ++index;
+        }
+        return index;
+    }
+
+    static size_type wordCount(size_type capacity) { return (capacity + 63) / 64; }
+
+    static size_type lowestBit(std::uint64_t bits) {
+#if defined(__GNUC__)
+        return static_cast<size_type>(__builtin_ctzll(bits));
+#else
+        size_type index = 0;
+        while (!(bits & 1)) {
+            bits >>= 1;
+            ++index;
+        }
+        return index;
+#endif
+    }
+
+    bool isMarked(size_type index) const { return (_marks[index / 64] >> (index % 64)) & 1; }
+
+    void setMark(size_type index, bool marked) {
+        const std::uint64_t bit = std::uint64_t(1) << (index % 64);
+        if (marked) {
+            _marks[index / 64] |= bit;
+        } else {
+            _marks[index / 64] &= ~bit;
+        }
+    }
+
+    size_type nextMarked(size_type index) const {
+        if (index >= _capacity) {
+            return _capacity;
+        }
+        const size_type nbWords = wordCount(_capacity);
+        size_type word = index / 64;
+        std::uint64_t bits = _marks[word] & (~std::uint64_t(0) << (index % 64));
+        while (bits == 0) {
+            if (++word == nbWords) {
+                return _capacity;
+            }
+            bits = _marks[word];
+        }
+        return word * 64 + lowestBit(bits);
+    }
+
+    size_type findIndex(const Key& key) const {
+        if (_size == 0) {
+            return _capacity;
+        }
+        const std::uint64_t h = mix(_hash(key));
+        const std::uint8_t tag = tagOf(h);
+        const size_type mask = _capacity - 1;
+        for (size_type index = static_cast<size_type>(h) & mask;; index = (index + 1) & mask) {
+            const std::uint8_t ctrl = _ctrl[index];
+            if (ctrl == kEmpty) {
+                return _capacity;
+            }
+            if (ctrl == tag && _equal(Layout::key(_slots[index]), key)) {
+                return index;
+            }
+        }
+    }
+
+    // Finds the key or the slot where to build it.
+    // If not found, caller builds the slot then calls commitInsert.
+    // Only rehashes if the key is missing and takes an empty slot past the
+    // load threshold: an existing key never invalidates iterators.
+    Probe prepareInsert(const Key& key) {
+        if (_capacity > 0) {
+            const Probe probe = this->findSlot(key);
+            if (probe.isFound || _ctrl[probe.index] == kErased || !this->isOverloaded()) {
+                return probe;
+            }
+        }
+        this->resize(this->growCapacity());
+        return this->findSlot(key);
+    }
+
+    bool isOverloaded() const { return (_size + _erased + 1) > _capacity - _capacity / 4; }
+
+    Probe findSlot(const Key& key) const {
+        const std::uint64_t h = mix(_hash(key));
+        const std::uint8_t tag = tagOf(h);
+        const size_type mask = _capacity - 1;
+        size_type target = _capacity;  // First erased slot seen, reused if key missing
+        size_type index = static_cast<size_type>(h) & mask;
+        for (;; index = (index + 1) & mask) {
+            const std::uint8_t ctrl = _ctrl[index];
+            if (ctrl == kEmpty) {
+                break;
+            }
+            if (ctrl == kErased) {
+                if (target == _capacity) {
+                    target = index;
+                }
+            } else if (ctrl == tag && _equal(Layout::key(_slots[index]), key)) {
+                return Probe{index, tag, true};
+            }
+        }
+        return Probe{(target == _capacity) ? index : target, tag, false};
+    }
+
+    void commitInsert(const Probe& probe) {
+        if (_ctrl[probe.index] == kErased) {
+            --_erased;
+        }
+        _ctrl[probe.index] = probe.tag;
+        ++_size;
+    }
+
+    size_type growCapacity() const {
+        if (_capacity == 0) {
+            return kMinCapacity;
+        }
+        // Only erased markers to drop: rehash in place, same capacity
+        return (_size + 1 > _capacity / 2) ? _capacity * 2 : _capacity;
+    }
+
+    void resize(size_type capacity) {
+        std::allocator<slot_type> slotAlloc;
+        std::allocator<std::uint8_t> ctrlAlloc;
+        std::allocator<std::uint64_t> marksAlloc;
+
+        std::uint8_t* oldCtrl = _ctrl;
+        std::uint64_t* oldMarks = _marks;
+        slot_type* oldSlots = _slots;
+        const size_type oldCapacity = _capacity;
+
+        _ctrl = ctrlAlloc.allocate(capacity);
+        _marks = marksAlloc.allocate(wordCount(capacity));
+        _slots = slotAlloc.allocate(capacity);
+        _capacity = capacity;
+        _erased = 0;
+        for (size_type k = 0; k < capacity; ++k) {
+            _ctrl[k] = kEmpty;
+        }
+        this->clear_marks();
+
+        const size_type mask = capacity - 1;
+        for (size_type k = 0; k < oldCapacity; ++k) {
+            if (oldCtrl[k] & kFullBit) {
+                const std::uint64_t h = mix(_hash(Layout::key(oldSlots[k])));
+                size_type index = static_cast<size_type>(h) & mask;
+                while (_ctrl[index] != kEmpty) {
+                    index = (index + 1) & mask;
+                }
+                ::new (static_cast<void*>(_slots + index)) slot_type(std::move(oldSlots[k]));
+                _ctrl[index] = tagOf(h);
+                if ((oldMarks[k / 64] >> (k % 64)) & 1) {
+                    this->setMark(index, true);
+                }
+                oldSlots[k].~slot_type();
+            }
+        }
+
+        if (oldCapacity > 0) {
+            ctrlAlloc.deallocate(oldCtrl, oldCapacity);
+            marksAlloc.deallocate(oldMarks, wordCount(oldCapacity));
+            slotAlloc.deallocate(oldSlots, oldCapacity);
+        }
+    }
+
+    void destroyAll() noexcept {
+        if (_capacity == 0) {
+            return;
+        }
+        this->clear();
+        std::allocator<std::uint8_t>().deallocate(_ctrl, _capacity);
+        std::allocator<std::uint64_t>().deallocate(_marks, wordCount(_capacity));
+        std::allocator<slot_type>().deallocate(_slots, _capacity);
+        _ctrl = nullptr;
+        _marks = nullptr;
+        _slots = nullptr;
+        _capacity = 0;
+    }
+};
+
+/**
+ * \brief
+ * Forward iterator over the full slots of a FlatHashMap.
+ *
+ *
+ * \tparam IsConst True for const_iterator.
+ */
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename Layout>
+template <bool IsConst>
+class FlatHashMap<Key, T, Hash, KeyEqual, Layout>::basic_iterator {
+   private:
+    friend FlatHashMap;
+    typedef typename Layout::template access<IsConst> access;
+    typedef typename std::conditional<IsConst, const FlatHashMap*, FlatHashMap*>::type map_pointer;
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename FlatHashMap::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef typename access::pointer pointer;
+    typedef typename access::reference reference;
+
+   private:
+    map_pointer _map = nullptr;
+    size_type _index = 0;
+
+    basic_iterator(map_pointer map, size_type index) : _map(map), _index(index) {}
+
+   public:
+    basic_iterator() = default;
+
+    // Allows iterator to const_iterator conversion
+    template <bool OtherConst, typename = typename std::enable_if<IsConst && !OtherConst>::type>
+    basic_iterator(const basic_iterator<OtherConst>& other) : _map(other._map), _index(other._index) {}
+
+    basic_iterator& operator++() {
+        _index = _map->nextFull(_index + 1);
+        return *this;
+    }
+
+    basic_iterator operator++(int) {
+        basic_iterator old = *this;
+        ++(*this);
+        return old;
+    }
+
+    bool operator==(const basic_iterator& other) const { return _index == other._index && _map == other._map; }
+
+    bool operator!=(const basic_iterator& other) const { return !(*this == other); }
+
+    reference operator*() const { return access::deref(_map->_slots[_index]); }
+
+    pointer operator->() const { return access::arrow(_map->_slots[_index]); }
+
+    template <bool>
+    friend class basic_iterator;
+};
+
+}  // namespace collabserver
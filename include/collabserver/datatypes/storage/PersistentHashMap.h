@@ -0,0 +1,641 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>  // std::hash, std::equal_to
+#include <iterator>
+#include <limits>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>  // std::pair
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Persistent hash map: copies share their nodes (Hash Array Mapped Trie).
+ *
+ * Elements are leaves of a trie indexed by 5 bits of the hash per level.
+ * Each branch only stores its present children (32 bits bitmap), so
+ * lookups go through about log32(n) nodes.
+ *
+ * \par Structural sharing
+ * Nodes are reference counted. A copy of the map only shares its root:
+ * O(1), whatever the size. A non-const access (find, begin, iteration,
+ * insert, erase) first copies the shared nodes on its path (Path copying),
+ * so that two copies never see the modifications of each other. Const
+ * accesses never copy.
+ *
+ * \par
+ * Reference counts are atomic and shared nodes are never written: a copy
+ * may be read or destroyed from another thread while the original is
+ * modified. A map object itself is not thread safe (The copy must be done
+ * by the thread that modifies the map, or under its lock).
+ *
+ * Implements the std::unordered_map interface subset of the storage
+ * policies (See StoragePolicy.h).
+ *
+ * \warning
+ * Elements are stable while the map is not copied: insert and erase do not
+ * move the other elements. After a copy, iterators and references taken
+ * before it are invalidated by the next non-const access.
+ *
+ * \tparam Key      Type of key.
+ * \tparam T        Type of mapped value.
+ * \tparam Hash     Hash function.
+ * \tparam KeyEqual Key equality function.
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class PersistentHashMap {
+   public:
+    template <bool IsConst>
+    class basic_iterator;
+
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::size_t size_type;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+    typedef basic_iterator<false> iterator;
+    typedef basic_iterator<true> const_iterator;
+
+   private:
+    static const unsigned kBits = 5;              // Hash bits per level
+    static const std::uint64_t kMask = 31;        // Child index mask
+    static const std::size_t kMaxDepth = 64 / 5;  // Deepest branch level
+
+    struct Node {
+        std::atomic<std::size_t> refs;  // Maps and nodes that point to it
+        const bool isLeaf;
+
+        explicit Node(bool leaf) : refs(1), isLeaf(leaf) {}
+    };
+
+    // One element. Elements with the exact same hash are chained.
+    struct Leaf : Node {
+        const std::uint64_t hash;
+        Node* next;  // Next leaf with the same hash (Or null)
+        value_type value;
+
+        template <typename... Args>
+        Leaf(std::uint64_t h, Node* n, Args&&... args)
+            : Node(true), hash(h), next(n), value(std::forward<Args>(args)...) {}
+    };
+
+    // Children pointers are allocated right after the branch (One per bit)
+    struct Branch : Node {
+        const std::uint32_t bitmap;
+
+        explicit Branch(std::uint32_t bits) : Node(false), bitmap(bits) {}
+
+        Node** children() { return reinterpret_cast<Node**>(this + 1); }
+
+        std::size_t size() const { return static_cast<std::size_t>(__builtin_popcount(bitmap)); }
+
+        std::size_t index(std::uint32_t bit) const {
+            return static_cast<std::size_t>(__builtin_popcount(bitmap & (bit - 1)));
+        }
+    };
+
+    Node* _root = nullptr;  // Always a branch (Or null if empty)
+    size_type _size = 0;
+
+    // -------------------------------------------------------------------------
+    // Initialization
+    // -------------------------------------------------------------------------
+
+   public:
+    PersistentHashMap() = default;
+
+    /**
+     * Copies other in O(1): the root is shared.
+     */
+    PersistentHashMap(const PersistentHashMap& other) : _root(other._root), _size(other._size) {
+        if (_root != nullptr) {
+            _root->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    PersistentHashMap(PersistentHashMap&& other) noexcept : _root(other._root), _size(other._size) {
+        other._root = nullptr;
+        other._size = 0;
+    }
+
+    PersistentHashMap& operator=(const PersistentHashMap& other) {
+        PersistentHashMap copy(other);
+        this->swap(copy);
+        return *this;
+    }
+
+    PersistentHashMap& operator=(PersistentHashMap&& other) noexcept {
+        PersistentHashMap moved(std::move(other));
+        this->swap(moved);
+        return *this;
+    }
+
+    ~PersistentHashMap() { release(_root); }
+
+    // -------------------------------------------------------------------------
+    // Iterators
+    // -------------------------------------------------------------------------
+
+   public:
+    iterator begin() { return iterator(this, (_root != nullptr) ? leftmost<true>(_root) : nullptr); }
+
+    const_iterator begin() const { return this->cbegin(); }
+
+    // DevNote: const accesses call the <false> helpers, which never write
+    const_iterator cbegin() const {
+        return const_iterator(this, (_root != nullptr) ? leftmost<false>(this->rootRef()) : nullptr);
+    }
+
+    iterator end() noexcept { return iterator(this, nullptr); }
+
+    const_iterator end() const noexcept { return this->cend(); }
+
+    const_iterator cend() const noexcept { return const_iterator(this, nullptr); }
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    bool empty() const noexcept { return _size == 0; }
+
+    size_type size() const noexcept { return _size; }
+
+    size_type max_size() const noexcept { return std::numeric_limits<size_type>::max() / sizeof(Leaf); }
+
+    /**
+     * Checks if the nodes of this map are shared with a copy.
+     *
+     * \return True if the root is shared, otherwise, returns false.
+     */
+    bool is_shared() const noexcept { return _root != nullptr && _root->refs.load(std::memory_order_acquire) != 1; }
+
+    // -------------------------------------------------------------------------
+    // Lookup methods
+    // -------------------------------------------------------------------------
+
+   public:
+    iterator find(const Key& key) { return iterator(this, findLeaf<true>(_root, key, hashOf(key))); }
+
+    const_iterator find(const Key& key) const {
+        return const_iterator(this, findLeaf<false>(this->rootRef(), key, hashOf(key)));
+    }
+
+    size_type count(const Key& key) const { return (this->find(key) != this->end()) ? 1 : 0; }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Inserts an element built from (key, args...) if key is not there.
+     * Nothing is built (args are not consumed) if key already exists.
+     *
+     * \param key   Key of the element.
+     * \param args  Arguments forwarded to the mapped value constructor.
+     * \return Iterator to the element and true if inserted.
+     */
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        const std::uint64_t hash = hashOf(key);
+        if (_root == nullptr) {
+            Leaf* leaf = newLeaf(hash, nullptr, std::forward<K>(key), std::forward<Args>(args)...);
+            _root = newBranch(bitOf(hash, 0));
+            static_cast<Branch*>(_root)->children()[0] = leaf;
+            ++_size;
+            return std::make_pair(iterator(this, leaf), true);
+        }
+
+        own(_root);
+        Node** slot = &_root;
+        for (unsigned shift = 0;; shift += kBits) {
+            Branch* branch = static_cast<Branch*>(*slot);
+            const std::uint32_t bit = bitOf(hash, shift);
+            if ((branch->bitmap & bit) == 0) {
+                Leaf* leaf = newLeaf(hash, nullptr, std::forward<K>(key), std::forward<Args>(args)...);
+                *slot = withChild(branch, bit, leaf);
+                ++_size;
+                return std::make_pair(iterator(this, leaf), true);
+            }
+
+            Node*& child = branch->children()[branch->index(bit)];
+            own(child);
+            if (!child->isLeaf) {
+                slot = &child;
+                continue;
+            }
+
+            Leaf* head = static_cast<Leaf*>(child);
+            if (head->hash != hash) {
+                Leaf* leaf = newLeaf(hash, nullptr, std::forward<K>(key), std::forward<Args>(args)...);
+                child = split(head, leaf, shift + kBits);
+                ++_size;
+                return std::make_pair(iterator(this, leaf), true);
+            }
+            for (Leaf* leaf = head;; leaf = static_cast<Leaf*>(leaf->next)) {
+                if (KeyEqual()(leaf->value.first, key)) {
+                    return std::make_pair(iterator(this, leaf), false);
+                }
+                if (leaf->next == nullptr) {
+                    break;
+                }
+                own(leaf->next);
+            }
+            // Same hash, other key: chained first
+            Leaf* leaf = newLeaf(hash, head, std::forward<K>(key), std::forward<Args>(args)...);
+            child = leaf;
+            ++_size;
+            return std::make_pair(iterator(this, leaf), true);
+        }
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return this->try_emplace(value.first, value.second); }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type value(std::forward<Args>(args)...);
+        return this->try_emplace(value.first, std::move(value.second));
+    }
+
+    /**
+     * Removes an element.
+     * Branches left with a single leaf are replaced by this leaf.
+     *
+     * \param pos Iterator to the element to remove.
+     * \return Iterator to the element after the removed one.
+     */
+    iterator erase(const_iterator pos) {
+        Leaf* target = pos._leaf;
+        Leaf* next = nextLeaf<true>(_root, target);
+        const std::uint64_t hash = target->hash;
+
+        // Path to the chain of target (path[d] is a child slot of level d)
+        Node** path[kMaxDepth + 2];
+        std::size_t depth = 0;
+        path[0] = &_root;
+        own(_root);
+        for (unsigned shift = 0; !(*path[depth])->isLeaf; shift += kBits) {
+            Branch* branch = static_cast<Branch*>(*path[depth]);
+            path[++depth] = &branch->children()[branch->index(bitOf(hash, shift))];
+            own(*path[depth]);
+        }
+        Node** link = path[depth];
+        while (*link != target) {
+            link = &static_cast<Leaf*>(*link)->next;
+            own(*link);
+        }
+        *link = target->next;
+        target->next = nullptr;
+        release(target);
+        --_size;
+
+        // Empty slots are removed from their branch, up to the root
+        while (depth > 0 && *path[depth] == nullptr) {
+            --depth;
+            Branch* branch = static_cast<Branch*>(*path[depth]);
+            *path[depth] = withoutChild(branch, bitOf(hash, static_cast<unsigned>(depth * kBits)));
+        }
+        // Non-root branches with a single leaf are replaced by the leaf
+        while (depth > 0 && *path[depth] != nullptr && !(*path[depth])->isLeaf) {
+            Branch* branch = static_cast<Branch*>(*path[depth]);
+            if (branch->size() != 1 || !branch->children()[0]->isLeaf) {
+                break;
+            }
+            *path[depth] = branch->children()[0];
+            freeBranch(branch);
+            --depth;
+        }
+        return iterator(this, next);
+    }
+
+    size_type erase(const Key& key) {
+        const auto it = this->find(key);
+        if (it == this->end()) {
+            return 0;
+        }
+        this->erase(it);
+        return 1;
+    }
+
+    void clear() noexcept {
+        release(_root);
+        _root = nullptr;
+        _size = 0;
+    }
+
+    void swap(PersistentHashMap& other) noexcept {
+        std::swap(_root, other._root);
+        std::swap(_size, other._size);
+    }
+
+    /**
+     * No-op (No buckets to prepare).
+     */
+    void reserve(size_type) {}
+
+    /**
+     * No-op (No buckets to rehash).
+     */
+    void rehash(size_type) {}
+
+    /**
+     * No buckets: returns the number of elements.
+     *
+     * \return Number of elements.
+     */
+    size_type bucket_count() const noexcept { return _size; }
+
+    // -------------------------------------------------------------------------
+    // Operators overload
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Check if lhs and rhs hold the same elements (In any order).
+     *
+     * \param lhs Left hand side
+     * \param rhs Right hand side
+     * \return True if equal, otherwise, return false.
+     */
+    friend bool operator==(const PersistentHashMap& lhs, const PersistentHashMap& rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        if (lhs._root == rhs._root) {
+            return true;  // Same shared nodes
+        }
+        for (const value_type& value : lhs) {
+            const auto it = rhs.find(value.first);
+            if (it == rhs.end() || !(it->second == value.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const PersistentHashMap& lhs, const PersistentHashMap& rhs) { return !(lhs == rhs); }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    static std::uint64_t hashOf(const Key& key) {
+        // Murmur3 finalizer: std::hash is often the identity for integers
+        std::uint64_t h = Hash()(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static std::uint32_t bitOf(std::uint64_t hash, unsigned shift) {
+        return std::uint32_t(1) << ((hash >> shift) & kMask);
+    }
+
+    Node*& rootRef() const { return const_cast<Node*&>(_root); }
+
+    template <typename K, typename... Args>
+    static Leaf* newLeaf(std::uint64_t hash, Node* next, K&& key, Args&&... args) {
+        return new Leaf(hash, next, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                        std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    static Branch* newBranch(std::uint32_t bitmap) {
+        const std::size_t nbChildren = static_cast<std::size_t>(__builtin_popcount(bitmap));
+        void* memory = ::operator new(sizeof(Branch) + nbChildren * sizeof(Node*));
+        return ::new (memory) Branch(bitmap);
+    }
+
+    // Frees the branch only (Children are not released)
+    static void freeBranch(Branch* branch) {
+        branch->~Branch();
+        ::operator delete(branch);
+    }
+
+    static void release(Node* node) {
+        while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (node->isLeaf) {
+                Leaf* leaf = static_cast<Leaf*>(node);
+                node = leaf->next;
+                delete leaf;
+            } else {
+                Branch* branch = static_cast<Branch*>(node);
+                for (std::size_t k = 0; k < branch->size(); ++k) {
+                    release(branch->children()[k]);
+                }
+                freeBranch(branch);
+                node = nullptr;
+            }
+        }
+    }
+
+    // Replaces the node of slot by a copy if it is shared
+    static void own(Node*& slot) {
+        Node* node = slot;
+        if (node->refs.load(std::memory_order_acquire) == 1) {
+            return;
+        }
+        if (node->isLeaf) {
+            const Leaf* leaf = static_cast<const Leaf*>(node);
+            if (leaf->next != nullptr) {
+                leaf->next->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+            slot = new Leaf(leaf->hash, leaf->next, leaf->value);
+        } else {
+            Branch* branch = static_cast<Branch*>(node);
+            Branch* copy = newBranch(branch->bitmap);
+            for (std::size_t k = 0; k < branch->size(); ++k) {
+                copy->children()[k] = branch->children()[k];
+                copy->children()[k]->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+            slot = copy;
+        }
+        release(node);
+    }
+
+    template <bool Owned>
+    static Node* enter(Node*& slot) {
+        if (Owned) {
+            own(slot);
+        }
+        return slot;
+    }
+
+    template <bool Owned>
+    static Leaf* findLeaf(Node*& root, const Key& key, std::uint64_t hash) {
+        if (root == nullptr) {
+            return nullptr;
+        }
+        Node* node = enter<Owned>(root);
+        for (unsigned shift = 0; !node->isLeaf; shift += kBits) {
+            Branch* branch = static_cast<Branch*>(node);
+            const std::uint32_t bit = bitOf(hash, shift);
+            if ((branch->bitmap & bit) == 0) {
+                return nullptr;
+            }
+            node = enter<Owned>(branch->children()[branch->index(bit)]);
+        }
+        if (static_cast<Leaf*>(node)->hash != hash) {
+            return nullptr;
+        }
+        for (;;) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            if (KeyEqual()(leaf->value.first, key)) {
+                return leaf;
+            }
+            if (leaf->next == nullptr) {
+                return nullptr;
+            }
+            node = enter<Owned>(leaf->next);
+        }
+    }
+
+    template <bool Owned>
+    static Leaf* leftmost(Node*& slot) {
+        Node* node = enter<Owned>(slot);
+        while (!node->isLeaf) {
+            node = enter<Owned>(static_cast<Branch*>(node)->children()[0]);
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    // Leaves are visited by chain, then in hash order (Lowest bits first)
+    template <bool Owned>
+    static Leaf* nextLeaf(Node*& root, Leaf* leaf) {
+        if (leaf->next != nullptr) {
+            return static_cast<Leaf*>(enter<Owned>(leaf->next));
+        }
+        // Leftmost leaf of the deepest later sibling on the path of leaf
+        Node** after = nullptr;
+        Node* node = enter<Owned>(root);
+        for (unsigned shift = 0; !node->isLeaf; shift += kBits) {
+            Branch* branch = static_cast<Branch*>(node);
+            const std::uint32_t bit = bitOf(leaf->hash, shift);
+            const std::size_t index = branch->index(bit);
+            if (index + 1 < branch->size()) {
+                after = &branch->children()[index + 1];
+            }
+            node = enter<Owned>(branch->children()[index]);
+        }
+        return (after != nullptr) ? leftmost<Owned>(*after) : nullptr;
+    }
+
+    // Branches down to the first level where the two hashes differ
+    static Node* split(Leaf* a, Leaf* b, unsigned shift) {
+        const std::uint32_t bitA = bitOf(a->hash, shift);
+        const std::uint32_t bitB = bitOf(b->hash, shift);
+        Branch* branch = newBranch(bitA | bitB);
+        if (bitA == bitB) {
+            branch->children()[0] = split(a, b, shift + kBits);
+        } else {
+            branch->children()[branch->index(bitA)] = a;
+            branch->children()[branch->index(bitB)] = b;
+        }
+        return branch;
+    }
+
+    // DevNote: branch is owned, its children are moved in the new one
+    static Branch* withChild(Branch* branch, std::uint32_t bit, Node* child) {
+        Branch* copy = newBranch(branch->bitmap | bit);
+        const std::size_t index = copy->index(bit);
+        for (std::size_t k = 0; k < branch->size(); ++k) {
+            copy->children()[k < index ? k : k + 1] = branch->children()[k];
+        }
+        copy->children()[index] = child;
+        freeBranch(branch);
+        return copy;
+    }
+
+    // Null if it was the last child
+    static Branch* withoutChild(Branch* branch, std::uint32_t bit) {
+        if (branch->size() == 1) {
+            freeBranch(branch);
+            return nullptr;
+        }
+        Branch* copy = newBranch(branch->bitmap & ~bit);
+        const std::size_t index = branch->index(bit);
+        for (std::size_t k = 0; k < branch->size(); ++k) {
+            if (k != index) {
+                copy->children()[k < index ? k : k - 1] = branch->children()[k];
+            }
+        }
+        freeBranch(branch);
+        return copy;
+    }
+};
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+const unsigned PersistentHashMap<Key, T, Hash, KeyEqual>::kBits;
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+const std::uint64_t PersistentHashMap<Key, T, Hash, KeyEqual>::kMask;
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+const std::size_t PersistentHashMap<Key, T, Hash, KeyEqual>::kMaxDepth;
+
+/**
+ * \brief
+ * PersistentHashMap iterator. Points to a leaf.
+ *
+ * Non-const iterators copy the shared nodes on their way (Like all
+ * non-const accesses), so that their elements may be modified.
+ */
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+template <bool IsConst>
+class PersistentHashMap<Key, T, Hash, KeyEqual>::basic_iterator {
+   private:
+    friend PersistentHashMap;
+    typedef typename std::conditional<IsConst, const PersistentHashMap, PersistentHashMap>::type map_type;
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename PersistentHashMap::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef typename std::conditional<IsConst, const value_type, value_type>::type* pointer;
+    typedef typename std::conditional<IsConst, const value_type, value_type>::type& reference;
+
+   private:
+    map_type* _map = nullptr;
+    Leaf* _leaf = nullptr;  // Null for end
+
+    basic_iterator(map_type* map, Leaf* leaf) : _map(map), _leaf(leaf) {}
+
+   public:
+    basic_iterator() = default;
+
+    // Allows iterator to const_iterator conversion
+    template <bool OtherConst, typename = typename std::enable_if<IsConst && !OtherConst>::type>
+    basic_iterator(const basic_iterator<OtherConst>& other) : _map(other._map), _leaf(other._leaf) {}
+
+    basic_iterator& operator++() {
+        _leaf = nextLeaf<!IsConst>(_map->rootRef(), _leaf);
+        return *this;
+    }
+
+    basic_iterator operator++(int) {
+        basic_iterator old = *this;
+        ++(*this);
+        return old;
+    }
+
+    bool operator==(const basic_iterator& other) const { return _leaf == other._leaf; }
+
+    bool operator!=(const basic_iterator& other) const { return !(*this == other); }
+
+    reference operator*() const { return _leaf->value; }
+
+    pointer operator->() const { return &_leaf->value; }
+
+    template <bool>
+    friend class basic_iterator;
+};
+
+}  // namespace collabserver
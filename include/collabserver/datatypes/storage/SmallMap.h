@@ -0,0 +1,477 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>  // std::hash, std::equal_to
+#include <iterator>
+#include <limits>
+#include <memory>  // std::allocator_traits
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>  // std::pair
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Associative container for maps that almost always hold a few elements.
+ *
+ * Up to N elements are stored inline, in an array inside the object, and
+ * found by linear search: no heap allocation, no bucket array. When the
+ * (N + 1)th key is inserted, all elements move to a std::unordered_map,
+ * built in place of the inline array (No extra indirection). rehash(0)
+ * moves them back inline once the size is lower or equal to N again
+ * (See LWWSet::compact).
+ *
+ * Implements the std::unordered_map interface subset of the storage
+ * policies (See StoragePolicy.h).
+ *
+ * \warning
+ * Inline elements are not stable: insert may move all of them and
+ * erase(it) moves the last element into the erased position (erase
+ * returns this same position). References and iterators are invalidated
+ * by any insert or erase.
+ *
+ * \tparam Key      Type of key.
+ * \tparam T        Type of mapped value.
+ * \tparam N        Max number of inline elements.
+ * \tparam Hash     Hash function (Only used once switched to the hash map).
+ * \tparam KeyEqual Key equality function.
+ */
+template <typename Key, typename T, std::size_t N, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class SmallMap {
+    static_assert(N > 0, "SmallMap needs at least one inline element");
+
+   public:
+    template <bool IsConst>
+    class basic_iterator;
+
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::size_t size_type;
+    typedef Hash hasher;
+    typedef KeyEqual key_equal;
+    typedef basic_iterator<false> iterator;
+    typedef basic_iterator<true> const_iterator;
+
+   private:
+    typedef std::unordered_map<Key, T, Hash, KeyEqual> big_map;
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type slot_type;
+
+    // Either the inline elements or the hash map
+    union Storage {
+        slot_type slots[N];  // Raw storage, only [0, _size) are built
+        big_map big;         // Only built if _size is kBig
+
+        Storage() {}
+        ~Storage() {}
+    };
+
+    static const size_type kBig = std::numeric_limits<size_type>::max();
+
+    size_type _size = 0;  // Nb of inline elements, or kBig
+    Storage _storage;
+
+    // -------------------------------------------------------------------------
+    // Initialization
+    // -------------------------------------------------------------------------
+
+   public:
+    SmallMap() = default;
+
+    SmallMap(const SmallMap& other) {
+        if (other.isBig()) {
+            ::new (static_cast<void*>(&_storage.big)) big_map(other._storage.big);
+            _size = kBig;
+        } else {
+            for (size_type k = 0; k < other._size; ++k) {
+                ::new (static_cast<void*>(this->slot(k))) value_type(*other.slot(k));
+                ++_size;
+            }
+        }
+    }
+
+    SmallMap(SmallMap&& other) noexcept(std::is_nothrow_move_constructible<value_type>::value) {
+        this->moveFrom(other);
+    }
+
+    SmallMap& operator=(const SmallMap& other) {
+        if (this != &other) {
+            SmallMap copy(other);
+            this->clear();
+            this->moveFrom(copy);
+        }
+        return *this;
+    }
+
+    SmallMap& operator=(SmallMap&& other) noexcept(std::is_nothrow_move_constructible<value_type>::value) {
+        if (this != &other) {
+            this->clear();
+            this->moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~SmallMap() { this->clear(); }
+
+    // -------------------------------------------------------------------------
+    // Iterators
+    // -------------------------------------------------------------------------
+
+   public:
+    iterator begin() noexcept { return this->isBig() ? iterator(_storage.big.begin()) : iterator(this->slot(0)); }
+
+    const_iterator begin() const noexcept { return this->cbegin(); }
+
+    const_iterator cbegin() const noexcept {
+        return this->isBig() ? const_iterator(_storage.big.cbegin()) : const_iterator(this->slot(0));
+    }
+
+    iterator end() noexcept { return this->isBig() ? iterator(_storage.big.end()) : iterator(this->slot(_size)); }
+
+    const_iterator end() const noexcept { return this->cend(); }
+
+    const_iterator cend() const noexcept {
+        return this->isBig() ? const_iterator(_storage.big.cend()) : const_iterator(this->slot(_size));
+    }
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    bool empty() const noexcept { return this->size() == 0; }
+
+    size_type size() const noexcept { return this->isBig() ? _storage.big.size() : _size; }
+
+    size_type max_size() const noexcept {
+        return std::allocator_traits<std::allocator<value_type>>::max_size(std::allocator<value_type>());
+    }
+
+    /**
+     * Checks whether elements are still stored inline.
+     *
+     * \return True if inline, false if moved to the hash map.
+     */
+    bool is_inline() const noexcept { return !this->isBig(); }
+
+    // -------------------------------------------------------------------------
+    // Lookup methods
+    // -------------------------------------------------------------------------
+
+   public:
+    iterator find(const Key& key) {
+        if (this->isBig()) {
+            return iterator(_storage.big.find(key));
+        }
+        return iterator(this->slot(this->findInline(key)));
+    }
+
+    const_iterator find(const Key& key) const {
+        if (this->isBig()) {
+            return const_iterator(_storage.big.find(key));
+        }
+        return const_iterator(this->slot(this->findInline(key)));
+    }
+
+    size_type count(const Key& key) const {
+        return this->isBig() ? _storage.big.count(key) : (this->findInline(key) < _size);
+    }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Inserts an element built from (key, args...) if key is not there.
+     * Nothing is built (args are not consumed) if key already exists.
+     *
+     * \param key   Key of the element.
+     * \param args  Arguments forwarded to the mapped value constructor.
+     * \return Iterator to the element and true if inserted.
+     */
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        if (!this->isBig()) {
+            const size_type index = this->findInline(key);
+            if (index < _size) {
+                return std::make_pair(iterator(this->slot(index)), false);
+            }
+            if (_size < N) {
+                ::new (static_cast<void*>(this->slot(_size)))
+                    value_type(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+                ++_size;
+                return std::make_pair(iterator(this->slot(_size - 1)), true);
+            }
+            this->moveToBig(N + 1);
+        }
+        big_map& big = _storage.big;
+        auto res = big.find(key);
+        if (res != big.end()) {
+            return std::make_pair(iterator(res), false);
+        }
+        res = big.emplace(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...))
+                  .first;
+        return std::make_pair(iterator(res), true);
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return this->try_emplace(value.first, value.second); }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type value(std::forward<Args>(args)...);
+        return this->try_emplace(value.first, std::move(value.second));
+    }
+
+    /**
+     * Removes an element.
+     * While inline, the last element is moved into the erased position.
+     *
+     * \param pos Iterator to the element to remove.
+     * \return Iterator to the element after the removed one (For inline,
+     *         the same position, which now holds the moved last element).
+     */
+    iterator erase(const_iterator pos) {
+        if (this->isBig()) {
+            return iterator(_storage.big.erase(pos._it));
+        }
+        value_type* hole = const_cast<value_type*>(pos._ptr);
+        value_type* last = this->slot(_size - 1);
+        hole->~value_type();
+        if (hole != last) {
+            ::new (static_cast<void*>(hole)) value_type(std::move(*last));
+            last->~value_type();
+        }
+        --_size;
+        return iterator(hole);
+    }
+
+    size_type erase(const Key& key) {
+        const auto it = this->find(key);
+        if (it == this->end()) {
+            return 0;
+        }
+        this->erase(it);
+        return 1;
+    }
+
+    void clear() noexcept {
+        if (this->isBig()) {
+            _storage.big.~big_map();
+            _size = 0;
+        } else {
+            this->destroyInline();
+        }
+    }
+
+    void swap(SmallMap& other) {
+        SmallMap tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    /**
+     * Prepares for count elements.
+     * Moves the elements to the hash map if count is greater than N.
+     *
+     * \param count Number of elements.
+     */
+    void reserve(size_type count) {
+        if (this->isBig()) {
+            _storage.big.reserve(count);
+        } else if (count > N) {
+            this->moveToBig(count);
+        }
+    }
+
+    /**
+     * Rehashes the hash map (No-op while inline).
+     * Elements move back inline if there are at most N of them and count
+     * is lower or equal to N (ex: rehash(0) to shrink after erase).
+     *
+     * \param count Minimal number of buckets.
+     */
+    void rehash(size_type count) {
+        if (!this->isBig()) {
+            return;
+        }
+        if (count <= N && _storage.big.size() <= N) {
+            this->moveToInline();
+        } else {
+            _storage.big.rehash(count);
+        }
+    }
+
+    /**
+     * Returns the number of buckets (N while inline).
+     *
+     * \return Number of buckets.
+     */
+    size_type bucket_count() const noexcept { return this->isBig() ? _storage.big.bucket_count() : N; }
+
+    // -------------------------------------------------------------------------
+    // Operators overload
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Check if lhs and rhs hold the same elements (In any order).
+     *
+     * \param lhs Left hand side
+     * \param rhs Right hand side
+     * \return True if equal, otherwise, return false.
+     */
+    friend bool operator==(const SmallMap& lhs, const SmallMap& rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (const value_type& value : lhs) {
+            const auto it = rhs.find(value.first);
+            if (it == rhs.end() || !(it->second == value.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const SmallMap& lhs, const SmallMap& rhs) { return !(lhs == rhs); }
+
+    // -------------------------------------------------------------------------
+    // Internal
+    // -------------------------------------------------------------------------
+
+   private:
+    bool isBig() const noexcept { return _size == kBig; }
+
+    value_type* slot(size_type index) { return reinterpret_cast<value_type*>(&_storage.slots[index]); }
+
+    const value_type* slot(size_type index) const {
+        return reinterpret_cast<const value_type*>(&_storage.slots[index]);
+    }
+
+    // Returns _size if not found
+    size_type findInline(const Key& key) const {
+        const KeyEqual equal;
+        size_type index = 0;
+        while (index < _size && !equal(this->slot(index)->first, key)) {
+            ++index;
+        }
+        return index;
+    }
+
+    void destroyInline() noexcept {
+        for (size_type k = 0; k < _size; ++k) {
+            this->slot(k)->~value_type();
+        }
+        _size = 0;
+    }
+
+    // Requires this to be empty
+    void moveFrom(SmallMap& other) {
+        if (other.isBig()) {
+            ::new (static_cast<void*>(&_storage.big)) big_map(std::move(other._storage.big));
+            _size = kBig;
+        } else {
+            for (size_type k = 0; k < other._size; ++k) {
+                ::new (static_cast<void*>(this->slot(k))) value_type(std::move(*other.slot(k)));
+                ++_size;
+            }
+        }
+        other.clear();
+    }
+
+    // DevNote: elements are moved out first, the hash map is built over them
+    void moveToBig(size_type count) {
+        big_map big;
+        big.reserve(count);
+        for (size_type k = 0; k < _size; ++k) {
+            big.emplace(std::move(*this->slot(k)));
+        }
+        this->destroyInline();
+        ::new (static_cast<void*>(&_storage.big)) big_map(std::move(big));
+        _size = kBig;
+    }
+
+    void moveToInline() {
+        big_map big(std::move(_storage.big));
+        this->clear();
+        for (auto& value : big) {
+            ::new (static_cast<void*>(this->slot(_size))) value_type(std::move(value));
+            ++_size;
+        }
+    }
+};
+
+template <typename Key, typename T, std::size_t N, typename Hash, typename KeyEqual>
+const typename SmallMap<Key, T, N, Hash, KeyEqual>::size_type SmallMap<Key, T, N, Hash, KeyEqual>::kBig;
+
+/**
+ * \brief
+ * SmallMap iterator. Points to an inline element, or wraps an iterator of
+ * the hash map.
+ */
+template <typename Key, typename T, std::size_t N, typename Hash, typename KeyEqual>
+template <bool IsConst>
+class SmallMap<Key, T, N, Hash, KeyEqual>::basic_iterator {
+   private:
+    friend SmallMap;
+    typedef typename std::conditional<IsConst, typename big_map::const_iterator, typename big_map::iterator>::type
+        big_iterator;
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename SmallMap::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef typename std::conditional<IsConst, const value_type, value_type>::type* pointer;
+    typedef typename std::conditional<IsConst, const value_type, value_type>::type& reference;
+
+   private:
+    pointer _ptr = nullptr;  // Inline element (Null if big)
+    big_iterator _it;
+
+    explicit basic_iterator(pointer ptr) : _ptr(ptr) {}
+    explicit basic_iterator(big_iterator it) : _it(it) {}
+
+   public:
+    basic_iterator() = default;
+
+    // Allows iterator to const_iterator conversion
+    template <bool OtherConst, typename = typename std::enable_if<IsConst && !OtherConst>::type>
+    basic_iterator(const basic_iterator<OtherConst>& other) : _ptr(other._ptr), _it(other._it) {}
+
+    basic_iterator& operator++() {
+        if (_ptr) {
+            ++_ptr;
+        } else {
+            ++_it;
+        }
+        return *this;
+    }
+
+    basic_iterator operator++(int) {
+        basic_iterator old = *this;
+        ++(*this);
+        return old;
+    }
+
+    bool operator==(const basic_iterator& other) const {
+        return _ptr == other._ptr && (_ptr != nullptr || _it == other._it);
+    }
+
+    bool operator!=(const basic_iterator& other) const { return !(*this == other); }
+
+    reference operator*() const { return _ptr ? *_ptr : *_it; }
+
+    pointer operator->() const { return _ptr ? _ptr : &*_it; }
+
+    template <bool>
+    friend class basic_iterator;
+};
+
+}  // namespace collabserver
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+#include "FlatHashMap.h"
+#include "PersistentHashMap.h"
+#include "SmallMap.h"
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Storage policies for the CRDT containers.
+ *
+ * The CmRDT containers (LWWSet, LWWMap...) keep each key and its CRDT
+ * metadata in an internal associative container. A storage policy selects
+ * which one. It defines two alias templates, both types with the
+ * std::unordered_map interface subset used by the containers:
+ * find, count, insert, erase(iterator), begin / end, size, empty, max_size,
+ * reserve, rehash, bucket_count, emplace and operator==. Iterators must give access to the key with
+ * 'it->first' and to the metadata with 'it->second'.
+ *  - map<K, V>: V is only the metadata (ex: LWWSet).
+ *  - keyed_map<K, V>: V already holds a copy of its key, readable with
+ *    'V::key()' (ex: LWWMap). The storage may use it to not store the key
+ *    a second time. V must be constructible from a key.
+ *
+ * \par Available policies
+ *  - HashMapStorage: node-based std::unordered_map (Default).
+ *  - FlatHashStorage: open-addressing FlatHashMap. Key and metadata are
+ *    stored inline in one array. Uses less memory and less cache misses,
+ *    but references are invalidated on rehash. Its keyed_map stores the
+ *    key only once, inside V.
+ *  - SmallMapStorage<N>: SmallMap. Up to N elements are stored inline (No
+ *    allocation), then moves to a std::unordered_map. For the many small
+ *    containers of a structure (ex: LWWGraph edges of each vertex).
+ *  - PersistentStorage: PersistentHashMap. Copies share their nodes, so
+ *    a copy of the container is O(1) (See LWWMap::snapshot). Lookups and
+ *    updates are slower than with a hash table.
+ *
+ * \par Example
+ * \code{.cpp}
+ * LWWSet<std::string, int, FlatHashStorage> data;
+ * \endcode
+ */
+struct HashMapStorage {
+    template <typename K, typename V>
+    using map = std::unordered_map<K, V>;
+
+    template <typename K, typename V>
+    using keyed_map = std::unordered_map<K, V>;
+};
+
+/**
+ * \copydoc HashMapStorage
+ */
+struct FlatHashStorage {
+    template <typename K, typename V>
+    using map = FlatHashMap<K, V>;
+
+    template <typename K, typename V>
+    using keyed_map = FlatHashMap<K, V, std::hash<K>, std::equal_to<K>, FlatKeyedLayout<K, V>>;
+};
+
+/**
+ * \copydoc HashMapStorage
+ *
+ * \tparam N Max number of inline elements.
+ */
+template <std::size_t N>
+struct SmallMapStorage {
+    template <typename K, typename V>
+    using map = SmallMap<K, V, N>;
+
+    template <typename K, typename V>
+    using keyed_map = SmallMap<K, V, N>;
+};
+
+/**
+ * \copydoc HashMapStorage
+ */
+struct PersistentStorage {
+    template <typename K, typename V>
+    using map = PersistentHashMap<K, V>;
+
+    template <typename K, typename V>
+    using keyed_map = PersistentHashMap<K, V>;
+};
+
+/**
+ * \brief
+ * Access to the optional per-element mark bit of a storage map.
+ *
+ * The CRDT containers mark their alive elements. With a map that supports
+ * marks (FlatHashMap), iterating alive elements jumps from one mark to the
+ * next instead of visiting each tombstone. For other maps, 'enabled' is
+ * false, mark / clear are no-op and first / next visit every element: the
+ * caller has to skip the removed ones itself.
+ *
+ *
+ * \tparam Map Storage map type.
+ */
+template <typename Map>
+struct StorageMarks {
+    static const bool enabled = false;
+
+    template <typename M, typename It>
+    static void mark(M&, It, bool) {}
+
+    template <typename M>
+    static void clear(M&) {}
+
+    template <typename M>
+    static auto first(M& map) -> decltype(map.begin()) {
+        return map.begin();
+    }
+
+    template <typename M, typename It>
+    static It next(M&, It it) {
+        return ++it;
+    }
+};
+
+template <typename K, typename V, typename H, typename E, typename L>
+struct StorageMarks<FlatHashMap<K, V, H, E, L>> {
+    static const bool enabled = true;
+
+    template <typename M, typename It>
+    static void mark(M& map, It it, bool marked) {
+        map.mark(it, marked);
+    }
+
+    template <typename M>
+    static void clear(M& map) {
+        map.clear_marks();
+    }
+
+    template <typename M>
+    static auto first(M& map) -> decltype(map.begin_marked()) {
+        return map.begin_marked();
+    }
+
+    template <typename M, typename It>
+    static It next(M& map, It it) {
+        return It(map.next_marked(it));
+    }
+};
+
+/**
+ * \brief
+ * Whether the nodes of a storage map may be shared between copies.
+ *
+ * Non-const lookups of such a map copy the shared nodes on their path
+ * (See PersistentHashMap): they must not run from several threads at once.
+ * The containers then apply a parallel merge on a single thread.
+ *
+ * \tparam Map Storage map type.
+ */
+template <typename Map>
+struct StorageSharedNodes {
+    static const bool enabled = false;
+};
+
+template <typename K, typename V, typename H, typename E>
+struct StorageSharedNodes<PersistentHashMap<K, V, H, E>> {
+    static const bool enabled = true;
+};
+
+/**
+ * \brief
+ * Inserts a key in a storage map only if not already there.
+ *
+ * Nothing is built (No element, no key copy) when the key already exists,
+ * and the map is neither rehashed nor grown: no allocation at all. (Except
+ * PersistentHashMap nodes still shared with a copy, copied on write).
+ * FlatHashMap, SmallMap and PersistentHashMap do it with a single lookup
+ * (try_emplace). Other maps first call find, then emplace on a real insert.
+ *
+ * \tparam Map Storage map type.
+ */
+template <typename Map>
+struct StorageEmplace {
+    /**
+     * For map<K, V>: inserted V is value-initialized.
+     */
+    template <typename M, typename K>
+    static std::pair<typename M::iterator, bool> try_emplace(M& map, K&& key) {
+        const auto it = map.find(key);
+        if (it != map.end()) {
+            return std::make_pair(it, false);
+        }
+        return map.emplace(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::tuple<>());
+    }
+
+    /**
+     * For keyed_map<K, V>: inserted V is built from the key and args.
+     * Args are not consumed if the key exists.
+     */
+    template <typename M, typename K, typename... Args>
+    static std::pair<typename M::iterator, bool> try_emplace_keyed(M& map, K&& key, Args&&... args) {
+        const auto it = map.find(key);
+        if (it != map.end()) {
+            return std::make_pair(it, false);
+        }
+        // DevNote: the map key is copied first, then V may take the key
+        const typename M::key_type& keyRef = key;
+        return map.emplace(std::piecewise_construct, std::forward_as_tuple(keyRef),
+                           std::forward_as_tuple(std::forward<K>(key), std::forward<Args>(args)...));
+    }
+};
+
+template <typename K, typename V, typename H, typename E, typename L>
+struct StorageEmplace<FlatHashMap<K, V, H, E, L>> {
+    template <typename M, typename Key>
+    static std::pair<typename M::iterator, bool> try_emplace(M& map, Key&& key) {
+        return map.try_emplace(std::forward<Key>(key));
+    }
+
+    template <typename M, typename Key, typename... Args>
+    static std::pair<typename M::iterator, bool> try_emplace_keyed(M& map, Key&& key, Args&&... args) {
+        return map.try_emplace(std::forward<Key>(key), std::forward<Args>(args)...);
+    }
+};
+
+template <typename K, typename V, std::size_t N, typename H, typename E>
+struct StorageEmplace<SmallMap<K, V, N, H, E>> {
+    template <typename M, typename Key>
+    static std::pair<typename M::iterator, bool> try_emplace(M& map, Key&& key) {
+        return map.try_emplace(std::forward<Key>(key));
+    }
+
+    template <typename M, typename Key, typename... Args>
+    static std::pair<typename M::iterator, bool> try_emplace_keyed(M& map, Key&& key, Args&&... args) {
+        // DevNote: the map key is copied first, then V may take the key
+        const typename M::key_type& keyRef = key;
+        return map.try_emplace(keyRef, std::forward<Key>(key), std::forward<Args>(args)...);
+    }
+};
+
+template <typename K, typename V, typename H, typename E>
+struct StorageEmplace<PersistentHashMap<K, V, H, E>> {
+    template <typename M, typename Key>
+    static std::pair<typename M::iterator, bool> try_emplace(M& map, Key&& key) {
+        return map.try_emplace(std::forward<Key>(key));
+    }
+
+    template <typename M, typename Key, typename... Args>
+    static std::pair<typename M::iterator, bool> try_emplace_keyed(M& map, Key&& key, Args&&... args) {
+        // DevNote: the map key is copied first, then V may take the key
+        const typename M::key_type& keyRef = key;
+        return map.try_emplace(keyRef, std::forward<Key>(key), std::forward<Args>(args)...);
+    }
+};
+
+}  // namespace collabserver
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Bounded lock-free queue for many producer threads and one consumer thread.
+ *
+ * Fixed ring of cells, each with a sequence number telling whether it is
+ * free for the producer of a given position, or filled for the consumer.
+ * Producers claim a position with a CAS on the tail, then fill the cell.
+ * The single consumer reads the head cell without any CAS.
+ *
+ * \par
+ * No allocation after construction. A producer never waits: try_push
+ * returns false if the queue is full. The consumer never waits either:
+ * try_pop returns false if the head cell is not filled yet. (Empty queue,
+ * or its producer is still copying the value).
+ *
+ * \warning
+ * Only one thread at a time may call try_pop.
+ *
+ * \tparam T Type of element (Default constructible, move assignable).
+ */
+template <typename T>
+class BoundedMPSCQueue {
+   private:
+    struct Cell {
+        std::atomic<std::size_t> seq;  // pos: free for pos, pos + 1: filled
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    std::size_t _mask;  // Nb of cells - 1 (Power of two)
+    char _padding0[64];
+    std::atomic<std::size_t> _tail;  // Producers
+    char _padding1[64];              // Producers and consumer on their own cache line
+    std::atomic<std::size_t> _head;  // Consumer (Atomic only for size)
+
+   public:
+    /**
+     * Creates an empty queue.
+     *
+     * \param capacity Max number of elements (Rounded up to a power of two).
+     */
+    explicit BoundedMPSCQueue(std::size_t capacity) : _mask(1), _tail(0), _head(0) {
+        while (_mask + 1 < capacity) {
+            _mask = (_mask << 1) | 1;
+        }
+        _cells.reset(new Cell[_mask + 1]);
+        for (std::size_t k = 0; k <= _mask; ++k) {
+            _cells[k].seq.store(k, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMPSCQueue(const BoundedMPSCQueue& other) = delete;
+    BoundedMPSCQueue& operator=(const BoundedMPSCQueue& other) = delete;
+
+    // -------------------------------------------------------------------------
+    // Capacity methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Returns the max number of elements.
+     */
+    std::size_t capacity() const { return _mask + 1; }
+
+    /**
+     * Returns the number of elements.
+     * Only a hint while other threads push or pop.
+     */
+    std::size_t size() const {
+        const std::size_t head = _head.load(std::memory_order_acquire);
+        const std::size_t tail = _tail.load(std::memory_order_acquire);
+        return (tail > head) ? (tail - head) : 0;
+    }
+
+    /**
+     * Checks whether the next push would fail.
+     * Only a hint while other threads push or pop.
+     */
+    bool full() const {
+        const std::size_t pos = _tail.load(std::memory_order_acquire);
+        const std::size_t seq = _cells[pos & _mask].seq.load(std::memory_order_acquire);
+        return static_cast<std::intptr_t>(seq - pos) < 0;
+    }
+
+    /**
+     * Checks whether the next pop would fail.
+     * Only called by the consumer thread.
+     */
+    bool empty() const {
+        const std::size_t pos = _head.load(std::memory_order_relaxed);
+        return _cells[pos & _mask].seq.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    // -------------------------------------------------------------------------
+    // Modifiers methods
+    // -------------------------------------------------------------------------
+
+   public:
+    /**
+     * Adds an element at the end of the queue.
+     * Value is only moved from if added.
+     *
+     * \param value Element to add.
+     * \return True if added, false if the queue is full.
+     */
+    template <typename V>
+    bool try_push(V&& value) {
+        std::size_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            const std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(seq - pos);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::forward<V>(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Cell not popped yet since last round
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);  // Claimed by another producer
+            }
+        }
+    }
+
+    /**
+     * Removes the first element of the queue.
+     * Only one thread at a time may call this.
+     *
+     * \param value Set with the removed element.
+     * \return True if removed, false if nothing to pop yet.
+     */
+    bool try_pop(T& value) {
+        const std::size_t pos = _head.load(std::memory_order_relaxed);
+        Cell& cell = _cells[pos & _mask];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        value = std::move(cell.value);
+        cell.seq.store(pos + _mask + 1, std::memory_order_release);
+        _head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+}  // namespace collabserver
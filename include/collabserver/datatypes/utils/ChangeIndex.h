@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <utility>
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Optional secondary index of keys ordered by timestamp.
+ *
+ * Used by the CRDT containers to extract the changes since a timestamp
+ * (See LWWSet::delta_since) without scanning all the elements.
+ * The index is disabled by default: it then only costs a null pointer and
+ * each update is a single branch.
+ *
+ * A key may be indexed at several timestamps (ex: after update with a lost
+ * old timestamp). Users must look up the key to get its actual state.
+ *
+ * \tparam U    Type of timestamps.
+ * \tparam Key  Type of indexed keys.
+ */
+template <typename U, typename Key>
+class ChangeIndex {
+   private:
+    typedef std::multimap<U, Key> index_type;
+    std::unique_ptr<index_type> _index;
+
+   public:
+    ChangeIndex() = default;
+    ChangeIndex(ChangeIndex&& other) = default;
+    ChangeIndex& operator=(ChangeIndex&& other) = default;
+
+    ChangeIndex(const ChangeIndex& other) : _index(other._index ? new index_type(*other._index) : nullptr) {}
+
+    ChangeIndex& operator=(const ChangeIndex& other) {
+        if (this != &other) {
+            _index.reset(other._index ? new index_type(*other._index) : nullptr);
+        }
+        return *this;
+    }
+
+   public:
+    /**
+     * Checks whether the index is enabled.
+     *
+     * \return True if enabled, otherwise, return false.
+     */
+    bool enabled() const noexcept { return _index != nullptr; }
+
+    /**
+     * Enables (With empty content) or disables the index.
+     *
+     * \param enable True to enable the index, false to drop it.
+     */
+    void enable(bool enable) {
+        if (!enable) {
+            _index.reset();
+        } else if (!_index) {
+            _index.reset(new index_type());
+        }
+    }
+
+    /**
+     * Number of indexed entries. (0 if disabled).
+     *
+     * \return Number of entries.
+     */
+    std::size_t size() const noexcept { return _index ? _index->size() : 0; }
+
+    /**
+     * Removes all entries. The index stays enabled.
+     */
+    void clear() noexcept {
+        if (_index) {
+            _index->clear();
+        }
+    }
+
+    /**
+     * Indexes key at stamp. Does nothing if this key is already indexed at
+     * this timestamp, or if the index is disabled.
+     *
+     * \param stamp Timestamp of the change.
+     * \param key   Changed key.
+     */
+    void insert(const U& stamp, const Key& key) {
+        if (_index && this->find(stamp, key) == _index->end()) {
+            _index->insert(std::make_pair(stamp, key));
+        }
+    }
+
+    /**
+     * Moves key from oldStamp to newStamp.
+     * If key was not indexed at oldStamp, only inserts it at newStamp.
+     *
+     * \param oldStamp  Previous timestamp of the key.
+     * \param newStamp  New timestamp of the key.
+     * \param key       Changed key.
+     */
+    void update(const U& oldStamp, const U& newStamp, const Key& key) {
+        if (_index) {
+            const auto it = this->find(oldStamp, key);
+            if (it != _index->end()) {
+                _index->erase(it);
+            }
+            this->insert(newStamp, key);
+        }
+    }
+
+    /**
+     * Removes all entries with timestamp strictly lower than stamp.
+     *
+     * \param stamp Lower bound of the kept entries.
+     */
+    void erase_before(const U& stamp) {
+        if (_index) {
+            _index->erase(_index->begin(), _index->lower_bound(stamp));
+        }
+    }
+
+    /**
+     * Calls fn(key) for each entry with timestamp equal or higher than
+     * since, in timestamp order. A key may be visited several times.
+     *
+     * \param since Lower bound timestamp.
+     * \param fn    Function called with each key.
+     */
+    template <typename Fn>
+    void for_each_since(const U& since, Fn fn) const {
+        if (_index) {
+            for (auto it = _index->lower_bound(since); it != _index->end(); ++it) {
+                fn(it->second);
+            }
+        }
+    }
+
+   private:
+    typename index_type::iterator find(const U& stamp, const Key& key) const {
+        auto range = _index->equal_range(stamp);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == key) {
+                return it;
+            }
+        }
+        return _index->end();
+    }
+};
+
+}  // namespace collabserver
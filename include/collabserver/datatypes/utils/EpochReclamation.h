@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Epoch based reclamation of memory read by lock-free readers.
+ *
+ * Readers enter a read section (See ReadGuard) before loading shared
+ * pointers, and leave it once done. Writers replace the shared pointers,
+ * then retire the old objects in a RetiredList: an object is only deleted
+ * once no reader that may have loaded it is still in its read section.
+ *
+ * \par Algorithm
+ * A global epoch counter. Readers register in the counter of the parity of
+ * the epoch they saw (Registration is retried if the epoch changed
+ * meanwhile). The epoch advances from e to e + 1 only when no reader of
+ * epoch e - 1 is left. An object retired at epoch r is unreachable by
+ * readers of epoch r + 1, so it is deleted once the epoch is r + 2.
+ *
+ * \par
+ * Readers never wait for writers (Nor writers for readers): a writer that
+ * cannot advance the epoch keeps its retired objects for later.
+ * Reader counters are split in slots (One per thread, modulo the number
+ * of slots) to avoid contention on a single counter.
+ */
+class EpochReclamation {
+   private:
+    struct Slot {
+        std::atomic<long> readers[2];
+        char padding[64];  // One cache line per slot (No false sharing)
+
+        Slot() {
+            readers[0].store(0);
+            readers[1].store(0);
+        }
+    };
+
+    std::atomic<std::uint64_t> _epoch;
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _nbSlots;
+
+   public:
+    /**
+     * RAII read section. Objects loaded from shared pointers while the
+     * guard exists are not deleted.
+     */
+    class ReadGuard {
+       private:
+        friend EpochReclamation;
+        std::atomic<long>* _counter;
+
+        explicit ReadGuard(std::atomic<long>* counter) : _counter(counter) {}
+
+       public:
+        ReadGuard(ReadGuard&& other) noexcept : _counter(other._counter) { other._counter = nullptr; }
+        ReadGuard(const ReadGuard& other) = delete;
+        ReadGuard& operator=(const ReadGuard& other) = delete;
+
+        ~ReadGuard() {
+            if (_counter != nullptr) {
+                _counter->fetch_sub(1);
+            }
+        }
+    };
+
+    /**
+     * \param nbSlots Number of reader counters (At least 1).
+     */
+    explicit EpochReclamation(std::size_t nbSlots = 64)
+        : _epoch(2), _slots(new Slot[nbSlots > 0 ? nbSlots : 1]), _nbSlots(nbSlots > 0 ? nbSlots : 1) {}
+
+    EpochReclamation(const EpochReclamation& other) = delete;
+    EpochReclamation& operator=(const EpochReclamation& other) = delete;
+
+    /**
+     * Enters a read section. Never blocks.
+     *
+     * \par
+     * Ends with a sequentially consistent fence: shared pointers loaded
+     * after it (Even with acquire loads) are ordered after the stores of
+     * the writers, so a reader of epoch r + 1 never loads an object
+     * retired at epoch r. (See RetiredList::retire)
+     *
+     * \return Guard that leaves the read section when destroyed.
+     */
+    ReadGuard read() const {
+        Slot& slot = _slots[threadSlot() % _nbSlots];
+        for (;;) {
+            const std::uint64_t epoch = _epoch.load();
+            std::atomic<long>& counter = slot.readers[epoch & 1];
+            counter.fetch_add(1);
+            if (_epoch.load() == epoch) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);  // Before the pointer loads (See retire)
+                return ReadGuard(&counter);
+            }
+            counter.fetch_sub(1);  // Epoch changed meanwhile: retry
+        }
+    }
+
+    /**
+     * Returns the current epoch.
+     *
+     * \return Current epoch.
+     */
+    std::uint64_t epoch() const { return _epoch.load(); }
+
+    /**
+     * Advances the epoch if no reader of the previous epoch is left.
+     * Never blocks.
+     *
+     * \return Current epoch (After the advance, if any).
+     */
+    std::uint64_t try_advance() {
+        std::uint64_t epoch = _epoch.load();
+        const std::size_t parity = (epoch + 1) & 1;  // Parity of epoch - 1
+        for (std::size_t k = 0; k < _nbSlots; ++k) {
+            if (_slots[k].readers[parity].load() != 0) {
+                return epoch;
+            }
+        }
+        _epoch.compare_exchange_strong(epoch, epoch + 1);
+        return _epoch.load();
+    }
+
+   private:
+    static std::size_t threadSlot() {
+        static std::atomic<std::size_t> nextSlot(0);
+        static thread_local const std::size_t slot = nextSlot.fetch_add(1);
+        return slot;
+    }
+};
+
+/**
+ * \brief
+ * Objects replaced by a writer, deleted once no reader may use them.
+ * (See EpochReclamation).
+ *
+ * Not thread safe: each writer (Or each lock) has its own list.
+ */
+class RetiredList {
+   private:
+    struct Retired {
+        void* ptr;
+        void (*destroy)(void*);
+        std::uint64_t epoch;
+    };
+
+    std::vector<Retired> _retired;
+
+   public:
+    RetiredList() = default;
+    RetiredList(const RetiredList& other) = delete;
+    RetiredList& operator=(const RetiredList& other) = delete;
+
+    ~RetiredList() { this->clear(); }
+
+    /**
+     * Retires an object allocated with new. Once in a while (Every
+     * threshold retired objects), deletes the objects no reader may use.
+     *
+     * \param ptr       Object no longer reachable by new readers. Replaced
+     *                  with a sequentially consistent store, so that the
+     *                  retire epoch is read after. This is enough only
+     *                  because readers load it after the seq cst fence of
+     *                  EpochReclamation::read (Acquire loads alone are
+     *                  not ordered against this store).
+     * \param epochs    Reclamation used by the readers.
+     * \param threshold Number of retired objects between two reclaims.
+     */
+    template <typename Obj>
+    void retire(const Obj* ptr, EpochReclamation& epochs, std::size_t threshold = 64) {
+        _retired.push_back(Retired{const_cast<Obj*>(ptr), &destroyObject<Obj>, epochs.epoch()});
+        if (_retired.size() % threshold == 0) {
+            this->reclaim(epochs);
+        }
+    }
+
+    /**
+     * Deletes the retired objects no reader may use.
+     *
+     * \param epochs Reclamation used by the readers.
+     */
+    void reclaim(EpochReclamation& epochs) {
+        const std::uint64_t epoch = epochs.try_advance();
+        std::size_t nbKept = 0;
+        for (const Retired& retired : _retired) {
+            if (retired.epoch + 2 <= epoch) {
+                retired.destroy(retired.ptr);
+            } else {
+                _retired[nbKept++] = retired;
+            }
+        }
+        _retired.resize(nbKept);
+    }
+
+    /**
+     * Deletes all retired objects. Only when no reader is left.
+     */
+    void clear() {
+        for (const Retired& retired : _retired) {
+            retired.destroy(retired.ptr);
+        }
+        _retired.clear();
+    }
+
+    /**
+     * Returns the number of objects not deleted yet.
+     *
+     * \return Number of retired objects.
+     */
+    std::size_t size() const noexcept { return _retired.size(); }
+
+   private:
+    template <typename Obj>
+    static void destroyObject(void* ptr) {
+        delete static_cast<Obj*>(ptr);
+    }
+};
+
+}  // namespace collabserver
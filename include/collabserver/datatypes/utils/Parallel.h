@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace collabserver {
+
+/**
+ * \brief
+ * Returns the number of threads to use for a parallel algorithm.
+ *
+ * \param nbThreads Requested number of threads (0 means hardware threads).
+ * \param size      Number of items to process (At most one thread per item).
+ * \return Number of threads, at least 1.
+ */
+inline unsigned int parallel_threads_count(unsigned int nbThreads, std::size_t size) {
+    if (nbThreads == 0) {
+        nbThreads = std::thread::hardware_concurrency();
+    }
+    if (nbThreads > size) {
+        nbThreads = static_cast<unsigned int>(size);
+    }
+    return (nbThreads == 0) ? 1 : nbThreads;
+}
+
+/**
+ * \brief
+ * Splits [0, size) in contiguous chunks, one per thread, and runs
+ * fn(begin, end, chunkIndex) on each chunk.
+ *
+ * The calling thread runs the first chunk. Returns once all chunks are done.
+ * If fn throws, the first exception is rethrown after all threads joined.
+ * If a thread can't be started, the calling thread runs its chunk too.
+ *
+ * \param size      Number of items.
+ * \param nbThreads Number of chunks (See parallel_threads_count).
+ * \param fn        Function called as fn(size_t begin, size_t end, unsigned int chunkIndex).
+ */
+template <typename Fn>
+void parallel_for_chunks(std::size_t size, unsigned int nbThreads, Fn fn) {
+    nbThreads = parallel_threads_count(nbThreads, size);
+    if (nbThreads == 1) {
+        fn(std::size_t(0), size, 0u);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(nbThreads);
+    threads.reserve(nbThreads - 1);
+
+    const std::size_t chunkSize = (size + nbThreads - 1) / nbThreads;
+    auto runChunk = [&](unsigned int chunk) {
+        const std::size_t begin = chunk * chunkSize;
+        const std::size_t end = (begin + chunkSize < size) ? begin + chunkSize : size;
+        try {
+            if (begin < end) {
+                fn(begin, end, chunk);
+            }
+        } catch (...) {
+            errors[chunk] = std::current_exception();
+        }
+    };
+
+    unsigned int nbStarted = 1;  // Chunks with their own thread (Chunk 0 is ours)
+    try {
+        for (; nbStarted < nbThreads; ++nbStarted) {
+            threads.emplace_back(runChunk, nbStarted);
+        }
+    } catch (...) {
+        // DevNote: threads started so far must be joined (Or std::terminate).
+        // Not started chunks are run below, on this thread.
+    }
+    runChunk(0);
+    for (unsigned int chunk = nbStarted; chunk < nbThreads; ++chunk) {
+        runChunk(chunk);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+}  // namespace collabserver
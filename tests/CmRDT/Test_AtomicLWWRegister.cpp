@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "collabserver/datatypes/CmRDT/AtomicLWWRegister.h"
+
+namespace collabserver {
+
+// Larger than 64 bits: stored with a seqlock
+struct Cursor {
+    int line;
+    int column;
+    int selectionLine;
+    int selectionColumn;
+
+    friend bool operator==(const Cursor& lhs, const Cursor& rhs) {
+        return lhs.line == rhs.line && lhs.column == rhs.column && lhs.selectionLine == rhs.selectionLine &&
+               lhs.selectionColumn == rhs.selectionColumn;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// query()
+// -----------------------------------------------------------------------------
+
+TEST(AtomicLWWRegister, queryTest) {
+    AtomicLWWRegister<int, int> data0;
+    ASSERT_TRUE(data0.is_packed());
+    ASSERT_EQ(data0.query(), 0);
+    ASSERT_EQ(data0.timestamp(), 0);
+
+    data0.update(42, 1);
+    ASSERT_EQ(data0.query(), 42);
+    ASSERT_EQ(data0.timestamp(), 1);
+
+    int value = 0;
+    int stamp = 0;
+    data0.load(value, stamp);
+    ASSERT_EQ(value, 42);
+    ASSERT_EQ(stamp, 1);
+}
+
+// -----------------------------------------------------------------------------
+// update()
+// -----------------------------------------------------------------------------
+
+TEST(AtomicLWWRegister, updateTest) {
+    AtomicLWWRegister<int, int> data0;
+
+    ASSERT_TRUE(data0.update(666, 6));
+    ASSERT_FALSE(data0.update(555, 5));
+    ASSERT_EQ(data0.query(), 666);
+    ASSERT_EQ(data0.timestamp(), 6);
+
+    ASSERT_TRUE(data0.update(888, 8));
+    ASSERT_FALSE(data0.update(777, 7));
+    ASSERT_FALSE(data0.update(999, 8));
+    ASSERT_EQ(data0.query(), 888);
+    ASSERT_EQ(data0.timestamp(), 8);
+}
+
+TEST(AtomicLWWRegister, updateTest_Seqlock) {
+    AtomicLWWRegister<Cursor, long> data0;
+    ASSERT_FALSE(data0.is_packed());
+
+    ASSERT_TRUE(data0.update(Cursor{1, 2, 3, 4}, 10));
+    ASSERT_FALSE(data0.update(Cursor{5, 6, 7, 8}, 9));
+    ASSERT_TRUE(data0.query() == (Cursor{1, 2, 3, 4}));
+    ASSERT_EQ(data0.timestamp(), 10);
+
+    ASSERT_TRUE(data0.update(Cursor{5, 6, 7, 8}, 11));
+    ASSERT_TRUE(data0.query() == (Cursor{5, 6, 7, 8}));
+    ASSERT_EQ(data0.timestamp(), 11);
+}
+
+// -----------------------------------------------------------------------------
+// crdt_equal()
+// -----------------------------------------------------------------------------
+
+TEST(AtomicLWWRegister, crdtEqualTest) {
+    AtomicLWWRegister<int, int> data0;
+    AtomicLWWRegister<int, int> data1;
+    ASSERT_TRUE(data0.crdt_equal(data1));
+
+    data0.update(42, 1);
+    data1.update(42, 2);
+    ASSERT_FALSE(data0.crdt_equal(data1));
+    ASSERT_TRUE(data0 == data1);
+
+    data0.update(42, 2);
+    ASSERT_TRUE(data0.crdt_equal(data1));
+}
+
+// -----------------------------------------------------------------------------
+// Update from several threads
+// -----------------------------------------------------------------------------
+
+// Each writer updates with its own stamps (Value built from the stamp).
+// Readers check they always see a value and timestamp from the same update.
+template <typename T, typename Make>
+static void updateFromThreads(Make make) {
+    const int nbWriters = 4;
+    const int nbReaders = 4;
+    const int nbUpdates = 20000;
+    AtomicLWWRegister<T, int> data0;
+
+    std::atomic<bool> isDone(false);
+    std::atomic<long> nbErrors(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < nbReaders; ++t) {
+        readers.emplace_back([&]() {
+            int lastStamp = 0;
+            while (!isDone) {
+                T value;
+                int stamp = 0;
+                data0.load(value, stamp);
+                if (stamp < lastStamp || (stamp != 0 && !(value == make(stamp)))) {
+                    ++nbErrors;
+                }
+                lastStamp = stamp;
+            }
+        });
+    }
+    std::vector<std::thread> writers;
+    for (int t = 0; t < nbWriters; ++t) {
+        writers.emplace_back([&, t]() {
+            for (int k = 0; k < nbUpdates; ++k) {
+                const int stamp = 1 + k * nbWriters + t;
+                data0.update(make(stamp), stamp);
+            }
+        });
+    }
+    for (auto& thread : writers) {
+        thread.join();
+    }
+    isDone = true;
+    for (auto& thread : readers) {
+        thread.join();
+    }
+
+    ASSERT_EQ(nbErrors, 0);
+    ASSERT_EQ(data0.timestamp(), nbUpdates * nbWriters);
+    ASSERT_TRUE(data0.query() == make(nbUpdates * nbWriters));
+}
+
+static int makeInt(int stamp) { return -stamp; }
+
+static Cursor makeCursor(int stamp) { return Cursor{stamp, 2 * stamp, 3 * stamp, 4 * stamp}; }
+
+TEST(AtomicLWWRegister, updateTest_FromThreads) { updateFromThreads<int>(makeInt); }
+
+TEST(AtomicLWWRegister, updateTest_FromThreadsSeqlock) { updateFromThreads<Cursor>(makeCursor); }
+
+}  // namespace collabserver
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "collabserver/datatypes/CmRDT/ConcurrentLWWMap.h"
+
+namespace collabserver {
+
+// -----------------------------------------------------------------------------
+// add() / set() / remove()
+// -----------------------------------------------------------------------------
+
+TEST(ConcurrentLWWMap, addRemoveTest) {
+    ConcurrentLWWMap<std::string, int, int> data0(4);
+    EXPECT_TRUE(data0.empty());
+    EXPECT_TRUE(data0.add("v1", 10));
+    EXPECT_FALSE(data0.add("v1", 11));
+    EXPECT_EQ(data0.count("v1"), 1);
+    EXPECT_EQ(data0.at("v1"), 0);
+    EXPECT_EQ(data0.size(), 1);
+
+    // Older remove is ignored
+    EXPECT_FALSE(data0.remove("v1", 5));
+    EXPECT_EQ(data0.count("v1"), 1);
+    EXPECT_TRUE(data0.remove("v1", 20));
+    EXPECT_EQ(data0.count("v1"), 0);
+    EXPECT_EQ(data0.crdt_count("v1"), 1);
+    EXPECT_THROW(data0.at("v1"), std::out_of_range);
+    EXPECT_EQ(data0.size(), 0);
+    EXPECT_EQ(data0.crdt_size(), 1);
+
+    // Remove before add
+    EXPECT_FALSE(data0.remove("v2", 30));
+    EXPECT_FALSE(data0.add("v2", 25));
+    EXPECT_EQ(data0.count("v2"), 0);
+}
+
+TEST(ConcurrentLWWMap, setTest) {
+    ConcurrentLWWMap<int, std::string, int> data0(4);
+    EXPECT_TRUE(data0.set(1, "a", 10));
+    EXPECT_FALSE(data0.set(1, "b", 5));
+    EXPECT_EQ(data0.at(1), "a");
+    EXPECT_TRUE(data0.set(1, "c", 20));
+
+    std::string value;
+    EXPECT_TRUE(data0.find(1, value));
+    EXPECT_EQ(value, "c");
+    EXPECT_FALSE(data0.find(2, value));
+
+    // Remove keeps the value, back once added again
+    data0.remove(1, 30);
+    EXPECT_FALSE(data0.find(1, value));
+    data0.add(1, 40);
+    EXPECT_EQ(data0.at(1), "c");
+
+    // The value has its own timestamp (Same as LWWMap::set)
+    EXPECT_TRUE(data0.set(1, "d", 35));
+    EXPECT_EQ(data0.at(1), "d");
+    EXPECT_FALSE(data0.set(1, "e", 25));
+    EXPECT_EQ(data0.snapshot().at(1), "d");
+}
+
+TEST(ConcurrentLWWMap, clearTest) {
+    ConcurrentLWWMap<int, int, int> data0(4);
+    for (int k = 0; k < 100; ++k) {
+        data0.set(k, k, k + 1);
+    }
+    EXPECT_TRUE(data0.clear(50));
+    EXPECT_EQ(data0.size(), 51);  // Keys set at 50 or later
+    EXPECT_EQ(data0.count(10), 0);
+    EXPECT_EQ(data0.at(60), 60);
+
+    // New key older than the clear is removed
+    EXPECT_FALSE(data0.add(1000, 20));
+    EXPECT_EQ(data0.count(1000), 0);
+    EXPECT_FALSE(data0.clear(40));
+}
+
+TEST(ConcurrentLWWMap, snapshotTest) {
+    ConcurrentLWWMap<int, int, int> data0(8);
+    LWWMap<int, int, int> data1;
+    for (int k = 0; k < 1000; ++k) {
+        data0.set(k % 300, k, k + 1);
+        data1.set(k % 300, k, k + 1);
+        if (k % 7 == 0) {
+            data0.remove(k % 200, k + 1);
+            data1.remove(k % 200, k + 1);
+        }
+    }
+    EXPECT_EQ(data0.size(), data1.size());
+    EXPECT_EQ(data0.crdt_size(), data1.crdt_size());
+    EXPECT_TRUE(data0.snapshot().crdt_equal(data1));
+}
+
+// -----------------------------------------------------------------------------
+// Readers and writers from several threads
+// -----------------------------------------------------------------------------
+
+// Writers apply random operations (Each one, one op out of nbWriters) while
+// readers look up keys. Values are always key * 1000000 + stamp: readers
+// check they never read a partially built or deleted value.
+// Value of a key is not CRDT (See LWWMap): add is not used, so that the
+// value of an alive key is the one of its last set whatever the order.
+TEST(ConcurrentLWWMap, concurrentTest_SameAsLWWMap) {
+    const int nbWriters = 4;
+    const int nbReaders = 4;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> randKey(0, 500);
+    std::uniform_int_distribution<int> randOp(0, 8);
+    std::vector<std::pair<int, int>> ops(40000);
+    for (auto& op : ops) {
+        op.first = randOp(gen);
+        op.second = randKey(gen);
+    }
+
+    LWWMap<int, std::string, int> expected;
+    ConcurrentLWWMap<int, std::string, int> data0(16);
+    auto apply = [&](int k) {
+        const auto& op = ops[k];
+        const std::string value = std::to_string(op.second * 1000000 + k + 1);
+        if (op.first < 6) {
+            data0.set(op.second, value, k + 1);
+        } else {
+            data0.remove(op.second, k + 1);
+        }
+    };
+    for (int k = 0; k < static_cast<int>(ops.size()); ++k) {
+        const auto& op = ops[k];
+        if (op.first < 6) {
+            expected.set(op.second, std::to_string(op.second * 1000000 + k + 1), k + 1);
+        } else {
+            expected.remove(op.second, k + 1);
+        }
+    }
+
+    std::atomic<bool> isDone(false);
+    std::atomic<long> nbErrors(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < nbReaders; ++t) {
+        readers.emplace_back([&, t]() {
+            std::mt19937 readGen(t);
+            while (!isDone) {
+                const int key = randKey(readGen);
+                std::string value;
+                if (data0.find(key, value) && !value.empty() && std::stoi(value) / 1000000 != key) {
+                    ++nbErrors;
+                }
+                data0.count(key);
+                data0.size();
+            }
+        });
+    }
+    std::vector<std::thread> writers;
+    for (int t = 0; t < nbWriters; ++t) {
+        writers.emplace_back([&, t]() {
+            for (int k = t; k < static_cast<int>(ops.size()); k += nbWriters) {
+                apply(k);
+            }
+        });
+    }
+    for (auto& thread : writers) {
+        thread.join();
+    }
+    isDone = true;
+    for (auto& thread : readers) {
+        thread.join();
+    }
+
+    ASSERT_EQ(nbErrors, 0);
+    ASSERT_EQ(data0.size(), expected.size());
+    ASSERT_EQ(data0.crdt_size(), expected.crdt_size());
+    ASSERT_TRUE(data0.snapshot() == expected);
+}
+
+}  // namespace collabserver
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "collabserver/datatypes/CmRDT/LWWGraph.h"
+
+namespace collabserver {
+
+typedef LWWGraph<std::string, int, int> StringGraph;
+typedef StringGraph::csr_type StringCSR;
+
+// Keys of the visited vertex, in visit order
+static std::string csrTest_Keys(const StringCSR& csr, const std::vector<StringCSR::vertex_id>& ids) {
+    std::string keys;
+    for (const auto id : ids) {
+        keys += csr.key(id);
+    }
+    return keys;
+}
+
+// a -> b -> d -> e
+// a -> c -> d
+// f -> a (f removed), g alone
+static StringGraph csrTest_BuildGraph() {
+    StringGraph data0;
+    data0.add_edge("a", "b", 1);
+    data0.add_edge("a", "c", 2);
+    data0.add_edge("b", "d", 3);
+    data0.add_edge("c", "d", 4);
+    data0.add_edge("d", "e", 5);
+    data0.add_edge("f", "a", 6);
+    data0.remove_vertex("f", 7);
+    data0.add_vertex("g", 8);
+    data0.add_edge("e", "b", 9);
+    data0.remove_edge("e", "b", 10);
+    return data0;
+}
+
+// -----------------------------------------------------------------------------
+// bfs()
+// -----------------------------------------------------------------------------
+
+TEST(GraphCSR, bfsTest) {
+    const StringGraph data0 = csrTest_BuildGraph();
+    const auto csr = data0.to_csr();
+
+    std::vector<StringCSR::vertex_id> ids;
+    std::vector<StringCSR::size_type> depths;
+    csr.bfs(csr.find("a"), [&](StringCSR::vertex_id id, StringCSR::size_type depth) {
+        ids.push_back(id);
+        depths.push_back(depth);
+    });
+    ASSERT_EQ(ids.size(), 5);
+    EXPECT_EQ(csr.key(ids[0]), "a");
+    EXPECT_EQ(csr.key(ids[3]), "d");
+    EXPECT_EQ(csr.key(ids[4]), "e");
+    EXPECT_EQ(depths, std::vector<StringCSR::size_type>({0, 1, 1, 2, 3}));
+
+    // Removed edge e -> b is not followed
+    ids.clear();
+    csr.bfs(csr.find("e"), [&](StringCSR::vertex_id id, StringCSR::size_type) { ids.push_back(id); });
+    EXPECT_EQ(csrTest_Keys(csr, ids), "e");
+}
+
+TEST(GraphCSR, bfsTest_Depths) {
+    const StringGraph data0 = csrTest_BuildGraph();
+    const auto csr = data0.to_csr();
+
+    const auto depths = csr.bfs_depths(csr.find("b"));
+    EXPECT_EQ(depths[csr.find("b")], 0);
+    EXPECT_EQ(depths[csr.find("d")], 1);
+    EXPECT_EQ(depths[csr.find("e")], 2);
+    EXPECT_EQ(depths[csr.find("a")], csr.npos);
+    EXPECT_EQ(depths[csr.find("g")], csr.npos);
+    EXPECT_EQ(csr.find("f"), csr.npos);
+}
+
+TEST(GraphCSR, bfsTest_ParallelSameAsSequential) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> randKey(0, 2999);
+    LWWGraph<int, int, int> data0;
+    for (int stamp = 1; stamp < 10000; ++stamp) {
+        if (stamp % 20 == 0) {
+            data0.remove_vertex(randKey(gen), stamp);
+        } else {
+            data0.add_edge(randKey(gen), randKey(gen), stamp);
+        }
+    }
+
+    const auto csr = data0.to_csr();
+    const auto source = csr.neighbors()[0];
+    const auto depths = csr.bfs_depths(source);
+    const unsigned int nbThreadsList[] = {0, 1, 2, 3, 8};
+    for (const unsigned int nbThreads : nbThreadsList) {
+        EXPECT_EQ(csr.bfs_depths_parallel(source, nbThreads), depths);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// dfs()
+// -----------------------------------------------------------------------------
+
+TEST(GraphCSR, dfsTest) {
+    const StringGraph data0 = csrTest_BuildGraph();
+    const auto csr = data0.to_csr();
+
+    std::vector<StringCSR::vertex_id> ids;
+    csr.dfs(csr.find("a"), [&](StringCSR::vertex_id id) { ids.push_back(id); });
+    ASSERT_EQ(ids.size(), 5);
+    EXPECT_EQ(csr.key(ids[0]), "a");
+
+    // Preorder: each vertex (But the source) follows one of its parents
+    for (std::size_t k = 1; k < ids.size(); ++k) {
+        bool hasParentBefore = false;
+        for (std::size_t p = 0; p < k; ++p) {
+            for (auto it = csr.neighbors_begin(ids[p]); it != csr.neighbors_end(ids[p]); ++it) {
+                hasParentBefore = hasParentBefore || (*it == ids[k]);
+            }
+        }
+        EXPECT_TRUE(hasParentBefore);
+    }
+
+    // Deep chain (No recursion)
+    LWWGraph<int, int, int> data1;
+    for (int k = 0; k < 100000; ++k) {
+        data1.add_edge(k, k + 1, k + 1);
+    }
+    const auto csr1 = data1.to_csr();
+    int nbVisited = 0;
+    csr1.dfs(csr1.find(0), [&](LWWGraph<int, int, int>::csr_type::vertex_id) { ++nbVisited; });
+    EXPECT_EQ(nbVisited, 100001);
+}
+
+// -----------------------------------------------------------------------------
+// reachable()
+// -----------------------------------------------------------------------------
+
+TEST(GraphCSR, reachableTest) {
+    const StringGraph data0 = csrTest_BuildGraph();
+    const auto csr = data0.to_csr();
+
+    EXPECT_TRUE(csr.reachable(csr.find("a"), csr.find("e")));
+    EXPECT_TRUE(csr.reachable(csr.find("c"), csr.find("e")));
+    EXPECT_TRUE(csr.reachable(csr.find("g"), csr.find("g")));
+    EXPECT_FALSE(csr.reachable(csr.find("e"), csr.find("b")));
+    EXPECT_FALSE(csr.reachable(csr.find("b"), csr.find("c")));
+    EXPECT_FALSE(csr.reachable(csr.find("a"), csr.find("g")));
+}
+
+// -----------------------------------------------------------------------------
+// topological_order()
+// -----------------------------------------------------------------------------
+
+TEST(GraphCSR, topologicalOrderTest) {
+    StringGraph data0 = csrTest_BuildGraph();
+    auto csr = data0.to_csr();
+
+    std::vector<StringCSR::vertex_id> order;
+    ASSERT_TRUE(csr.topological_order(order));
+    ASSERT_EQ(order.size(), csr.nb_vertex());
+    std::vector<std::size_t> position(csr.nb_vertex());
+    for (std::size_t k = 0; k < order.size(); ++k) {
+        position[order[k]] = k;
+    }
+    for (StringCSR::vertex_id id = 0; id < csr.nb_vertex(); ++id) {
+        for (auto it = csr.neighbors_begin(id); it != csr.neighbors_end(id); ++it) {
+            EXPECT_LT(position[id], position[*it]);
+        }
+    }
+
+    // Cycle e -> b -> d -> e
+    data0.add_edge("e", "b", 20);
+    csr = data0.to_csr();
+    EXPECT_FALSE(csr.topological_order(order));
+    EXPECT_EQ(order.size(), 3);  // a, c and g only
+}
+
+}  // namespace collabserver
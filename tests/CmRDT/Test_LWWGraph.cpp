@@ -1,8 +1,14 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <random>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "../TestUtils.h"
 #include "collabserver/datatypes/CmRDT/LWWGraph.h"
 
 namespace collabserver {
@@ -20,6 +26,25 @@ namespace collabserver {
     ASSERT_EQ(info_.isFromAdded, from_added_);                               \
     ASSERT_EQ(info_.isToAdded, to_added_)
 
+// Random graph operation: kind in [0, 10), keys in [0, 10]
+struct GraphTestOp {
+    int kind;
+    int from;
+    int to;
+    int stamp;
+};
+
+// Random ops with the stamps 1 to nbOps (See test_checkAnyOrder)
+static std::vector<GraphTestOp> graphTest_randomOps(int nbOps, std::mt19937& rng) {
+    std::uniform_int_distribution<int> randKey(0, 10);
+    std::uniform_int_distribution<int> randKind(0, 9);
+    std::vector<GraphTestOp> ops;
+    for (int stamp = 1; stamp <= nbOps; ++stamp) {
+        ops.push_back(GraphTestOp{randKind(rng), randKey(rng), randKey(rng), stamp});
+    }
+    return ops;
+}
+
 // -----------------------------------------------------------------------------
 // empty()
 // -----------------------------------------------------------------------------
@@ -274,6 +299,277 @@ TEST(LWWGraph, crdtSizeEdgesTest_WithRemoveCalls) {
     EXPECT_EQ(data0.crdt_size_edges(), 6);
 }
 
+// -----------------------------------------------------------------------------
+// size_edges() + crdt_size_edges()
+// -----------------------------------------------------------------------------
+
+// Checks the edge counters against the sum of the edges of each vertex
+template <typename Graph>
+static void sizeEdgesTest_CheckAgainstFullSum(const Graph& data) {
+    typename Graph::size_type_edges size = 0;
+    typename Graph::size_type_edges crdtSize = 0;
+    for (auto it = data.begin(); it != data.end(); ++it) {
+        size += it->second.edges().size();
+    }
+    for (auto it = data.crdt_begin(); it != data.crdt_end(); ++it) {
+        crdtSize += it->second.value().edges().crdt_size();
+    }
+    ASSERT_EQ(data.size_edges(), size);
+    ASSERT_EQ(data.crdt_size_edges(), crdtSize);
+}
+
+TEST(LWWGraph, sizeEdgesTest_RandomAgainstFullSum) {
+    std::mt19937 gen(1337);
+    std::uniform_int_distribution<int> randKey(0, 20);
+    std::uniform_int_distribution<int> randOp(0, 19);
+    LWWGraph<int, int, int> data0;
+    LWWGraph<int, int, int> data1;
+
+    for (int stamp = 1; stamp < 5000; ++stamp) {
+        const int op = randOp(gen);
+        const int key = randKey(gen);
+        if (op < 8) {
+            data0.add_edge(key, randKey(gen), stamp);
+        } else if (op < 11) {
+            data0.remove_edge(key, randKey(gen), stamp);
+        } else if (op < 13) {
+            data0.remove_vertex(key, stamp);
+        } else if (op < 14) {
+            data0.add_vertex(key, stamp);
+        } else if (op < 15) {
+            data0.clear_vertex_edges(key, stamp);
+        } else if (op < 16 && stamp % 100 == 0) {
+            data0.clear_vertices(stamp - 20);
+        } else if (op < 17) {
+            // Concurrent operations from another replicate
+            data1.add_edge(key, randKey(gen), stamp - 15);
+            data1.remove_edge(randKey(gen), key, stamp - 5);
+            if (stamp % 2 == 0) {
+                data0.merge(data1);
+            } else {
+                data0.merge(data1.delta_since(stamp - 50));
+            }
+        } else if (op < 18 && stamp % 200 == 0) {
+            data0.compact(stamp - 100);
+        } else {
+            // Old add received late
+            data0.add_edge(key, randKey(gen), stamp / 2);
+        }
+        sizeEdgesTest_CheckAgainstFullSum(data0);
+    }
+    sizeEdgesTest_CheckAgainstFullSum(data1);
+    sizeEdgesTest_CheckAgainstFullSum(data1.delta_since(2000));
+}
+
+// -----------------------------------------------------------------------------
+// Edge storage
+// -----------------------------------------------------------------------------
+
+// Applies the same random operations for any storage policy
+template <typename Graph>
+static void edgeStorageTest_ApplyRandom(Graph& data0) {
+    std::mt19937 gen(4242);
+    std::uniform_int_distribution<int> randKey(0, 200);
+    std::uniform_int_distribution<int> randOp(0, 19);
+    Graph data1;
+
+    for (int stamp = 1; stamp < 1500; ++stamp) {
+        const int op = randOp(gen);
+        const int key = randKey(gen);
+        if (op < 10) {
+            data0.add_edge(key, randKey(gen), stamp);
+        } else if (op < 13) {
+            data0.remove_edge(key, randKey(gen), stamp);
+        } else if (op < 15) {
+            data0.remove_vertex(key, stamp);
+        } else if (op < 16) {
+            data0.clear_vertex_edges(key, stamp);
+        } else if (op < 18) {
+            data1.add_edge(key, randKey(gen), stamp - 15);
+            data1.remove_edge(randKey(gen), key, stamp - 5);
+            data0.merge(data1);
+        } else if (op < 19 && stamp % 100 == 0) {
+            data0.compact(stamp - 50);
+        } else {
+            data0.add_edge(key, randKey(gen), stamp / 2);
+        }
+    }
+}
+
+TEST(LWWGraph, edgeStorageTest_SameAsHashMapStorage) {
+    LWWGraph<int, int, int, SmallMapStorage<2>> data0;
+    LWWGraph<int, int, int, HashMapStorage> data1;
+    edgeStorageTest_ApplyRandom(data0);
+    edgeStorageTest_ApplyRandom(data1);
+
+    ASSERT_EQ(data0.size_vertex(), data1.size_vertex());
+    ASSERT_EQ(data0.crdt_size_vertex(), data1.crdt_size_vertex());
+    ASSERT_EQ(data0.size_edges(), data1.size_edges());
+    ASSERT_EQ(data0.crdt_size_edges(), data1.crdt_size_edges());
+    for (int from = 0; from <= 200; ++from) {
+        for (int to = 0; to <= 200; ++to) {
+            ASSERT_EQ(data0.count_edge(from, to), data1.count_edge(from, to));
+        }
+    }
+
+    // Inline and hash table edges after the random operations
+    bool hasInline = false;
+    bool hasHashMap = false;
+    for (auto it = data0.crdt_begin(); it != data0.crdt_end(); ++it) {
+        const bool isInline = it->second.value().edges().crdt_size() <= 2;
+        hasInline = hasInline || isInline;
+        hasHashMap = hasHashMap || !isInline;
+    }
+    ASSERT_TRUE(hasInline);
+    ASSERT_TRUE(hasHashMap);
+}
+
+// -----------------------------------------------------------------------------
+// in_degree() / out_degree() / in_edges()
+// -----------------------------------------------------------------------------
+
+// Origins of the edges to a vertex, sorted
+template <typename Range>
+static std::vector<int> inEdgesTest_Sorted(const Range& range) {
+    std::vector<int> keys(range.begin(), range.end());
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+TEST(LWWGraph, inDegreeTest) {
+    LWWGraph<int, int, int> data0;
+    data0.add_edge(1, 2, 10);
+    data0.add_edge(3, 2, 11);
+    data0.add_edge(2, 2, 12);
+    data0.add_edge(2, 4, 13);
+    EXPECT_EQ(data0.in_degree(2), 3);
+    EXPECT_EQ(data0.out_degree(2), 2);
+    EXPECT_EQ(data0.in_degree(1), 0);
+    EXPECT_EQ(data0.out_degree(1), 1);
+    EXPECT_EQ(inEdgesTest_Sorted(data0.in_edges(2)), std::vector<int>({1, 2, 3}));
+
+    // Duplicate add doesn't count twice
+    data0.add_edge(1, 2, 14);
+    EXPECT_EQ(data0.in_degree(2), 3);
+
+    // Removed edges are only in crdt variants
+    data0.remove_edge(3, 2, 15);
+    EXPECT_EQ(data0.in_degree(2), 2);
+    EXPECT_EQ(data0.crdt_in_degree(2), 3);
+    EXPECT_EQ(inEdgesTest_Sorted(data0.in_edges(2)), std::vector<int>({1, 2}));
+    EXPECT_EQ(inEdgesTest_Sorted(data0.crdt_in_edges(2)), std::vector<int>({1, 2, 3}));
+    EXPECT_EQ(data0.in_edges(2).size(), 2);
+    EXPECT_EQ(data0.crdt_in_edges(2).size(), 3);
+
+    data0.clear_vertex_edges(2, 16);
+    EXPECT_EQ(data0.out_degree(2), 0);
+    EXPECT_EQ(data0.crdt_out_degree(2), 2);
+    EXPECT_EQ(data0.in_degree(2), 1);
+    EXPECT_EQ(data0.in_degree(4), 0);
+    EXPECT_EQ(data0.crdt_in_degree(4), 1);
+}
+
+TEST(LWWGraph, inDegreeTest_RemovedVertex) {
+    LWWGraph<int, int, int> data0;
+    data0.add_edge(1, 2, 10);
+    data0.add_edge(3, 2, 11);
+    data0.remove_vertex(2, 12);
+    EXPECT_EQ(data0.in_degree(2), 0);
+    EXPECT_TRUE(data0.in_edges(2).empty());
+    EXPECT_EQ(data0.crdt_in_degree(2), 2);
+    EXPECT_EQ(data0.out_degree(1), 0);
+
+    // Vertex added back: old edges are still removed
+    data0.add_edge(3, 2, 13);
+    EXPECT_EQ(data0.in_degree(2), 1);
+    EXPECT_EQ(inEdgesTest_Sorted(data0.in_edges(2)), std::vector<int>({3}));
+
+    // Unknown vertex
+    EXPECT_EQ(data0.in_degree(42), 0);
+    EXPECT_EQ(data0.crdt_in_degree(42), 0);
+    EXPECT_EQ(data0.out_degree(42), 0);
+    EXPECT_TRUE(data0.in_edges(42).empty());
+    EXPECT_TRUE(data0.crdt_in_edges(42).begin() == data0.crdt_in_edges(42).end());
+}
+
+// Checks degrees and in_edges of each vertex against a scan of all edges.
+// Removed edges to a vertex purged by compact are not indexed: crdt variants
+// are only checked if isCrdtExact.
+static void inDegreeTest_CheckAgainstScan(const LWWGraph<int, int, int>& data, int maxKey, bool isCrdtExact) {
+    std::vector<std::vector<int>> inEdges(maxKey + 1);
+    std::vector<std::vector<int>> crdtInEdges(maxKey + 1);
+    for (auto it = data.crdt_begin(); it != data.crdt_end(); ++it) {
+        const auto& edges = it->second.value().edges();
+        for (auto edge_it = edges.crdt_begin(); edge_it != edges.crdt_end(); ++edge_it) {
+            crdtInEdges[edge_it->first].push_back(it->first);
+            if (!edge_it->second.isRemoved()) {
+                inEdges[edge_it->first].push_back(it->first);
+            }
+        }
+    }
+    for (int key = 0; key <= maxKey; ++key) {
+        std::sort(inEdges[key].begin(), inEdges[key].end());
+        std::sort(crdtInEdges[key].begin(), crdtInEdges[key].end());
+        ASSERT_EQ(data.in_degree(key), inEdges[key].size());
+        ASSERT_EQ(inEdgesTest_Sorted(data.in_edges(key)), inEdges[key]);
+        const auto vertex_it = data.crdt_find_vertex(key);
+        const auto outDegree = (vertex_it != data.crdt_end()) ? vertex_it->second.value().edges().size() : 0;
+        ASSERT_EQ(data.out_degree(key), data.has_vertex(key) ? outDegree : 0);
+        if (isCrdtExact) {
+            ASSERT_EQ(data.crdt_in_degree(key), crdtInEdges[key].size());
+            ASSERT_EQ(inEdgesTest_Sorted(data.crdt_in_edges(key)), crdtInEdges[key]);
+        }
+    }
+}
+
+static void inDegreeTest_CheckRandom(bool withCompact) {
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<int> randKey(0, 30);
+    std::uniform_int_distribution<int> randOp(0, 19);
+    LWWGraph<int, int, int> data0;
+    LWWGraph<int, int, int> data1;
+    std::vector<std::pair<int, int>> batch;
+
+    for (int stamp = 1; stamp < 4000; ++stamp) {
+        const int op = randOp(gen);
+        const int key = randKey(gen);
+        if (op < 7) {
+            data0.add_edge(key, randKey(gen), stamp);
+        } else if (op < 10) {
+            data0.remove_edge(key, randKey(gen), stamp);
+        } else if (op < 12) {
+            data0.remove_vertex(key, stamp);
+        } else if (op < 13) {
+            data0.clear_vertex_edges(key, stamp);
+        } else if (op < 14 && stamp % 100 == 0) {
+            data0.clear_vertices(stamp - 20);
+        } else if (op < 15) {
+            batch.clear();
+            for (int k = 0; k < 5; ++k) {
+                batch.emplace_back(randKey(gen), key);
+            }
+            data0.add_edges(batch.begin(), batch.end(), stamp);
+        } else if (op < 17) {
+            data1.add_edge(key, randKey(gen), stamp - 15);
+            data1.remove_edge(randKey(gen), key, stamp - 5);
+            if (stamp % 2 == 0) {
+                data0.merge(data1);
+            } else {
+                data0.merge(data1.delta_since(stamp - 50));
+            }
+        } else if (op < 18 && withCompact && stamp % 200 == 0) {
+            data0.compact(stamp - 100);
+        } else {
+            data0.add_edge(key, randKey(gen), stamp / 2);
+        }
+        inDegreeTest_CheckAgainstScan(data0, 30, !withCompact);
+    }
+}
+
+TEST(LWWGraph, inDegreeTest_RandomAgainstScan) { inDegreeTest_CheckRandom(false); }
+
+TEST(LWWGraph, inDegreeTest_RandomAgainstScanWithCompact) { inDegreeTest_CheckRandom(true); }
+
 // -----------------------------------------------------------------------------
 // at_vertex()
 // -----------------------------------------------------------------------------
@@ -346,6 +642,20 @@ TEST(LWWGraph, atVertexTest_InvalidVertexThrowException) {
     ASSERT_EQ(nbException, 3);
 }
 
+TEST(LWWGraph, atVertexTest_ConstGraph) {
+    LWWGraph<std::string, std::string, int> data0;
+    data0.set_vertex("v1", "Kaamelott", 10);
+    data0.set_vertex("v2", "Caradoc", 10);
+    data0.remove_vertex("v2", 20);
+
+    const auto& constData0 = data0;
+    EXPECT_EQ(constData0.at_vertex("v1"), "Kaamelott");
+    EXPECT_EQ(constData0.crdt_at_vertex("v1"), "Kaamelott");
+    EXPECT_EQ(constData0.crdt_at_vertex("v2"), "Caradoc");
+    EXPECT_THROW(constData0.at_vertex("v2"), std::out_of_range);
+    EXPECT_THROW(constData0.crdt_at_vertex("v3"), std::out_of_range);
+}
+
 // -----------------------------------------------------------------------------
 // crdt_at_vertex()
 // -----------------------------------------------------------------------------
@@ -1053,6 +1363,98 @@ TEST(LWWGraph, addVertexTest_WithRemoveVertexReturnType) {
     ASSERT_FALSE(data0.add_vertex("v1", 90));
 }
 
+// -----------------------------------------------------------------------------
+// add_vertices()
+// -----------------------------------------------------------------------------
+
+TEST(LWWGraph, addVerticesTest) {
+    LWWGraph<std::string, int, int> data0;
+    data0.add_vertex("v1", 10);
+    data0.remove_vertex("v2", 30);
+
+    const std::vector<std::string> keys = {"v1", "v2", "v3", "v3"};
+    const std::vector<bool> results = data0.add_vertices(keys.begin(), keys.end(), 20);
+    EXPECT_EQ(results, std::vector<bool>({false, false, true, false}));
+    EXPECT_EQ(data0.size_vertex(), 2);
+    EXPECT_EQ(data0.crdt_size_vertex(), 3);
+    EXPECT_EQ(data0.crdt_find_vertex("v1")->second.timestamp(), 20);
+    EXPECT_EQ(data0.count_vertex("v2"), 0);
+    EXPECT_EQ(data0.count_vertex("v3"), 1);
+}
+
+// -----------------------------------------------------------------------------
+// set_vertex()
+// -----------------------------------------------------------------------------
+
+TEST(LWWGraph, setVertexTest) {
+    LWWGraph<std::string, std::string, int> data0;
+
+    // New vertex is built with its content
+    ASSERT_TRUE(data0.set_vertex("v1", "carrot", 10));
+    auto vertex_it = data0.crdt_find_vertex("v1");
+    _ASSERT_VERTEX_EQ(vertex_it, "v1", false, 10, data0);
+    EXPECT_EQ(data0.at_vertex("v1"), "carrot");
+
+    // Older set is lost, newer replaces content
+    data0.add_edge("v1", "v2", 11);
+    ASSERT_FALSE(data0.set_vertex("v1", "coconut", 5));
+    EXPECT_EQ(data0.at_vertex("v1"), "carrot");
+    ASSERT_TRUE(data0.set_vertex("v1", "coconut", 20));
+    EXPECT_EQ(data0.at_vertex("v1"), "coconut");
+
+    // Edges are kept
+    EXPECT_TRUE(data0.has_edge("v1", "v2"));
+    EXPECT_EQ(data0.size_edges(), 1);
+}
+
+TEST(LWWGraph, setVertexTest_WithRemoveVertex) {
+    LWWGraph<std::string, std::string, int> data0;
+
+    // Remove wins for the vertex, the content is still set
+    data0.remove_vertex("v1", 20);
+    ASSERT_TRUE(data0.set_vertex("v1", "carrot", 10));
+    EXPECT_FALSE(data0.has_vertex("v1"));
+    EXPECT_EQ(data0.crdt_at_vertex("v1"), "carrot");
+
+    ASSERT_TRUE(data0.set_vertex("v1", "coconut", 30));
+    EXPECT_TRUE(data0.has_vertex("v1"));
+    EXPECT_EQ(data0.at_vertex("v1"), "coconut");
+}
+
+TEST(LWWGraph, setVertexTest_Commutative) {
+    LWWGraph<std::string, std::string, int> data0;
+    LWWGraph<std::string, std::string, int> data1;
+
+    data0.set_vertex("v1", "carrot", 10);
+    data0.set_vertex("v1", "coconut", 20);
+    data0.add_edge("v1", "v2", 15);
+
+    data1.add_edge("v1", "v2", 15);
+    data1.set_vertex("v1", "coconut", 20);
+    data1.set_vertex("v1", "carrot", 10);
+
+    EXPECT_EQ(data0.at_vertex("v1"), "coconut");
+    EXPECT_TRUE(data0 == data1);
+}
+
+TEST(LWWGraph, setVertexTest_CommutativeWithAddEdge) {
+    typedef LWWGraph<std::string, std::string, int> Graph;
+    const std::vector<std::function<void(Graph&)>> ops = {
+        [](Graph& data) { data.set_vertex("v1", "carrot", 10); },
+        [](Graph& data) { data.add_edge("v1", "v2", 20); },
+        [](Graph& data) { data.set_vertex("v1", "coconut", 5); },
+        [](Graph& data) { data.remove_vertex("v1", 15); },
+    };
+    std::mt19937 rng(7);
+    test_checkAnyOrder<Graph>(
+        ops, 50, rng, [](Graph& data, const std::function<void(Graph&)>& op) { op(data); },
+        [](const Graph& expected, const Graph& data) {
+            EXPECT_EQ(data.at_vertex("v1"), "carrot");
+            EXPECT_TRUE(data.has_edge("v1", "v2"));
+            EXPECT_TRUE(data.crdt_equal(expected));
+        });
+}
+
 // -----------------------------------------------------------------------------
 // remove_vertex()
 // -----------------------------------------------------------------------------
@@ -1188,6 +1590,129 @@ TEST(LWWGraph, removeVertexTest_WithAddVertexReturnType) {
     ASSERT_FALSE(data0.remove_vertex("v1", 31));
 }
 
+TEST(LWWGraph, removeVertexTest_OnlyIncomingEdges) {
+    LWWGraph<int, int, int> data0;
+
+    // Star to vertex 0, plus a chain not linked to it
+    for (int k = 1; k <= 100; ++k) {
+        data0.add_edge(k, 0, k);
+        data0.add_edge(k, k + 1, k);
+    }
+    data0.add_edge(0, 0, 200);
+    ASSERT_EQ(data0.size_edges(), 201);
+
+    ASSERT_TRUE(data0.remove_vertex(0, 300));
+    EXPECT_EQ(data0.size_edges(), 100);
+    for (int k = 1; k <= 100; ++k) {
+        EXPECT_FALSE(data0.has_edge(k, 0));
+        EXPECT_TRUE(data0.has_edge(k, k + 1));
+        auto edge_it = data0.crdt_find_vertex(k)->second.value().edges().crdt_find(0);
+        ASSERT_TRUE(edge_it->second.isRemoved());
+        ASSERT_EQ(edge_it->second.timestamp(), 300);
+    }
+    EXPECT_FALSE(data0.has_edge(0, 0));
+}
+
+TEST(LWWGraph, removeVertexTest_OnlyIncomingEdgesFlatHashStorage) {
+    // Reverse adjacency of 100 is a FlatHashMap, at each load (Rehash)
+    for (int nbEdges = 1; nbEdges <= 20; ++nbEdges) {
+        LWWGraph<int, int, int, FlatHashStorage> data0;
+        for (int k = 0; k < nbEdges; ++k) {
+            data0.add_edge(k, 100, 10 + k);
+        }
+        ASSERT_TRUE(data0.remove_vertex(100, 50));
+        EXPECT_EQ(data0.size_edges(), 0);
+        EXPECT_EQ(data0.in_degree(100), 0);
+        EXPECT_EQ(data0.crdt_in_degree(100), nbEdges);
+        for (int k = 0; k < nbEdges; ++k) {
+            EXPECT_FALSE(data0.has_edge(k, 100));
+        }
+    }
+}
+
+TEST(LWWGraph, removeVertexTest_AddEdgeAfterConcurrentRemove) {
+    LWWGraph<std::string, int, int> data0;
+
+    // Add edge received after a newer remove_vertex: edge stays removed
+    data0.add_vertex("v2", 5);
+    data0.remove_vertex("v2", 20);
+    data0.add_edge("v1", "v2", 10);
+    EXPECT_FALSE(data0.has_edge("v1", "v2"));
+
+    // Newer add edge, then removed with its vertex
+    data0.add_edge("v1", "v2", 30);
+    EXPECT_TRUE(data0.has_edge("v1", "v2"));
+    ASSERT_TRUE(data0.remove_vertex("v2", 40));
+    EXPECT_FALSE(data0.has_edge("v1", "v2"));
+
+    // Remove older than the edge: edge is kept
+    data0.add_edge("v1", "v2", 50);
+    data0.add_edge("v3", "v2", 60);
+    data0.remove_vertex("v2", 55);
+    EXPECT_FALSE(data0.has_edge("v1", "v2"));
+    EXPECT_TRUE(data0.has_edge("v3", "v2"));
+    data0.remove_vertex("v2", 70);
+    EXPECT_FALSE(data0.has_edge("v3", "v2"));
+    EXPECT_EQ(data0.size_edges(), 0);
+}
+
+TEST(LWWGraph, removeVertexTest_EdgesFromMergeAndDelta) {
+    LWWGraph<std::string, int, int> data0;
+    LWWGraph<std::string, int, int> data1;
+    LWWGraph<std::string, int, int> data2;
+
+    data0.add_vertex("v1", 1);
+    data1.add_edge("v2", "v1", 10);
+    data2.add_edge("v3", "v1", 11);
+    data0.merge(data1);
+    data0.merge(data2.delta_since(5));
+    ASSERT_TRUE(data0.has_edge("v2", "v1"));
+    ASSERT_TRUE(data0.has_edge("v3", "v1"));
+
+    ASSERT_TRUE(data0.remove_vertex("v1", 20));
+    EXPECT_FALSE(data0.has_edge("v2", "v1"));
+    EXPECT_FALSE(data0.has_edge("v3", "v1"));
+
+    // Delta graph itself
+    auto delta = data1.delta_since(0);
+    delta.remove_vertex("v1", 20);
+    EXPECT_FALSE(delta.has_edge("v2", "v1"));
+}
+
+TEST(LWWGraph, removeVertexTest_RandomAgainstFullScan) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> randKey(0, 15);
+    std::uniform_int_distribution<int> randOp(0, 9);
+    LWWGraph<int, int, int> data0;
+    LWWGraph<int, int, int> data1;
+
+    for (int stamp = 1; stamp < 3000; ++stamp) {
+        const int op = randOp(gen);
+        const int key = randKey(gen);
+        if (op < 5) {
+            data0.add_edge(key, randKey(gen), stamp);
+        } else if (op < 6) {
+            data0.remove_edge(key, randKey(gen), stamp);
+        } else if (op < 7) {
+            data0.clear_vertex_edges(key, stamp);
+        } else if (op < 8) {
+            // Older concurrent operations from another replicate
+            data1.add_edge(key, randKey(gen), stamp - 10);
+            data0.merge(data1);
+        } else if (op < 9 && stamp % 500 == 0) {
+            data0.compact(stamp - 100);
+        } else {
+            data0.remove_vertex(key, stamp);
+            for (auto it = data0.crdt_begin(); it != data0.crdt_end(); ++it) {
+                const auto& edges = it->second.value().edges();
+                if (edges.count(key) == 1) {
+                    ASSERT_GT(edges.crdt_find(key)->second.timestamp(), stamp);
+                }
+            }
+        }
+    }
+}
+
 // -----------------------------------------------------------------------------
 // add_edge()
 // -----------------------------------------------------------------------------
@@ -1360,6 +1885,225 @@ TEST(LWWGraph, addEdgeTest_WithToAndFromEqualReturnType) {
     _ASSERT_ADD_EDGE_INFO_EQ(coco, true, false, false);
 }
 
+// -----------------------------------------------------------------------------
+// add_edges()
+// -----------------------------------------------------------------------------
+
+// Check add_edges gives the same graph and infos as add_edge in order
+template <typename Graph>
+static void addEdgesTest_CheckSameAsAddEdge(const Graph& data0, const Graph& data1,
+                                            const std::vector<typename Graph::AddEdgeInfo>& infos,
+                                            const std::vector<typename Graph::AddEdgeInfo>& expected) {
+    ASSERT_EQ(infos.size(), expected.size());
+    for (std::size_t i = 0; i < infos.size(); ++i) {
+        EXPECT_EQ(infos[i].isEdgeAdded, expected[i].isEdgeAdded) << "edge " << i;
+        EXPECT_EQ(infos[i].isFromAdded, expected[i].isFromAdded) << "edge " << i;
+        EXPECT_EQ(infos[i].isToAdded, expected[i].isToAdded) << "edge " << i;
+    }
+    EXPECT_TRUE(data0.crdt_equal(data1));
+    EXPECT_EQ(data0.size_edges(), data1.size_edges());
+    EXPECT_EQ(data0.crdt_size_edges(), data1.crdt_size_edges());
+}
+
+TEST(LWWGraph, addEdgesTest) {
+    LWWGraph<std::string, int, int> data0;
+    const std::vector<std::pair<std::string, std::string>> edges = {
+        {"v1", "v2"}, {"v1", "v3"}, {"v2", "v3"}, {"v1", "v2"}, {"v3", "v3"}};
+    const auto infos = data0.add_edges(edges.begin(), edges.end(), 10);
+    ASSERT_EQ(infos.size(), 5);
+    EXPECT_TRUE(infos[0].isEdgeAdded && infos[0].isFromAdded && infos[0].isToAdded);
+    EXPECT_TRUE(infos[1].isEdgeAdded && !infos[1].isFromAdded && infos[1].isToAdded);
+    EXPECT_TRUE(infos[2].isEdgeAdded && !infos[2].isFromAdded && !infos[2].isToAdded);
+    EXPECT_FALSE(infos[3].isEdgeAdded || infos[3].isFromAdded || infos[3].isToAdded);
+    EXPECT_TRUE(infos[4].isEdgeAdded && !infos[4].isFromAdded && !infos[4].isToAdded);
+    EXPECT_EQ(data0.size_vertex(), 3);
+    EXPECT_EQ(data0.size_edges(), 4);
+    EXPECT_EQ(data0.count_edge("v1", "v3"), 1);
+
+    // Reverse adjacency is filled (remove_vertex removes incoming edges)
+    data0.remove_vertex("v3", 20);
+    EXPECT_EQ(data0.size_edges(), 1);
+    EXPECT_EQ(data0.count_edge("v1", "v2"), 1);
+}
+
+TEST(LWWGraph, addEdgesTest_WithRemovedVertex) {
+    LWWGraph<std::string, int, int> data0;
+    LWWGraph<std::string, int, int> data1;
+    data0.remove_vertex("v2", 20);
+    data1.remove_vertex("v2", 20);
+
+    const std::vector<std::pair<std::string, std::string>> edges = {{"v1", "v2"}, {"v2", "v1"}, {"v1", "v3"}};
+    const auto infos = data0.add_edges(edges.begin(), edges.end(), 10);
+    std::vector<LWWGraph<std::string, int, int>::AddEdgeInfo> expected;
+    for (const auto& edge : edges) {
+        expected.push_back(data1.add_edge(edge.first, edge.second, 10));
+    }
+    addEdgesTest_CheckSameAsAddEdge(data0, data1, infos, expected);
+    EXPECT_EQ(data0.size_edges(), 1);
+    EXPECT_EQ(data0.crdt_size_edges(), 3);
+}
+
+TEST(LWWGraph, addEdgesTest_VertexReaddedInRange) {
+    typedef LWWGraph<std::string, int, int> Graph;
+    Graph data0;
+    Graph data1;
+    data0.remove_vertex("v2", 20);
+    data1.remove_vertex("v2", 20);
+
+    // First edge is before v2 is added again: removed, as with add_edge
+    const std::vector<Graph::BatchEdge> edges = {{"v1", "v2", 10}, {"v3", "v2", 30}, {"v1", "v2", 15}};
+    const auto infos = data0.add_edges(edges.begin(), edges.end());
+    std::vector<Graph::AddEdgeInfo> expected;
+    for (const auto& edge : edges) {
+        expected.push_back(data1.add_edge(edge.from, edge.to, edge.stamp));
+    }
+    addEdgesTest_CheckSameAsAddEdge(data0, data1, infos, expected);
+    EXPECT_EQ(data0.count_edge("v1", "v2"), 0);
+    EXPECT_EQ(data0.count_edge("v3", "v2"), 1);
+}
+
+TEST(LWWGraph, addEdgesTest_RandomSameAsAddEdge) {
+    typedef LWWGraph<int, int, int> Graph;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> randKey(0, 60);
+    Graph data0;
+    Graph data1;
+
+    // Existing graph with removed vertex and edges
+    for (int stamp = 1; stamp < 300; ++stamp) {
+        const int from = randKey(gen);
+        const int to = randKey(gen);
+        if (stamp % 7 == 0) {
+            data0.remove_vertex(from, stamp * 10);
+            data1.remove_vertex(from, stamp * 10);
+        } else if (stamp % 5 == 0) {
+            data0.remove_edge(from, to, stamp * 10);
+            data1.remove_edge(from, to, stamp * 10);
+        } else {
+            data0.add_edge(from, to, stamp * 10);
+            data1.add_edge(from, to, stamp * 10);
+        }
+    }
+
+    // Same stamp for all edges (Older and newer than the existing graph)
+    const int stamps[] = {1505, 3005};
+    for (const int stamp : stamps) {
+        std::vector<std::pair<int, int>> edges;
+        for (int k = 0; k < 500; ++k) {
+            edges.push_back(std::make_pair(randKey(gen), randKey(gen)));
+        }
+        const auto infos = data0.add_edges(edges.begin(), edges.end(), stamp);
+        std::vector<Graph::AddEdgeInfo> expected;
+        for (const auto& edge : edges) {
+            expected.push_back(data1.add_edge(edge.first, edge.second, stamp));
+        }
+        addEdgesTest_CheckSameAsAddEdge(data0, data1, infos, expected);
+    }
+
+    // Stamp for each edge (Some older than the vertex remove)
+    std::vector<Graph::BatchEdge> edges;
+    for (int k = 0; k < 1000; ++k) {
+        edges.push_back(Graph::BatchEdge{randKey(gen), randKey(gen), 1000 + (k * 37) % 3000});
+    }
+    const auto infos = data0.add_edges(edges.begin(), edges.end());
+    std::vector<Graph::AddEdgeInfo> expected;
+    for (const auto& edge : edges) {
+        expected.push_back(data1.add_edge(edge.from, edge.to, edge.stamp));
+    }
+    addEdgesTest_CheckSameAsAddEdge(data0, data1, infos, expected);
+
+    // Same reverse adjacency
+    for (int key = 0; key <= 60; key += 3) {
+        data0.remove_vertex(key, 5000 + key);
+        data1.remove_vertex(key, 5000 + key);
+    }
+    EXPECT_TRUE(data0.crdt_equal(data1));
+    EXPECT_EQ(data0.size_edges(), data1.size_edges());
+}
+
+// -----------------------------------------------------------------------------
+// set_edge() / at_edge()
+// -----------------------------------------------------------------------------
+
+typedef LWWGraph<int, int, int, SmallMapStorage<4>, double> WeightedGraph;
+
+TEST(LWWGraph, setEdgeTest) {
+    WeightedGraph data0;
+    ASSERT_TRUE(data0.set_edge(1, 2, 0.5, 10));
+    ASSERT_TRUE(data0.has_edge(1, 2));
+    ASSERT_TRUE(data0.has_vertex(2));
+    ASSERT_EQ(data0.in_degree(2), 1);
+    ASSERT_EQ(data0.at_edge(1, 2), 0.5);
+
+    // Newer value wins, older is ignored
+    ASSERT_TRUE(data0.set_edge(1, 2, 1.5, 20));
+    ASSERT_FALSE(data0.set_edge(1, 2, 2.5, 15));
+    ASSERT_EQ(data0.at_edge(1, 2), 1.5);
+    ASSERT_EQ(data0.size_edges(), 1);
+
+    // Removed edge keeps its value, back once added again
+    data0.remove_edge(1, 2, 30);
+    ASSERT_THROW(data0.at_edge(1, 2), std::out_of_range);
+    ASSERT_EQ(data0.crdt_at_edge(1, 2), 1.5);
+    data0.add_edge(1, 2, 40);
+    ASSERT_EQ(data0.at_edge(1, 2), 1.5);
+
+    // Edge added without value
+    data0.add_edge(2, 3, 50);
+    ASSERT_EQ(data0.at_edge(2, 3), 0.0);
+    ASSERT_THROW(data0.at_edge(3, 2), std::out_of_range);
+    ASSERT_THROW(data0.at_edge(4, 2), std::out_of_range);
+    ASSERT_THROW(data0.crdt_at_edge(4, 2), std::out_of_range);
+}
+
+TEST(LWWGraph, setEdgeTest_OlderThanRemoveVertex) {
+    WeightedGraph data0;
+    data0.remove_vertex(2, 20);
+    ASSERT_TRUE(data0.set_edge(1, 2, 0.5, 10));
+    ASSERT_FALSE(data0.has_edge(1, 2));
+    ASSERT_EQ(data0.crdt_at_edge(1, 2), 0.5);
+    ASSERT_EQ(data0.in_degree(2), 0);
+}
+
+TEST(LWWGraph, operatorEQTest_EdgeValue) {
+    WeightedGraph data0;
+    WeightedGraph data1;
+    data0.set_edge(1, 2, 0.5, 10);
+    data1.set_edge(1, 2, 0.5, 11);
+    ASSERT_TRUE(data0 == data1);
+    data1.set_edge(1, 2, 1.5, 12);
+    ASSERT_FALSE(data0 == data1);
+}
+
+// Same operations received in random orders, or merged, give the same
+// values. (Value of an edge is independent from its add / remove)
+TEST(LWWGraph, setEdgeTest_AnyOrderAndMerge) {
+    auto apply = [](WeightedGraph& graph, const GraphTestOp& op) {
+        if (op.kind < 5) {
+            graph.set_edge(op.from, op.to, op.stamp * 0.5, op.stamp);
+        } else if (op.kind < 6) {
+            graph.add_edge(op.from, op.to, op.stamp);
+        } else if (op.kind < 8) {
+            graph.remove_edge(op.from, op.to, op.stamp);
+        } else {
+            graph.remove_vertex(op.from, op.stamp);
+        }
+    };
+    auto check = [](const WeightedGraph& expected, const WeightedGraph& graph) {
+        ASSERT_TRUE(graph == expected);
+        for (auto it = expected.crdt_begin(); it != expected.crdt_end(); ++it) {
+            for (auto edge_it = it->second.value().edges().crdt_begin();
+                 edge_it != it->second.value().edges().crdt_end(); ++edge_it) {
+                ASSERT_EQ(graph.crdt_at_edge(it->first, edge_it->first), edge_it->second.payload());
+            }
+        }
+    };
+    std::mt19937 gen(7);
+    for (int trial = 0; trial < 200; ++trial) {
+        test_checkAnyOrder<WeightedGraph>(graphTest_randomOps(40, gen), 1, gen, apply, check);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // remove_edge()
 // -----------------------------------------------------------------------------
@@ -1705,6 +2449,74 @@ TEST(LWWGraph, removeVertexTest_AddEdgeConcurrentWithFromDeletedLater) {
     ASSERT_TRUE(data0.crdt_has_edge("v1", "v2"));
 }
 
+TEST(LWWGraph, addEdgeTest_OlderThanRemoveOfVertexAddedBack) {
+    LWWGraph<std::string, int, int> data0;
+    LWWGraph<std::string, int, int> data1;
+
+    // data0 receives the add_edge first, data1 last (v2 is back meanwhile)
+    data0.add_edge("v1", "v2", 10);
+    data0.remove_vertex("v2", 20);
+    data0.add_edge("v3", "v2", 30);
+    data1.remove_vertex("v2", 20);
+    data1.add_edge("v3", "v2", 30);
+    data1.add_edge("v1", "v2", 10);
+
+    ASSERT_TRUE(data0 == data1);
+    ASSERT_FALSE(data1.has_edge("v1", "v2"));
+    ASSERT_TRUE(data1.has_edge("v3", "v2"));
+    ASSERT_EQ(data1.in_degree("v2"), 1);
+
+    // Newer add_edge than the remove
+    data1.add_edge("v1", "v2", 15);
+    ASSERT_FALSE(data1.has_edge("v1", "v2"));
+    data1.add_edge("v1", "v2", 25);
+    ASSERT_TRUE(data1.has_edge("v1", "v2"));
+}
+
+TEST(LWWGraph, addEdgeTest_BeforeRemoveOfOtherVertex) {
+    LWWGraph<std::string, int, int> data0;
+    LWWGraph<std::string, int, int> data1;
+
+    // The edge is removed by the remove_vertex, then added back
+    data0.add_edge("v1", "v2", 10);
+    data0.remove_vertex("v2", 20);
+    data0.add_edge("v1", "v2", 30);
+    data1.add_edge("v1", "v3", 40);
+    data1.remove_vertex("v2", 20);
+    data1.add_edge("v1", "v2", 10);
+    data1.add_edge("v1", "v2", 30);
+    data0.add_edge("v1", "v3", 40);
+
+    ASSERT_TRUE(data0 == data1);
+    ASSERT_TRUE(data1.has_edge("v1", "v2"));
+}
+
+// Same operations received in random orders give the same graph
+TEST(LWWGraph, operationsTest_AnyOrder) {
+    typedef LWWGraph<int, int, int> Graph;
+    auto apply = [](Graph& graph, const GraphTestOp& op) {
+        if (op.kind < 5) {
+            graph.add_edge(op.from, op.to, op.stamp);
+        } else if (op.kind < 7) {
+            graph.remove_edge(op.from, op.to, op.stamp);
+        } else if (op.kind < 8) {
+            graph.remove_vertex(op.from, op.stamp);
+        } else if (op.kind < 9) {
+            graph.clear_vertex_edges(op.from, op.stamp);
+        } else {
+            graph.add_vertex(op.from, op.stamp);
+        }
+    };
+    auto check = [](const Graph& expected, const Graph& graph) {
+        ASSERT_TRUE(graph == expected);
+        ASSERT_EQ(graph.crdt_size_edges(), expected.crdt_size_edges());
+    };
+    std::mt19937 gen(99);
+    for (int trial = 0; trial < 200; ++trial) {
+        test_checkAnyOrder<Graph>(graphTest_randomOps(40, gen), 1, gen, apply, check);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // crdt_size()
 // -----------------------------------------------------------------------------
@@ -2270,4 +3082,435 @@ TEST(LWWGraph, crdtIteratorTest_end) {
     EXPECT_EQ(k, 0);
 }
 
+// -----------------------------------------------------------------------------
+// to_csr()
+// -----------------------------------------------------------------------------
+
+TEST(LWWGraph, toCsrTest) {
+    LWWGraph<std::string, int, int> data0;
+    data0.add_edge("v1", "v2", 10);
+    data0.add_edge("v1", "v3", 11);
+    data0.add_edge("v2", "v3", 12);
+    data0.add_edge("v3", "v3", 13);
+    data0.add_vertex("v4", 14);
+    data0.crdt_at_vertex("v4") = 42;
+
+    // Removed vertex and edges are not in the view
+    data0.add_edge("v5", "v1", 15);
+    data0.remove_vertex("v5", 16);
+    data0.add_edge("v2", "v1", 17);
+    data0.remove_edge("v2", "v1", 18);
+
+    const auto csr = data0.to_csr();
+    ASSERT_EQ(csr.nb_vertex(), 4);
+    ASSERT_EQ(csr.nb_edges(), 4);
+    ASSERT_EQ(csr.offsets().size(), 5);
+    EXPECT_EQ(csr.find("v5"), csr.npos);
+    EXPECT_EQ(csr.find("v42"), csr.npos);
+
+    const auto v1 = csr.find("v1");
+    const auto v2 = csr.find("v2");
+    const auto v3 = csr.find("v3");
+    const auto v4 = csr.find("v4");
+    ASSERT_NE(v1, csr.npos);
+    ASSERT_NE(v4, csr.npos);
+    EXPECT_EQ(csr.key(v1), "v1");
+    EXPECT_EQ(csr.content(v4), 42);
+    EXPECT_EQ(csr.degree(v1), 2);
+    EXPECT_EQ(csr.degree(v2), 1);
+    EXPECT_EQ(csr.degree(v3), 1);
+    EXPECT_EQ(csr.degree(v4), 0);
+    EXPECT_EQ(*csr.neighbors_begin(v2), v3);
+    EXPECT_EQ(*csr.neighbors_begin(v3), v3);
+    EXPECT_EQ(csr.neighbors_begin(v1)[0], std::min(v2, v3));
+    EXPECT_EQ(csr.neighbors_begin(v1)[1], std::max(v2, v3));
+
+    // Content points back to the graph
+    data0.at_vertex("v4") = 64;
+    EXPECT_EQ(csr.content(v4), 64);
+}
+
+TEST(LWWGraph, toCsrTest_Empty) {
+    LWWGraph<std::string, int, int> data0;
+    auto csr = data0.to_csr_parallel(4);
+    EXPECT_EQ(csr.nb_vertex(), 0);
+    EXPECT_EQ(csr.nb_edges(), 0);
+    EXPECT_EQ(csr.offsets().size(), 1);
+
+    data0.remove_vertex("v1", 10);
+    csr = data0.to_csr_parallel(4);
+    EXPECT_EQ(csr.nb_vertex(), 0);
+}
+
+TEST(LWWGraph, toCsrTest_ParallelSameAsGraph) {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> randKey(0, 499);
+    LWWGraph<int, int, int> data0;
+    for (int stamp = 1; stamp < 5000; ++stamp) {
+        const int key = randKey(gen);
+        if (stamp % 10 == 0) {
+            data0.remove_vertex(key, stamp);
+        } else if (stamp % 7 == 0) {
+            data0.remove_edge(key, randKey(gen), stamp);
+        } else {
+            data0.add_edge(key, randKey(gen), stamp);
+        }
+    }
+
+    const auto csr = data0.to_csr();
+    const unsigned int nbThreadsList[] = {0, 2, 3, 8};
+    for (const unsigned int nbThreads : nbThreadsList) {
+        const auto csrParallel = data0.to_csr_parallel(nbThreads);
+        EXPECT_EQ(csrParallel.offsets(), csr.offsets());
+        EXPECT_EQ(csrParallel.neighbors(), csr.neighbors());
+    }
+
+    ASSERT_EQ(csr.nb_vertex(), data0.size_vertex());
+    ASSERT_EQ(csr.nb_edges(), data0.size_edges());
+    for (auto it = data0.begin(); it != data0.end(); ++it) {
+        const auto id = csr.find(it->first);
+        ASSERT_NE(id, csr.npos);
+        ASSERT_EQ(csr.degree(id), it->second.edges().size());
+        for (auto edge_it = csr.neighbors_begin(id); edge_it != csr.neighbors_end(id); ++edge_it) {
+            ASSERT_TRUE(data0.has_edge(it->first, csr.key(*edge_it)));
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// compact()
+// -----------------------------------------------------------------------------
+
+TEST(LWWGraph, compactTest) {
+    LWWGraph<std::string, int, int> data0;
+    data0.add_edge("v1", "v2", 10);
+    data0.add_edge("v2", "v3", 11);
+    data0.add_edge("v3", "v1", 12);
+    data0.remove_vertex("v1", 13);
+    data0.remove_edge("v2", "v3", 14);
+    ASSERT_EQ(data0.crdt_size_vertex(), 3);
+    ASSERT_EQ(data0.crdt_size_edges(), 3);
+
+    // v1 and all removed edges purged
+    ASSERT_EQ(data0.compact(20), 4);
+    ASSERT_EQ(data0.crdt_size_vertex(), 2);
+    ASSERT_EQ(data0.crdt_size_edges(), 0);
+    ASSERT_EQ(data0.size_vertex(), 2);
+    ASSERT_TRUE(data0.has_vertex("v2"));
+    ASSERT_TRUE(data0.has_vertex("v3"));
+    ASSERT_EQ(data0.crdt_in_degree("v2"), 0);  // Purged edges are not indexed anymore
+    ASSERT_EQ(data0.crdt_in_degree("v3"), 0);
+
+    // Late duplicate add_edge doesn't bring back the edge or vertex
+    auto info = data0.add_edge("v1", "v2", 10);
+    _ASSERT_ADD_EDGE_INFO_EQ(info, false, false, false);
+    ASSERT_FALSE(data0.has_vertex("v1"));
+    info = data0.add_edge("v2", "v3", 11);
+    _ASSERT_ADD_EDGE_INFO_EQ(info, false, false, false);
+    ASSERT_FALSE(data0.has_edge("v2", "v3"));
+
+    // Newer ops are applied as usual
+    info = data0.add_edge("v1", "v2", 21);
+    _ASSERT_ADD_EDGE_INFO_EQ(info, true, true, false);
+    ASSERT_TRUE(data0.has_edge("v1", "v2"));
+}
+
+TEST(LWWGraph, compactTest_LateDuplicates) {
+    LWWGraph<int, int, int> data0;
+    data0.add_vertex(12, 5);
+    data0.add_edge(12, 13, 7);
+    data0.remove_vertex(12, 10);
+    data0.remove_vertex(13, 11);
+    ASSERT_EQ(data0.compact(20), 3);
+    ASSERT_TRUE(data0.crdt_empty());
+
+    // Duplicates received after compact do nothing: vertex don't come back
+    ASSERT_FALSE(data0.add_vertex(12, 5));
+    ASSERT_FALSE(data0.remove_vertex(12, 5));
+    ASSERT_FALSE(data0.add_vertex(12, 7));
+    auto info = data0.add_edge(12, 13, 7);
+    _ASSERT_ADD_EDGE_INFO_EQ(info, false, false, false);
+    ASSERT_FALSE(data0.remove_edge(12, 13, 8));
+    ASSERT_FALSE(data0.add_vertex(13, 9));
+    ASSERT_TRUE(data0.crdt_empty());
+    ASSERT_EQ(data0.crdt_size_edges(), 0);
+
+    // Same after a newer remove_edge created temporary vertex
+    ASSERT_FALSE(data0.remove_edge(12, 13, 25));
+    ASSERT_FALSE(data0.add_vertex(12, 7));
+    ASSERT_FALSE(data0.add_vertex(13, 9));
+    ASSERT_EQ(data0.size_vertex(), 0);
+
+    // Newer ops are applied as usual
+    ASSERT_TRUE(data0.add_vertex(12, 21));
+    ASSERT_EQ(data0.size_vertex(), 1);
+}
+
+TEST(LWWGraph, compactTest_KeepVertexWithNewerEdgeTombstone) {
+    LWWGraph<std::string, int, int> data0;
+    data0.add_vertex("v1", 10);
+    data0.remove_vertex("v1", 11);
+    data0.remove_edge("v1", "v2", 30);  // Newer than watermark
+
+    ASSERT_EQ(data0.compact(20), 1);  // Only temporary vertex v2
+    ASSERT_TRUE(data0.crdt_has_vertex("v1"));
+    ASSERT_TRUE(data0.crdt_has_edge("v1", "v2"));
+
+    // Concurrent add_edge older than the edge remove: still removed
+    data0.add_edge("v1", "v2", 25);
+    ASSERT_FALSE(data0.has_edge("v1", "v2"));
+}
+
+TEST(LWWGraph, compactTest_MergeNotCompacted) {
+    LWWGraph<std::string, int, int> data0;
+    LWWGraph<std::string, int, int> data1;
+    for (LWWGraph<std::string, int, int>* data : {&data0, &data1}) {
+        data->add_edge("v1", "v2", 5);
+        data->remove_vertex("v1", 10);
+        data->add_vertex("v3", 11);
+        data->remove_edge("v4", "v3", 30);  // Newer than watermark
+    }
+    data0.compact(20);
+    ASSERT_FALSE(data0.crdt_has_vertex("v1"));
+    ASSERT_TRUE(data0.crdt_has_edge("v4", "v3"));
+    const auto crdtSize = data0.crdt_size_vertex();
+
+    // Purged vertex of a not compacted replicate don't come back
+    data0.merge(data1);
+    ASSERT_EQ(data0.crdt_size_vertex(), crdtSize);
+    ASSERT_FALSE(data0.crdt_has_vertex("v1"));
+    ASSERT_TRUE(data0.crdt_has_edge("v4", "v3"));
+    ASSERT_TRUE(data0 == data1);
+}
+
+// -----------------------------------------------------------------------------
+// merge()
+// -----------------------------------------------------------------------------
+
+TEST(LWWGraph, mergeTest) {
+    LWWGraph<std::string, int, int> data0;
+    LWWGraph<std::string, int, int> data1;
+
+    data0.add_edge("v1", "v2", 10);
+    data0.add_edge("v2", "v3", 11);
+    data1.add_edge("v3", "v1", 12);
+    data1.remove_vertex("v2", 13);  // data1 never saw edges of v2
+
+    data0.merge(data1);
+    data1.merge(data0);
+    ASSERT_TRUE(data0 == data1);
+    ASSERT_EQ(data0.size_vertex(), 2);
+    ASSERT_FALSE(data0.has_vertex("v2"));
+    ASSERT_FALSE(data0.has_edge("v1", "v2"));
+    ASSERT_FALSE(data0.has_edge("v2", "v3"));
+    ASSERT_TRUE(data0.has_edge("v3", "v1"));
+
+    // Vertex added back: edges older than its remove are still removed
+    data0.add_vertex("v2", 14);
+    ASSERT_TRUE(data0.has_vertex("v2"));
+    ASSERT_FALSE(data0.has_edge("v1", "v2"));
+}
+
+TEST(LWWGraph, mergeTest_FromCompacted) {
+    LWWGraph<std::string, int, int> data0;
+    data0.add_edge("v1", "v2", 1);
+    data0.add_edge("v2", "v3", 2);
+    data0.remove_vertex("v3", 3);
+    ASSERT_EQ(data0.compact(10), 2);
+
+    // Alive vertices and edges older than the compact time are not lost
+    LWWGraph<std::string, int, int> data1;
+    data1.merge(data0);
+    ASSERT_TRUE(data1 == data0);
+    ASSERT_EQ(data1.size_vertex(), 2);
+    ASSERT_EQ(data1.size_edges(), 1);
+    ASSERT_TRUE(data1.has_edge("v1", "v2"));
+    ASSERT_EQ(data1.in_degree("v2"), 1);
+
+    LWWGraph<std::string, int, int> data2;
+    data2.merge(data0.delta_since(0));
+    ASSERT_TRUE(data2 == data0);
+
+    // Compact time is merged too
+    auto info = data1.add_edge("v2", "v3", 2);
+    _ASSERT_ADD_EDGE_INFO_EQ(info, false, false, false);
+    ASSERT_FALSE(data1.has_vertex("v3"));
+}
+
+TEST(LWWGraph, mergeTest_EdgesOlderThanClear) {
+    LWWGraph<int, int, int> data0;
+    LWWGraph<int, int, int> data1;
+    LWWGraph<int, int, int> all;
+    data0.clear_vertices(23);
+    data1.add_edge(3, 4, 15);
+    all.add_edge(3, 4, 15);
+    all.clear_vertices(23);
+
+    // Edge merged in after the clear is removed by it
+    data0.merge(data1);
+    ASSERT_TRUE(data0 == all);
+    ASSERT_EQ(data0.size_edges(), 0);
+    ASSERT_EQ(data0.crdt_size_edges(), 1);
+    ASSERT_EQ(data0.in_degree(4), 0);
+
+    data0.add_vertex(3, 30);
+    data0.add_vertex(4, 31);
+    all.add_vertex(3, 30);
+    all.add_vertex(4, 31);
+    ASSERT_FALSE(data0.has_edge(3, 4));
+    ASSERT_TRUE(data0 == all);
+
+    // Same with the operations received in another order
+    LWWGraph<int, int, int> data2;
+    data2.clear_vertices(23);
+    data2.add_vertex(3, 30);
+    data2.add_vertex(4, 31);
+    data2.add_edge(3, 4, 15);
+    ASSERT_FALSE(data2.has_edge(3, 4));
+    ASSERT_TRUE(data2 == all);
+}
+
+static void mergeTest_CheckAgainstAllOperations(unsigned int nbThreads) {
+    LWWGraph<int, int, int> replicas[3];
+    LWWGraph<int, int, int> all;
+    std::mt19937 rng(7);
+    for (int stamp = 1; stamp <= 5000; ++stamp) {
+        LWWGraph<int, int, int>& replica = replicas[rng() % 3];
+        const int from = static_cast<int>(rng() % 100);
+        const int to = static_cast<int>(rng() % 100);
+        const int op = static_cast<int>(rng() % 1000);
+        if (op < 2) {
+            replica.clear_vertices(stamp);
+            all.clear_vertices(stamp);
+        } else if (op < 100) {
+            replica.add_vertex(from, stamp);
+            all.add_vertex(from, stamp);
+        } else if (op < 200) {
+            replica.remove_vertex(from, stamp);
+            all.remove_vertex(from, stamp);
+        } else if (op < 700) {
+            replica.add_edge(from, to, stamp);
+            all.add_edge(from, to, stamp);
+        } else {
+            replica.remove_edge(from, to, stamp);
+            all.remove_edge(from, to, stamp);
+        }
+    }
+
+    LWWGraph<int, int, int> merged(replicas[0]);
+    if (nbThreads == 1) {
+        merged.merge(replicas[1]);
+        merged.merge(replicas[2]);
+    } else {
+        merged.merge_parallel(replicas[1], nbThreads);
+        merged.merge_parallel(replicas[2], nbThreads);
+    }
+    ASSERT_TRUE(merged == all);
+    ASSERT_EQ(merged.size_vertex(), all.size_vertex());
+    ASSERT_EQ(merged.size_edges(), all.size_edges());
+    sizeEdgesTest_CheckAgainstFullSum(merged);
+    inDegreeTest_CheckAgainstScan(merged, 99, true);
+
+    // Edges of removed vertex stay removed once the vertex are added back
+    for (int key = 0; key < 100; ++key) {
+        merged.add_vertex(key, 6000);
+        all.add_vertex(key, 6000);
+    }
+    ASSERT_TRUE(merged == all);
+    ASSERT_EQ(merged.size_edges(), all.size_edges());
+}
+
+TEST(LWWGraph, mergeTest_SameResultsAsAllOperations) { mergeTest_CheckAgainstAllOperations(1); }
+
+TEST(LWWGraph, mergeParallelTest_SameResultsAsAllOperations) { mergeTest_CheckAgainstAllOperations(4); }
+
+// -----------------------------------------------------------------------------
+// delta_since()
+// -----------------------------------------------------------------------------
+
+TEST(LWWGraph, deltaSinceTest) {
+    LWWGraph<std::string, int, int> data0;
+    data0.track_changes(true);
+    data0.add_edge("v1", "v2", 10);
+    data0.add_edge("v2", "v3", 11);
+    data0.add_edge("v3", "v4", 12);
+    LWWGraph<std::string, int, int> data1(data0);
+
+    data0.remove_vertex("v2", 20);
+    data0.add_edge("v4", "v5", 21);
+
+    auto delta = data0.delta_since(15);
+    ASSERT_EQ(delta.crdt_size_vertex(), 4);  // v1 (Edge to v2), v2, v4, v5
+    ASSERT_FALSE(delta.crdt_has_vertex("v3"));
+    ASSERT_EQ(delta.crdt_size_edges(), 3);  // 2 removed by remove_vertex
+    data1.merge(delta);
+    ASSERT_TRUE(data1 == data0);
+    ASSERT_FALSE(data1.has_edge("v1", "v2"));
+}
+
+TEST(LWWGraph, deltaSinceTest_SameVertexChangedManyTimes) {
+    LWWGraph<std::string, int, int> data0;
+    data0.track_changes(true);
+    data0.add_vertex("v1", 10);
+    data0.add_edge("v1", "v2", 30);
+    data0.remove_edge("v1", "v2", 20);  // Older than the last change of v1
+    data0.set_vertex("v1", 42, 25);
+
+    auto delta = data0.delta_since(30);
+    ASSERT_EQ(delta.crdt_size_vertex(), 2);
+    ASSERT_TRUE(delta.has_edge("v1", "v2"));
+    ASSERT_EQ(data0.delta_since(31).crdt_size_vertex(), 0);
+
+    // Index rebuilt from the current content
+    data0.track_changes(false);
+    data0.remove_vertex("v2", 40);
+    data0.track_changes(true);
+    delta = data0.delta_since(35);
+    ASSERT_EQ(delta.crdt_size_vertex(), 2);  // v1 (Edge to v2), v2
+    ASSERT_FALSE(delta.has_vertex("v2"));
+
+    data0.add_vertex("v2", 50);
+    delta = data0.delta_since(45);
+    ASSERT_EQ(delta.crdt_size_vertex(), 1);
+    ASSERT_TRUE(delta.has_vertex("v2"));
+}
+
+static void deltaSinceTest_CheckCatchUp(bool isTracking) {
+    LWWGraph<int, int, int> data0;
+    data0.track_changes(isTracking);
+    LWWGraph<int, int, int> data1;
+    std::mt19937 rng(7);
+    const int since = 9901;
+    for (int stamp = 1; stamp <= 10000; ++stamp) {
+        if (stamp == since) {
+            data1 = data0;
+        }
+        const int from = static_cast<int>(rng() % 1000);
+        const int to = static_cast<int>(rng() % 1000);
+        const int op = static_cast<int>(rng() % 1000);
+        if (op < 2 && stamp < since) {
+            data0.clear_vertices(stamp);
+        } else if (op < 100) {
+            data0.add_vertex(from, stamp);
+        } else if (op < 200) {
+            data0.remove_vertex(from, stamp);
+        } else if (op < 700) {
+            data0.add_edge(from, to, stamp);
+        } else {
+            data0.remove_edge(from, to, stamp);
+        }
+    }
+
+    const auto delta = data0.delta_since(since);
+    ASSERT_LT(delta.crdt_size_vertex(), data0.crdt_size_vertex());
+    data1.merge(delta);
+    ASSERT_TRUE(data1 == data0);
+    ASSERT_EQ(data1.size_edges(), data0.size_edges());
+}
+
+TEST(LWWGraph, deltaSinceTest_CatchUpLaggingReplicate) {
+    deltaSinceTest_CheckCatchUp(false);
+    deltaSinceTest_CheckCatchUp(true);
+}
+
 }  // namespace collabserver
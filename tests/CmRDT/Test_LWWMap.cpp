@@ -1,5 +1,15 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../TestUtils.h"
 #include "collabserver/datatypes/CmRDT/LWWMap.h"
 
 namespace collabserver {
@@ -11,6 +21,11 @@ namespace collabserver {
     EXPECT_EQ(elt_it_->second.isRemoved(), is_removed_);          \
     EXPECT_EQ(elt_it_->second.timestamp(), stamp_)
 
+// Tests run for each storage policy (TypeParam)
+template <typename Storage>
+class LWWMapStorageTest : public ::testing::Test {};
+TYPED_TEST_SUITE(LWWMapStorageTest, StoragePolicies);
+
 // -----------------------------------------------------------------------------
 // empty()
 // -----------------------------------------------------------------------------
@@ -333,6 +348,18 @@ TEST(LWWMap, atTest_InvalidKeyThrowException) {
     ASSERT_EQ(nbException, 5);
 }
 
+TEST(LWWMap, atTest_ConstMap) {
+    LWWMap<std::string, int, int> data0;
+    data0.set("v1", 42, 10);
+    data0.remove("v2", 11);
+    const LWWMap<std::string, int, int>& data1 = data0;
+
+    ASSERT_EQ(data1.at("v1"), 42);
+    ASSERT_THROW(data1.at("v2"), std::out_of_range);
+    ASSERT_EQ(data1.crdt_at("v2"), 0);
+    ASSERT_THROW(data1.crdt_at("v3"), std::out_of_range);
+}
+
 // -----------------------------------------------------------------------------
 // crdt_at()
 // -----------------------------------------------------------------------------
@@ -702,6 +729,65 @@ TEST(LWWMap, clearTest_ThenAddAfterOlderClear) {
     EXPECT_EQ(data0.crdt_size(), 3);
 }
 
+TEST(LWWMap, clearTest_LazyThenCrdtQuery) {
+    LWWMap<std::string, int, int> data0;
+    data0.add("e1", 11);
+    data0.crdt_at("e1") = 42;
+    data0.add("e2", 12);
+    ASSERT_TRUE(data0.clear(20));
+
+    EXPECT_EQ(data0.size(), 0);
+    EXPECT_EQ(data0.count("e1"), 0);
+    EXPECT_THROW(data0.at("e1"), std::out_of_range);
+    EXPECT_TRUE(data0.begin() == data0.end());
+
+    // Content is kept, only metadata are updated
+    auto it = data0.crdt_find("e1");
+    _ASSERT_ELT_EQ(it, "e1", true, 20, data0);
+    EXPECT_EQ(it->second.value(), 42);
+
+    ASSERT_TRUE(data0.add("e1", 21));
+    EXPECT_EQ(data0.at("e1"), 42);
+    EXPECT_EQ(data0.size(), 1);
+    for (const auto& elt : data0) {
+        EXPECT_EQ(elt.first, "e1");
+    }
+}
+
+TEST(LWWMap, clearTest_LazyThenConcurrentConstQueries) {
+    LWWMap<int, int, int, FlatHashStorage> data0;
+    for (int k = 0; k < 100; ++k) {
+        data0.set(k, -k, k + 1);
+    }
+    ASSERT_TRUE(data0.clear(200));
+    LWWMap<int, int, int, FlatHashStorage> settled(data0);
+    settled.compact(0);  // Any write settles the lazy clear
+
+    // Const queries never write: they may run concurrently
+    const auto& reader = data0;
+    std::atomic<int> nbErrors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (int k = 0; k < 100; ++k) {
+                const auto it = reader.crdt_find(k);
+                if (it == reader.crdt_end() || !it->second.isRemoved() || it->second.timestamp() != 200 ||
+                    it->second.value() != -k) {
+                    ++nbErrors;
+                }
+            }
+            if (!reader.crdt_equal(settled) || reader.delta_since(150).crdt_size() != 100) {
+                ++nbErrors;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(nbErrors, 0);
+    EXPECT_TRUE(reader.snapshot().crdt_equal(settled));
+}
+
 // -----------------------------------------------------------------------------
 // add()
 // -----------------------------------------------------------------------------
@@ -938,6 +1024,195 @@ TEST(LWWMap, removeTest_IdempotentReturnType) {
     _ASSERT_ELT_EQ(coco, "e1", true, 20, data0);
 }
 
+// -----------------------------------------------------------------------------
+// add() / remove() with moved keys
+// -----------------------------------------------------------------------------
+
+TYPED_TEST(LWWMapStorageTest, addRemoveTest_NoAllocationOnExistingKey) {
+    typedef LWWMap<std::string, std::string, int, TypeParam> Map;
+    // Key and value too long for the small string optimization
+    const std::string key = "a key long enough to be allocated on the heap";
+    std::string movedKey = key;
+    Map data0;
+    data0.add(key, 10);
+    data0.at(key).assign(64, 'x');
+
+    const long nbAllocations = test_nbAllocations;
+    ASSERT_FALSE(data0.add(key, 20));
+    ASSERT_FALSE(data0.add(key, 5));
+    ASSERT_TRUE(data0.remove(key, 30));
+    ASSERT_FALSE(data0.remove(key, 25));
+    ASSERT_TRUE(data0.add(std::move(movedKey), 40));
+    ASSERT_FALSE(data0.remove(std::move(movedKey), 35));
+    EXPECT_EQ(test_nbAllocations - nbAllocations, 0);
+
+    // Key not consumed since already there
+    EXPECT_EQ(movedKey, key);
+    auto coco = data0.crdt_find(key);
+    _ASSERT_ELT_EQ(coco, key, false, 40, data0);
+    EXPECT_EQ(coco->second.value(), std::string(64, 'x'));
+}
+
+TYPED_TEST(LWWMapStorageTest, addRemoveTest_MovedKey) {
+    typedef LWWMap<std::string, std::string, int, TypeParam> Map;
+    const std::string key0 = "carrot is the best vegetable ever created";
+    const std::string key1 = "coconut is not a vegetable, but still great";
+    std::string movedKey0 = key0;
+    std::string movedKey1 = key1;
+    Map data0;
+
+    ASSERT_TRUE(data0.add(std::move(movedKey0), 10));
+    ASSERT_FALSE(data0.remove(std::move(movedKey1), 20));
+    EXPECT_NE(movedKey0, key0);
+    EXPECT_NE(movedKey1, key1);
+
+    auto coco = data0.crdt_find(key0);
+    _ASSERT_ELT_EQ(coco, key0, false, 10, data0);
+    EXPECT_EQ(coco->second.key(), key0);
+    coco = data0.crdt_find(key1);
+    _ASSERT_ELT_EQ(coco, key1, true, 20, data0);
+    EXPECT_EQ(coco->second.key(), key1);
+    EXPECT_EQ(data0.size(), 1);
+    EXPECT_EQ(data0.crdt_size(), 2);
+}
+
+// -----------------------------------------------------------------------------
+// set()
+// -----------------------------------------------------------------------------
+
+TEST(LWWMap, setTest) {
+    LWWMap<std::string, int, int> data0;
+
+    // New key is set
+    ASSERT_TRUE(data0.set("coco", 42, 10));
+    auto coco = data0.crdt_find("coco");
+    _ASSERT_ELT_EQ(coco, "coco", false, 10, data0);
+    EXPECT_EQ(data0.at("coco"), 42);
+
+    // Only newer value replaces current one
+    ASSERT_FALSE(data0.set("coco", 1, 5));
+    EXPECT_EQ(data0.at("coco"), 42);
+    ASSERT_TRUE(data0.set("coco", 64, 20));
+    EXPECT_EQ(data0.at("coco"), 64);
+    ASSERT_FALSE(data0.set("coco", 2, 20));
+    EXPECT_EQ(data0.at("coco"), 64);
+    coco = data0.crdt_find("coco");
+    _ASSERT_ELT_EQ(coco, "coco", false, 20, data0);
+
+    // Same as add for the key, but add doesn't hide an older set
+    data0.add("coco", 30);
+    ASSERT_TRUE(data0.set("coco", 3, 25));
+    EXPECT_EQ(data0.at("coco"), 3);
+    coco = data0.crdt_find("coco");
+    _ASSERT_ELT_EQ(coco, "coco", false, 30, data0);
+    EXPECT_EQ(coco->second.valueTimestamp(), 25);
+    EXPECT_EQ(data0.size(), 1);
+}
+
+TEST(LWWMap, setTest_WithRemove) {
+    LWWMap<std::string, int, int> data0;
+
+    // Remove wins for the key, the value is still set
+    data0.remove("coco", 20);
+    ASSERT_TRUE(data0.set("coco", 42, 10));
+    auto coco = data0.crdt_find("coco");
+    _ASSERT_ELT_EQ(coco, "coco", true, 20, data0);
+    EXPECT_EQ(data0.crdt_at("coco"), 42);
+
+    // Set wins
+    ASSERT_TRUE(data0.set("coco", 64, 30));
+    coco = data0.crdt_find("coco");
+    _ASSERT_ELT_EQ(coco, "coco", false, 30, data0);
+    EXPECT_EQ(data0.at("coco"), 64);
+    ASSERT_TRUE(data0.remove("coco", 40));
+    EXPECT_EQ(data0.crdt_at("coco"), 64);
+}
+
+TEST(LWWMap, setTest_WithClear) {
+    LWWMap<std::string, int, int> data0;
+
+    // Keys older than the clear stay removed, their values are still set
+    data0.set("coco", 1, 10);
+    data0.clear(20);
+    ASSERT_TRUE(data0.set("coco", 2, 15));
+    ASSERT_TRUE(data0.set("carrot", 3, 15));
+    EXPECT_EQ(data0.crdt_at("coco"), 2);
+    EXPECT_EQ(data0.crdt_at("carrot"), 3);
+    EXPECT_EQ(data0.size(), 0);
+    auto carrot = data0.crdt_find("carrot");
+    _ASSERT_ELT_EQ(carrot, "carrot", true, 20, data0);
+
+    ASSERT_TRUE(data0.set("carrot", 4, 25));
+    EXPECT_EQ(data0.at("carrot"), 4);
+    EXPECT_EQ(data0.size(), 1);
+}
+
+TEST(LWWMap, setTest_Commutative) {
+    LWWMap<std::string, int, int> data0;
+    LWWMap<std::string, int, int> data1;
+
+    data0.set("coco", 1, 10);
+    data0.set("coco", 2, 30);
+    data0.remove("coco", 20);
+
+    data1.remove("coco", 20);
+    data1.set("coco", 2, 30);
+    data1.set("coco", 1, 10);
+
+    EXPECT_EQ(data0.at("coco"), 2);
+    EXPECT_TRUE(data0 == data1);
+    EXPECT_TRUE(data0.crdt_equal(data1));
+}
+
+TEST(LWWMap, setTest_CommutativeWithAddRemove) {
+    typedef LWWMap<int, int, int> Map;
+    const std::vector<std::function<void(Map&)>> ops = {
+        [](Map& data) { data.set(1, 7, 10); },
+        [](Map& data) { data.add(1, 20); },
+        [](Map& data) { data.set(1, 8, 5); },
+        [](Map& data) { data.remove(1, 15); },
+    };
+    std::mt19937 rng(7);
+    test_checkAnyOrder<Map>(
+        ops, 50, rng, [](Map& data, const std::function<void(Map&)>& op) { op(data); },
+        [](const Map& expected, const Map& data) {
+            EXPECT_EQ(data.at(1), 7);
+            EXPECT_TRUE(data.crdt_equal(expected));
+        });
+}
+
+TYPED_TEST(LWWMapStorageTest, setTest_MoveOnlyIfAssigned) {
+    typedef LWWMap<std::string, std::string, int, TypeParam> Map;
+    const std::string key = "a key long enough to be allocated on the heap";
+    const std::string value0 = "a value long enough to be allocated on the heap";
+    const std::string value1 = "another value, also allocated on the heap";
+    Map data0;
+
+    // Moved into the new element
+    std::string movedKey = key;
+    std::string movedValue = value0;
+    ASSERT_TRUE(data0.set(std::move(movedKey), std::move(movedValue), 10));
+    EXPECT_NE(movedValue, value0);
+    EXPECT_EQ(data0.at(key), value0);
+
+    // Lost: nothing consumed, no allocation
+    movedKey = key;
+    movedValue = value1;
+    long nbAllocations = test_nbAllocations;
+    ASSERT_FALSE(data0.set(std::move(movedKey), std::move(movedValue), 5));
+    EXPECT_EQ(test_nbAllocations - nbAllocations, 0);
+    EXPECT_EQ(movedKey, key);
+    EXPECT_EQ(movedValue, value1);
+    EXPECT_EQ(data0.at(key), value0);
+
+    // Wins: value moved in, no allocation
+    nbAllocations = test_nbAllocations;
+    ASSERT_TRUE(data0.set(key, std::move(movedValue), 20));
+    EXPECT_EQ(test_nbAllocations - nbAllocations, 0);
+    EXPECT_EQ(data0.at(key), value1);
+    EXPECT_EQ(data0.size(), 1);
+}
+
 // -----------------------------------------------------------------------------
 // add() + remove()
 // -----------------------------------------------------------------------------
@@ -1192,6 +1467,391 @@ TEST(LWWMap, crdtEqualTest_EmptyVsAdd) {
     ASSERT_TRUE(data1.crdt_equal(data0));
 }
 
+// -----------------------------------------------------------------------------
+// compact()
+// -----------------------------------------------------------------------------
+
+TEST(LWWMap, compactTest) {
+    LWWMap<std::string, int, int, FlatHashStorage> data0;
+    for (int k = 0; k < 1000; ++k) {
+        data0.add(std::to_string(k), 10);
+        data0.crdt_at(std::to_string(k)) = k;
+    }
+    for (int k = 0; k < 1000; ++k) {
+        if (k % 10 != 0) {
+            data0.remove(std::to_string(k), 20);
+        }
+    }
+    ASSERT_EQ(data0.compact(30), 900);
+    ASSERT_EQ(data0.crdt_size(), 100);
+    ASSERT_EQ(data0.size(), 100);
+    ASSERT_EQ(data0.at("990"), 990);
+
+    // Duplicate add after compact doesn't bring back the key
+    ASSERT_FALSE(data0.add("1", 10));
+    ASSERT_EQ(data0.count("1"), 0);
+    ASSERT_TRUE(data0.add("1", 31));
+    ASSERT_EQ(data0.count("1"), 1);
+}
+
+TEST(LWWMap, compactTest_WithPredicate) {
+    LWWMap<std::string, int, int> data0;
+    data0.remove("v1", 10);
+    data0.remove("v2", 11);
+    data0.crdt_at("v2") = 42;
+    ASSERT_EQ(data0.compact(20, [](const int& v) { return v != 42; }), 1);
+    ASSERT_EQ(data0.crdt_count("v1"), 0);
+    ASSERT_EQ(data0.crdt_count("v2"), 1);
+}
+
+TYPED_TEST(LWWMapStorageTest, compactTest_LateDuplicates) {
+    LWWMap<int, int, int, TypeParam> data0;
+    data0.set(12, 42, 5);
+    data0.add(12, 7);
+    data0.remove(12, 10);
+    ASSERT_EQ(data0.compact(20), 1);
+
+    // Duplicates received after compact do nothing: key doesn't come back
+    ASSERT_FALSE(data0.add(12, 5));
+    ASSERT_FALSE(data0.set(12, 42, 5));
+    ASSERT_FALSE(data0.remove(12, 5));
+    ASSERT_FALSE(data0.add(12, 7));
+    ASSERT_EQ(data0.count(12), 0);
+    ASSERT_EQ(data0.crdt_count(12), 0);
+
+    // Newer ops are applied as usual
+    ASSERT_TRUE(data0.add(12, 21));
+    ASSERT_EQ(data0.count(12), 1);
+}
+
+TYPED_TEST(LWWMapStorageTest, compactTest_MergeNotCompacted) {
+    LWWMap<int, int, int, TypeParam> data0;
+    LWWMap<int, int, int, TypeParam> data1;
+    for (LWWMap<int, int, int, TypeParam>* data : {&data0, &data1}) {
+        data->set(12, 42, 5);
+        data->remove(12, 10);
+        data->set(13, 43, 6);
+        data->remove(14, 7);
+        data->add(15, 25);
+    }
+    ASSERT_EQ(data0.compact(20), 2);
+    ASSERT_EQ(data0.crdt_size(), 2);
+
+    // Purged tombstones of a not compacted replicate don't come back
+    data0.merge(data1);
+    ASSERT_EQ(data0.crdt_size(), 2);
+    data0.merge_parallel(data1, 2u);
+    ASSERT_EQ(data0.crdt_size(), 2);
+    ASSERT_TRUE(data0 == data1);
+    ASSERT_EQ(data0.at(13), 43);
+}
+
+// -----------------------------------------------------------------------------
+// snapshot()
+// -----------------------------------------------------------------------------
+
+TYPED_TEST(LWWMapStorageTest, snapshotTest) {
+    typedef LWWMap<int, int, int, TypeParam> Map;
+    Map data0;
+    for (int k = 0; k < 1000; ++k) {
+        data0.set(k, k, k + 1);
+    }
+    data0.remove(10, 2000);
+    const Map data1 = data0.snapshot();
+
+    // Later updates are not seen by the snapshot
+    data0.set(1, -1, 3000);
+    data0.remove(2, 3001);
+    data0.set(5000, 0, 3002);
+    data0.add(10, 3003);
+    data0.compact(2000);
+    ASSERT_EQ(data1.size(), 999);
+    ASSERT_EQ(data1.crdt_size(), 1000);
+    ASSERT_EQ(data1.at(1), 1);
+    ASSERT_EQ(data1.count(2), 1);
+    ASSERT_EQ(data1.count(5000), 0);
+    ASSERT_EQ(data1.count(10), 0);
+    ASSERT_EQ(data0.at(1), -1);
+    ASSERT_EQ(data0.size(), 1000);
+
+    // And snapshot has the exact same state as the map had
+    Map data2;
+    for (int k = 0; k < 1000; ++k) {
+        data2.set(k, k, k + 1);
+    }
+    data2.remove(10, 2000);
+    ASSERT_TRUE(data1.crdt_equal(data2));
+}
+
+TEST(LWWMap, snapshotTest_AfterLazyClear) {
+    LWWMap<int, int, int, PersistentStorage> data0;
+    for (int k = 0; k < 100; ++k) {
+        data0.set(k, k, k + 1);
+    }
+    data0.clear(50);
+    const auto data1 = data0.snapshot();
+    data0.set(1, 1, 200);
+
+    ASSERT_EQ(data1.size(), 51);
+    ASSERT_EQ(data1.count(1), 0);
+    ASSERT_TRUE(data1.crdt_find(1)->second.isRemoved());
+    ASSERT_EQ(data1.crdt_find(1)->second.timestamp(), 50);
+}
+
+// The snapshot is iterated from another thread while the map is updated
+TEST(LWWMap, snapshotTest_ReadFromOtherThread) {
+    LWWMap<int, int, int, PersistentStorage> data0;
+    for (int k = 0; k < 2000; ++k) {
+        data0.set(k, k, 1);
+    }
+    const auto data1 = data0.snapshot();
+    long sum = 0;
+    std::thread reader([&]() {
+        for (int loop = 0; loop < 10; ++loop) {
+            for (const auto& elt : data1) {
+                sum += elt.second;
+            }
+        }
+    });
+    for (int k = 0; k < 2000; ++k) {
+        data0.set(k, -k, 2);
+        data0.remove(k + 1, 3);
+        data0.add(k + 5000, 4);
+    }
+    reader.join();
+    ASSERT_EQ(sum, 10L * (1999L * 2000L / 2));
+    ASSERT_EQ(data1.size(), 2000);
+}
+
+// -----------------------------------------------------------------------------
+// merge()
+// -----------------------------------------------------------------------------
+
+TEST(LWWMap, mergeTest) {
+    LWWMap<std::string, std::string, int> data0;
+    LWWMap<std::string, std::string, int> data1;
+
+    data0.add("v1", 10);
+    data0.at("v1") = "data0";
+    data0.add("v2", 11);
+    data0.at("v2") = "data0";
+    data1.add("v1", 20);
+    data1.at("v1") = "data1";
+    data1.remove("v2", 5);
+    data1.remove("v3", 21);
+
+    LWWMap<std::string, std::string, int> merged0(data0);
+    LWWMap<std::string, std::string, int> merged1(data1);
+    merged0.merge(data1);
+    merged1.merge(data0);
+    ASSERT_TRUE(merged0 == merged1);
+    ASSERT_EQ(merged0.size(), 2);
+    ASSERT_EQ(merged0.at("v1"), "data1");
+    ASSERT_EQ(merged0.at("v2"), "data0");
+    ASSERT_EQ(merged0.count("v3"), 0);
+    ASSERT_EQ(merged0.crdt_count("v3"), 1);
+
+    // Idempotent
+    merged0.merge(data1);
+    ASSERT_TRUE(merged0.crdt_equal(merged1));
+}
+
+TEST(LWWMap, mergeTest_FromCompacted) {
+    LWWMap<std::string, std::string, int> data0;
+    data0.add("v1", 1);
+    data0.at("v1") = "data0";
+    data0.add("v2", 2);
+    data0.remove("v2", 3);
+    ASSERT_EQ(data0.compact(10), 1);
+
+    // Alive keys older than the compact time are not lost
+    LWWMap<std::string, std::string, int> data1;
+    data1.merge(data0);
+    ASSERT_EQ(data1.size(), 1);
+    ASSERT_EQ(data1.at("v1"), "data0");
+    ASSERT_TRUE(data1.crdt_equal(data0));
+
+    LWWMap<std::string, std::string, int> data2;
+    data2.merge(data0.delta_since(0));
+    ASSERT_EQ(data2.count("v1"), 1);
+
+    // Compact time is merged too
+    ASSERT_FALSE(data1.add("v2", 2));
+    ASSERT_EQ(data1.count("v2"), 0);
+}
+
+TEST(LWWMap, mergeTest_WithMergeValue) {
+    LWWMap<std::string, int, int> data0;
+    LWWMap<std::string, int, int> data1;
+
+    data0.add("v1", 10);
+    data0.at("v1") = 1;
+    data1.add("v1", 5);
+    data1.at("v1") = 2;
+    data1.add("v2", 5);
+    data1.at("v2") = 3;
+
+    // Values are summed, whatever the timestamp
+    data0.merge(data1, [](int& value, const int& otherValue, bool) { value += otherValue; });
+    ASSERT_EQ(data0.at("v1"), 3);
+    ASSERT_EQ(data0.at("v2"), 3);
+    ASSERT_EQ(data0.crdt_find("v1")->second.timestamp(), 10);
+}
+
+TYPED_TEST(LWWMapStorageTest, mergeTest_SameResultsAsAllOperations) {
+    typedef LWWMap<int, int, int, TypeParam> Map;
+    std::mt19937 rng(7);
+    Map replicas[3];
+    Map all;
+    for (const TestOp& op : test_randomOps(30000, 3000, 1, 0, rng)) {
+        Map& replica = replicas[rng() % 3];
+        test_apply(replica, op);
+        test_apply(all, op);
+        if (op.kind == TestOp::ADD) {
+            replica.crdt_at(op.key) = op.stamp;
+            all.crdt_at(op.key) = op.stamp;
+        }
+    }
+
+    // Sequential and parallel merge
+    for (const unsigned int nbThreads : {1u, 4u}) {
+        Map merged(replicas[0]);
+        merged.merge_parallel(replicas[1], nbThreads);
+        merged.merge_parallel(replicas[2], nbThreads);
+        ASSERT_TRUE(merged == all);
+        ASSERT_EQ(merged.size(), all.size());
+        ASSERT_EQ(merged.crdt_size(), all.crdt_size());
+    }
+
+    // Other merge order (Removed values may differ, only check content)
+    Map merged(replicas[2]);
+    merged.merge(replicas[0]);
+    merged.merge(replicas[1]);
+    ASSERT_TRUE(merged == all);
+}
+
+// -----------------------------------------------------------------------------
+// delta_since()
+// -----------------------------------------------------------------------------
+
+TEST(LWWMap, deltaSinceTest) {
+    LWWMap<std::string, std::string, int> data0;
+    data0.track_changes(true);
+    data0.add("v1", 10);
+    data0.at("v1") = "old";
+    LWWMap<std::string, std::string, int> data1(data0);
+
+    data0.add("v2", 20);
+    data0.at("v2") = "new";
+    data0.remove("v1", 30);
+
+    auto delta = data0.delta_since(15);
+    ASSERT_EQ(delta.crdt_size(), 2);
+    ASSERT_EQ(delta.size(), 1);
+    ASSERT_EQ(delta.at("v2"), "new");
+    data1.merge(delta);
+    ASSERT_TRUE(data1 == data0);
+    ASSERT_EQ(data1.count("v1"), 0);
+}
+
+TYPED_TEST(LWWMapStorageTest, deltaSinceTest_CatchUpLaggingReplicate) {
+    typedef LWWMap<int, int, int, TypeParam> Map;
+    const int since = 15001;
+    for (const bool isTracking : {false, true}) {
+        std::mt19937 rng(7);
+        Map data0;
+        data0.track_changes(isTracking);
+        Map data1;
+        for (const TestOp& op : test_randomOps(20000, 3000, 1, 0, rng)) {
+            if (op.stamp == since) {
+                data1 = data0;  // Lagging replicate received all ops before since
+            }
+            if (op.kind == TestOp::ADD) {
+                data0.set(op.key, op.stamp, op.stamp);
+            } else if (op.kind != TestOp::CLEAR || op.stamp < since) {
+                test_apply(data0, op);
+            }
+        }
+
+        const Map delta = data0.delta_since(since);
+        ASSERT_LT(delta.crdt_size(), data0.crdt_size());
+        data1.merge(delta);
+        ASSERT_TRUE(data1 == data0);
+        ASSERT_TRUE(data1.crdt_equal(data0));
+    }
+}
+
+// Keys updated by a lazy clear are moved in the change index: same deltas as
+// without the index
+TEST(LWWMap, deltaSinceTest_TrackedKeysUpdatedByClear) {
+    LWWMap<int, int, int> tracked;
+    tracked.track_changes(true);
+    LWWMap<int, int, int> untracked;
+    LWWMap<int, int, int> other;
+    other.add(6, 120);
+    for (LWWMap<int, int, int>* data : {&tracked, &untracked}) {
+        for (int k = 0; k < 20; ++k) {
+            data->add(k, k + 1);
+        }
+        ASSERT_TRUE(data->clear(100));
+        data->add(3, 50);  // Older than clear: only updates the key to the clear
+        data->remove(4, 60);
+        data->add(5, 150);
+        data->merge(other);
+    }
+
+    // Updates all keys older than the clear (Nothing purged)
+    tracked.compact(0);
+    untracked.compact(0);
+    EXPECT_EQ(tracked.delta_since(50).crdt_size(), 20);
+    const int sinceList[] = {0, 10, 50, 100, 101, 120, 150, 200};
+    for (const int since : sinceList) {
+        EXPECT_TRUE(tracked.delta_since(since).crdt_equal(untracked.delta_since(since))) << since;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// apply_batch()
+// -----------------------------------------------------------------------------
+
+TEST(LWWMap, applyBatchTest) {
+    typedef LWWMap<std::string, int, int>::batch_operation Op;
+    LWWMap<std::string, int, int> data0;
+    data0.add("v1", 5);
+    data0.at("v1") = 42;
+
+    const std::vector<Op> ops = {
+        {Op::ADD, "v2", 10}, {Op::ADD, "v1", 11}, {Op::REMOVE, "v2", 12}, {Op::ADD, "v2", 8}, {Op::REMOVE, "v3", 13},
+    };
+    const std::vector<bool> results = data0.apply_batch(ops.begin(), ops.end());
+    const std::vector<bool> expected = {true, false, true, false, false};
+    ASSERT_EQ(results, expected);
+    ASSERT_EQ(data0.size(), 1);
+    ASSERT_EQ(data0.at("v1"), 42);
+    ASSERT_EQ(data0.crdt_find("v1")->second.timestamp(), 11);
+    ASSERT_EQ(data0.crdt_size(), 3);
+}
+
+TYPED_TEST(LWWMapStorageTest, applyBatchTest_SameResultsAsSequential) {
+    LWWMap<int, int, int, TypeParam> data0;
+    LWWMap<int, int, int, TypeParam> data1;
+    std::mt19937 rng(42);
+    const std::vector<TestOp> ops = test_randomOps(20000, 200, 2, 20000, rng);
+    std::size_t batchSize = 1;
+    for (std::size_t begin = 0; begin < ops.size(); begin += batchSize) {
+        // Batches of several sizes
+        batchSize = std::min<std::size_t>(1 + rng() % 500, ops.size() - begin);
+        std::vector<bool> expected;
+        for (std::size_t k = begin; k < begin + batchSize; ++k) {
+            expected.push_back(test_apply(data0, ops[k]));
+        }
+        ASSERT_EQ(data1.apply_batch(ops.begin() + begin, ops.begin() + begin + batchSize), expected);
+        ASSERT_EQ(data1.size(), data0.size());
+    }
+    ASSERT_TRUE(data1 == data0);
+    ASSERT_TRUE(data1.crdt_equal(data0));
+}
+
 // -----------------------------------------------------------------------------
 // Operator==
 // -----------------------------------------------------------------------------
@@ -1650,6 +2310,31 @@ TEST(LWWMap, crdtIteratorTest_Reference) {
     ASSERT_EQ(it->first, "e1");
 }
 
+TEST(LWWMap, crdtIteratorTest_Forward) {
+    LWWMap<std::string, int, int> data0;
+    data0.set("e1", 42, 10);
+    data0.remove("e2", 20);
+    const LWWMap<std::string, int, int>& cdata0 = data0;  // Const crdt iterators
+
+    // Entry references stay valid as long as the iterator
+    auto it = cdata0.crdt_begin();
+    const auto& elt = it->second;
+    const std::string& key = (*it).first;
+    auto first = it++;
+    EXPECT_EQ(first->first, key);
+    EXPECT_EQ(elt.key(), key);
+    EXPECT_EQ(elt.isRemoved(), key == "e2");
+    EXPECT_EQ(std::distance(first, cdata0.crdt_end()), 2);
+    EXPECT_TRUE(++it == cdata0.crdt_end());
+
+    // Multipass algorithms
+    typedef LWWMap<std::string, int, int>::const_crdt_iterator::reference entry_ref;
+    const auto set_it = std::max_element(cdata0.crdt_begin(), cdata0.crdt_end(), [](entry_ref lhs, entry_ref rhs) {
+        return lhs.second.value() < rhs.second.value();
+    });
+    EXPECT_EQ(set_it->first, "e1");
+}
+
 TEST(LWWMap, crdtIteratorTest_end) {
     LWWMap<std::string, int, int> data0;
 
@@ -1669,4 +2354,124 @@ TEST(LWWMap, crdtIteratorTest_end) {
     EXPECT_EQ(k, 0);
 }
 
+// -----------------------------------------------------------------------------
+// Storage policy (FlatHashStorage)
+// -----------------------------------------------------------------------------
+
+TEST(LWWMap, flatStorageTest_AddRemove) {
+    LWWMap<std::string, std::string, int, FlatHashStorage> data0;
+
+    ASSERT_TRUE(data0.add("v1", 10));
+    ASSERT_TRUE(data0.add("v2", 11));
+    ASSERT_FALSE(data0.add("v1", 12));
+    ASSERT_TRUE(data0.remove("v1", 13));
+    ASSERT_FALSE(data0.remove("v3", 14));
+    ASSERT_EQ(data0.size(), 1);
+    ASSERT_EQ(data0.crdt_size(), 3);
+
+    auto it = data0.crdt_find("v1");
+    _ASSERT_ELT_EQ(it, "v1", true, 13, data0);
+    it = data0.crdt_find("v3");
+    _ASSERT_ELT_EQ(it, "v3", true, 14, data0);
+
+    data0.at("v2") = "content";
+    ASSERT_EQ(data0.crdt_at("v2"), "content");
+    ASSERT_EQ(data0.crdt_find("v2")->second.value(), "content");
+    ASSERT_EQ(data0.crdt_find("v2")->second.key(), "v2");
+
+    ASSERT_TRUE(data0.clear(20));
+    ASSERT_TRUE(data0.empty());
+    ASSERT_FALSE(data0.add("v4", 15));
+    ASSERT_TRUE(data0.add("v4", 21));
+    ASSERT_EQ(data0.size(), 1);
+}
+
+TEST(LWWMap, flatStorageTest_IteratorReference) {
+    LWWMap<std::string, int, int, FlatHashStorage> data0;
+    data0.add("v1", 10);
+    data0.add("v2", 11);
+    data0.remove("v2", 12);
+
+    // Iterator gives std::pair<const Key, T>& as for the default storage
+    int nbVisited = 0;
+    for (auto& elt : data0) {
+        LWWMap<std::string, int, int, FlatHashStorage>::reference ref = elt;
+        ASSERT_EQ(ref.first, "v1");
+        ref.second = 42;
+        ++nbVisited;
+    }
+    ASSERT_EQ(nbVisited, 1);
+    ASSERT_EQ(data0.find("v1")->second, 42);
+
+    // Key is stored once: the key seen by crdt_iterator is the one in value
+    auto it = data0.crdt_find("v1");
+    ASSERT_EQ(&(it->first), &(data0.find("v1")->first));
+}
+
+TEST(LWWMap, flatStorageTest_SameResultsAsDefaultStorage) {
+    LWWMap<int, int, int> data0;
+    LWWMap<int, int, int, FlatHashStorage> data1;
+
+    // Pseudo random op stream (Deterministic)
+    unsigned int seed = 42;
+    for (int stamp = 1; stamp < 20000; ++stamp) {
+        seed = seed * 1103515245 + 12345;
+        const int key = (seed >> 8) % 3000;
+        if ((seed >> 4) % 3 == 0) {
+            ASSERT_EQ(data0.remove(key, stamp), data1.remove(key, stamp));
+        } else {
+            ASSERT_EQ(data0.add(key, stamp), data1.add(key, stamp));
+            data0.crdt_at(key) = stamp;
+            data1.crdt_at(key) = stamp;
+        }
+    }
+    ASSERT_EQ(data0.size(), data1.size());
+    ASSERT_EQ(data0.crdt_size(), data1.crdt_size());
+    for (auto it = data0.crdt_begin(); it != data0.crdt_end(); ++it) {
+        auto other_it = data1.crdt_find(it->first);
+        _ASSERT_ELT_EQ(other_it, it->first, it->second.isRemoved(), it->second.timestamp(), data1);
+        ASSERT_EQ(other_it->second.value(), it->second.value());
+    }
+
+    LWWMap<int, int, int, FlatHashStorage> data2(data1);
+    ASSERT_TRUE(data2.crdt_equal(data1));
+    ASSERT_TRUE(data2 == data1);
+}
+
+TEST(LWWMap, flatStorageTest_IteratorManyTombstones) {
+    LWWMap<int, int, int, FlatHashStorage> data0;
+
+    for (int k = 0; k < 5000; ++k) {
+        data0.add(k, 10);
+        data0.crdt_at(k) = k;
+    }
+    for (int k = 0; k < 5000; ++k) {
+        if (k % 1000 != 0) {
+            data0.remove(k, 20);
+        }
+    }
+
+    // Update through iterator
+    int nbVisited = 0;
+    for (auto& elt : data0) {
+        ASSERT_EQ(elt.first % 1000, 0);
+        elt.second = -elt.first;
+        ++nbVisited;
+    }
+    ASSERT_EQ(nbVisited, 5);
+
+    const auto& data1 = data0;
+    nbVisited = 0;
+    for (auto it = data1.cbegin(); it != data1.cend(); ++it) {
+        ASSERT_EQ(it->second, -it->first);
+        ++nbVisited;
+    }
+    ASSERT_EQ(nbVisited, 5);
+    ASSERT_EQ(data1.count(3000), 1);
+    ASSERT_EQ(data1.count(3001), 0);
+
+    data0.clear(30);
+    ASSERT_TRUE(data0.begin() == data0.end());
+}
+
 }  // namespace collabserver
@@ -1,5 +1,16 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../TestUtils.h"
 #include "collabserver/datatypes/CmRDT/LWWSet.h"
 
 namespace collabserver {
@@ -11,6 +22,11 @@ namespace collabserver {
     EXPECT_EQ(elt_it_->second.isRemoved(), is_removed_);          \
     EXPECT_EQ(elt_it_->second.timestamp(), stamp_)
 
+// Tests run for each storage policy (TypeParam)
+template <typename Storage>
+class LWWSetStorageTest : public ::testing::Test {};
+TYPED_TEST_SUITE(LWWSetStorageTest, StoragePolicies);
+
 // -----------------------------------------------------------------------------
 // empty()
 // -----------------------------------------------------------------------------
@@ -501,6 +517,133 @@ TEST(LWWSet, clearTest_ThenAddAfterOlderClear) {
     EXPECT_EQ(data0.crdt_size(), 3);
 }
 
+TEST(LWWSet, clearTest_LazyThenCrdtQuery) {
+    LWWSet<std::string, int, FlatHashStorage> data0;
+    data0.add("e1", 11);
+    data0.add("e2", 12);
+    data0.remove("e3", 13);
+    ASSERT_TRUE(data0.clear(20));
+
+    EXPECT_EQ(data0.size(), 0);
+    EXPECT_EQ(data0.count("e1"), 0);
+    EXPECT_TRUE(data0.find("e2") == data0.end());
+    EXPECT_TRUE(data0.begin() == data0.end());
+
+    // Internal state is the same as with a full clear
+    auto it = data0.crdt_find("e1");
+    _ASSERT_ELT_EQ(it, "e1", true, 20, data0);
+    int nbVisited = 0;
+    for (auto crdt_it = data0.crdt_begin(); crdt_it != data0.crdt_end(); ++crdt_it) {
+        EXPECT_TRUE(crdt_it->second.isRemoved());
+        EXPECT_EQ(crdt_it->second.timestamp(), 20);
+        ++nbVisited;
+    }
+    EXPECT_EQ(nbVisited, 3);
+
+    // Older clear after newer add: only older elts are removed
+    ASSERT_TRUE(data0.add("e1", 25));
+    ASSERT_TRUE(data0.add("e4", 30));
+    ASSERT_TRUE(data0.clear(27));
+    EXPECT_EQ(data0.size(), 1);
+    EXPECT_EQ(data0.count("e4"), 1);
+    it = data0.crdt_find("e1");
+    _ASSERT_ELT_EQ(it, "e1", true, 27, data0);
+}
+
+TEST(LWWSet, clearTest_LazyThenConcurrentConstQueries) {
+    LWWSet<int, int, FlatHashStorage> data0;
+    for (int k = 0; k < 100; ++k) {
+        data0.add(k, k + 1);
+    }
+    ASSERT_TRUE(data0.clear(200));
+    LWWSet<int, int, FlatHashStorage> settled(data0);
+    settled.compact(0);  // Any write settles the lazy clear
+
+    // Const queries never write: they may run concurrently
+    const auto& reader = data0;
+    std::atomic<int> nbErrors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (int k = 0; k < 100; ++k) {
+                const auto it = reader.crdt_find(k);
+                if (it == reader.crdt_end() || !it->second.isRemoved() || it->second.timestamp() != 200) {
+                    ++nbErrors;
+                }
+            }
+            if (!reader.crdt_equal(settled) || reader.delta_since(150).crdt_size() != 100) {
+                ++nbErrors;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(nbErrors, 0);
+    EXPECT_TRUE(reader.snapshot().crdt_equal(settled));
+}
+
+// Applies the same ops on a LWWSet and on a plain model with a full clear
+// sweep. Ops are shuffled by blocks so that some clears are older than
+// already applied ops.
+TYPED_TEST(LWWSetStorageTest, clearTest_SameResultsAsFullSweep) {
+    struct Entry {
+        int stamp;
+        bool isRemoved;
+    };
+    LWWSet<int, int, TypeParam> data0;
+    std::map<int, Entry> model;
+    int modelClearTime = 0;
+
+    std::mt19937 rng(42);
+    for (const TestOp& op : test_randomOps(20000, 500, 20, 50, rng)) {
+        const int stamp = op.stamp;
+        auto model_it = model.find(op.key);
+        bool expected = false;
+        if (op.kind == TestOp::CLEAR) {
+            if (stamp > modelClearTime) {
+                modelClearTime = stamp;
+                for (auto& elt : model) {
+                    if (stamp > elt.second.stamp) {
+                        elt.second = Entry{stamp, true};
+                    }
+                }
+                expected = true;
+            }
+        } else if (op.kind == TestOp::ADD) {
+            if (model_it == model.end()) {
+                expected = stamp > modelClearTime;
+                model[op.key] = expected ? Entry{stamp, false} : Entry{modelClearTime, true};
+            } else if (stamp > model_it->second.stamp) {
+                expected = model_it->second.isRemoved;
+                model_it->second = Entry{stamp, false};
+            }
+        } else {
+            if (model_it == model.end()) {
+                model[op.key] = Entry{std::max(stamp, modelClearTime), true};
+            } else if (stamp > model_it->second.stamp) {
+                expected = !model_it->second.isRemoved;
+                model_it->second = Entry{stamp, true};
+            }
+        }
+        ASSERT_EQ(test_apply(data0, op), expected);
+    }
+
+    std::set<int> alive;
+    for (const auto& elt : model) {
+        if (!elt.second.isRemoved) {
+            alive.insert(elt.first);
+        }
+    }
+    ASSERT_EQ(data0.size(), alive.size());
+    ASSERT_EQ(std::set<int>(data0.begin(), data0.end()), alive);
+    ASSERT_EQ(data0.crdt_size(), model.size());
+    for (const auto& elt : model) {
+        auto it = data0.crdt_find(elt.first);
+        _ASSERT_ELT_EQ(it, elt.first, elt.second.isRemoved, elt.second.stamp, data0);
+    }
+}
+
 // -----------------------------------------------------------------------------
 // add()
 // -----------------------------------------------------------------------------
@@ -738,6 +881,72 @@ TEST(LWWSet, removeTest_IdempotentReturnType) {
     _ASSERT_ELT_EQ(coco, "e1", true, 20, data0);
 }
 
+// -----------------------------------------------------------------------------
+// add() / remove() with moved keys
+// -----------------------------------------------------------------------------
+
+TYPED_TEST(LWWSetStorageTest, addRemoveTest_NoAllocationOnExistingKey) {
+    typedef LWWSet<std::string, int, TypeParam> Set;
+    // Key too long for the small string optimization
+    const std::string key = "a key long enough to be allocated on the heap";
+    std::string movedKey = key;
+    Set data0;
+    data0.add(key, 10);
+
+    const long nbAllocations = test_nbAllocations;
+    ASSERT_FALSE(data0.add(key, 20));
+    ASSERT_FALSE(data0.add(key, 5));
+    ASSERT_TRUE(data0.remove(key, 30));
+    ASSERT_FALSE(data0.remove(key, 25));
+    ASSERT_TRUE(data0.add(std::move(movedKey), 40));
+    ASSERT_FALSE(data0.remove(std::move(movedKey), 35));
+    EXPECT_EQ(test_nbAllocations - nbAllocations, 0);
+
+    // Key not consumed since already there
+    EXPECT_EQ(movedKey, key);
+    auto coco = data0.crdt_find(key);
+    _ASSERT_ELT_EQ(coco, key, false, 40, data0);
+}
+
+// Whatever the fill level, including right at the load threshold of the storage
+TYPED_TEST(LWWSetStorageTest, addRemoveTest_NoAllocationAtLoadThreshold) {
+    typedef LWWSet<std::string, int, TypeParam> Set;
+    for (int nbKeys = 1; nbKeys <= 40; ++nbKeys) {
+        Set data0;
+        for (int k = 0; k < nbKeys; ++k) {
+            data0.add("a key long enough to be allocated on the heap " + std::to_string(k), 10);
+        }
+        const std::string key = "a key long enough to be allocated on the heap 0";
+
+        const long nbAllocations = test_nbAllocations;
+        ASSERT_FALSE(data0.add(key, 20));
+        ASSERT_TRUE(data0.remove(key, 30));
+        ASSERT_TRUE(data0.add(key, 40));
+        EXPECT_EQ(test_nbAllocations - nbAllocations, 0) << "with " << nbKeys << " keys";
+    }
+}
+
+TYPED_TEST(LWWSetStorageTest, addRemoveTest_MovedKey) {
+    typedef LWWSet<std::string, int, TypeParam> Set;
+    const std::string key0 = "carrot is the best vegetable ever created";
+    const std::string key1 = "coconut is not a vegetable, but still great";
+    std::string movedKey0 = key0;
+    std::string movedKey1 = key1;
+    Set data0;
+
+    ASSERT_TRUE(data0.add(std::move(movedKey0), 10));
+    ASSERT_FALSE(data0.remove(std::move(movedKey1), 20));
+    EXPECT_NE(movedKey0, key0);
+    EXPECT_NE(movedKey1, key1);
+
+    auto coco = data0.crdt_find(key0);
+    _ASSERT_ELT_EQ(coco, key0, false, 10, data0);
+    coco = data0.crdt_find(key1);
+    _ASSERT_ELT_EQ(coco, key1, true, 20, data0);
+    EXPECT_EQ(data0.size(), 1);
+    EXPECT_EQ(data0.crdt_size(), 2);
+}
+
 // -----------------------------------------------------------------------------
 // add() + remove()
 // -----------------------------------------------------------------------------
@@ -997,6 +1206,409 @@ TEST(LWWSet, crdtEqualTest_EmptyVsAdd) {
     ASSERT_TRUE(data1.crdt_equal(data0));
 }
 
+// -----------------------------------------------------------------------------
+// compact()
+// -----------------------------------------------------------------------------
+
+TEST(LWWSet, compactTest) {
+    LWWSet<std::string, int> data0;
+    data0.add("v1", 10);
+    data0.add("v2", 11);
+    data0.add("v3", 12);
+    data0.remove("v1", 13);
+    data0.remove("v2", 20);
+    data0.remove("v4", 14);
+    ASSERT_EQ(data0.crdt_size(), 4);
+
+    // Only tombstones older than watermark are purged
+    ASSERT_EQ(data0.compact(15), 2);
+    ASSERT_EQ(data0.crdt_size(), 2);
+    ASSERT_EQ(data0.size(), 1);
+    ASSERT_EQ(data0.crdt_count("v1"), 0);
+    ASSERT_EQ(data0.crdt_count("v4"), 0);
+    ASSERT_EQ(data0.crdt_count("v2"), 1);
+    ASSERT_EQ(data0.count("v3"), 1);
+
+    // Idempotent
+    ASSERT_EQ(data0.compact(15), 0);
+    ASSERT_EQ(data0.crdt_size(), 2);
+}
+
+TYPED_TEST(LWWSetStorageTest, compactTest_LateDuplicates) {
+    LWWSet<int, int, TypeParam> data0;
+    data0.add(12, 5);
+    data0.add(12, 7);
+    data0.remove(12, 10);
+    ASSERT_EQ(data0.compact(20), 1);
+
+    // Duplicates received after compact do nothing: key doesn't come back
+    ASSERT_FALSE(data0.add(12, 5));
+    ASSERT_FALSE(data0.add(12, 7));
+    ASSERT_FALSE(data0.remove(12, 5));
+    ASSERT_FALSE(data0.add(12, 7));
+    ASSERT_EQ(data0.count(12), 0);
+    ASSERT_EQ(data0.crdt_count(12), 0);
+
+    // Newer ops are applied as usual
+    ASSERT_TRUE(data0.add(12, 21));
+    ASSERT_EQ(data0.count(12), 1);
+}
+
+TYPED_TEST(LWWSetStorageTest, compactTest_LateDuplicatesInBatch) {
+    typedef typename LWWSet<int, int, TypeParam>::batch_operation Op;
+    LWWSet<int, int, TypeParam> data0;
+    data0.add(12, 5);
+    data0.remove(12, 10);
+    data0.compact(20);
+
+    const std::vector<Op> ops = {{Op::REMOVE, 12, 5}, {Op::ADD, 12, 7}, {Op::ADD, 13, 8}, {Op::ADD, 13, 22}};
+    const std::vector<bool> expected = {false, false, false, true};
+    ASSERT_EQ(data0.apply_batch(ops.begin(), ops.end()), expected);
+    ASSERT_EQ(data0.crdt_count(12), 0);
+    ASSERT_EQ(data0.count(13), 1);
+}
+
+TYPED_TEST(LWWSetStorageTest, compactTest_MergeNotCompacted) {
+    LWWSet<int, int, TypeParam> data0;
+    LWWSet<int, int, TypeParam> data1;
+    for (LWWSet<int, int, TypeParam>* data : {&data0, &data1}) {
+        data->add(12, 5);
+        data->remove(12, 10);
+        data->add(13, 6);
+        data->remove(14, 7);
+        data->add(15, 25);
+    }
+    ASSERT_EQ(data0.compact(20), 2);
+    ASSERT_EQ(data0.crdt_size(), 2);
+
+    // Purged tombstones of a not compacted replicate don't come back
+    data0.merge(data1);
+    ASSERT_EQ(data0.crdt_size(), 2);
+    data0.merge_parallel(data1, 2u);
+    ASSERT_EQ(data0.crdt_size(), 2);
+    ASSERT_TRUE(data0 == data1);
+
+    // Compacted replicate merged in the other one brings its floor
+    data1.merge(data0);
+    ASSERT_FALSE(data1.add(12, 15));
+    ASSERT_EQ(data1.crdt_size(), 4);
+}
+
+TEST(LWWSet, compactTest_SameContentAsNotCompacted) {
+    LWWSet<int, int, FlatHashStorage> data0;
+    LWWSet<int, int, FlatHashStorage> data1;
+
+    unsigned int seed = 7;
+    for (int stamp = 1; stamp < 20000; ++stamp) {
+        seed = seed * 1103515245 + 12345;
+        const int key = (seed >> 8) % 2000;
+        if ((seed >> 4) % 2 == 0) {
+            data0.remove(key, stamp);
+            data1.remove(key, stamp);
+        } else {
+            data0.add(key, stamp);
+            data1.add(key, stamp);
+        }
+        if (stamp % 5000 == 0) {
+            data1.compact(stamp - 1000);
+        }
+    }
+    ASSERT_TRUE(data0 == data1);
+    ASSERT_LT(data1.crdt_size(), data0.crdt_size());
+    const auto nbTombstones = data1.crdt_size() - data1.size();
+    ASSERT_EQ(data1.compact(20000), nbTombstones);
+    ASSERT_EQ(data1.crdt_size(), data1.size());
+    ASSERT_TRUE(data0 == data1);
+}
+
+// -----------------------------------------------------------------------------
+// snapshot()
+// -----------------------------------------------------------------------------
+
+TYPED_TEST(LWWSetStorageTest, snapshotTest) {
+    LWWSet<int, int, TypeParam> data0;
+    for (int k = 0; k < 1000; ++k) {
+        data0.add(k, k + 1);
+    }
+    data0.clear(500);
+    const auto data1 = data0.snapshot();
+
+    data0.add(1, 2000);
+    data0.remove(900, 2001);
+    data0.compact(2000);
+    ASSERT_EQ(data0.count(1), 1);
+    ASSERT_EQ(data0.crdt_count(2), 0);
+    ASSERT_EQ(data1.size(), 501);
+    ASSERT_EQ(data1.crdt_size(), 1000);
+    ASSERT_EQ(data1.count(1), 0);
+    ASSERT_EQ(data1.count(900), 1);
+    ASSERT_EQ(data1.crdt_find(2)->second.timestamp(), 500);
+
+    LWWSet<int, int> data2;
+    for (int k = 0; k < 1000; ++k) {
+        data2.add(k, k + 1);
+    }
+    data2.clear(500);
+    int nbAlive = 0;
+    for (const auto& key : data1) {
+        ASSERT_EQ(data2.count(key), 1);
+        ++nbAlive;
+    }
+    ASSERT_EQ(nbAlive, 501);
+}
+
+// -----------------------------------------------------------------------------
+// merge()
+// -----------------------------------------------------------------------------
+
+TEST(LWWSet, mergeTest) {
+    LWWSet<std::string, int> data0;
+    LWWSet<std::string, int> data1;
+
+    data0.add("v1", 10);
+    data0.add("v2", 11);
+    data0.remove("v3", 12);
+    data1.remove("v1", 20);
+    data1.add("v3", 21);
+    data1.add("v4", 22);
+
+    LWWSet<std::string, int> merged0(data0);
+    LWWSet<std::string, int> merged1(data1);
+    merged0.merge(data1);
+    merged1.merge(data0);
+    ASSERT_TRUE(merged0.crdt_equal(merged1));
+    ASSERT_EQ(merged0.size(), 3);
+    ASSERT_EQ(merged0.count("v1"), 0);
+    ASSERT_EQ(merged0.count("v2"), 1);
+    ASSERT_EQ(merged0.count("v3"), 1);
+    ASSERT_EQ(merged0.count("v4"), 1);
+    ASSERT_EQ(merged0.crdt_find("v1")->second.timestamp(), 20);
+
+    // Idempotent
+    merged0.merge(data1);
+    merged0.merge(merged0);
+    ASSERT_TRUE(merged0.crdt_equal(merged1));
+}
+
+TEST(LWWSet, mergeTest_WithClear) {
+    LWWSet<std::string, int> data0;
+    LWWSet<std::string, int> data1;
+
+    data0.add("v1", 10);
+    data0.add("v2", 30);
+    data1.add("v3", 11);
+    data1.clear(20);
+
+    data0.merge(data1);
+    ASSERT_EQ(data0.size(), 1);
+    ASSERT_EQ(data0.count("v2"), 1);
+    ASSERT_EQ(data0.crdt_clear_time(), 20);
+
+    // Late add is below the merged clear
+    ASSERT_FALSE(data0.add("v4", 15));
+    ASSERT_EQ(data0.count("v4"), 0);
+}
+
+TEST(LWWSet, mergeTest_FromCompacted) {
+    LWWSet<std::string, int> data0;
+    data0.add("v1", 1);
+    data0.add("v2", 2);
+    data0.remove("v2", 3);
+    ASSERT_EQ(data0.compact(10), 1);
+
+    // Alive keys older than the compact time are not lost
+    LWWSet<std::string, int> data1;
+    data1.merge(data0);
+    ASSERT_EQ(data1.size(), 1);
+    ASSERT_EQ(data1.count("v1"), 1);
+    ASSERT_TRUE(data1.crdt_equal(data0));
+
+    LWWSet<std::string, int> data2;
+    data2.merge(data0.delta_since(0));
+    ASSERT_EQ(data2.count("v1"), 1);
+
+    // Compact time is merged too
+    ASSERT_FALSE(data1.add("v2", 2));
+    ASSERT_EQ(data1.count("v2"), 0);
+}
+
+TYPED_TEST(LWWSetStorageTest, mergeTest_SameResultsAsAllOperations) {
+    typedef LWWSet<int, int, TypeParam> Set;
+    std::mt19937 rng(7);
+    Set replicas[3];
+    Set all;
+    for (const TestOp& op : test_randomOps(30000, 3000, 1, 0, rng)) {
+        test_apply(replicas[rng() % 3], op);
+        test_apply(all, op);
+    }
+
+    // Sequential and parallel merge
+    for (const unsigned int nbThreads : {1u, 4u}) {
+        Set merged(replicas[0]);
+        merged.merge_parallel(replicas[1], nbThreads);
+        merged.merge_parallel(replicas[2], nbThreads);
+        ASSERT_TRUE(merged == all);
+        ASSERT_EQ(merged.size(), all.size());
+        ASSERT_TRUE(merged.crdt_equal(all));
+    }
+
+    // Other merge order
+    Set merged(replicas[2]);
+    merged.merge(replicas[0]);
+    merged.merge(replicas[1]);
+    ASSERT_TRUE(merged.crdt_equal(all));
+}
+
+// -----------------------------------------------------------------------------
+// delta_since()
+// -----------------------------------------------------------------------------
+
+TEST(LWWSet, deltaSinceTest) {
+    LWWSet<std::string, int> data0;
+    data0.add("v1", 10);
+    data0.add("v2", 20);
+    data0.remove("v1", 30);
+    data0.remove("v3", 40);
+
+    for (int k = 0; k < 2; ++k) {
+        data0.track_changes(k == 1);
+        ASSERT_EQ(data0.is_tracking_changes(), k == 1);
+
+        auto delta = data0.delta_since(15);
+        ASSERT_EQ(delta.crdt_size(), 3);
+        ASSERT_EQ(delta.size(), 1);
+        ASSERT_EQ(delta.count("v2"), 1);
+        ASSERT_TRUE(delta.crdt_find("v1")->second.isRemoved());
+        ASSERT_EQ(delta.crdt_find("v1")->second.timestamp(), 30);
+
+        delta = data0.delta_since(35);
+        ASSERT_EQ(delta.crdt_size(), 1);
+        ASSERT_EQ(delta.crdt_count("v3"), 1);
+
+        delta = data0.delta_since(50);
+        ASSERT_TRUE(delta.crdt_empty());
+    }
+}
+
+TEST(LWWSet, deltaSinceTest_WithClear) {
+    LWWSet<std::string, int> data0;
+    data0.track_changes(true);
+    data0.add("v1", 10);
+    data0.add("v2", 20);
+    LWWSet<std::string, int> data1(data0);
+
+    data0.clear(30);
+    data0.add("v3", 40);
+
+    auto delta = data0.delta_since(25);
+    ASSERT_EQ(delta.crdt_size(), 1);
+    ASSERT_EQ(delta.crdt_clear_time(), 30);
+    data1.merge(delta);
+    ASSERT_TRUE(data1.crdt_equal(data0));
+}
+
+TYPED_TEST(LWWSetStorageTest, deltaSinceTest_CatchUpLaggingReplicate) {
+    typedef LWWSet<int, int, TypeParam> Set;
+    const int since = 15001;
+    for (const bool isTracking : {false, true}) {
+        std::mt19937 rng(7);
+        Set data0;
+        data0.track_changes(isTracking);
+        Set data1;
+        for (const TestOp& op : test_randomOps(20000, 3000, 1, 0, rng)) {
+            if (op.stamp == since) {
+                data1 = data0;  // Lagging replicate received all ops before since
+            }
+            if (op.kind != TestOp::CLEAR || op.stamp < since) {
+                test_apply(data0, op);
+            }
+        }
+
+        const Set delta = data0.delta_since(since);
+        ASSERT_LT(delta.crdt_size(), data0.crdt_size());
+        data1.merge(delta);
+        ASSERT_TRUE(data1 == data0);
+        ASSERT_TRUE(data1.crdt_equal(data0));
+    }
+}
+
+// Keys updated by a lazy clear are moved in the change index: same deltas as
+// without the index
+TEST(LWWSet, deltaSinceTest_TrackedKeysUpdatedByClear) {
+    LWWSet<int, int> tracked;
+    tracked.track_changes(true);
+    LWWSet<int, int> untracked;
+    LWWSet<int, int> other;
+    other.add(6, 120);
+    for (LWWSet<int, int>* data : {&tracked, &untracked}) {
+        for (int k = 0; k < 20; ++k) {
+            data->add(k, k + 1);
+        }
+        ASSERT_TRUE(data->clear(100));
+        data->add(3, 50);  // Older than clear: only updates the key to the clear
+        data->remove(4, 60);
+        data->add(5, 150);
+        data->merge(other);
+    }
+
+    // Updates all keys older than the clear (Nothing purged)
+    tracked.compact(0);
+    untracked.compact(0);
+    EXPECT_EQ(tracked.delta_since(50).crdt_size(), 20);
+    const int sinceList[] = {0, 10, 50, 100, 101, 120, 150, 200};
+    for (const int since : sinceList) {
+        EXPECT_TRUE(tracked.delta_since(since).crdt_equal(untracked.delta_since(since))) << since;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// apply_batch()
+// -----------------------------------------------------------------------------
+
+TEST(LWWSet, applyBatchTest) {
+    typedef LWWSet<std::string, int>::batch_operation Op;
+    LWWSet<std::string, int> data0;
+    data0.add("v1", 5);
+
+    const std::vector<Op> ops = {
+        {Op::ADD, "v2", 10},    {Op::REMOVE, "v1", 11}, {Op::ADD, "v2", 12},  {Op::REMOVE, "v2", 9},
+        {Op::REMOVE, "v2", 13}, {Op::CLEAR, "", 14},    {Op::ADD, "v1", 4},   {Op::ADD, "v3", 15},
+    };
+    const std::vector<bool> results = data0.apply_batch(ops.begin(), ops.end());
+    const std::vector<bool> expected = {true, true, false, false, true, true, false, true};
+    ASSERT_EQ(results, expected);
+    ASSERT_EQ(data0.size(), 1);
+    ASSERT_EQ(data0.count("v3"), 1);
+    ASSERT_EQ(data0.crdt_find("v2")->second.timestamp(), 14);
+}
+
+TEST(LWWSet, applyBatchTest_EmptyRange) {
+    LWWSet<std::string, int> data0;
+    std::vector<LWWSet<std::string, int>::batch_operation> ops;
+    ASSERT_TRUE(data0.apply_batch(ops.begin(), ops.end()).empty());
+    ASSERT_TRUE(data0.crdt_empty());
+}
+
+TYPED_TEST(LWWSetStorageTest, applyBatchTest_SameResultsAsSequential) {
+    LWWSet<int, int, TypeParam> data0;
+    LWWSet<int, int, TypeParam> data1;
+    std::mt19937 rng(42);
+    const std::vector<TestOp> ops = test_randomOps(20000, 200, 2, 20000, rng);
+    std::size_t batchSize = 1;
+    for (std::size_t begin = 0; begin < ops.size(); begin += batchSize) {
+        // Batches of several sizes
+        batchSize = std::min<std::size_t>(1 + rng() % 500, ops.size() - begin);
+        std::vector<bool> expected;
+        for (std::size_t k = begin; k < begin + batchSize; ++k) {
+            expected.push_back(test_apply(data0, ops[k]));
+        }
+        ASSERT_EQ(data1.apply_batch(ops.begin() + begin, ops.begin() + begin + batchSize), expected);
+        ASSERT_EQ(data1.size(), data0.size());
+    }
+    ASSERT_TRUE(data1 == data0);
+    ASSERT_TRUE(data1.crdt_equal(data0));
+}
+
 // -----------------------------------------------------------------------------
 // iterator
 // -----------------------------------------------------------------------------
@@ -1230,6 +1842,30 @@ TEST(LWWSet, crdtIteratorTest_Reference) {
     }
 }
 
+TEST(LWWSet, crdtIteratorTest_Forward) {
+    LWWSet<std::string, int> data0;
+    data0.add("v1", 10);
+    data0.remove("v2", 20);
+
+    // Entry references stay valid as long as the iterator
+    auto it = data0.crdt_begin();
+    const auto& meta = it->second;
+    const std::string& key = (*it).first;
+    auto first = it++;
+    EXPECT_EQ(first->first, key);
+    EXPECT_EQ(meta.timestamp(), key == "v1" ? 10 : 20);
+    EXPECT_EQ(meta.isRemoved(), key == "v2");
+    EXPECT_EQ(std::distance(first, data0.crdt_end()), 2);
+    EXPECT_TRUE(++it == data0.crdt_end());
+
+    // Multipass algorithms
+    typedef LWWSet<std::string, int>::const_crdt_iterator::reference entry_ref;
+    const auto removed_it = std::find_if(data0.crdt_begin(), data0.crdt_end(),
+                                         [](entry_ref entry) { return entry.second.isRemoved(); });
+    ASSERT_TRUE(removed_it != data0.crdt_end());
+    EXPECT_EQ(removed_it->first, "v2");
+}
+
 // -----------------------------------------------------------------------------
 // Operator==
 // -----------------------------------------------------------------------------
@@ -1280,4 +1916,201 @@ TEST(LWWSet, operatorEQTest_DifferentTimestamp) {
     ASSERT_FALSE(data0 != data1);
 }
 
+// -----------------------------------------------------------------------------
+// Storage policy (FlatHashStorage)
+// -----------------------------------------------------------------------------
+
+TEST(LWWSet, flatStorageTest_AddRemove) {
+    LWWSet<std::string, int, FlatHashStorage> data0;
+
+    ASSERT_TRUE(data0.add("v1", 10));
+    ASSERT_TRUE(data0.add("v2", 11));
+    ASSERT_FALSE(data0.add("v1", 12));
+    ASSERT_TRUE(data0.remove("v1", 13));
+    ASSERT_FALSE(data0.remove("v3", 14));
+    ASSERT_EQ(data0.size(), 1);
+    ASSERT_EQ(data0.crdt_size(), 3);
+    ASSERT_EQ(data0.count("v1"), 0);
+    ASSERT_EQ(data0.count("v2"), 1);
+
+    auto it = data0.crdt_find("v1");
+    _ASSERT_ELT_EQ(it, "v1", true, 13, data0);
+    it = data0.crdt_find("v3");
+    _ASSERT_ELT_EQ(it, "v3", true, 14, data0);
+
+    ASSERT_TRUE(data0.clear(20));
+    ASSERT_TRUE(data0.empty());
+    ASSERT_FALSE(data0.add("v4", 15));
+    ASSERT_TRUE(data0.add("v4", 21));
+    ASSERT_EQ(data0.size(), 1);
+}
+
+TEST(LWWSet, flatStorageTest_SameResultsAsDefaultStorage) {
+    LWWSet<int, int> data0;
+    LWWSet<int, int, FlatHashStorage> data1;
+
+    // Pseudo random op stream (Deterministic)
+    unsigned int seed = 42;
+    for (int stamp = 1; stamp < 20000; ++stamp) {
+        seed = seed * 1103515245 + 12345;
+        const int key = (seed >> 8) % 3000;
+        if ((seed >> 4) % 3 == 0) {
+            ASSERT_EQ(data0.remove(key, stamp), data1.remove(key, stamp));
+        } else {
+            ASSERT_EQ(data0.add(key, stamp), data1.add(key, stamp));
+        }
+    }
+    ASSERT_EQ(data0.size(), data1.size());
+    ASSERT_EQ(data0.crdt_size(), data1.crdt_size());
+
+    int nbVisited = 0;
+    for (const auto& key : data1) {
+        ASSERT_EQ(data0.count(key), 1);
+        ++nbVisited;
+    }
+    ASSERT_EQ(nbVisited, data1.size());
+    for (auto it = data0.crdt_begin(); it != data0.crdt_end(); ++it) {
+        auto other_it = data1.crdt_find(it->first);
+        _ASSERT_ELT_EQ(other_it, it->first, it->second.isRemoved(), it->second.timestamp(), data1);
+    }
+}
+
+TEST(LWWSet, flatStorageTest_IteratorManyTombstones) {
+    LWWSet<int, int, FlatHashStorage> data0;
+
+    for (int k = 0; k < 5000; ++k) {
+        data0.add(k, 10);
+    }
+    for (int k = 0; k < 5000; ++k) {
+        if (k % 500 != 0) {
+            data0.remove(k, 20);
+        }
+    }
+    data0.add(42, 30);
+    data0.remove(500, 30);
+
+    std::set<int> visited(data0.begin(), data0.end());
+    ASSERT_EQ(visited.size(), data0.size());
+    ASSERT_EQ(visited, std::set<int>({0, 42, 1000, 1500, 2000, 2500, 3000, 3500, 4000, 4500}));
+    ASSERT_TRUE(data0.find(42) != data0.end());
+    ASSERT_TRUE(data0.find(500) == data0.end());
+
+    // Iterate from find
+    int nbVisited = 0;
+    for (auto it = data0.find(42); it != data0.end(); ++it) {
+        ++nbVisited;
+    }
+    ASSERT_LE(nbVisited, 10);
+    ASSERT_GE(nbVisited, 1);
+
+    data0.clear(40);
+    ASSERT_TRUE(data0.begin() == data0.end());
+    data0.add(7, 50);
+    ASSERT_EQ(*data0.begin(), 7);
+    ASSERT_TRUE(++data0.begin() == data0.end());
+}
+
+TEST(LWWSet, flatStorageTest_CrdtEqual) {
+    LWWSet<int, int, FlatHashStorage> data0;
+    LWWSet<int, int, FlatHashStorage> data1;
+
+    data0.add(1, 10);
+    data0.remove(2, 11);
+    data1.remove(2, 11);
+    ASSERT_FALSE(data0.crdt_equal(data1));
+    data1.add(1, 10);
+    ASSERT_TRUE(data0.crdt_equal(data1));
+    ASSERT_TRUE(data0 == data1);
+}
+
+// -----------------------------------------------------------------------------
+// set() / at() (Payload)
+// -----------------------------------------------------------------------------
+
+TEST(LWWSet, setTest_Payload) {
+    LWWSet<int, int, HashMapStorage, std::string> data0;
+    ASSERT_TRUE(data0.set(1, "a", 10));
+    ASSERT_EQ(data0.count(1), 1);
+    ASSERT_EQ(data0.at(1), "a");
+
+    // Newer assign wins, older is ignored
+    ASSERT_TRUE(data0.set(1, "b", 20));
+    ASSERT_FALSE(data0.set(1, "c", 15));
+    ASSERT_FALSE(data0.set(1, "b", 20));
+    ASSERT_EQ(data0.at(1), "b");
+    ASSERT_EQ(data0.crdt_find(1)->second.payloadTimestamp(), 20);
+
+    // Removed key keeps its payload, back once added again
+    data0.remove(1, 30);
+    ASSERT_THROW(data0.at(1), std::out_of_range);
+    ASSERT_EQ(data0.crdt_at(1), "b");
+    data0.add(1, 40);
+    ASSERT_EQ(data0.at(1), "b");
+
+    ASSERT_THROW(data0.at(2), std::out_of_range);
+    ASSERT_THROW(data0.crdt_at(2), std::out_of_range);
+    data0.add(2, 50);
+    ASSERT_EQ(data0.at(2), "");
+}
+
+TEST(LWWSet, setTest_PayloadOwnTimestamp) {
+    LWWSet<int, int, HashMapStorage, int> data0;
+
+    // Assign older than the remove: key stays removed, payload assigned
+    data0.remove(1, 20);
+    ASSERT_TRUE(data0.set(1, 42, 10));
+    ASSERT_EQ(data0.count(1), 0);
+    ASSERT_EQ(data0.crdt_at(1), 42);
+
+    // Same after a clear
+    data0.set(2, 1, 30);
+    data0.clear(40);
+    ASSERT_TRUE(data0.set(2, 2, 35));
+    ASSERT_EQ(data0.count(2), 0);
+    ASSERT_EQ(data0.crdt_at(2), 2);
+}
+
+TEST(LWWSet, setTest_NoPayloadNoSpace) {
+    EXPECT_EQ(sizeof(LWWSet<int, int>::Metadata), sizeof(std::pair<int, bool>));
+}
+
+TEST(LWWSet, mergeTest_Payload) {
+    LWWSet<int, int, HashMapStorage, int> data0;
+    LWWSet<int, int, HashMapStorage, int> data1;
+    data0.set(1, 10, 10);
+    data1.set(1, 20, 20);
+    data1.remove(1, 21);
+    data0.set(2, 30, 30);
+    data1.set(3, 40, 40);
+
+    auto data2 = data0;
+    data2.merge(data1);
+    data1.merge(data0);
+    ASSERT_TRUE(data1.crdt_equal(data2));
+    ASSERT_TRUE(data1 == data2);
+    ASSERT_EQ(data1.count(1), 0);
+    ASSERT_EQ(data1.crdt_at(1), 20);
+    ASSERT_EQ(data1.at(2), 30);
+    ASSERT_EQ(data1.at(3), 40);
+
+    // Delta keeps the payload of changed keys
+    data0.set(2, 50, 50);
+    const auto delta = data0.delta_since(50);
+    ASSERT_EQ(delta.crdt_size(), 1);
+    data1.merge(delta);
+    ASSERT_EQ(data1.at(2), 50);
+}
+
+TEST(LWWSet, operatorEQTest_Payload) {
+    LWWSet<int, int, HashMapStorage, int> data0;
+    LWWSet<int, int, HashMapStorage, int> data1;
+    data0.set(1, 10, 10);
+    data1.set(1, 10, 11);
+    ASSERT_TRUE(data0 == data1);
+    ASSERT_FALSE(data0.crdt_equal(data1));
+
+    data1.set(1, 20, 12);
+    ASSERT_FALSE(data0 == data1);
+}
+
 }  // namespace collabserver
@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "collabserver/datatypes/CmRDT/ShardedLWWGraph.h"
+
+namespace collabserver {
+
+typedef ShardedLWWGraph<int, int, int> IntShardedGraph;
+
+// -----------------------------------------------------------------------------
+// add_edge() / remove_edge()
+// -----------------------------------------------------------------------------
+
+TEST(ShardedLWWGraph, addEdgeTest) {
+    IntShardedGraph data0(8);
+    LWWGraph<int, int, int> data1;
+    for (int k = 0; k < 20; ++k) {
+        const auto info0 = data0.add_edge(k, (k * 7) % 20, k + 1);
+        const auto info1 = data1.add_edge(k, (k * 7) % 20, k + 1);
+        EXPECT_EQ(info0.isEdgeAdded, info1.isEdgeAdded);
+        EXPECT_EQ(info0.isFromAdded, info1.isFromAdded);
+        EXPECT_EQ(info0.isToAdded, info1.isToAdded);
+    }
+    EXPECT_EQ(data0.size_vertex(), 20);
+    EXPECT_EQ(data0.size_edges(), 20);
+    EXPECT_TRUE(data0.has_edge(3, 1));
+    EXPECT_FALSE(data0.has_edge(1, 3));
+    EXPECT_EQ(data0.in_degree(0), 1);  // 0 -> 0
+    EXPECT_EQ(data0.out_degree(3), 1);
+
+    EXPECT_TRUE(data0.remove_edge(3, 1, 30));
+    EXPECT_FALSE(data0.has_edge(3, 1));
+    EXPECT_EQ(data0.in_degree(1), 0);
+    EXPECT_EQ(data0.crdt_size_edges(), 20);
+    EXPECT_TRUE(data0.snapshot().crdt_equal(data1) == false);
+
+    data1.remove_edge(3, 1, 30);
+    EXPECT_TRUE(data0.snapshot().crdt_equal(data1));
+}
+
+TEST(ShardedLWWGraph, setEdgeTest) {
+    ShardedLWWGraph<int, int, int, SmallMapStorage<4>, std::string> data0(8);
+    EXPECT_TRUE(data0.set_edge(1, 2, "label", 10));
+    EXPECT_FALSE(data0.set_edge(1, 2, "older", 5));
+    EXPECT_TRUE(data0.has_edge(1, 2));
+    EXPECT_EQ(data0.in_degree(2), 1);
+    EXPECT_EQ(data0.snapshot().at_edge(1, 2), "label");
+}
+
+// -----------------------------------------------------------------------------
+// remove_vertex() / clear_vertex_edges()
+// -----------------------------------------------------------------------------
+
+TEST(ShardedLWWGraph, removeVertexTest_EdgesInOtherShards) {
+    IntShardedGraph data0(16);
+    for (int k = 1; k <= 50; ++k) {
+        data0.add_edge(0, k, k);
+        data0.add_edge(k, 0, 100 + k);
+    }
+    EXPECT_EQ(data0.in_degree(0), 50);
+    EXPECT_EQ(data0.in_degree(7), 1);
+
+    EXPECT_TRUE(data0.remove_vertex(0, 200));
+    EXPECT_FALSE(data0.has_vertex(0));
+    EXPECT_EQ(data0.size_vertex(), 50);
+    EXPECT_EQ(data0.size_edges(), 0);
+    EXPECT_EQ(data0.crdt_size_edges(), 100);
+    for (int k = 1; k <= 50; ++k) {
+        EXPECT_FALSE(data0.has_edge(k, 0));
+        EXPECT_EQ(data0.in_degree(k), 0);
+        EXPECT_EQ(data0.out_degree(k), 0);
+    }
+
+    // Old add_edge received late: still removed
+    data0.add_edge(3, 0, 150);
+    EXPECT_FALSE(data0.has_edge(3, 0));
+}
+
+TEST(ShardedLWWGraph, clearVertexEdgesTest) {
+    IntShardedGraph data0(4);
+    data0.add_edge(1, 2, 10);
+    data0.add_edge(1, 3, 11);
+    data0.add_edge(3, 1, 12);
+    EXPECT_TRUE(data0.clear_vertex_edges(1, 13));
+    EXPECT_TRUE(data0.has_vertex(1));
+    EXPECT_EQ(data0.out_degree(1), 0);
+    EXPECT_EQ(data0.in_degree(1), 1);
+    EXPECT_EQ(data0.in_degree(2), 0);
+    EXPECT_EQ(data0.size_edges(), 1);
+
+    // Unknown vertex: clear is kept for edges received later
+    EXPECT_FALSE(data0.clear_vertex_edges(42, 14));
+    data0.add_edge(42, 1, 5);
+    EXPECT_FALSE(data0.has_edge(42, 1));
+}
+
+// -----------------------------------------------------------------------------
+// set_vertex() / visit_vertex()
+// -----------------------------------------------------------------------------
+
+TEST(ShardedLWWGraph, visitVertexTest) {
+    ShardedLWWGraph<std::string, std::string, int> data0(4);
+    data0.set_vertex("v1", "content", 10);
+    std::string content;
+    EXPECT_TRUE(data0.visit_vertex(
+        "v1", [&](const LWWGraph<std::string, std::string, int>::Vertex& vertex) { content = vertex.content(); }));
+    EXPECT_EQ(content, "content");
+
+    data0.remove_vertex("v1", 11);
+    EXPECT_FALSE(data0.visit_vertex("v1", [](const LWWGraph<std::string, std::string, int>::Vertex&) {}));
+}
+
+// -----------------------------------------------------------------------------
+// compact()
+// -----------------------------------------------------------------------------
+
+TEST(ShardedLWWGraph, compactTest) {
+    IntShardedGraph data0(8);
+    LWWGraph<int, int, int> data1;
+    for (int k = 0; k < 30; ++k) {
+        data0.add_edge(k, k + 1, k + 1);
+        data1.add_edge(k, k + 1, k + 1);
+    }
+    data0.remove_vertex(10, 40);
+    data1.remove_vertex(10, 40);
+    data0.remove_edge(20, 21, 41);
+    data1.remove_edge(20, 21, 41);
+
+    EXPECT_EQ(data0.compact(50), data1.compact(50));
+    EXPECT_EQ(data0.crdt_size_vertex(), data1.crdt_size_vertex());
+    EXPECT_EQ(data0.crdt_size_edges(), data1.crdt_size_edges());
+    EXPECT_EQ(data0.in_degree(11), 0);
+    EXPECT_TRUE(data0.snapshot().crdt_equal(data1));
+}
+
+// -----------------------------------------------------------------------------
+// Operations from several threads
+// -----------------------------------------------------------------------------
+
+struct ConcurrentTestOp {
+    int type;
+    int from;
+    int to;
+};
+
+template <typename Graph>
+static void concurrentTest_Apply(Graph& graph, const ConcurrentTestOp& op, int stamp) {
+    if (op.type < 10) {
+        graph.add_edge(op.from, op.to, stamp);
+    } else if (op.type < 14) {
+        graph.remove_edge(op.from, op.to, stamp);
+    } else if (op.type < 16) {
+        graph.remove_vertex(op.from, stamp);
+    } else if (op.type < 17) {
+        graph.clear_vertex_edges(op.from, stamp);
+    } else {
+        graph.add_vertex(op.from, stamp);
+    }
+}
+
+// Random operations with unique timestamps, applied to a LWWGraph in order
+// and to a ShardedLWWGraph from several threads (Each thread applies one op
+// out of nbThreads). Vertex content is not CRDT: set_vertex is not used.
+// Timestamps of removed edges may differ (Not compared).
+static void concurrentTest_CheckSameAsLWWGraph(std::size_t nbShards, int nbThreads) {
+    std::mt19937 gen(nbThreads);
+    std::uniform_int_distribution<int> randKey(0, 200);
+    std::uniform_int_distribution<int> randOp(0, 19);
+    std::vector<ConcurrentTestOp> ops(20000);
+    for (auto& op : ops) {
+        op.type = randOp(gen);
+        op.from = randKey(gen);
+        op.to = randKey(gen);
+    }
+
+    LWWGraph<int, int, int> expected;
+    IntShardedGraph data0(nbShards);
+    for (std::size_t k = 0; k < ops.size(); ++k) {
+        concurrentTest_Apply(expected, ops[k], static_cast<int>(k + 1));
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nbThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (std::size_t k = t; k < ops.size(); k += nbThreads) {
+                concurrentTest_Apply(data0, ops[k], static_cast<int>(k + 1));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    const auto snapshot = data0.snapshot();
+    ASSERT_TRUE(snapshot == expected);
+    ASSERT_EQ(data0.crdt_size_vertex(), expected.crdt_size_vertex());
+    ASSERT_EQ(data0.size_vertex(), expected.size_vertex());
+    ASSERT_EQ(data0.size_edges(), expected.size_edges());
+    ASSERT_EQ(data0.crdt_size_edges(), expected.crdt_size_edges());
+    for (int key = 0; key <= 200; ++key) {
+        ASSERT_EQ(data0.in_degree(key), expected.in_degree(key));
+        ASSERT_EQ(data0.out_degree(key), expected.out_degree(key));
+        ASSERT_EQ(snapshot.crdt_in_degree(key), expected.crdt_in_degree(key));
+    }
+}
+
+TEST(ShardedLWWGraph, concurrentTest_SameAsLWWGraph) {
+    concurrentTest_CheckSameAsLWWGraph(1, 1);
+    concurrentTest_CheckSameAsLWWGraph(16, 1);
+    concurrentTest_CheckSameAsLWWGraph(16, 8);
+    concurrentTest_CheckSameAsLWWGraph(3, 8);
+}
+
+}  // namespace collabserver
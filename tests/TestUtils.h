@@ -0,0 +1,84 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "collabserver/datatypes/CmRDT/LWWBatchOperation.h"
+#include "collabserver/datatypes/storage/StoragePolicy.h"
+
+namespace collabserver {
+
+// Number of calls to operator new since the tests started.
+// (Defined in runAllTests.cpp with the operator new replacement)
+extern std::atomic<long> test_nbAllocations;
+
+// Storage policies of LWWSet and LWWMap, for typed tests (TYPED_TEST_SUITE).
+typedef ::testing::Types<HashMapStorage, FlatHashStorage, PersistentStorage> StoragePolicies;
+
+// Operation of a random test scenario (See test_randomOps). Same type as
+// the apply_batch operations of LWWSet<int, int> and LWWMap<int, T, int>.
+typedef LWWBatchOperation<int, int> TestOp;
+
+// Random ops with the stamps 1 to nbOps, on keys [0, nbKeys). Per thousand,
+// clearPerMille ops are clears, adds up to 600, removes otherwise. Ops are
+// shuffled by blocks of blockSize to be received out of order (None if 0).
+inline std::vector<TestOp> test_randomOps(int nbOps, int nbKeys, int clearPerMille, std::size_t blockSize,
+                                          std::mt19937& rng) {
+    std::vector<TestOp> ops;
+    ops.reserve(static_cast<std::size_t>(nbOps));
+    for (int stamp = 1; stamp <= nbOps; ++stamp) {
+        const int key = static_cast<int>(rng() % static_cast<unsigned int>(nbKeys));
+        const int kind = static_cast<int>(rng() % 1000);
+        if (kind < clearPerMille) {
+            ops.push_back(TestOp{TestOp::CLEAR, key, stamp});
+        } else {
+            ops.push_back(TestOp{(kind < 600) ? TestOp::ADD : TestOp::REMOVE, key, stamp});
+        }
+    }
+    for (std::size_t k = 0; blockSize > 0 && k < ops.size(); k += blockSize) {
+        std::shuffle(ops.begin() + k, ops.begin() + std::min(k + blockSize, ops.size()), rng);
+    }
+    return ops;
+}
+
+// Applies op on a LWWSet or a LWWMap. Returns what the operation returned.
+template <typename Data>
+bool test_apply(Data& data, const TestOp& op) {
+    if (op.kind == TestOp::ADD) {
+        return data.add(op.key, op.stamp);
+    } else if (op.kind == TestOp::REMOVE) {
+        return data.remove(op.key, op.stamp);
+    }
+    return data.clear(op.stamp);
+}
+
+// Applies ops in their order, then in nbOrders random orders. Each random
+// order is also split between two replicates, merged after. Calls
+// check(const Data& expected, const Data& data) on each result, where
+// expected received the ops in their order.
+template <typename Data, typename Op, typename Apply, typename Check>
+void test_checkAnyOrder(std::vector<Op> ops, int nbOrders, std::mt19937& rng, Apply apply, Check check) {
+    Data expected;
+    for (const Op& op : ops) {
+        apply(expected, op);
+    }
+    for (int k = 0; k < nbOrders; ++k) {
+        std::shuffle(ops.begin(), ops.end(), rng);
+        Data data;
+        Data halves[2];
+        for (std::size_t i = 0; i < ops.size(); ++i) {
+            apply(data, ops[i]);
+            apply(halves[i % 2], ops[i]);
+        }
+        halves[0].merge(halves[1]);
+        check(expected, data);
+        check(expected, halves[0]);
+    }
+}
+
+}  // namespace collabserver
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "collabserver/datatypes/collabdata/CollabData.h"
+#include "collabserver/datatypes/collabdata/CollabDataAsyncObserver.h"
+
+namespace collabserver {
+
+// -----------------------------------------------------------------------------
+// Mock classes
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+class MockAsyncCollabData : public CollabData {
+   public:
+    bool applyExternOperation(unsigned int /*id*/, const std::string& /*buffer*/) override { return false; }
+};
+
+// -----------------------------------------------------------------------------
+class MockAsyncOperation : public CollabDataOperation {
+   public:
+    int value;
+    bool isCloneable;
+
+   public:
+    explicit MockAsyncOperation(int v, bool cloneable = true) : value(v), isCloneable(cloneable) {}
+
+    unsigned int getType() const override { return 1; }
+    bool serialize(std::stringstream& /*buffer*/) const override { return false; }
+    bool unserialize(const std::stringstream& /*buffer*/) override { return false; }
+    void accept(CollabDataOperationHandler& /*visitor*/) const override {}
+    CollabDataOperationPtr clone() const override {
+        return isCloneable ? std::make_shared<MockAsyncOperation>(*this) : nullptr;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Records delivered values and batch sizes. May sleep to simulate a slow observer.
+class MockBatchObserver : public CollabDataOperationObserver {
+   public:
+    std::vector<int> values;
+    std::vector<std::size_t> batchSizes;
+    std::chrono::microseconds delay{0};
+
+   public:
+    void onOperation(const CollabDataOperation& op) override {
+        values.push_back(static_cast<const MockAsyncOperation&>(op).value);
+    }
+
+    void onOperations(const std::vector<CollabDataOperationPtr>& ops) override {
+        std::this_thread::sleep_for(delay);
+        batchSizes.push_back(ops.size());
+        CollabDataOperationObserver::onOperations(ops);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Executor that keeps tasks until run() is called
+class MockManualExecutor {
+   public:
+    std::vector<std::function<void()>> tasks;
+
+   public:
+    CollabDataAsyncObserver::Executor executor() {
+        return [this](std::function<void()> task) { tasks.push_back(std::move(task)); };
+    }
+
+    // Runs the scheduled tasks (And the ones they schedule)
+    void run() {
+        while (!tasks.empty()) {
+            std::function<void()> task = std::move(tasks.front());
+            tasks.erase(tasks.begin());
+            task();
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+// onOperation()
+// -----------------------------------------------------------------------------
+
+TEST(CollabDataAsyncObserver, onOperationTest) {
+    MockAsyncCollabData data;
+    MockBatchObserver observer;
+    CollabDataAsyncObserver asyncObserver(observer);
+    data.addOperationObserver(asyncObserver);
+
+    for (int k = 0; k < 100; ++k) {
+        data.notifyOperationObservers(MockAsyncOperation(k));
+    }
+    asyncObserver.flush();
+    ASSERT_EQ(asyncObserver.size(), 0);
+    ASSERT_EQ(observer.values.size(), 100);
+    for (int k = 0; k < 100; ++k) {
+        ASSERT_EQ(observer.values[k], k);
+    }
+}
+
+TEST(CollabDataAsyncObserver, onOperationTest_Batches) {
+    MockBatchObserver observer;
+    MockManualExecutor manual;
+    CollabDataAsyncObserver asyncObserver(observer, 100, CollabDataAsyncObserver::Overflow::Block, 3,
+                                          manual.executor());
+
+    for (int k = 0; k < 7; ++k) {
+        asyncObserver.onOperation(MockAsyncOperation(k));
+    }
+    ASSERT_EQ(manual.tasks.size(), 1);  // One scheduled task at a time
+    ASSERT_TRUE(observer.values.empty());
+    ASSERT_EQ(asyncObserver.size(), 7);
+
+    manual.run();
+    ASSERT_EQ(observer.batchSizes, (std::vector<std::size_t>{3, 3, 1}));
+    ASSERT_EQ(observer.values, (std::vector<int>{0, 1, 2, 3, 4, 5, 6}));
+}
+
+TEST(CollabDataAsyncObserver, onOperationTest_Drop) {
+    MockBatchObserver observer;
+    MockManualExecutor manual;
+    CollabDataAsyncObserver asyncObserver(observer, 4, CollabDataAsyncObserver::Overflow::Drop, 64,
+                                          manual.executor());
+
+    for (int k = 0; k < 10; ++k) {
+        asyncObserver.onOperation(MockAsyncOperation(k));
+    }
+    ASSERT_EQ(asyncObserver.size(), 4);
+    ASSERT_EQ(asyncObserver.nb_dropped(), 6);
+
+    manual.run();
+    ASSERT_EQ(observer.values, (std::vector<int>{0, 1, 2, 3}));
+
+    // Room again once delivered
+    asyncObserver.onOperation(MockAsyncOperation(42));
+    manual.run();
+    ASSERT_EQ(observer.values.back(), 42);
+    ASSERT_EQ(asyncObserver.nb_dropped(), 6);
+}
+
+TEST(CollabDataAsyncObserver, onOperationTest_BlockOnSlowObserver) {
+    MockBatchObserver observer;
+    observer.delay = std::chrono::microseconds(200);
+    CollabDataAsyncObserver asyncObserver(observer, 2, CollabDataAsyncObserver::Overflow::Block, 2);
+
+    for (int k = 0; k < 50; ++k) {
+        asyncObserver.onOperation(MockAsyncOperation(k));
+        ASSERT_LE(asyncObserver.size(), 2);
+    }
+    asyncObserver.flush();
+    ASSERT_EQ(asyncObserver.nb_dropped(), 0);
+    ASSERT_EQ(observer.values.size(), 50);
+    for (int k = 0; k < 50; ++k) {
+        ASSERT_EQ(observer.values[k], k);
+    }
+}
+
+TEST(CollabDataAsyncObserver, onOperationTest_NotCloneable) {
+    MockBatchObserver observer;
+    MockManualExecutor manual;
+    CollabDataAsyncObserver asyncObserver(observer, 16, CollabDataAsyncObserver::Overflow::Block, 64,
+                                          manual.executor());
+    asyncObserver.onOperation(MockAsyncOperation(1));
+    asyncObserver.onOperation(MockAsyncOperation(2));
+    manual.run();
+
+    // Delivered inline, after queued ones
+    asyncObserver.onOperation(MockAsyncOperation(3, false));
+    ASSERT_EQ(observer.values, (std::vector<int>{1, 2, 3}));
+    ASSERT_EQ(observer.batchSizes.back(), 1);
+}
+
+TEST(CollabDataAsyncObserver, destructorTest_DeliversQueuedOperations) {
+    MockBatchObserver observer;
+    {
+        CollabDataAsyncObserver asyncObserver(observer);
+        for (int k = 0; k < 20; ++k) {
+            asyncObserver.onOperation(MockAsyncOperation(k));
+        }
+    }
+    ASSERT_EQ(observer.values.size(), 20);
+}
+
+}  // namespace collabserver
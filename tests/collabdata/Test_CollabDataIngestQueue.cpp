@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "collabserver/datatypes/collabdata/CollabDataIngestQueue.h"
+
+namespace collabserver {
+
+// -----------------------------------------------------------------------------
+// Mock classes
+// -----------------------------------------------------------------------------
+
+// Records applied operations. Operations with an empty buffer are invalid.
+class MockIngestCollabData : public CollabData {
+   public:
+    std::vector<unsigned int> applied;
+
+   public:
+    bool applyExternOperation(unsigned int id, const std::string& buffer) override {
+        if (buffer.empty()) {
+            return false;
+        }
+        applied.push_back(id);
+        return true;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// push() / drain()
+// -----------------------------------------------------------------------------
+
+TEST(CollabDataIngestQueue, pushTest) {
+    MockIngestCollabData data;
+    CollabDataIngestQueue queue(data, 16);
+    ASSERT_EQ(queue.capacity(), 16);
+
+    std::vector<int> results;
+    for (unsigned int k = 1; k <= 10; ++k) {
+        const std::string buffer = (k == 5) ? "" : "op";
+        ASSERT_TRUE(queue.push(k, buffer, [&results](bool isApplied) { results.push_back(isApplied ? 1 : 0); }));
+    }
+    ASSERT_EQ(queue.size(), 10);
+    ASSERT_TRUE(data.applied.empty());
+
+    // Applied in push order, completion called for each
+    ASSERT_EQ(queue.drain(), 10);
+    ASSERT_EQ(queue.size(), 0);
+    ASSERT_EQ(data.applied, (std::vector<unsigned int>{1, 2, 3, 4, 6, 7, 8, 9, 10}));
+    ASSERT_EQ(results, (std::vector<int>{1, 1, 1, 1, 0, 1, 1, 1, 1, 1}));
+}
+
+TEST(CollabDataIngestQueue, pushTest_RejectWhenFull) {
+    MockIngestCollabData data;
+    CollabDataIngestQueue queue(data, 4, CollabDataIngestQueue::Backpressure::Reject);
+
+    int nbDone = 0;
+    for (unsigned int k = 0; k < 4; ++k) {
+        ASSERT_TRUE(queue.push(k, "op", [&nbDone](bool) { ++nbDone; }));
+    }
+    ASSERT_FALSE(queue.push(4, "op", [&nbDone](bool) { ++nbDone; }));
+
+    ASSERT_EQ(queue.drain(2), 2);
+    ASSERT_EQ(nbDone, 2);
+    ASSERT_TRUE(queue.push(5, "op"));
+    ASSERT_EQ(queue.drain(), 3);
+
+    // Rejected operation is never applied
+    ASSERT_EQ(nbDone, 4);
+    ASSERT_EQ(data.applied, (std::vector<unsigned int>{0, 1, 2, 3, 5}));
+}
+
+TEST(CollabDataIngestQueue, pushTest_BlockUntilDrained) {
+    MockIngestCollabData data;
+    CollabDataIngestQueue queue(data, 2, CollabDataIngestQueue::Backpressure::Block, 1);
+
+    const unsigned int nbOps = 1000;
+    std::thread producer([&]() {
+        for (unsigned int k = 0; k < nbOps; ++k) {
+            ASSERT_TRUE(queue.push(k, "op"));
+        }
+    });
+    while (data.applied.size() < nbOps) {
+        queue.drain();
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    for (unsigned int k = 0; k < nbOps; ++k) {
+        ASSERT_EQ(data.applied[k], k);
+    }
+}
+
+TEST(CollabDataIngestQueue, destructorTest_AppliesQueuedOperations) {
+    MockIngestCollabData data;
+    int nbDone = 0;
+    {
+        CollabDataIngestQueue queue(data);
+        for (unsigned int k = 0; k < 20; ++k) {
+            queue.push(k, "op", [&nbDone](bool) { ++nbDone; });
+        }
+    }
+    ASSERT_EQ(data.applied.size(), 20);
+    ASSERT_EQ(nbDone, 20);
+}
+
+// -----------------------------------------------------------------------------
+// start() / stop()
+// -----------------------------------------------------------------------------
+
+TEST(CollabDataIngestQueue, startTest) {
+    MockIngestCollabData data;
+    CollabDataIngestQueue queue(data);
+    ASSERT_FALSE(queue.is_running());
+
+    // Operations queued before start are applied too
+    queue.push(1, "op");
+    queue.start();
+    ASSERT_TRUE(queue.is_running());
+    queue.push(2, "op");
+    queue.stop();
+    ASSERT_FALSE(queue.is_running());
+    ASSERT_EQ(data.applied, (std::vector<unsigned int>{1, 2}));
+
+    // Restart
+    queue.start();
+    queue.push(3, "op");
+    queue.stop();
+    ASSERT_EQ(data.applied, (std::vector<unsigned int>{1, 2, 3}));
+}
+
+// Each producer pushes ids p * nbOps + k: order is kept per producer
+static void startTest_ManyProducers(CollabDataIngestQueue::Backpressure policy) {
+    const unsigned int nbProducers = 4;
+    const unsigned int nbOps = 5000;
+    MockIngestCollabData data;
+    CollabDataIngestQueue queue(data, 64, policy, 16);
+    queue.start();
+
+    std::atomic<unsigned int> nbDone(0);
+    std::atomic<unsigned int> nbRejected(0);
+    std::vector<std::thread> producers;
+    for (unsigned int p = 0; p < nbProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (unsigned int k = 0; k < nbOps; ++k) {
+                while (!queue.push(p * nbOps + k, "op", [&nbDone](bool) { ++nbDone; })) {
+                    ++nbRejected;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : producers) {
+        thread.join();
+    }
+    queue.stop();
+
+    ASSERT_EQ(nbDone, nbProducers * nbOps);
+    ASSERT_EQ(data.applied.size(), nbProducers * nbOps);
+    std::vector<unsigned int> next(nbProducers, 0);
+    for (const unsigned int id : data.applied) {
+        const unsigned int p = id / nbOps;
+        ASSERT_EQ(id % nbOps, next[p]);
+        ++next[p];
+    }
+    if (policy == CollabDataIngestQueue::Backpressure::Block) {
+        ASSERT_EQ(nbRejected, 0);
+    }
+}
+
+TEST(CollabDataIngestQueue, startTest_ManyProducersBlock) {
+    startTest_ManyProducers(CollabDataIngestQueue::Backpressure::Block);
+}
+
+TEST(CollabDataIngestQueue, startTest_ManyProducersReject) {
+    startTest_ManyProducers(CollabDataIngestQueue::Backpressure::Reject);
+}
+
+}  // namespace collabserver
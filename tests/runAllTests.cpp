@@ -16,6 +16,26 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace collabserver {
+std::atomic<long> test_nbAllocations(0);
+}  // namespace collabserver
+
+// Counts calls to operator new. (See TestUtils.h)
+void* operator new(std::size_t size) {
+    ++collabserver::test_nbAllocations;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
 /*
  * Start your engiiiiines!!! Yeah!
  * Let's hope they will all pass! (And they will! Yes yes!)
@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "collabserver/datatypes/storage/FlatHashMap.h"
+
+namespace collabserver {
+
+// -----------------------------------------------------------------------------
+// insert() / find()
+// -----------------------------------------------------------------------------
+
+TEST(FlatHashMap, insertTest) {
+    FlatHashMap<int, int> data0;
+    ASSERT_TRUE(data0.empty());
+
+    auto res = data0.insert(std::make_pair(1, 10));
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first->first, 1);
+    ASSERT_EQ(res.first->second, 10);
+    ASSERT_EQ(data0.size(), 1);
+
+    // Duplicate key doesn't override
+    res = data0.insert(std::make_pair(1, 20));
+    ASSERT_FALSE(res.second);
+    ASSERT_EQ(res.first->second, 10);
+    ASSERT_EQ(data0.size(), 1);
+}
+
+TEST(FlatHashMap, insertTest_WithRehash) {
+    FlatHashMap<int, int> data0;
+    for (int k = 0; k < 10000; ++k) {
+        ASSERT_TRUE(data0.insert(std::make_pair(k * 1024, k)).second);
+    }
+    ASSERT_EQ(data0.size(), 10000);
+    for (int k = 0; k < 10000; ++k) {
+        auto it = data0.find(k * 1024);
+        ASSERT_TRUE(it != data0.end());
+        ASSERT_EQ(it->second, k);
+    }
+    ASSERT_TRUE(data0.find(1) == data0.end());
+    ASSERT_EQ(data0.count(1), 0);
+    ASSERT_EQ(data0.count(1024), 1);
+}
+
+TEST(FlatHashMap, findTest_EmptyMap) {
+    FlatHashMap<std::string, int> data0;
+    ASSERT_TRUE(data0.find("v1") == data0.end());
+    ASSERT_EQ(data0.count("v1"), 0);
+    ASSERT_TRUE(data0.begin() == data0.end());
+}
+
+// -----------------------------------------------------------------------------
+// try_emplace()
+// -----------------------------------------------------------------------------
+
+TEST(FlatHashMap, tryEmplaceTest) {
+    FlatHashMap<std::string, std::string> data0;
+
+    std::string key = "v1";
+    auto res = data0.try_emplace(std::move(key), "content");
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first->first, "v1");
+    ASSERT_EQ(res.first->second, "content");
+
+    // Key is not consumed if already there
+    std::string other = "v1";
+    res = data0.try_emplace(std::move(other), "ignored");
+    ASSERT_FALSE(res.second);
+    ASSERT_EQ(res.first->second, "content");
+    ASSERT_EQ(other, "v1");
+}
+
+TEST(FlatHashMap, tryEmplaceTest_ExistingKeyAtLoadThreshold) {
+    FlatHashMap<int, int> data0;
+    for (int k = 0; k < 6; ++k) {
+        data0.try_emplace(k, k);
+    }
+    const auto nbBuckets = data0.bucket_count();
+    const auto it = data0.find(3);
+
+    // No rehash (Iterators still valid) for existing keys
+    for (int k = 0; k < 6; ++k) {
+        ASSERT_FALSE(data0.try_emplace(k, -1).second);
+        ASSERT_FALSE(data0.insert(std::make_pair(k, -1)).second);
+    }
+    ASSERT_EQ(data0.bucket_count(), nbBuckets);
+    ASSERT_EQ(it->first, 3);
+    ASSERT_EQ(it->second, 3);
+
+    // New key past the threshold still grows
+    ASSERT_TRUE(data0.try_emplace(6, 6).second);
+    ASSERT_GT(data0.bucket_count(), nbBuckets);
+    for (int k = 0; k <= 6; ++k) {
+        ASSERT_EQ(data0.find(k)->second, k);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// erase()
+// -----------------------------------------------------------------------------
+
+TEST(FlatHashMap, eraseTest) {
+    FlatHashMap<int, int> data0;
+    for (int k = 0; k < 100; ++k) {
+        data0.insert(std::make_pair(k, k));
+    }
+    for (int k = 0; k < 100; k += 2) {
+        ASSERT_EQ(data0.erase(k), 1);
+    }
+    ASSERT_EQ(data0.erase(0), 0);
+    ASSERT_EQ(data0.size(), 50);
+    for (int k = 0; k < 100; ++k) {
+        ASSERT_EQ(data0.count(k), (k % 2 == 0) ? 0 : 1);
+    }
+
+    // Erased slots are reused
+    for (int k = 0; k < 100; k += 2) {
+        ASSERT_TRUE(data0.insert(std::make_pair(k, -k)).second);
+    }
+    ASSERT_EQ(data0.size(), 100);
+    ASSERT_EQ(data0.find(42)->second, -42);
+}
+
+TEST(FlatHashMap, eraseTest_WhileIterating) {
+    FlatHashMap<int, int> data0;
+    for (int k = 0; k < 1000; ++k) {
+        data0.insert(std::make_pair(k, k));
+    }
+    int nbVisited = 0;
+    for (auto it = data0.begin(); it != data0.end();) {
+        ++nbVisited;
+        if (it->first % 3 == 0) {
+            it = data0.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ASSERT_EQ(nbVisited, 1000);
+    ASSERT_EQ(data0.size(), 666);
+}
+
+TEST(FlatHashMap, eraseTest_ManyInsertEraseCycles) {
+    FlatHashMap<int, int> data0;
+    for (int k = 0; k < 100000; ++k) {
+        data0.insert(std::make_pair(k, k));
+        data0.erase(k);
+    }
+    ASSERT_TRUE(data0.empty());
+    ASSERT_LE(data0.bucket_count(), 16);
+}
+
+TEST(FlatHashMap, rehashTest_ShrinkAfterErase) {
+    FlatHashMap<int, int> data0;
+    for (int k = 0; k < 10000; ++k) {
+        data0.insert(std::make_pair(k, k));
+    }
+    for (int k = 0; k < 10000; ++k) {
+        if (k % 100 != 0) {
+            data0.erase(k);
+        }
+    }
+    const auto bucketsBefore = data0.bucket_count();
+    data0.rehash(0);
+    ASSERT_LT(data0.bucket_count(), bucketsBefore);
+    ASSERT_EQ(data0.size(), 100);
+    for (int k = 0; k < 10000; k += 100) {
+        ASSERT_EQ(data0.find(k)->second, k);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Copy / Move
+// -----------------------------------------------------------------------------
+
+TEST(FlatHashMap, copyTest) {
+    FlatHashMap<std::string, int> data0;
+    data0.insert(std::make_pair("v1", 1));
+    data0.insert(std::make_pair("v2", 2));
+
+    FlatHashMap<std::string, int> data1(data0);
+    ASSERT_TRUE(data0 == data1);
+
+    data1.insert(std::make_pair("v3", 3));
+    ASSERT_TRUE(data0 != data1);
+    ASSERT_EQ(data0.size(), 2);
+
+    FlatHashMap<std::string, int> data2(std::move(data1));
+    ASSERT_EQ(data2.size(), 3);
+    ASSERT_TRUE(data1.empty());
+
+    data1 = data2;
+    ASSERT_TRUE(data1 == data2);
+}
+
+// -----------------------------------------------------------------------------
+// Iterators
+// -----------------------------------------------------------------------------
+
+TEST(FlatHashMap, iteratorTest) {
+    FlatHashMap<int, int> data0;
+    std::unordered_map<int, int> expected;
+    for (int k = 0; k < 500; ++k) {
+        data0.insert(std::make_pair(k * 7, k));
+        expected[k * 7] = k;
+    }
+
+    int nbVisited = 0;
+    for (const auto& elt : data0) {
+        ASSERT_EQ(expected.at(elt.first), elt.second);
+        ++nbVisited;
+    }
+    ASSERT_EQ(nbVisited, 500);
+
+    // Update through iterator
+    for (auto& elt : data0) {
+        elt.second = 0;
+    }
+    ASSERT_EQ(data0.find(7)->second, 0);
+
+    FlatHashMap<int, int>::const_iterator it = data0.find(7);
+    ASSERT_TRUE(it != data0.cend());
+}
+
+// -----------------------------------------------------------------------------
+// Marks
+// -----------------------------------------------------------------------------
+
+TEST(FlatHashMap, marksTest) {
+    FlatHashMap<int, int> data0;
+    ASSERT_TRUE(data0.begin_marked() == data0.end());
+
+    for (int k = 0; k < 1000; ++k) {
+        auto res = data0.insert(std::make_pair(k, k));
+        ASSERT_FALSE(data0.is_marked(res.first));
+        if (k % 100 == 0) {
+            data0.mark(res.first, true);
+        }
+    }
+
+    // Marks are kept on rehash
+    data0.reserve(10000);
+    int nbVisited = 0;
+    for (auto it = data0.begin_marked(); it != data0.end(); it = data0.next_marked(it)) {
+        ASSERT_EQ(it->first % 100, 0);
+        ASSERT_TRUE(data0.is_marked(it));
+        ++nbVisited;
+    }
+    ASSERT_EQ(nbVisited, 10);
+
+    // Erase drops the mark, unmark works
+    data0.erase(0);
+    data0.mark(data0.find(100), false);
+    ASSERT_FALSE(data0.is_marked(data0.find(100)));
+    nbVisited = 0;
+    for (auto it = data0.begin_marked(); it != data0.end(); it = data0.next_marked(it)) {
+        ++nbVisited;
+    }
+    ASSERT_EQ(nbVisited, 8);
+
+    // Copy keeps marks
+    const FlatHashMap<int, int> data1(data0);
+    ASSERT_TRUE(data1.is_marked(data1.find(200)));
+    ASSERT_FALSE(data1.is_marked(data1.find(201)));
+
+    data0.clear_marks();
+    ASSERT_TRUE(data0.begin_marked() == data0.end());
+    ASSERT_EQ(data0.size(), 999);
+}
+
+}  // namespace collabserver
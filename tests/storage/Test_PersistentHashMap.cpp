@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "collabserver/datatypes/storage/PersistentHashMap.h"
+
+namespace collabserver {
+
+// All keys with the same hash: chained leaves
+struct PersistentHashMap_CollidingHash {
+    std::size_t operator()(int key) const { return static_cast<std::size_t>(key % 3); }
+};
+
+// -----------------------------------------------------------------------------
+// try_emplace() / find()
+// -----------------------------------------------------------------------------
+
+TEST(PersistentHashMap, tryEmplaceTest) {
+    PersistentHashMap<std::string, int> data0;
+    ASSERT_TRUE(data0.empty());
+    ASSERT_TRUE(data0.find("a") == data0.end());
+
+    auto res = data0.try_emplace("a", 1);
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first->first, "a");
+    ASSERT_EQ(res.first->second, 1);
+
+    // Duplicate key doesn't override
+    res = data0.try_emplace("a", 2);
+    ASSERT_FALSE(res.second);
+    ASSERT_EQ(res.first->second, 1);
+    ASSERT_EQ(data0.size(), 1);
+
+    // Value initialized
+    res = data0.try_emplace("b");
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first->second, 0);
+    ASSERT_EQ(data0.count("b"), 1);
+    ASSERT_EQ(data0.count("c"), 0);
+}
+
+TEST(PersistentHashMap, tryEmplaceTest_CollidingHash) {
+    PersistentHashMap<int, int, PersistentHashMap_CollidingHash> data0;
+    for (int k = 0; k < 300; ++k) {
+        ASSERT_TRUE(data0.try_emplace(k, k).second);
+    }
+    ASSERT_EQ(data0.size(), 300);
+    for (int k = 0; k < 300; ++k) {
+        ASSERT_EQ(data0.find(k)->second, k);
+    }
+    ASSERT_EQ(data0.count(300), 0);
+}
+
+// -----------------------------------------------------------------------------
+// erase()
+// -----------------------------------------------------------------------------
+
+TEST(PersistentHashMap, eraseTest_WhileIterating) {
+    PersistentHashMap<int, int> data0;
+    for (int k = 0; k < 1000; ++k) {
+        data0.try_emplace(k, k);
+    }
+    int nbVisited = 0;
+    for (auto it = data0.begin(); it != data0.end();) {
+        ++nbVisited;
+        if (it->first % 2 == 0) {
+            it = data0.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ASSERT_EQ(nbVisited, 1000);
+    ASSERT_EQ(data0.size(), 500);
+    for (int k = 0; k < 1000; ++k) {
+        ASSERT_EQ(data0.count(k), static_cast<std::size_t>(k % 2));
+    }
+}
+
+TEST(PersistentHashMap, eraseTest_RandomAgainstUnorderedMap) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> randKey(0, 999);
+    PersistentHashMap<int, int> data0;
+    PersistentHashMap<int, int, PersistentHashMap_CollidingHash> data1;
+    std::unordered_map<int, int> expected;
+    for (int k = 0; k < 20000; ++k) {
+        const int key = randKey(gen);
+        if (k % 3 == 0) {
+            ASSERT_EQ(data1.erase(key), expected.count(key));
+            ASSERT_EQ(data0.erase(key), expected.erase(key));
+        } else {
+            ASSERT_EQ(data1.try_emplace(key, k).second, expected.count(key) == 0);
+            ASSERT_EQ(data0.try_emplace(key, k).second, expected.emplace(key, k).second);
+        }
+        ASSERT_EQ(data0.size(), expected.size());
+    }
+    for (const auto& elt : expected) {
+        ASSERT_EQ(data0.find(elt.first)->second, elt.second);
+        ASSERT_EQ(data1.find(elt.first)->second, elt.second);
+    }
+    while (!data0.empty()) {
+        data0.erase(data0.begin());
+    }
+    ASSERT_TRUE(data0.begin() == data0.end());
+}
+
+// -----------------------------------------------------------------------------
+// Copy (Structural sharing)
+// -----------------------------------------------------------------------------
+
+TEST(PersistentHashMap, copyTest) {
+    PersistentHashMap<std::string, int> data0;
+    data0.try_emplace("v1", 1);
+    data0.try_emplace("v2", 2);
+
+    PersistentHashMap<std::string, int> data1(data0);
+    ASSERT_TRUE(data0.is_shared());
+    ASSERT_TRUE(data0 == data1);
+
+    // Modifications are not seen by the other copy
+    data1.try_emplace("v3", 3);
+    data1.find("v1")->second = 10;
+    ASSERT_TRUE(data0 != data1);
+    ASSERT_EQ(data0.size(), 2);
+    ASSERT_EQ(data0.find("v1")->second, 1);
+    ASSERT_EQ(data1.find("v1")->second, 10);
+
+    data0.erase("v2");
+    ASSERT_EQ(data1.count("v2"), 1);
+
+    PersistentHashMap<std::string, int> data2(std::move(data1));
+    ASSERT_EQ(data2.size(), 3);
+    ASSERT_TRUE(data1.empty());
+}
+
+TEST(PersistentHashMap, copyTest_ConstAccessDoesNotCopy) {
+    PersistentHashMap<int, int> data0;
+    for (int k = 0; k < 100; ++k) {
+        data0.try_emplace(k, k);
+    }
+    const PersistentHashMap<int, int> data1(data0);
+    ASSERT_EQ(data1.find(42)->second, 42);
+    int nbVisited = 0;
+    for (const auto& elt : data1) {
+        nbVisited += (elt.first == elt.second) ? 1 : 0;
+    }
+    ASSERT_EQ(nbVisited, 100);
+    ASSERT_TRUE(data1.is_shared());
+}
+
+TEST(PersistentHashMap, copyTest_RandomSnapshots) {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> randKey(0, 2000);
+    PersistentHashMap<int, int> data0;
+    std::unordered_map<int, int> expected;
+    std::vector<std::pair<PersistentHashMap<int, int>, std::unordered_map<int, int>>> snapshots;
+    for (int k = 0; k < 20000; ++k) {
+        const int key = randKey(gen);
+        if (k % 4 == 0) {
+            data0.erase(key);
+            expected.erase(key);
+        } else if (k % 4 == 1) {
+            const auto it = data0.find(key);
+            if (it != data0.end()) {
+                it->second = k;
+                expected[key] = k;
+            }
+        } else {
+            data0.try_emplace(key, k);
+            expected.emplace(key, k);
+        }
+        if (k % 1000 == 0) {
+            snapshots.emplace_back(data0, expected);
+        }
+    }
+    snapshots.emplace_back(data0, expected);
+    for (const auto& snapshot : snapshots) {
+        const PersistentHashMap<int, int>& data1 = snapshot.first;
+        ASSERT_EQ(data1.size(), snapshot.second.size());
+        std::size_t nbVisited = 0;
+        for (const auto& elt : data1) {
+            ASSERT_EQ(snapshot.second.at(elt.first), elt.second);
+            ++nbVisited;
+        }
+        ASSERT_EQ(nbVisited, snapshot.second.size());
+    }
+}
+
+// The copy is read from another thread while the original is modified
+TEST(PersistentHashMap, copyTest_ReadFromOtherThread) {
+    PersistentHashMap<int, int> data0;
+    for (int k = 0; k < 5000; ++k) {
+        data0.try_emplace(k, k);
+    }
+    const PersistentHashMap<int, int> data1(data0);
+    long sum = 0;
+    std::thread reader([&]() {
+        for (int loop = 0; loop < 20; ++loop) {
+            for (const auto& elt : data1) {
+                sum += elt.second;
+            }
+        }
+    });
+    for (int k = 0; k < 5000; ++k) {
+        data0.find(k)->second = -1;
+    }
+    for (int k = 0; k < 5000; ++k) {
+        data0.erase(k);
+        data0.try_emplace(k + 10000, k);
+    }
+    reader.join();
+    ASSERT_EQ(sum, 20L * (4999L * 5000L / 2));
+    ASSERT_EQ(data1.size(), 5000);
+}
+
+}  // namespace collabserver
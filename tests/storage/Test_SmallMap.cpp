@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "../TestUtils.h"
+#include "collabserver/datatypes/storage/SmallMap.h"
+
+namespace collabserver {
+
+// -----------------------------------------------------------------------------
+// try_emplace() / find()
+// -----------------------------------------------------------------------------
+
+TEST(SmallMap, tryEmplaceTest) {
+    SmallMap<std::string, int, 4> data0;
+    ASSERT_TRUE(data0.empty());
+
+    auto res = data0.try_emplace("a", 1);
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first->first, "a");
+    ASSERT_EQ(res.first->second, 1);
+
+    // Duplicate key doesn't override
+    res = data0.try_emplace("a", 2);
+    ASSERT_FALSE(res.second);
+    ASSERT_EQ(res.first->second, 1);
+    ASSERT_EQ(data0.size(), 1);
+
+    // Value initialized
+    res = data0.try_emplace("b");
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first->second, 0);
+    ASSERT_EQ(data0.count("b"), 1);
+    ASSERT_EQ(data0.count("c"), 0);
+    ASSERT_TRUE(data0.find("c") == data0.end());
+}
+
+TEST(SmallMap, tryEmplaceTest_NoAllocationWhileInline) {
+    SmallMap<int, int, 4> data0;
+    const long nbAllocations = test_nbAllocations;
+    for (int k = 0; k < 4; ++k) {
+        ASSERT_TRUE(data0.try_emplace(k, k * 10).second);
+    }
+    ASSERT_EQ(test_nbAllocations, nbAllocations);
+    ASSERT_TRUE(data0.is_inline());
+}
+
+TEST(SmallMap, tryEmplaceTest_SwitchToHashMap) {
+    SmallMap<int, int, 4> data0;
+    for (int k = 0; k < 1000; ++k) {
+        ASSERT_TRUE(data0.try_emplace(k, k * 10).second);
+        ASSERT_EQ(data0.is_inline(), k < 4);
+    }
+    ASSERT_EQ(data0.size(), 1000);
+    for (int k = 0; k < 1000; ++k) {
+        auto it = data0.find(k);
+        ASSERT_TRUE(it != data0.end());
+        ASSERT_EQ(it->second, k * 10);
+        ASSERT_FALSE(data0.try_emplace(k, 0).second);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// erase()
+// -----------------------------------------------------------------------------
+
+TEST(SmallMap, eraseTest) {
+    SmallMap<int, int, 4> data0;
+    data0.try_emplace(1, 10);
+    data0.try_emplace(2, 20);
+    data0.try_emplace(3, 30);
+
+    ASSERT_EQ(data0.erase(2), 1);
+    ASSERT_EQ(data0.erase(2), 0);
+    ASSERT_EQ(data0.size(), 2);
+    ASSERT_EQ(data0.count(2), 0);
+    ASSERT_EQ(data0.find(1)->second, 10);
+    ASSERT_EQ(data0.find(3)->second, 30);
+}
+
+TEST(SmallMap, eraseTest_WhileIterating) {
+    const int sizes[] = {3, 4, 100};
+    for (const int size : sizes) {
+        SmallMap<int, int, 4> data0;
+        for (int k = 0; k < size; ++k) {
+            data0.try_emplace(k, k);
+        }
+        // Erase even keys, each other key is visited once
+        int nbVisited = 0;
+        for (auto it = data0.begin(); it != data0.end();) {
+            ++nbVisited;
+            if (it->first % 2 == 0) {
+                it = data0.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        ASSERT_EQ(nbVisited, size);
+        ASSERT_EQ(data0.size(), static_cast<std::size_t>(size / 2));
+        for (int k = 0; k < size; ++k) {
+            ASSERT_EQ(data0.count(k), static_cast<std::size_t>(k % 2));
+        }
+    }
+}
+
+TEST(SmallMap, eraseTest_RandomAgainstUnorderedMap) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> randKey(0, 9);
+    SmallMap<int, int, 4> data0;
+    std::unordered_map<int, int> expected;
+    for (int k = 0; k < 10000; ++k) {
+        const int key = randKey(gen);
+        if (k % 3 == 0) {
+            ASSERT_EQ(data0.erase(key), expected.erase(key));
+        } else {
+            ASSERT_EQ(data0.try_emplace(key, k).second, expected.emplace(key, k).second);
+        }
+        if (k % 100 == 0) {
+            data0.rehash(0);
+        }
+        ASSERT_EQ(data0.size(), expected.size());
+    }
+    for (const auto& elt : expected) {
+        ASSERT_EQ(data0.find(elt.first)->second, elt.second);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// rehash() / reserve()
+// -----------------------------------------------------------------------------
+
+TEST(SmallMap, rehashTest_BackInline) {
+    SmallMap<std::string, int, 2> data0;
+    data0.try_emplace("a", 1);
+    data0.try_emplace("b", 2);
+    data0.try_emplace("c", 3);
+    ASSERT_FALSE(data0.is_inline());
+
+    // Still too many elements
+    data0.rehash(0);
+    ASSERT_FALSE(data0.is_inline());
+
+    data0.erase("a");
+    data0.rehash(0);
+    ASSERT_TRUE(data0.is_inline());
+    ASSERT_EQ(data0.size(), 2);
+    ASSERT_EQ(data0.find("b")->second, 2);
+    ASSERT_EQ(data0.find("c")->second, 3);
+}
+
+TEST(SmallMap, reserveTest) {
+    SmallMap<int, int, 4> data0;
+    data0.try_emplace(1, 10);
+    data0.reserve(4);
+    ASSERT_TRUE(data0.is_inline());
+    data0.reserve(100);
+    ASSERT_FALSE(data0.is_inline());
+    ASSERT_EQ(data0.find(1)->second, 10);
+}
+
+// -----------------------------------------------------------------------------
+// Copy / move / operator==
+// -----------------------------------------------------------------------------
+
+TEST(SmallMap, copyTest) {
+    const int sizes[] = {0, 3, 10};
+    for (const int size : sizes) {
+        SmallMap<std::string, int, 4> data0;
+        for (int k = 0; k < size; ++k) {
+            data0.try_emplace(std::to_string(k), k);
+        }
+
+        SmallMap<std::string, int, 4> data1(data0);
+        ASSERT_TRUE(data1 == data0);
+        data1.try_emplace("x", 42);
+        ASSERT_TRUE(data1 != data0);
+        ASSERT_EQ(data0.count("x"), 0);
+
+        data1 = data0;
+        ASSERT_TRUE(data1 == data0);
+
+        SmallMap<std::string, int, 4> data2(std::move(data1));
+        ASSERT_TRUE(data2 == data0);
+        ASSERT_TRUE(data1.empty());
+
+        data1 = std::move(data2);
+        ASSERT_TRUE(data1 == data0);
+    }
+}
+
+TEST(SmallMap, operatorEqualTest_AnyOrder) {
+    SmallMap<int, int, 4> data0;
+    SmallMap<int, int, 4> data1;
+    for (int k = 0; k < 3; ++k) {
+        data0.try_emplace(k, k);
+        data1.try_emplace(2 - k, 2 - k);
+    }
+    ASSERT_TRUE(data0 == data1);
+
+    data1.find(1)->second = 42;
+    ASSERT_FALSE(data0 == data1);
+}
+
+}  // namespace collabserver